@@ -322,6 +322,37 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Make data_ a view of the count() elements of Blob other's data
+   *        starting at element offset, e.g. to let a producer write straight
+   *        into its part of a concatenation.
+   *
+   * The view lives on the host only and is dropped by the next Reshape that
+   * reallocates.
+   */
+  void ShareDataSlice(const Blob& other, size_t offset);
+  /// @brief Make diff_ a view into the diff of Blob other; see ShareDataSlice.
+  void ShareDiffSlice(const Blob& other, size_t offset);
+  /// @brief Whether data_ is the view into other set by ShareDataSlice.
+  bool SharesDataSlice(const Blob& other, size_t offset) const;
+  /// @brief Whether diff_ is the view into other set by ShareDiffSlice.
+  bool SharesDiffSlice(const Blob& other, size_t offset) const;
+  /**
+   * @brief Give data_ and diff_ memory of their own, holding the same values,
+   *        if either is a view into Blob other that no longer starts at
+   *        element offset.
+   *
+   * A view survives a Reshape that keeps its own shape, so it goes stale when
+   * a sibling part of the same concatenation changes size; writing the other
+   * parts into other would then overwrite it.
+   */
+  void UnshareStaleSlice(const Blob& other, size_t offset);
+
+  /**
+   * @brief Set the NUMA placement of the host memory of data and diff. The
+   *        placement is kept across Reshape calls that reallocate.
+   */
+  void set_placement(const numa::Placement& placement);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -334,6 +365,7 @@ class Blob {
   vector<int> shape_;
   size_t count_;
   size_t capacity_;
+  numa::Placement placement_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
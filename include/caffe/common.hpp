@@ -168,6 +168,13 @@ class Caffe {
     }
     return *(Get().random_generator_);
   }
+  // Installs rng as the calling thread's generator and returns the previous
+  // one, which may be empty. Lets a task on a worker thread draw from a
+  // stream seeded by the master.
+  inline static shared_ptr<RNG> swap_rng_stream(shared_ptr<RNG> rng) {
+    Get().random_generator_.swap(rng);
+    return rng;
+  }
 #ifndef CPU_ONLY
   inline static cublasHandle_t cublas_handle() { return Get().cublas_handle_; }
   inline static curandGenerator_t curand_generator() {
@@ -129,7 +129,7 @@ public:
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-    : layer_param_(param), is_shared_(false) {
+    : layer_param_(param), latency_mode_(false), is_shared_(false) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       // LOG(ERROR) << "layer " << layer_param_.name() << " construction with blobs size: " << layer_param_.blobs_size();
@@ -387,6 +387,16 @@ public:
     return true;
   }
 
+  /**
+   * @brief Returns true if Reshape makes the bottom or top blobs share memory
+   *        with blobs the Net does not hold, such as those of an inner net.
+   *
+   * Net::ShareConcatSliceBuffers leaves such blobs alone, since turning them
+   * into views would detach them from the memory the layer works on until
+   * its next Reshape.
+   */
+  virtual inline bool AliasesBlobsInReshape() const { return false; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -409,6 +419,17 @@ public:
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Returns the sorted rows (indices along the first axis) of the
+   *        parameter blob at param_id whose diff Backward_cpu has written
+   *        since the list was last cleared, or NULL if the gradient may be
+   *        dense.
+   *
+   * The net and the solvers use a list to clear, update and regularize only
+   * those rows; they clear it together with the rows' diff.
+   */
+  virtual vector<int>* sparse_param_rows(const int param_id) { return NULL; }
+
   inline Phase phase() { return phase_; }
 
   /**
@@ -419,6 +440,16 @@ public:
     phase_ = phase;
   }
 
+  /**
+   * @brief Sets whether the layer should split the work of a single item
+   *        over threads when the batch is too small to occupy them all.
+   *        Takes effect on the next Reshape; see Net::SetLatencyMode.
+   */
+  inline void set_latency_mode(bool latency_mode) {
+    latency_mode_ = latency_mode;
+  }
+  inline bool latency_mode() const { return latency_mode_; }
+
 
 
  protected:
@@ -426,6 +457,8 @@ public:
   LayerParameter layer_param_;
   /** The phase: TRAIN or TEST */
   Phase phase_;
+  /** Whether to favour per-item latency over batch throughput */
+  bool latency_mode_;
   /** The vector that stores the learnable parameters as a set of blobs. */
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   /** Vector indicating whether to compute the diff of each param blob. */
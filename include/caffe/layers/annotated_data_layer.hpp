@@ -68,7 +68,27 @@ class AnnotatedDataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
 
+  // Working set of one batch item. The buffers live across batches, so the
+  // protobuf messages keep their allocated strings and repeated fields and
+  // the per-item blob keeps its shape storage instead of being reallocated
+  // for every image by every prefetch thread.
+  struct ItemBuffers {
+    AnnotatedDatum anno_datum;
+    AnnotatedDatum distort_datum;
+    AnnotatedDatum expand_datum;
+    AnnotatedDatum sampled_datum;
+    // Points to one of the messages above once distortion and expansion
+    // have been applied.
+    AnnotatedDatum* expanded;
+    vector<NormalizedBBox> sampled_bboxes;
+    RepeatedPtrField<AnnotationGroup> transformed_anno;
+    Blob<Dtype> data_blob;
+  };
+  // Makes sure there is one ItemBuffers per batch item.
+  void PrepareItemBuffers(int batch_size);
+
   DataReader reader_;
+  vector<shared_ptr<ItemBuffers> > item_buffers_;
   bool has_anno_type_;
   AnnotatedDatum_AnnotationType anno_type_;
   vector<BatchSampler> batch_samplers_;
@@ -55,7 +55,7 @@ template <typename Dtype>
 class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), num_of_threads_(1), intra_threads_(1) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -87,6 +87,9 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   void clear_weight_mt(void);
   void sum_weight_mt(Dtype* weight_diff);
+  // Team size for the batch-parallel regions: num_of_threads_, capped at
+  // the share of the core group running the layer (see Net branch_groups).
+  int group_threads() const;
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -143,6 +146,8 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int num_of_threads_;              // Number of threads to be used for
                                     // batch based parallelization eg.
                                     // min(batch,omp_get_num_threads())
+  int intra_threads_;               // Number of threads splitting a single
+                                    // item over channels in latency mode
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
@@ -196,6 +201,40 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), data);
     }
   }
+  // Single-channel 2D variants of the above, used to split im2col/col2im
+  // over channels when intra_threads_ > 1.
+  inline void conv_im2col_channel_cpu(const Dtype* data, int c,
+      Dtype* col_buff) {
+    const int im_dim = conv_input_shape_.cpu_data()[1] *
+        conv_input_shape_.cpu_data()[2];
+    const int col_dim = kernel_shape_.cpu_data()[0] *
+        kernel_shape_.cpu_data()[1] * conv_out_spatial_dim_;
+    im2col_cpu(data + c * im_dim, 1,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+        col_buff + c * col_dim);
+  }
+  inline void conv_col2im_channel_cpu(const Dtype* col_buff, int c,
+      Dtype* data) {
+    const int im_dim = conv_input_shape_.cpu_data()[1] *
+        conv_input_shape_.cpu_data()[2];
+    const int col_dim = kernel_shape_.cpu_data()[0] *
+        kernel_shape_.cpu_data()[1] * conv_out_spatial_dim_;
+    col2im_cpu(col_buff + c * col_dim, 1,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1], data + c * im_dim);
+  }
+  void forward_cpu_gemm_intra(const Dtype* input, const Dtype* weights,
+      Dtype* output, bool skip_im2col);
+  void backward_cpu_gemm_intra(const Dtype* output, const Dtype* weights,
+      Dtype* input);
+
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -46,6 +46,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/performance.hpp"
 
 namespace caffe {
 
@@ -85,7 +86,12 @@ class BaseDataLayer : public Layer<Dtype> {
 template <typename Dtype>
 class Batch {
  public:
+  Batch() : wait_time_(0), load_time_(0), read_time_(0) {}
   Blob<Dtype> data_, label_;
+  // Prefetch statistics in microseconds: how long the worker waited for this
+  // batch to be free, and spent in load_batch. Layers that can tell reading
+  // the input apart from transforming it also set read_time_.
+  double wait_time_, load_time_, read_time_;
 };
 
 template <typename Dtype>
@@ -104,18 +110,40 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
+  // Whether load_batch may run on several prefetch threads at once.
+  virtual inline bool ConcurrentLoadBatch() const { return false; }
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
 
   virtual void GetBatch();
-
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
+  // Loads free batches until stopped. With several prefetch threads, batches
+  // are handed over in the order given by SequenceBatch.
+  void PrefetchLoop();
+  // To be called by load_batch, if it runs concurrently, once it has taken
+  // the input of the batch, e.g. under the lock guarding the input.
+  void SequenceBatch(Batch<Dtype>* batch);
+  void PrefetchWorkerEntry(int worker, int device, Caffe::Brew mode,
+      int rand_seed, int solver_count, bool root_solver);
+  // Pops the next loaded batch and reports the prefetch statistics.
+  Batch<Dtype>* NextFullBatch();
+
+  // Prefetches data_param().prefetch() batches, on prefetch_threads_
+  // background threads or, if none, on the thread calling Forward.
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  int prefetch_threads_;
+
+  class sync;
+  shared_ptr<sync> sync_;
+
+  PERFORMANCE_COUNTER_ID_DECL(perf_id_queue_);
+  PERFORMANCE_EVENT_ID_DECL(perf_id_wait_);
+  PERFORMANCE_EVENT_ID_DECL(perf_id_free_wait_);
+  PERFORMANCE_EVENT_ID_DECL(perf_id_read_);
+  PERFORMANCE_EVENT_ID_DECL(perf_id_transform_);
 
   Blob<Dtype> transformed_data_;
 };
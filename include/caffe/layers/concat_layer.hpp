@@ -49,6 +49,11 @@ namespace caffe {
 /**
  * @brief Takes at least two Blob%s and concatenates them along either the num
  *        or channel dimension, outputting the result.
+ *
+ * With concat_param.channels_last every @f$ (N \times C \times H \times W) @f$
+ * input is written to its slice of the @f$ N \times \sum_i H_i W_i C_i @f$
+ * output in @f$ (N \times H \times W \times C) @f$ order, which is what a
+ * Permute (0, 2, 3, 1) and a Flatten in front of the Concat produce.
  */
 template <typename Dtype>
 class ConcatLayer : public Layer<Dtype> {
@@ -112,11 +117,14 @@ class ConcatLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  void UnshareStaleSlices(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   int count_;
   int num_concats_;
   int concat_input_size_;
   int concat_axis_;
+  bool channels_last_;
 };
 
 }  // namespace caffe
@@ -49,6 +49,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
 
+namespace boost { class mutex; }
+
 namespace caffe {
 
 template <typename Dtype>
@@ -64,11 +66,15 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline int MaxTopBlobs() const { return 2; }
+  virtual inline bool ConcurrentLoadBatch() const { return true; }
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
 
   DataReader reader_;
+  // Guards taking a batch's data points off reader_ when several prefetch
+  // threads run load_batch.
+  shared_ptr<boost::mutex> read_mutex_;
 };
 
 }  // namespace caffe
@@ -121,6 +121,10 @@ class DetectionOutputLayer : public Layer<Dtype> {
 
   int num_;
   int num_priors_;
+  // The priors of the previous pass, and the bboxes converted from them.
+  vector<Dtype> last_prior_data_;
+  vector<NormalizedBBox> prior_bboxes_;
+  vector<vector<float> > prior_variances_;
 
   float nms_threshold_;
   int top_k_;
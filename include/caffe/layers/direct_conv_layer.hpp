@@ -0,0 +1,108 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_DIRECT_CONV_LAYER_HPP_
+#define CAFFE_DIRECT_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/base_conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Direct implementation of ConvolutionLayer for the CPU, selected with
+ *        the DIRECT engine.
+ *
+ * The output is computed straight from the input without im2col: the work
+ * is split into tiles of one output row for a block of output channels, so
+ * the input rows feeding a tile stay in cache while every channel of the
+ * block consumes them. Tiles of all images, groups and rows are distributed
+ * over the OpenMP threads, which also keeps all cores busy for a single
+ * image. The gradients are computed in the same way, with every thread
+ * owning the input rows or filter coefficients it writes, so no per-thread
+ * column or weight buffers are needed.
+ *
+ * Only 2D convolution is handled directly; other inputs fall back to the
+ * im2col path of BaseConvolutionLayer.
+ */
+template <typename Dtype>
+class DirectConvolutionLayer : public BaseConvolutionLayer<Dtype> {
+ public:
+  explicit DirectConvolutionLayer(const LayerParameter& param)
+      : BaseConvolutionLayer<Dtype>(param) {}
+
+  virtual inline const char* type() const { return "Convolution"; }
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual inline bool reverse_dimensions() { return false; }
+  virtual void compute_output_shape();
+
+  // Geometry of the 2D convolution, read from the base class on Reshape.
+  struct Geometry {
+    int channels, height, width;
+    int num_output, out_height, out_width;
+    int group, kernel_h, kernel_w;
+    int pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w;
+  };
+
+  // True when the direct kernels apply; otherwise the im2col path is used.
+  bool direct_;
+  Geometry geometry_;
+
+ private:
+  void ForwardDirect(const Dtype* input, const Dtype* weight,
+      const Dtype* bias, Dtype* output);
+  void BackwardDataDirect(const Dtype* top_diff, const Dtype* weight,
+      Dtype* bottom_diff);
+  void BackwardWeightDirect(const Dtype* top_diff, const Dtype* input,
+      Dtype* weight_diff);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DIRECT_CONV_LAYER_HPP_
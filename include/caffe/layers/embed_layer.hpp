@@ -67,6 +67,10 @@ class EmbedLayer : public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  virtual vector<int>* sparse_param_rows(const int param_id) {
+    return (param_id == 0 && sparse_update_) ? &touched_rows_ : NULL;
+  }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -82,6 +86,9 @@ class EmbedLayer : public Layer<Dtype> {
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
+  bool sparse_update_;
+  /// weight rows accumulated into since the net last cleared them
+  vector<int> touched_rows_;
 };
 
 }  // namespace caffe
@@ -0,0 +1,124 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_FUSED_LSTM_LAYER_HPP_
+#define CAFFE_FUSED_LSTM_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief CPU implementation of LSTMLayer as a single layer, selected with
+ *        the FUSED engine.
+ *
+ * LSTMLayer runs an unrolled net with several layers and blobs per timestep.
+ * This layer computes the same function with the same parameters directly:
+ * the input projection W_xc * x_t + b_c of all timesteps is one GEMM, each
+ * timestep then adds W_hc * h_{t-1} with one GEMM and applies the gate
+ * non-linearities and the cell update in one pass. The backward pass walks
+ * the timesteps in reverse with the same structure and computes the weight
+ * gradients of all timesteps with one GEMM each.
+ *
+ * The parameters are laid out as in LSTMLayer -- W_xc, b_c, W_xc_static (with
+ * a static input only) and W_hc -- so trained models work with both engines.
+ * As with LSTMLayer, no gradient is propagated to the hidden state inputs,
+ * and the number of timesteps may change between batches.
+ */
+template <typename Dtype>
+class FusedLSTMLayer : public Layer<Dtype> {
+ public:
+  explicit FusedLSTMLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  /// @brief Zeros the hidden state carried over to the next batch.
+  virtual void Reset();
+
+  virtual inline const char* type() const { return "LSTM"; }
+  virtual inline int MinBottomBlobs() const {
+    return this->layer_param_.recurrent_param().expose_hidden() ? 4 : 2;
+  }
+  virtual inline int MaxBottomBlobs() const { return MinBottomBlobs() + 1; }
+  virtual inline int ExactNumTopBlobs() const {
+    return this->layer_param_.recurrent_param().expose_hidden() ? 3 : 1;
+  }
+
+  virtual inline bool AllowForceBackward(const int bottom_index) const {
+    // Can't propagate to sequence continuation indicators.
+    return bottom_index != 1;
+  }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  int T_;  // timesteps
+  int N_;  // independent streams
+  int hidden_dim_;
+  int input_dim_;
+  int static_dim_;
+  bool static_input_;
+  bool expose_hidden_;
+
+  /// gate inputs [i', f', o', g'] per timestep; activations after Forward
+  Blob<Dtype> gates_;
+  /// cell states c_t
+  Blob<Dtype> cell_;
+  /// cont_t * h_{t-1}, the input of the recurrent GEMM
+  Blob<Dtype> h_conted_;
+  /// W_xc_static * x_static, shared by all timesteps
+  Blob<Dtype> static_gates_;
+  /// the states before the first timestep; their diffs carry the gradient
+  /// from one timestep to the previous one in Backward
+  Blob<Dtype> h_0_, c_0_;
+  /// the states after the last timestep, kept for the next batch
+  Blob<Dtype> h_T_, c_T_;
+  Blob<Dtype> bias_multiplier_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_FUSED_LSTM_LAYER_HPP_
@@ -0,0 +1,178 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_FUSED_NEURON_LAYER_HPP_
+#define CAFFE_FUSED_NEURON_LAYER_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#if defined __x86_64__ || defined _M_X64
+# define XBYAK_NO_OP_NAMES
+# define XBYAK_USE_MMAP_ALLOCATOR
+# include "../xbyak/xbyak_util.h"
+#endif
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/neuron_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief One element-wise layer of a FusedNeuronLayer, with its parameters
+ *        folded into up to three coefficients.
+ */
+template <typename Dtype>
+struct FusedNeuronOp {
+  enum Type { RELU, SIGMOID, TANH, ABSVAL, POWER, EXP, LOG, BNLL, ELU, SCALE };
+  Type type;
+  // RELU: a = negative_slope.  POWER: y = (b * x + c)^a.
+  // EXP: y = b * exp(a * x).  LOG: y = c * log(a * x + b).  ELU: a = alpha.
+  Dtype a, b, c;
+  // SCALE: y = scale[ch] * x + shift[ch] for the elements x of channel ch,
+  // the learned coefficients of a Scale or Bias layer. scale_blob and
+  // shift_blob index the layer blobs, -1 for a coefficient the layer lacks.
+  int scale_blob, shift_blob;
+  const Dtype* scale;
+  const Dtype* shift;
+  int channels, inner_dim;
+};
+
+/**
+ * @brief Generates the forward pass of a chain of piecewise linear
+ *        operations (ReLU, AbsVal and Power with power 1 or 2) as a single
+ *        AVX loop, keeping each element in a register from load to store.
+ */
+template <typename Dtype>
+class FusedNeuronCodeGenerator
+#if defined __x86_64__ || defined _M_X64
+  : public ::Xbyak::CodeGenerator
+#endif
+{
+ public:
+  FusedNeuronCodeGenerator();
+  ~FusedNeuronCodeGenerator();
+
+  /// Applies the chain to blocks * kBlock elements.
+  typedef void (Callback_t)(
+    const Dtype* bottom_data,
+    Dtype* top_data,
+    int64_t blocks);
+
+  static const int kBlock = 8;
+
+  /// Returns NULL when the chain or the CPU is not supported.
+  Callback_t* Get_callback(const vector<FusedNeuronOp<Dtype> >& ops);
+
+ private:
+  void Create_callback(const vector<FusedNeuronOp<Dtype> >& ops);
+
+  Callback_t* Callback;
+  bool Generated;
+  // Broadcast operands of the generated code, read at every call.
+  vector<float> Constants;
+};
+
+/**
+ * @brief Applies a chain of element-wise layers in a single pass over the
+ *        data.
+ *
+ * Net::CompileNet replaces runs of consecutive ReLU, Sigmoid, TanH, AbsVal,
+ * Power, Exp, Log, BNLL and ELU layers of the CAFFE engine, and of Scale
+ * and Bias layers with per-channel learned coefficients, with this layer.
+ * Each of those layers streams the whole blob through memory, while here
+ * the data is processed in tiles that stay in L1 across all operations of
+ * the chain, in parallel over the tiles. The blobs of the Scale and Bias
+ * layers become the blobs of this layer, in chain order.
+ *
+ * Only the forward pass of chains of ReLU, AbsVal and Power with power 1 or
+ * 2 is JIT compiled for AVX, by FusedNeuronCodeGenerator; other chains and
+ * the backward pass run the tiled C++ loops. Layers with more than one
+ * bottom, such as Eltwise, are not fused.
+ *
+ * Backward recomputes the intermediate values of a tile from the input and
+ * multiplies the top diff with the derivatives of all operations in reverse,
+ * so no intermediate blobs are stored. When computed in place, the input is
+ * kept in bottom_copy_ unless the net never runs backward through the layer
+ * (see set_need_backward); Net::CompileNet therefore leaves in-place chains
+ * of nets that may run backward unfused.
+ */
+template <typename Dtype>
+class FusedNeuronLayer : public NeuronLayer<Dtype> {
+ public:
+  explicit FusedNeuronLayer(const LayerParameter& param)
+      : NeuronLayer<Dtype>(param), need_backward_(true) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "FusedNeuron"; }
+
+  /// @brief Whether a layer can be part of a FusedNeuronLayer.
+  static bool CanFuse(const LayerParameter& param);
+  /// @brief The number of blobs a fusable layer contributes.
+  static int NumParamBlobs(const LayerParameter& param);
+  /// @brief Lets an in-place layer skip keeping its input when the net
+  ///        never runs its backward pass.
+  inline void set_need_backward(bool need_backward) {
+    need_backward_ = need_backward;
+  }
+  /// @brief The longest chain a FusedNeuronLayer applies.
+  static const int kMaxOps = 8;
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  vector<FusedNeuronOp<Dtype> > ops_;
+  FusedNeuronCodeGenerator<Dtype> code_generator_;
+  typename FusedNeuronCodeGenerator<Dtype>::Callback_t* forward_code_;
+  Blob<Dtype> bottom_copy_;
+  bool need_backward_;
+  // Per-thread sums of the parameter diffs of Backward_cpu.
+  vector<Dtype> param_diff_buffer_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_FUSED_NEURON_LAYER_HPP_
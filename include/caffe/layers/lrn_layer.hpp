@@ -84,12 +84,16 @@ class LRNLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void CrossChannelForward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  virtual void WithinChannelForward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
   virtual void WithinChannelForward(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void CrossChannelBackward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void CrossChannelBackward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  virtual void WithinChannelBackward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void WithinChannelBackward(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
@@ -103,17 +107,11 @@ class LRNLayer : public Layer<Dtype> {
   int height_;
   int width_;
 
-  // Fields used for normalization ACROSS_CHANNELS
-  // scale_ stores the intermediate summing results
+  // scale_ stores the denominators k + alpha / n * sum(x^2), kept for
+  // backward; the CPU fills it for both normalization regions
   Blob<Dtype> scale_;
-  Blob<Dtype> padded_ratio_;   // buffer for backward
-  Blob<Dtype> accum_ratio_;    // buffer for backward
-
-  int num_of_threads_;              // Number of threads to be used for
-                                    // batch based parallelization eg.
-                                    // min(batch,omp_get_num_threads())
 
-  // Fields used for normalization WITHIN_CHANNEL
+  // Fields used for normalization WITHIN_CHANNEL on the GPU
   shared_ptr<SplitLayer<Dtype> > split_layer_;
   vector<Blob<Dtype>*> split_top_vec_;
   shared_ptr<PowerLayer<Dtype> > square_layer_;
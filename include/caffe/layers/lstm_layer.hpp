@@ -72,6 +72,9 @@ template <typename Dtype> class RecurrentLayer;
  * Notably, this implementation lacks the "diagonal" gates, as used in the
  * LSTM architectures described by Alex Graves [3] and others.
  *
+ * This is the CAFFE engine of the LSTM layer type; FusedLSTMLayer computes
+ * the same on the CPU without unrolling.
+ *
  * [1] Hochreiter, Sepp, and Schmidhuber, Jürgen. "Long short-term memory."
  *     Neural Computation 9, no. 8 (1997): 1735-1780.
  *
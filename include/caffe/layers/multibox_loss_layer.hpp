@@ -90,6 +90,17 @@ class MultiBoxLossLayer : public LossLayer<Dtype> {
   virtual Dtype get_normalizer(
       LossParameter_NormalizationMode normalization_mode, int valid_count);
 
+  /// Match and mine all images of the batch on flat arrays, in parallel over
+  /// the images, giving the same results as FindMatches and
+  /// MineHardExamples. Used when flat_matching_ is set.
+  void FlatMatch(const vector<Blob<Dtype>*>& bottom, int* num_negs);
+  /// Same as EncodeLocPrediction after FlatMatch.
+  void FlatEncodeLocPrediction(const Dtype* loc_data, Dtype* loc_pred_data,
+      Dtype* loc_gt_data);
+  /// Same as EncodeConfPrediction after FlatMatch.
+  void FlatEncodeConfPrediction(const Dtype* conf_data,
+      Dtype* conf_pred_data, Dtype* conf_gt_data);
+
   // The internal localization loss layer.
   shared_ptr<Layer<Dtype> > loc_loss_layer_;
   LocLossType loc_loss_type_;
@@ -147,6 +158,31 @@ class MultiBoxLossLayer : public LossLayer<Dtype> {
   vector<map<int, vector<int> > > all_match_indices_;
   vector<vector<int> > all_neg_indices_;
 
+  // The priors of the previous pass, and what was derived from them.
+  vector<Dtype> last_prior_data_;
+  vector<NormalizedBBox> cached_prior_bboxes_;
+  vector<vector<float> > cached_prior_variances_;
+
+  // Whether the configuration is handled by FlatMatch: locations shared
+  // among classes, priors used for matching, no hard example mining or
+  // NMS, and softmax confidence loss.
+  bool flat_matching_;
+  // Priors as all xmin, then all ymin, xmax and ymax, with their sizes and
+  // variances (4 per prior).
+  vector<float> prior_bboxes_;
+  vector<float> prior_sizes_;
+  vector<float> prior_variances_;
+  // Ground truth of image i is [gt_offsets_[i], gt_offsets_[i + 1]), with
+  // [xmin, ymin, xmax, ymax] per ground truth.
+  vector<int> gt_offsets_;
+  vector<float> gt_bboxes_;
+  vector<float> gt_sizes_;
+  vector<int> gt_labels_;
+  // Matches of image i are at [match_offsets_[i], match_offsets_[i + 1])
+  // in loc_pred_; its mined negatives follow its matches in conf_pred_.
+  vector<int> match_offsets_;
+  vector<int> conf_offsets_;
+
   // How to normalize the loss.
   LossParameter_NormalizationMode normalization_;
 };
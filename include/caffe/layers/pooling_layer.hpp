@@ -60,6 +60,10 @@ class PoolingLayer : public Layer<Dtype> {
   friend class PoolingCodeGeneratorBackward<Dtype>;
   PoolingCodeGeneratorForward<Dtype> Forward_code_generator;
   PoolingCodeGeneratorBackward<Dtype> Backward_code_generator;
+  // The top shape followed by the input spatial shape, on which the
+  // generated code depends too: e.g. with global pooling, inputs of
+  // different shapes give the same top shape.
+  vector<int> code_signature(const Blob<Dtype>* top) const;
 
 
  public:
@@ -85,8 +85,24 @@ class PoolingCodeGeneratorForward
     Blob<Dtype>* top,
     bool use_top_mask);
 
+  // 3D pooling generates code for 8 consecutive outputs of a row whose
+  // windows lie inside the input along the width; Forward3D runs it over
+  // the rows and computes the other outputs itself.
+  struct Row_args {
+    const Dtype* bottom;  // Window of the first output, clipped in z and h.
+    Dtype* top;
+    void* mask;
+    int64_t blocks;       // Number of 8 output blocks.
+    int64_t depth;        // Clipped window depth and height.
+    int64_t height;
+    float index;          // Index of bottom within its channel.
+    float pool_size;
+  };
+  typedef void (Row_callback_t)(const Row_args* args);
+
  private:
   void Create_callback(PoolingLayer<Dtype>* layer);
+  void Create_row_callback(PoolingLayer<Dtype>* layer);
 
   static void Naive(
     const Dtype* bottom_data,
@@ -99,10 +115,25 @@ class PoolingCodeGeneratorForward
     int64_t channel_end,
     PoolingLayer<Dtype>* layer,
     bool use_top_mask);
+  static void Forward3D(
+    const Dtype* bottom_data,
+    Dtype* top_data,
+    int top_count,
+    int batch_start,
+    int batch_end,
+    void* mask,
+    int64_t channel_start,
+    int64_t channel_end,
+    PoolingLayer<Dtype>* layer,
+    bool use_top_mask);
   Callback_t* Callback;
+  Row_callback_t* Row_callback;
   std::vector<int> Layer_output_shape_signature;
   bool Use_top_mask;
   PoolingParameter_PoolMethod Method;
+  // Element offsets and float indices of the 8 lanes within a row.
+  int Lane_offsets[8];
+  float Lane_indices[8];
 };
 
 template <typename Dtype>
@@ -128,8 +159,20 @@ class PoolingCodeGeneratorBackward
 
   Callback_t* Get_callback(PoolingLayer<Dtype>* layer, Blob<Dtype>* top);
 
+  // As in the forward pass, for average pooling with unit width stride.
+  struct Row_args {
+    Dtype* bottom_diff;
+    const Dtype* top_diff;
+    int64_t blocks;
+    int64_t depth;
+    int64_t height;
+    float pool_size;
+  };
+  typedef void (Row_callback_t)(const Row_args* args);
+
  private:
   void Create_callback(PoolingLayer<Dtype>* layer);
+  void Create_row_callback(PoolingLayer<Dtype>* layer);
 
   static void Naive(
     const Dtype* top_diff,
@@ -141,7 +184,18 @@ class PoolingCodeGeneratorBackward
     bool use_top_mask,
     const void* mask,
     PoolingLayer<Dtype>* layer);
+  static void Backward3D(
+    const Dtype* top_diff,
+    Dtype* bottom_diff,
+    int batch_start,
+    int batch_end,
+    int64_t channel_start,
+    int64_t channel_end,
+    bool use_top_mask,
+    const void* mask,
+    PoolingLayer<Dtype>* layer);
   Callback_t* Callback;
+  Row_callback_t* Row_callback;
   std::vector<int> layer_output_shape_signature;
 };
 }  // namespace caffe
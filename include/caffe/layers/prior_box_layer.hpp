@@ -38,8 +38,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef CAFFE_PRIORBOX_LAYER_HPP_
 #define CAFFE_PRIORBOX_LAYER_HPP_
 
+#include <map>
+#include <string>
 #include <vector>
 
+#include <boost/weak_ptr.hpp>
+
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
@@ -52,6 +56,11 @@ namespace caffe {
  *
  * Intended for use with MultiBox detection method to generate prior (template).
  *
+ * The priors only depend on the layer parameters and the input shapes, so they
+ * are generated once per shape and shared, read-only, by all PriorBox layers
+ * (of any net) with the same parameters and shapes. Layers consuming the
+ * output must not modify it in place.
+ *
  * NOTE: does not implement Backwards operation.
  */
 template <typename Dtype>
@@ -100,6 +109,10 @@ class PriorBoxLayer : public Layer<Dtype> {
     return;
   }
 
+  /// @brief Writes the priors and their variances for the given shapes.
+  void GeneratePriors(int layer_width, int layer_height, int img_width,
+      int img_height, Dtype* top_data);
+
   vector<float> min_sizes_;
   vector<float> max_sizes_;
   vector<float> aspect_ratios_;
@@ -114,6 +127,18 @@ class PriorBoxLayer : public Layer<Dtype> {
   float step_h_;
 
   float offset_;
+
+  // Serialized prior_box_param, the common part of the cache keys.
+  string param_key_;
+  // The shapes the current priors_ were generated for.
+  int cached_layer_width_;
+  int cached_layer_height_;
+  int cached_img_width_;
+  int cached_img_height_;
+  shared_ptr<Blob<Dtype> > priors_;
+
+  // Priors in use by any layer, by parameters and shapes.
+  static map<const string, boost::weak_ptr<Blob<Dtype> > > cached_priors_;
 };
 
 }  // namespace caffe
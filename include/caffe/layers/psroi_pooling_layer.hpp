@@ -69,6 +69,11 @@ class PSROIPoolingLayer : public Layer<Dtype> {
   int pooled_height_;
   int pooled_width_;
   Blob<int> mapping_channel_;
+  /// bottom[0] transposed to channels-last, with the output_dim channels
+  /// feeding one bin stored next to each other
+  Blob<Dtype> bottom_nhwc_;
+  /// ROI indices, largest first, for the dynamic forward schedule
+  vector<int> roi_order_;
 };
 
 }  // namespace caffe
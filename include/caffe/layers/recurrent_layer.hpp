@@ -95,6 +95,8 @@ class RecurrentLayer : public Layer<Dtype> {
     // Can't propagate to sequence continuation indicators.
     return bottom_index != 1;
   }
+  // Reshape shares the bottoms and tops with the blobs of the unrolled net.
+  virtual inline bool AliasesBlobsInReshape() const { return true; }
 
  protected:
   /**
@@ -82,6 +82,11 @@ class ROIPoolingLayer : public Layer<Dtype> {
   int pooled_w_;
   Dtype spatial_scale_;
   Blob<int> max_idx_;
+  /// bottom[0] transposed to channels-last, so each bin is pooled across
+  /// all channels at once with unit-stride loads
+  Blob<Dtype> bottom_nhwc_;
+  /// ROI indices, largest first, for the dynamic forward schedule
+  vector<int> roi_order_;
 };
 
 }  // namespace caffe
@@ -72,16 +72,15 @@ class SoftmaxLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
-  virtual void Forward_cpu_fast_case(const vector<Blob<Dtype>*>& bottom,
-     const vector<Blob<Dtype>*>& top);
 
   int outer_num_;
   int inner_num_;
   int softmax_axis_;
-  /// sum_multiplier is used to carry out sum using BLAS
-  Blob<Dtype> sum_multiplier_;
-  /// scale is an intermediate Blob to hold temporary results.
+#ifndef CPU_ONLY
+  /// scale is an intermediate Blob for the GPU kernels; the CPU path
+  /// keeps its per-position max and sum in registers.
   Blob<Dtype> scale_;
+#endif
 };
 
 }  // namespace caffe
@@ -54,14 +54,53 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 
 namespace caffe {
 
+/**
+ * @brief Decodes a video file or a webcam on its own thread into a ring of
+ *        preallocated cv::Mat%s, ahead of the frames being used.
+ *
+ * Frames come out in order. Of every skip_frames + 1 frames only the last one
+ * is retrieved; the others are just grabbed. Once the video has ended an
+ * empty frame comes out.
+ */
+class VideoFrameReader : public InternalThread {
+ public:
+  /// Reads video_file, or the webcam device_id if video_file is empty.
+  VideoFrameReader(const string& video_file, int device_id, int skip_frames,
+                   int ring_size);
+  virtual ~VideoFrameReader();
+
+  /// Waits for the next frame and returns its slot in the ring.
+  int pop() { return full_.pop("Waiting for video frames"); }
+  /// Gives a slot returned by pop back for decoding.
+  void push(int slot) { free_.push(slot); }
+  const cv::Mat& frame(int slot) const { return ring_[slot]; }
+  /// Waits for the next frame without taking it.
+  const cv::Mat& peek() { return ring_[full_.peek()]; }
+
+ protected:
+  virtual void InternalThreadEntry();
+
+  cv::VideoCapture cap_;
+  int skip_frames_;
+  vector<cv::Mat> ring_;
+  BlockingQueue<int> free_;
+  BlockingQueue<int> full_;
+
+  DISABLE_COPY_AND_ASSIGN(VideoFrameReader);
+};
+
 /**
  * @brief Provides data to the Net from webcam or video files.
  *
- * TODO(weiliu89): thorough documentation for Forward and proto params.
+ * Videos are decoded ahead by VideoFrameReader%s. With a source list,
+ * decode_threads of its videos are decoded at once and the items of a batch
+ * are taken from them in turn; a video that ends is replaced by the next one
+ * of the list.
  */
 template <typename Dtype>
 class VideoDataLayer : public BasePrefetchingDataLayer<Dtype> {
@@ -77,14 +116,17 @@ class VideoDataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  /// Starts decoding the next video of the list, if there is one left.
+  shared_ptr<VideoFrameReader> NextReader();
 
   VideoDataParameter_VideoType video_type_;
-  cv::VideoCapture cap_;
+  vector<string> videos_;
+  int videos_id_;
+  vector<shared_ptr<VideoFrameReader> > readers_;
+  int readers_id_;
+  int ring_size_;
 
   int skip_frames_;
-
-  int total_frames_;
-  int processed_frames_;
   vector<int> top_shape_;
 };
 
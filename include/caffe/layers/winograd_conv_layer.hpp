@@ -0,0 +1,104 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/direct_conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd implementation of ConvolutionLayer for the CPU, selected
+ *        with the WINOGRAD engine.
+ *
+ * 3x3 convolutions with stride 1 and no dilation are computed with the
+ * minimal filtering algorithms F(4x4,3x3), or F(2x2,3x3) for outputs smaller
+ * than 8x8, which take 4x and 2.25x fewer multiplications than the direct
+ * method. The input is cut into overlapping tiles; blocks of tiles are
+ * transformed, multiplied with the transformed filters by one GEMM per
+ * tile element and transformed back, with the blocks distributed over the
+ * OpenMP threads.
+ *
+ * The transformed filters are cached and recomputed only when the weights
+ * change. Other shapes, and the backward pass, use DirectConvolutionLayer.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public DirectConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : DirectConvolutionLayer<Dtype>(param), tile_(0), alpha_(0),
+        tiles_h_(0), tiles_w_(0), num_threads_(1) {}
+
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  // Output tile size m of F(m x m, 3x3), or 0 when the layer falls back to
+  // DirectConvolutionLayer.
+  int tile_size() const { return tile_; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ private:
+  void TransformWeights(const Dtype* weight);
+
+  int tile_;
+  int alpha_;
+  int tiles_h_;
+  int tiles_w_;
+  // Threads scratch_ has room for.
+  int num_threads_;
+  // Transformed filters, group by group, laid out as alpha * alpha matrices
+  // of (num_output / group) x (channels / group).
+  vector<Dtype> transformed_weights_;
+  // The weights transformed_weights_ was computed from.
+  vector<Dtype> cached_weights_;
+  // Transformed input and output tiles of one block for every thread.
+  vector<Dtype> scratch_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
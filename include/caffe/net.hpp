@@ -74,6 +74,24 @@ class Net {
   /// enable train and test with one network, for saving memory
   void SetPhase(Phase phase);
 
+  /**
+   * @brief Switches every layer between batch-parallel execution and
+   *        splitting each item over threads (see NetParameter.latency_mode),
+   *        then reshapes the net so the layers pick up the change.
+   */
+  void SetLatencyMode(bool latency_mode);
+  inline bool latency_mode() const { return latency_mode_; }
+
+  /**
+   * @brief Sets how many core groups run independent layers concurrently
+   *        (see NetParameter.branch_groups); 1 runs layers in index order.
+   */
+  inline void set_branch_groups(int branch_groups) {
+    CHECK_GE(branch_groups, 1);
+    branch_groups_ = branch_groups;
+  }
+  inline int branch_groups() const { return branch_groups_; }
+
   /**
    * @brief Run Forward and return the result.
    *
@@ -135,6 +153,7 @@ class Net {
 
   /// @brief Updates the network weights based on the diff values computed.
   void Update();
+  void Update(int learnable_param_id);
   /**
    * @brief Shares weight data of owner blobs with shared blobs.
    *
@@ -146,6 +165,11 @@ class Net {
   /**
    * @brief For an already initialized net, implicitly copies (i.e., using no
    *        additional memory) the pre-trained layers from another Net.
+   *
+   * Here and in CopyTrainedLayersFrom, layers are matched by the names they
+   * have in the net definition, also when they were fused into a
+   * FusedNeuron layer (see NetParameter.fuse_neurons); ToProto and ToHDF5
+   * write fused layers under those names as well.
    */
   void ShareTrainedLayersWith(const Net* other);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
@@ -229,6 +253,24 @@ class Net {
   inline const vector<Blob<Dtype>*>& learnable_params() const {
     return learnable_params_;
   }
+  /**
+   * @brief Returns the rows of learnable param learnable_param_id that hold
+   *        its gradient, or NULL when the whole diff has to be treated as
+   *        the gradient.
+   *
+   * Rows are only reported for layers with row-sparse gradients (see
+   * Layer::sparse_param_rows), when sparse updates are enabled and in CPU
+   * mode. ClearParamDiffs then zeros just these rows, and anything writing
+   * the diff outside of them has to leave sparse updates disabled.
+   */
+  inline vector<int>* learnable_param_rows(int learnable_param_id) const {
+    return (sparse_updates_ && Caffe::mode() == Caffe::CPU) ?
+        learnable_param_rows_[learnable_param_id] : NULL;
+  }
+  /// @brief Enables the row-sparse handling of learnable_param_rows;
+  ///        solvers set it according to whether they support it.
+  void set_sparse_updates(bool value);
+  inline bool sparse_updates() const { return sparse_updates_; }
 
   vector<int> get_layer_learnable_param_ids(int layer_id) const;
 
@@ -315,6 +357,34 @@ class Net {
   static void CompilationRuleThree(const NetParameter& param,
                              NetParameter* param_compiled);
 
+  /**
+  * @brief This is rule that replaces chains of element-wise layers (ReLU,
+  *        Sigmoid, TanH etc. of the CAFFE engine, per-channel Scale and
+  *        Bias) where each layer consumes the top of the previous one with
+  *        a single FusedNeuron layer, if the net sets fuse_neurons
+  */
+  static void CompilationRuleFour(const NetParameter& param,
+                             NetParameter* param_compiled);
+
+  /// @brief Whether CompilationRuleFour can fuse param.layer(layer_id)
+  static bool IsFusableNeuron(const NetParameter& param, int layer_id);
+
+  /**
+  * @brief This is rule that analyze layer if it is Concat of CAFFE engine
+  *        and every bottom comes from a Flatten of a Permute to channels-last
+  *        order, as in SSD prediction heads. If that is the case the Permute
+  *        and Flatten layers are dropped and the Concat writes the Permute
+  *        inputs transposed straight into its output, if the net sets
+  *        fold_permute_flatten
+  */
+  static void CompilationRuleFive(const NetParameter& param,
+                             NetParameter* param_compiled);
+
+  /// @brief Index of the last layer before layer_id that produces blob_name,
+  ///        or -1 if there is none
+  static int GetBlobProducer(const string& blob_name,
+                             const NetParameter& param, int layer_id);
+
 
 
   static void GetBlobConsumers(std::vector<const LayerParameter*> &cnsmer_blobs,
@@ -339,6 +409,37 @@ class Net {
   /// @brief Append a new parameter blob to the net.
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
+  /// @brief The names of the layers of the net definition that layer_param
+  ///        stands for, more than one for a FusedNeuron layer, and the
+  ///        index of the first of its num_blobs blobs each of them owns;
+  ///        first_blobs ends with num_blobs.
+  static void UnfusedLayers(const LayerParameter& layer_param, int num_blobs,
+                            vector<string>* names, vector<int>* first_blobs);
+  /// @brief Find the layer named layer_name in the net definition, possibly
+  ///        fused: the id of the layer holding it and its range of blobs.
+  bool FindUnfusedLayer(const string& layer_name, int* layer_id,
+                        int* first_blob, int* num_blobs) const;
+  /// @brief Apply the NUMA placement to the parameters and activations.
+  void SetUpNumaPlacement(const NumaParameter& numa_param);
+
+  /**
+   * @brief Let the inputs of Concat and the outputs of Slice layers that
+   *        join or split along their outermost axis live inside the joined
+   *        blob, so that the layers do not have to copy them.
+   *
+   * Runs after every Init and Reshape in CPU mode; blobs whose memory is
+   * shared, replaced by data layers or modified in place are left alone.
+   */
+  void ShareConcatSliceBuffers();
+  /// @brief Record, for each layer, the earlier layers it has to wait for.
+  void BuildLayerDependencies();
+  /// @brief Whether Forward/Backward can run layers as a dataflow graph.
+  bool UseBranchGroups() const;
+  /// @brief Run layers lo..hi concurrently in dependency order.
+  void RunLayerGraph(int lo, int hi, bool forward, vector<Dtype>* losses);
+  void RunLayerTask(int layer_id, int lo, int hi, bool forward,
+                    int group_threads, const vector<unsigned int>* seeds,
+                    vector<int>* pending, vector<Dtype>* losses);
 
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
@@ -353,10 +454,16 @@ class Net {
   string engine_name_;
   /// @brief The phase: TRAIN or TEST
   Phase phase_;
+  /// @brief Whether layers split single items over threads
+  bool latency_mode_;
+  /// @brief Number of core groups running independent layers concurrently
+  int branch_groups_;
   /// @brief Individual layers in the net
   vector<shared_ptr<Layer<Dtype> > > layers_;
   vector<string> layer_names_;
   map<string, int> layer_names_index_;
+  /// @brief The layer id each layer fused into a FusedNeuron layer maps to
+  map<string, int> fused_layer_names_index_;
   vector<bool> layer_need_backward_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
@@ -372,6 +479,11 @@ class Net {
   /// top_vecs stores the vectors containing the output for each layer
   vector<vector<Blob<Dtype>*> > top_vecs_;
   vector<vector<int> > top_id_vecs_;
+  /// For each layer, the earlier layers whose outputs, inputs or shared
+  /// parameters it touches (layer_deps_) and the reverse edges
+  /// (layer_users_).
+  vector<vector<int> > layer_deps_;
+  vector<vector<int> > layer_users_;
   /// Vector of weight in the loss (or objective) function of each net blob,
   /// indexed by blob_id.
   vector<Dtype> blob_loss_weights_;
@@ -396,6 +508,10 @@ class Net {
    * and learnable_params_[learnable_param_ids_[i]] gives its owner.
    */
   vector<int> learnable_param_ids_;
+  /// the rows touched by the owner layer for row-sparse learnable_params_
+  vector<vector<int>*> learnable_param_rows_;
+  /// Whether learnable_param_rows_ are used to clear and update params
+  bool sparse_updates_;
   /// the learning rate multipliers for learnable_params_
   vector<float> params_lr_;
   vector<bool> has_params_lr_;
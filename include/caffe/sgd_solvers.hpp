@@ -57,6 +57,7 @@ class SGDSolver : public Solver<Dtype> {
   explicit SGDSolver(const string& param_file)
       : Solver<Dtype>(param_file) { PreSolve(); }
   virtual inline const char* type() const { return "SGD"; }
+  virtual inline bool SupportsSparseUpdates() const { return true; }
 
   const vector<shared_ptr<Blob<Dtype> > >& history() { return history_; }
 
@@ -95,6 +96,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
   explicit NesterovSolver(const string& param_file)
       : SGDSolver<Dtype>(param_file) {}
   virtual inline const char* type() const { return "Nesterov"; }
+  virtual inline bool SupportsSparseUpdates() const { return false; }
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
@@ -130,6 +132,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
   explicit RMSPropSolver(const string& param_file)
       : SGDSolver<Dtype>(param_file) { constructor_sanity_check(); }
   virtual inline const char* type() const { return "RMSProp"; }
+  virtual inline bool SupportsSparseUpdates() const { return false; }
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
@@ -153,6 +156,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
   explicit AdaDeltaSolver(const string& param_file)
       : SGDSolver<Dtype>(param_file) { AdaDeltaPreSolve(); }
   virtual inline const char* type() const { return "AdaDelta"; }
+  virtual inline bool SupportsSparseUpdates() const { return false; }
 
  protected:
   void AdaDeltaPreSolve();
@@ -146,6 +146,12 @@ class Solver {
   // written to disk together with the learned net.
   void Snapshot();
 
+  /**
+   * @brief Whether the update can be restricted to the rows listed by
+   *        Net::learnable_param_rows, leaving the others lazily untouched.
+   */
+  virtual inline bool SupportsSparseUpdates() const { return false; }
+
   // Make and apply the update value for the current iteration.
   virtual void ApplyUpdate() = 0;
   virtual void ApplyUpdate(int param_id) = 0;
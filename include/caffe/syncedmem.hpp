@@ -49,6 +49,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/common.hpp"
 
 #include "caffe/multinode/mlsl.hpp"
+#include "caffe/util/host_allocator.hpp"
+#include "caffe/util/numa.hpp"
 
 namespace caffe {
 
@@ -57,6 +59,8 @@ namespace caffe {
 // The improvement in performance seems negligible in the single GPU case,
 // but might be more significant for parallel training. Most importantly,
 // it improved stability for large models on many GPUs.
+// CPU allocations go through the caching host allocator, which serves
+// repeated allocations of similar sizes from freed blocks.
 inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
@@ -72,11 +76,7 @@ inline void CaffeMallocHost(void** ptr, size_t size, bool* use_cuda) {
   } else {
 #endif /* !USE_MLSL */
 
-#ifdef USE_MKL
-    *ptr = mkl_malloc(size ? size : 1, 64);
-#else
-   *ptr = malloc(size);
-#endif
+    *ptr = host_allocator::Allocate(size);
 
 #ifdef USE_MLSL
   }
@@ -100,11 +100,7 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
   } else {
 #endif /* !USE_MLSL */
 
-#ifdef USE_MKL
-    mkl_free(ptr);
-#else
-    free(ptr);
-#endif
+    host_allocator::Free(ptr);
 
 #ifdef USE_MLSL
   }
@@ -143,13 +139,18 @@ class SyncedMemory {
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL),
         size_(0), head_(UNINITIALIZED), own_cpu_data_(false),
-        cpu_malloc_use_cuda_(false), own_gpu_data_(false), own_prv_data_(false),
-        gpu_device_(-1) {}
+        cpu_malloc_use_cuda_(false), cpu_malloc_use_numa_(false),
+        own_gpu_data_(false), own_prv_data_(false), gpu_device_(-1) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL),
         size_(size), head_(UNINITIALIZED), own_cpu_data_(false),
-        cpu_malloc_use_cuda_(false), own_gpu_data_(false), own_prv_data_(false),
-        gpu_device_(-1) {}
+        cpu_malloc_use_cuda_(false), cpu_malloc_use_numa_(false),
+        own_gpu_data_(false), own_prv_data_(false), gpu_device_(-1) {}
+  // A view of size bytes of the host memory of base, starting offset bytes
+  // in. The view never allocates nor frees host memory and keeps base alive;
+  // writes through either one are seen by the other on the host.
+  SyncedMemory(const shared_ptr<SyncedMemory>& base, size_t offset,
+               size_t size);
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -159,6 +160,14 @@ class SyncedMemory {
   void* mutable_gpu_data();
 
   const void* cpu_ptr() const { return cpu_ptr_; }
+  // The memory this one is a view of, or NULL.
+  const shared_ptr<SyncedMemory>& base() const { return base_; }
+
+  // Sets the NUMA placement of the host memory. It is used by the next host
+  // allocation; already allocated pages are migrated where the policy
+  // requires it.
+  void set_placement(const numa::Placement& placement);
+  const numa::Placement& placement() const { return placement_; }
 
   shared_ptr<PrvMemDescr> prv_descriptor_;
   void set_prv_descriptor(shared_ptr<PrvMemDescr> descriptor, bool same_data);
@@ -176,15 +185,20 @@ class SyncedMemory {
  private:
   void to_cpu();
   void to_gpu();
+  void alloc_cpu();
+  void free_cpu();
   void* cpu_ptr_;
   void* gpu_ptr_;
   const size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
+  bool cpu_malloc_use_numa_;
+  numa::Placement placement_;
   bool own_gpu_data_;
   bool own_prv_data_;
   int gpu_device_;
+  shared_ptr<SyncedMemory> base_;
   boost::mutex mtx;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
@@ -180,6 +180,17 @@ void MatchBBox(const vector<NormalizedBBox>& gt,
     const bool ignore_cross_boundary_bbox,
     vector<int>* match_indices, vector<float>* match_overlaps);
 
+// Match prediction bboxes with all ground truth bboxes, as MatchBBox does
+// for label -1, on flat arrays. gt_bboxes holds [xmin, ymin, xmax, ymax] per
+// ground truth, pred_bboxes holds the num_pred xmin, then the ymin, xmax and
+// ymax of all predictions. The sizes are given by BBoxSize. overlaps is
+// scratch space for the num_gt x num_pred overlap matrix.
+void MatchBBox(const float* gt_bboxes, const float* gt_sizes,
+    const int num_gt, const float* pred_bboxes, const float* pred_sizes,
+    const int num_pred, const MatchType match_type,
+    const float overlap_threshold, const bool ignore_cross_boundary_bbox,
+    vector<float>* overlaps, int* match_indices, float* match_overlaps);
+
 // Find matches between prediction bboxes and ground truth bboxes.
 //    all_loc_preds: stores the location prediction, where each item contains
 //      location prediction for an image.
@@ -377,6 +388,28 @@ void GetPriorBBoxes(const Dtype* prior_data, const int num_priors,
       vector<NormalizedBBox>* prior_bboxes,
       vector<vector<float> >* prior_variances);
 
+// Check whether prior_data differs from the priors of the previous call.
+//    prior_data: 1 x 2 x num_priors * 4 x 1 blob.
+//    num_priors: number of priors.
+//    last_prior_data: a copy of the previous priors, updated if they differ.
+// Priors only change with the input shapes, so callers keep what they derive
+// from them until this returns true.
+template <typename Dtype>
+bool PriorsChanged(const Dtype* prior_data, const int num_priors,
+      vector<Dtype>* last_prior_data);
+
+// Order ROIs by decreasing volume, the largest first.
+//    rois: num_rois x (1 + 2 * num_spatial_axes) blob of
+//      [batch_index start_0 .. start_k end_0 .. end_k] rows.
+//    num_rois: number of ROIs.
+//    num_spatial_axes: number of start/end coordinate pairs per ROI.
+//    order: stores the ROI indices, ties kept in their original order.
+// Pooling cost grows with ROI size, so handing the largest ROIs out first to
+// a dynamic schedule keeps one big ROI from being left for the last thread.
+template <typename Dtype>
+void SortROIsByArea(const Dtype* rois, const int num_rois,
+      const int num_spatial_axes, vector<int>* order);
+
 // Get detection results from det_data.
 //    det_data: 1 x 1 x num_det x 7 blob.
 //    num_det: the number of detections.
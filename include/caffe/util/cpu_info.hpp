@@ -139,7 +139,10 @@ class OpenMpManager {
   static void setGpuEnabled();
   static void setGpuDisabled();
 
-  static void bindCurrentThreadToNonPrimaryCoreIfPossible();
+  // Binds to a core other than the first one, if there is any. Threads with
+  // different indices are spread over the remaining cores.
+  static void bindCurrentThreadToNonPrimaryCoreIfPossible(
+    unsigned threadIndex = 0);
 
   static void bindOpenMpThreads();
   static void printVerboseInformation();
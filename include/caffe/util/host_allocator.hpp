@@ -0,0 +1,97 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+#define CAFFE_UTIL_HOST_ALLOCATOR_HPP_
+
+#include <stdint.h>
+
+#include <cstddef>
+
+namespace caffe {
+namespace host_allocator {
+
+/**
+ * @brief Counters of the caching host allocator behind CaffeMallocHost.
+ *
+ * Blocks are rounded up to size classes that are at most 25% larger than the
+ * request. Freed blocks are kept in a small per-thread cache and a shared
+ * cache, so that reshaping blobs back and forth or recreating the same
+ * temporaries every iteration does not reach the system allocator.
+ */
+struct Stats {
+  // Bytes requested by the blocks currently handed out.
+  size_t live_bytes;
+  // Maximum of live_bytes since the start or the last ResetPeak().
+  size_t peak_bytes;
+  // Bytes held in the caches, ready to be reused.
+  size_t cached_bytes;
+  // Allocations served from a cache and from the system allocator.
+  uint64_t hits;
+  uint64_t misses;
+
+  double hit_rate() const {
+    return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.;
+  }
+};
+
+// Returns at least size bytes, aligned as the system allocator aligns them.
+// Returns NULL when the system allocator fails.
+void* Allocate(size_t size);
+
+// Returns a block obtained from Allocate to the caches, or to the system when
+// the caches are full.
+void Free(void* ptr);
+
+Stats GetStats();
+void ResetPeak();
+
+// Bounds the bytes kept in the shared cache; blocks that do not fit are
+// released to the system right away. Lowering the limit trims the cache, and
+// a limit of zero disables caching and empties the caches of all threads.
+// The default is 1 GB.
+void SetCacheLimit(size_t bytes);
+size_t CacheLimit();
+
+// Releases all cached blocks, of the shared cache and of every thread, to the
+// system.
+void ReleaseCached();
+
+}  // namespace host_allocator
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HOST_ALLOCATOR_HPP_
@@ -120,6 +120,11 @@ void RandomOrderChannels(const cv::Mat& in_img, cv::Mat* out_img,
                          const float random_order_prob);
 
 cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param);
+
+// Same random distortions as ApplyDistort, applied to an 8-bit BGR image in
+// place by a single pass over the pixels, without intermediate images.
+// Other image types fall back to ApplyDistort.
+void ApplyDistortInPlace(const DistortionParameter& param, cv::Mat* img);
 #endif  // USE_OPENCV
 
 }  // namespace caffe
@@ -165,6 +165,9 @@ inline bool ReadFileToDatum(const string& filename, Datum* datum) {
   return ReadFileToDatum(filename, -1, datum);
 }
 
+// Hints the OS to start reading the file in the background, where supported.
+void ReadFileAhead(const string& filename);
+
 bool ReadImageToDatum(const string& filename, const int label,
     const int height, const int width, const bool is_color,
     const std::string & encoding, Datum* datum);
@@ -266,9 +269,20 @@ inline bool MapLabelToDisplayName(const LabelMap& map,
 }
 
 #ifdef USE_OPENCV
+// Reads the size of a JPEG from its frame header, without decoding it.
+// Returns false if the file is not a JPEG.
+bool ReadJPEGSize(const string& filename, int* height, int* width);
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width, const bool is_color);
 
+// As above, but a JPEG at least twice as large as height x width is decoded
+// directly at 1/2, 1/4 or 1/8 of its size, in the DCT domain, then resized.
+// Faster, though the result differs slightly from a full size resize.
+cv::Mat ReadImageToCVMat(const string& filename,
+    const int height, const int width, const bool is_color,
+    const bool reduced_decode);
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width);
 
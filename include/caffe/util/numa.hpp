@@ -0,0 +1,93 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_NUMA_HPP_
+#define CAFFE_UTIL_NUMA_HPP_
+
+#include <stdint.h>
+
+#include <cstddef>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+namespace numa {
+
+/**
+ * @brief Where the host pages of one SyncedMemory should live on a
+ *        multi-socket machine. A default constructed Placement leaves
+ *        allocation to CaffeMallocHost.
+ */
+struct Placement {
+  Placement();
+  Placement(const NumaParameter& param, NumaParameter_Policy policy);
+
+  bool enabled() const { return enabled_; }
+
+  NumaParameter_Policy policy;
+  // Bit i selects node i for INTERLEAVE and BIND; zero selects all nodes.
+  uint64_t nodemask;
+  // Buffers of at least this many bytes get a transparent huge page hint.
+  size_t huge_page_bytes;
+  // Zero fresh pages from all OpenMP threads with a static schedule.
+  bool parallel_first_touch;
+
+ private:
+  bool enabled_;
+};
+
+// Number of online NUMA nodes; 1 when the topology cannot be read.
+int NumNodes();
+
+size_t PageSize();
+
+// Maps size bytes of zeroed memory, applies the placement before the first
+// touch and touches the pages according to placement.parallel_first_touch.
+void* Allocate(size_t size, const Placement& placement);
+
+// Releases memory returned by Allocate.
+void Free(void* ptr, size_t size);
+
+// Applies placement to memory that may already be touched, migrating its
+// pages for INTERLEAVE and BIND. Only whole pages inside the buffer are
+// affected.
+void Migrate(void* ptr, size_t size, const Placement& placement);
+
+}  // namespace numa
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_NUMA_HPP_
@@ -69,6 +69,27 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
   m_MACRO.Stop();                                         \
   performance::monitor.UpdateEventById(id_name, m_MACRO);
 
+// Records a value obtained elsewhere, e.g. timed on another thread, as one
+// call of the event. Times are in nanoseconds.
+#define PERFORMANCE_EVENT_UPDATE_ID(id_name, value)                      \
+  performance::monitor.UpdateEventById(id_name,                          \
+    performance::PreciseTime(value), performance::PreciseTime(value));
+
+// Counters sample quantities that are not times, e.g. queue lengths, and
+// are reported apart from the events.
+#define PERFORMANCE_COUNTER_ID_DECL(id_name) \
+  int id_name
+
+#define PERFORMANCE_COUNTER_ID_RESET(id_name) \
+  id_name = PERFORMANCE_EVENT_ID_UNSET
+
+#define PERFORMANCE_COUNTER_ID_INIT(id_name, counter_name) \
+  if ((id_name) == PERFORMANCE_EVENT_ID_UNSET)             \
+    id_name = performance::monitor.GetCounterIdByName(counter_name)
+
+#define PERFORMANCE_COUNTER_UPDATE_ID(id_name, value) \
+  performance::monitor.UpdateCounterById(id_name, value)
+
 #define PERFORMANCE_CREATE_MONITOR() \
   namespace performance {            \
   Monitor monitor; };
@@ -79,7 +100,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define PERFORMANCE_MEASUREMENT_END_MKL(prefix)       \
   do {                                                \
-    static char name[256];                            \
+    char name[256];                                   \
     snprintf(name, sizeof(name), "%s_mkl_%s", prefix, \
       this->layer_param_.name().c_str());             \
     PERFORMANCE_MEASUREMENT_END(name);                \
@@ -87,7 +108,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define PERFORMANCE_MEASUREMENT_END_MKL_DETAILED(prefix, suffix) \
   do {                                                           \
-    static char name[256];                                       \
+    char name[256];                                              \
     snprintf(name, sizeof(name), "%s_mkl_%s%s", prefix,          \
       this->layer_param_.name().c_str(), suffix);                \
     PERFORMANCE_MEASUREMENT_END(name);                           \
@@ -107,6 +128,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PERFORMANCE_MKLDNN_NAME(prefix) \
   (std::string(prefix) + "_mkldnn_" + this->layer_param_.name()).c_str()
 
+#define PERFORMANCE_PREFETCH_NAME(prefix) \
+  (std::string("prefetch_") + prefix + "_" + this->layer_param_.name()).c_str()
+
 #else
 #define PERFORMANCE_EVENT_ID_DECL(id_name)
 #define PERFORMANCE_EVENT_ID_RESET(id_name)
@@ -115,6 +139,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PERFORMANCE_MEASUREMENT_END(name)
 #define PERFORMANCE_MEASUREMENT_END_STATIC(name)
 #define PERFORMANCE_MEASUREMENT_END_ID(id_name)
+#define PERFORMANCE_EVENT_UPDATE_ID(id_name, value)
+#define PERFORMANCE_COUNTER_ID_DECL(id_name)
+#define PERFORMANCE_COUNTER_ID_RESET(id_name)
+#define PERFORMANCE_COUNTER_ID_INIT(id_name, counter_name)
+#define PERFORMANCE_COUNTER_UPDATE_ID(id_name, value)
 #define PERFORMANCE_CREATE_MONITOR()
 #define PERFORMANCE_INIT_MONITOR()
 #define PERFORMANCE_MEASUREMENT_END_MKL(prefix)
@@ -123,6 +152,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PERFORMANCE_MKL_NAME(prefix)
 #define PERFORMANCE_MKLDNN_NAME_DETAILED(prefix, suffix)
 #define PERFORMANCE_MKLDNN_NAME(prefix)
+#define PERFORMANCE_PREFETCH_NAME(prefix)
 #endif
 
 #ifdef PERFORMANCE_MONITORING
@@ -138,6 +168,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <utility>
 #include <vector>
 
+#include "boost/thread/mutex.hpp"
+
 namespace performance {
 
   class PreciseTime {
@@ -231,8 +263,10 @@ namespace performance {
     PreciseTime monotonic_time_stamp_;
     Measurement* next_;
 
+    // Nested measurements suspend the enclosing one of the same thread;
+    // layers of a branch group are measured on their worker threads.
     static Measurement*& GetStack() {
-      static Measurement* stack = NULL;
+      static thread_local Measurement* stack = NULL;
       return stack;
     }
 
@@ -253,7 +287,7 @@ namespace performance {
     }
 
     void Start() {
-      static Measurement*& stack = GetStack();
+      Measurement*& stack = GetStack();
 
       if (stack)
           stack->Suspend();
@@ -273,7 +307,7 @@ namespace performance {
       monotonic_accumulator_ = monotonic_accumulator_ + 
         PreciseTime::GetMonotonicTime() - monotonic_time_stamp_;
 
-      static Measurement*& stack = GetStack();
+      Measurement*& stack = GetStack();
 
       stack = next_;
 
@@ -311,10 +345,12 @@ namespace performance {
     }
 
     void Update(const Measurement &measurement) {
-      const PreciseTime &process_time_stamp = measurement.GetProcessTimeStamp();
-      const PreciseTime &monotonic_time_stamp =
-        measurement.GetMonotonicTimeStamp();
+      Update(measurement.GetProcessTimeStamp(),
+        measurement.GetMonotonicTimeStamp());
+    }
 
+    void Update(const PreciseTime &process_time_stamp,
+      const PreciseTime &monotonic_time_stamp) {
       total_process_time_ = total_process_time_ + process_time_stamp;
       total_monotonic_time_ = total_monotonic_time_ + monotonic_time_stamp;
 
@@ -370,6 +406,47 @@ namespace performance {
     }
   };
 
+  class Counter {
+    unsigned number_of_samples_;
+    uint64_t total_;
+    uint64_t minimum_;
+    uint64_t maximum_;
+
+   public:
+    Counter() : number_of_samples_(0), total_(0), minimum_(0), maximum_(0) {
+    }
+
+    void Update(uint64_t value) {
+      total_ += value;
+
+      if (minimum_ > value || !number_of_samples_)
+          minimum_ = value;
+
+      if (maximum_ < value || !number_of_samples_)
+          maximum_ = value;
+
+      number_of_samples_++;
+    }
+
+    unsigned GetNumberOfSamples() const {
+      return number_of_samples_;
+    }
+
+    double GetAverage() const {
+      return number_of_samples_
+        ? static_cast<double>(total_) / number_of_samples_
+        : 0.;
+    }
+
+    uint64_t GetMinimum() const {
+      return minimum_;
+    }
+
+    uint64_t GetMaximum() const {
+      return maximum_;
+    }
+  };
+
   class Log {
    public:
     static void WriteLine() {
@@ -388,6 +465,11 @@ namespace performance {
         "Layer");
     }
 
+    static void WriteCounterHeaders() {
+      printf("%10s %16s %16s %16s : %s\n\n",
+        "Samples", "Avg", "Min", "Max", "Counter");
+    }
+
     static void WriteNoSpacing(const char* string, const PreciseTime& time) {
       printf("%18lu : %s\n", (uint64_t)time, string);
     }
@@ -412,11 +494,21 @@ namespace performance {
           (uint64_t)event.GetMaximalProcessTime(),
           string);
     }
+
+    static void Write(const char *string, const Counter &counter) {
+      printf("%10u %16.2f %16lu %16lu : %s \n",
+          counter.GetNumberOfSamples(),
+          counter.GetAverage(),
+          counter.GetMinimum(),
+          counter.GetMaximum(),
+          string);
+    }
   };
 
   class Monitor {
     typedef std::vector<std::string> NameVector;
     typedef std::vector<Event> EventVector;
+    typedef std::vector<Counter> CounterVector;
     typedef std::pair<std::string, unsigned> Pair;
     typedef std::map<std::string, unsigned> Map;
     typedef Map::iterator Iterator;
@@ -424,6 +516,11 @@ namespace performance {
 
     EventVector events_;
     Map event_name_id_map_;
+    CounterVector counters_;
+    Map counter_name_id_map_;
+    // Events are looked up and updated from the worker threads of branch
+    // groups as well.
+    boost::mutex mutex_;
 
     bool are_measurements_enabled_;
 
@@ -441,9 +538,23 @@ namespace performance {
       if (events_.size())
         DumpEventsLog();
 
+      if (counters_.size())
+        DumpCountersLog();
+
       DumpGeneralLog();
     }
 
+    void DumpCountersLog() {
+      Log::WriteLine();
+      Log::WriteLine("Counters");
+      Log::WriteLine();
+      Log::WriteCounterHeaders();
+
+      Iterator iterator = counter_name_id_map_.begin();
+      for (; iterator != counter_name_id_map_.end(); iterator++)
+        Log::Write(iterator->first.c_str(), counters_[iterator->second]);
+    }
+
     void DumpEventsLog() {
       ObtainEventNames();
       ObtainTotalMklConversionTime();
@@ -519,6 +630,10 @@ namespace performance {
 
       Iterator iterator = event_name_id_map_.begin();
       for (; iterator != event_name_id_map_.end(); iterator++) {
+        // Prefetch events are timed on the prefetch threads, so they are not
+        // part of the breakdown.
+        if (iterator->first.compare(0, 9, "prefetch_") == 0)
+          continue;
         if (iterator->first.find("mkl") != std::string::npos)
           total_mkl_time_ = total_mkl_time_ +
             events_[iterator->second].GetTotalProcessTime();
@@ -611,6 +726,7 @@ namespace performance {
       if (!are_measurements_enabled_)
         return PERFORMANCE_EVENT_ID_UNSET;
 
+      boost::mutex::scoped_lock lock(mutex_);
       Pair pair(event_name, events_.size());
       Status status = event_name_id_map_.insert(pair);
 
@@ -622,8 +738,39 @@ namespace performance {
     }
 
     void UpdateEventById(unsigned event_id, const Measurement &measurement) {
-      if (are_measurements_enabled_)
+      if (are_measurements_enabled_) {
+        boost::mutex::scoped_lock lock(mutex_);
         events_[event_id].Update(measurement);
+      }
+    }
+
+    void UpdateEventById(unsigned event_id, const PreciseTime &process_time,
+      const PreciseTime &monotonic_time) {
+      if (are_measurements_enabled_) {
+        boost::mutex::scoped_lock lock(mutex_);
+        events_[event_id].Update(process_time, monotonic_time);
+      }
+    }
+
+    unsigned GetCounterIdByName(const char *counter_name) {
+      if (!are_measurements_enabled_)
+        return PERFORMANCE_EVENT_ID_UNSET;
+
+      boost::mutex::scoped_lock lock(mutex_);
+      Pair pair(counter_name, counters_.size());
+      Status status = counter_name_id_map_.insert(pair);
+
+      if (status.second)
+        counters_.push_back(Counter());
+
+      return status.first->second;
+    }
+
+    void UpdateCounterById(unsigned counter_id, uint64_t value) {
+      if (are_measurements_enabled_) {
+        boost::mutex::scoped_lock lock(mutex_);
+        counters_[counter_id].Update(value);
+      }
     }
   };
 
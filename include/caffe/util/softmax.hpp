@@ -0,0 +1,64 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAFFE_UTIL_SOFTMAX_HPP_
+#define CAFFE_UTIL_SOFTMAX_HPP_
+
+namespace caffe {
+
+/**
+ * @brief Softmax over the channel axis of an (outer_num, channels, inner_num)
+ *        array in two passes: an online pass keeping the running max and
+ *        sum of exponentials, then a normalizing pass.
+ *
+ * If log_norm is not NULL it receives max + log(sum) for each of the
+ * outer_num * inner_num positions, so that log probabilities can be taken
+ * as data - log_norm without reading prob back.
+ */
+template <typename Dtype>
+void softmax_cpu(const Dtype* data, const int outer_num, const int channels,
+    const int inner_num, Dtype* prob, Dtype* log_norm);
+
+/// bottom_diff = prob * (top_diff - dot(top_diff, prob)) over the channels.
+template <typename Dtype>
+void softmax_backward_cpu(const Dtype* prob, const Dtype* top_diff,
+    const int outer_num, const int channels, const int inner_num,
+    Dtype* bottom_diff);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SOFTMAX_HPP_
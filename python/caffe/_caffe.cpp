@@ -47,6 +47,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <numpy/arrayobject.h>
 
 // these need to be included after boost on OS X
+#include <algorithm>  // NOLINT(build/include_order)
 #include <string>  // NOLINT(build/include_order)
 #include <vector>  // NOLINT(build/include_order)
 #include <fstream>  // NOLINT
@@ -223,6 +224,245 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
       PyArray_DIMS(data_arr)[0]);
 }
 
+// Releases the GIL for the lifetime of the object, when release is set.
+class ScopedGILRelease {
+ public:
+  explicit ScopedGILRelease(bool release = true)
+      : state_(release ? PyEval_SaveThread() : NULL) {}
+  ~ScopedGILRelease() {
+    if (state_) {
+      PyEval_RestoreThread(state_);
+    }
+  }
+
+ private:
+  PyThreadState* state_;
+};
+
+// Python layers call back into the interpreter, so nets that contain them
+// have to keep the GIL while they run.
+bool Net_HasPythonLayers(const Net<Dtype>& net) {
+  for (int i = 0; i < net.layers().size(); ++i) {
+    if (string(net.layers()[i]->type()) == "Python") {
+      return true;
+    }
+  }
+  return false;
+}
+
+Dtype Net_ForwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release(!Net_HasPythonLayers(*net));
+  return net->ForwardFromTo(start, end);
+}
+
+void Net_BackwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release(!Net_HasPythonLayers(*net));
+  net->BackwardFromTo(start, end);
+}
+
+// Wraps the data of blob in an ndarray that keeps pyblob alive.
+PyObject* Blob_DataArray(bp::object pyblob, Blob<Dtype>* blob) {
+  vector<npy_intp> dims(blob->shape().begin(), blob->shape().end());
+  PyObject *arr_obj = PyArray_SimpleNewFromData(blob->num_axes(), dims.data(),
+      NPY_FLOAT32, blob->mutable_cpu_data());
+  // SetBaseObject steals a ref, so we need to INCREF.
+  Py_INCREF(pyblob.ptr());
+  PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(arr_obj),
+      pyblob.ptr());
+  return arr_obj;
+}
+
+// Bilinear source taps of one output axis, with pixel centers aligned as in
+// cv::resize and skimage.transform.resize. Equal sizes give exact copies.
+struct ResizeTap {
+  int lo;
+  int hi;
+  Dtype weight;
+};
+
+void ComputeResizeTaps(int in_size, int out_size, vector<ResizeTap>* taps) {
+  taps->resize(out_size);
+  const Dtype ratio = static_cast<Dtype>(in_size) / out_size;
+  for (int i = 0; i < out_size; ++i) {
+    Dtype src = (i + Dtype(0.5)) * ratio - Dtype(0.5);
+    src = std::min(std::max(src, Dtype(0)), Dtype(in_size - 1));
+    ResizeTap& tap = (*taps)[i];
+    tap.lo = static_cast<int>(src);
+    tap.hi = std::min(tap.lo + 1, in_size - 1);
+    tap.weight = src - tap.lo;
+  }
+}
+
+struct BatchImage {
+  const uint8_t* data;
+  int height;
+  int width;
+  vector<ResizeTap> y_taps;
+  vector<ResizeTap> x_taps;
+};
+
+// Resizes HxWxC uint8 images to the geometry of blob and stores
+// (pixel - mean) * scale in NCHW order. Output channel c is read from input
+// channel channel_order[c]. mean holds one value per channel or per element
+// of a blob item, or nothing.
+void PreprocessBatch(const vector<BatchImage>& images,
+    const vector<int>& channel_order, const vector<Dtype>& mean, Dtype scale,
+    Blob<Dtype>* blob) {
+  const int num = images.size();
+  const int channels = blob->shape(1);
+  const int height = blob->shape(2);
+  const int width = blob->shape(3);
+  const bool mean_per_pixel = mean.size() > channels;
+  Dtype* out = blob->mutable_cpu_data();
+#pragma omp parallel for collapse(2)
+  for (int n = 0; n < num; ++n) {
+    for (int y = 0; y < height; ++y) {
+      const BatchImage& image = images[n];
+      const ResizeTap& y_tap = image.y_taps[y];
+      const int row_size = image.width * channels;
+      const uint8_t* row_lo = image.data + y_tap.lo * row_size;
+      const uint8_t* row_hi = image.data + y_tap.hi * row_size;
+      for (int c = 0; c < channels; ++c) {
+        const int src_c = channel_order[c];
+        Dtype* out_row = out + ((n * channels + c) * height + y) * width;
+        const Dtype* mean_row =
+            mean_per_pixel ? &mean[(c * height + y) * width] : NULL;
+        const Dtype mean_c = mean.empty() || mean_per_pixel ? 0 : mean[c];
+        for (int x = 0; x < width; ++x) {
+          const ResizeTap& x_tap = image.x_taps[x];
+          const int lo = x_tap.lo * channels + src_c;
+          const int hi = x_tap.hi * channels + src_c;
+          const Dtype top =
+              row_lo[lo] + x_tap.weight * (row_lo[hi] - row_lo[lo]);
+          const Dtype bottom =
+              row_hi[lo] + x_tap.weight * (row_hi[hi] - row_hi[lo]);
+          const Dtype value = top + y_tap.weight * (bottom - top);
+          out_row[x] = (value - (mean_row ? mean_row[x] : mean_c)) * scale;
+        }
+      }
+    }
+  }
+}
+
+// Preprocesses a list of HxWxC uint8 images into the input blob, runs the
+// net forward and returns the outputs as ndarrays sharing the blob memory.
+// The GIL is released while preprocessing, and while running the net unless
+// it contains Python layers.
+bp::dict Net_ForwardBatch(Net<Dtype>* net, bp::list images_list,
+    bp::object mean_obj, Dtype scale, bp::object channel_swap_obj,
+    bp::object blob_obj) {
+  shared_ptr<Blob<Dtype> > blob;
+  if (blob_obj.is_none()) {
+    if (net->input_blob_indices().empty()) {
+      throw std::runtime_error("forward_batch needs a net with inputs");
+    }
+    blob = net->blobs()[net->input_blob_indices()[0]];
+  } else {
+    const string blob_name = bp::extract<string>(blob_obj);
+    if (!net->has_blob(blob_name)) {
+      throw std::runtime_error("Unknown blob " + blob_name);
+    }
+    blob = net->blob_by_name(blob_name);
+  }
+  if (blob->num_axes() != 4) {
+    throw std::runtime_error("forward_batch needs a 4-d input blob");
+  }
+  const int num = bp::len(images_list);
+  const int channels = blob->shape(1);
+  const int height = blob->shape(2);
+  const int width = blob->shape(3);
+  if (num == 0) {
+    throw std::runtime_error("forward_batch needs at least one image");
+  }
+
+  // The converted arrays hold references that keep the pixels alive while
+  // the GIL is released.
+  vector<bp::object> arrays(num);
+  vector<BatchImage> images(num);
+  for (int n = 0; n < num; ++n) {
+    PyObject* arr_obj = PyArray_FROM_OTF(bp::object(images_list[n]).ptr(),
+        NPY_UINT8, NPY_ARRAY_IN_ARRAY);
+    if (!arr_obj) {
+      bp::throw_error_already_set();
+    }
+    arrays[n] = bp::object(bp::handle<>(arr_obj));
+    PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(arr_obj);
+    const int ndim = PyArray_NDIM(arr);
+    if (!(ndim == 3 && PyArray_DIMS(arr)[2] == channels) &&
+        !(ndim == 2 && channels == 1)) {
+      throw std::runtime_error("images must be HxWxC with the channels of "
+          "the input blob");
+    }
+    BatchImage& image = images[n];
+    image.data = static_cast<const uint8_t*>(PyArray_DATA(arr));
+    image.height = PyArray_DIMS(arr)[0];
+    image.width = PyArray_DIMS(arr)[1];
+    if (image.height == 0 || image.width == 0) {
+      throw std::runtime_error("images must not be empty");
+    }
+  }
+
+  vector<Dtype> mean;
+  if (!mean_obj.is_none()) {
+    bp::object mean_arr(bp::handle<>(PyArray_FROM_OTF(mean_obj.ptr(),
+        NPY_FLOAT32, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_FORCECAST)));
+    PyArrayObject* arr = reinterpret_cast<PyArrayObject*>(mean_arr.ptr());
+    const Dtype* data = static_cast<const Dtype*>(PyArray_DATA(arr));
+    mean.assign(data, data + PyArray_SIZE(arr));
+    if (mean.size() != channels && mean.size() != channels * height * width) {
+      throw std::runtime_error("mean must have one value per channel or the "
+          "shape of an input item");
+    }
+  }
+
+  vector<int> channel_order(channels);
+  for (int c = 0; c < channels; ++c) {
+    channel_order[c] = c;
+  }
+  if (!channel_swap_obj.is_none()) {
+    if (bp::len(channel_swap_obj) != channels) {
+      throw std::runtime_error("channel_swap must list every channel");
+    }
+    for (int c = 0; c < channels; ++c) {
+      channel_order[c] = bp::extract<int>(channel_swap_obj[c]);
+      if (channel_order[c] < 0 || channel_order[c] >= channels) {
+        throw std::runtime_error("channel_swap out of range");
+      }
+    }
+  }
+
+  const bool reshape = blob->shape(0) != num;
+  {
+    ScopedGILRelease release;
+    if (reshape) {
+      vector<int> shape = blob->shape();
+      shape[0] = num;
+      blob->Reshape(shape);
+    }
+    for (int n = 0; n < num; ++n) {
+      ComputeResizeTaps(images[n].height, height, &images[n].y_taps);
+      ComputeResizeTaps(images[n].width, width, &images[n].x_taps);
+    }
+    PreprocessBatch(images, channel_order, mean, scale, blob.get());
+  }
+  if (reshape) {
+    // Reshaping the net calls the reshape of Python layers.
+    ScopedGILRelease release(!Net_HasPythonLayers(*net));
+    net->Reshape();
+  }
+  Net_ForwardFromTo(net, 0, net->layers().size() - 1);
+
+  bp::dict outputs;
+  for (int i = 0; i < net->output_blob_indices().size(); ++i) {
+    const int blob_id = net->output_blob_indices()[i];
+    const shared_ptr<Blob<Dtype> >& output = net->blobs()[blob_id];
+    bp::object pyblob(output);
+    outputs[net->blob_names()[blob_id]] =
+        bp::object(bp::handle<>(Blob_DataArray(pyblob, output.get())));
+  }
+  return outputs;
+}
+
 Solver<Dtype>* GetSolverFromFile(const string& filename) {
   SolverParameter param;
   ReadSolverParamsFromTextFileOrDie(filename, &param);
@@ -344,8 +584,17 @@ BOOST_PYTHON_MODULE(_caffe) {
             bp::arg("engine")=bp::object())))
     // Legacy constructor
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
+    .def("_forward", &Net_ForwardFromTo)
+    .def("_backward", &Net_BackwardFromTo)
+    .def("forward_batch", &Net_ForwardBatch,
+        (bp::arg("self"), bp::arg("images"), bp::arg("mean") = bp::object(),
+         bp::arg("scale") = 1., bp::arg("channel_swap") = bp::object(),
+         bp::arg("blob") = bp::object()),
+        "Resizes a list of HxWxC uint8 images to the input blob, stores\n"
+        "(pixel - mean) * scale in channel-major order with the input\n"
+        "channels taken in channel_swap order, runs forward and returns a\n"
+        "dict of output arrays sharing the memory of the output blobs.\n"
+        "The GIL is released during preprocessing and the forward pass.")
     .def("reshape", &Net<Dtype>::Reshape)
     .def("clear_param_diffs", static_cast<void (Net<Dtype>::*)(void)>(
     &Net<Dtype>::ClearParamDiffs))
@@ -353,6 +602,8 @@ BOOST_PYTHON_MODULE(_caffe) {
     .def("copy_from", static_cast<void (Net<Dtype>::*)(const string)>(
         &Net<Dtype>::CopyTrainedLayersFrom))
     .def("share_with", &Net<Dtype>::ShareTrainedLayersWith)
+    .add_property("latency_mode", &Net<Dtype>::latency_mode,
+        &Net<Dtype>::SetLatencyMode)
     .add_property("_blob_loss_weights", bp::make_function(
         &Net<Dtype>::blob_loss_weights, bp::return_internal_reference<>()))
     .def("_bottom_ids", bp::make_function(&Net<Dtype>::bottom_ids,
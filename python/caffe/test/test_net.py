@@ -394,3 +394,61 @@ layer {
         net = caffe.Net(self.f.name, caffe.TEST, stages=['deploy'])
         self.check_net(net, ['pred'])
 
+
+
+class TestForwardBatch(unittest.TestCase):
+
+    TEST_NET = """
+layer {
+  name: "data"
+  type: "Input"
+  top: "data"
+  input_param { shape { dim: 1 dim: 3 dim: 4 dim: 5 } }
+}
+layer {
+  name: "out"
+  type: "Power"
+  bottom: "data"
+  top: "out"
+  power_param { scale: 2 }
+}
+"""
+
+    def setUp(self):
+        self.f = tempfile.NamedTemporaryFile(mode='w+')
+        self.f.write(self.TEST_NET)
+        self.f.flush()
+        self.net = caffe.Net(self.f.name, caffe.TEST)
+
+    def tearDown(self):
+        self.f.close()
+
+    def test_preprocess(self):
+        images = [np.random.randint(256, size=(4, 5, 3)).astype(np.uint8)
+                  for _ in range(3)]
+        mean = np.array([10., 20., 30.])
+        out = self.net.forward_batch(images, mean=mean, scale=0.5,
+                                     channel_swap=(2, 1, 0))
+        self.assertEqual(list(out.keys()), ['out'])
+        self.assertEqual(self.net.blobs['data'].data.shape, (3, 3, 4, 5))
+        expected = np.array([(im.transpose(2, 0, 1)[::-1] -
+                              mean[:, None, None]) * 0.5 for im in images])
+        np.testing.assert_allclose(self.net.blobs['data'].data, expected,
+                                   rtol=1e-5, atol=1e-5)
+        np.testing.assert_allclose(out['out'], 2 * expected,
+                                   rtol=1e-5, atol=1e-5)
+        # The outputs are views of the output blob.
+        out['out'][...] = 0
+        self.assertTrue((self.net.blobs['out'].data == 0).all())
+
+    def test_resize(self):
+        images = [np.full((8, 10, 3), 7, dtype=np.uint8),
+                  np.full((2, 3, 3), 9, dtype=np.uint8)]
+        out = self.net.forward_batch(images)
+        self.assertEqual(out['out'].shape, (2, 3, 4, 5))
+        np.testing.assert_allclose(out['out'][0], 14)
+        np.testing.assert_allclose(out['out'][1], 18)
+
+    def test_wrong_channels(self):
+        with self.assertRaises(RuntimeError):
+            self.net.forward_batch([np.zeros((4, 5, 1), dtype=np.uint8)])
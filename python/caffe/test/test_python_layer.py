@@ -39,6 +39,8 @@ import tempfile
 import os
 import six
 
+import numpy as np
+
 import caffe
 
 
@@ -105,6 +107,15 @@ def python_net_file():
         return f.name
 
 
+def image_net_file():
+    with tempfile.NamedTemporaryFile(mode='w+', delete=False) as f:
+        f.write("""name: 'pythonnet' force_backward: true
+        input: 'data' input_shape { dim: 1 dim: 1 dim: 4 dim: 5 }
+        layer { type: 'Python' name: 'one' bottom: 'data' top: 'one'
+          python_param { module: 'test_python_layer' layer: 'SimpleLayer' } }""")
+        return f.name
+
+
 def exception_net_file():
     with tempfile.NamedTemporaryFile(mode='w+', delete=False) as f:
         f.write("""name: 'pythonnet' force_backward: true
@@ -163,6 +174,18 @@ class TestPythonLayer(unittest.TestCase):
             for d in blob.data.shape:
                 self.assertEqual(s, d)
 
+    def test_forward_batch(self):
+        # forward_batch keeps the GIL for Python layers while it reshapes
+        # and runs the net.
+        net_file = image_net_file()
+        net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+        images = [np.full((4, 5), x, dtype=np.uint8) for x in (1, 2, 3)]
+        out = net.forward_batch(images)
+        self.assertEqual(out['one'].shape, (3, 1, 4, 5))
+        for n, x in enumerate((1, 2, 3)):
+            np.testing.assert_allclose(out['one'][n], 10 * x)
+
     def test_exception(self):
         net_file = exception_net_file()
         self.assertRaises(RuntimeError, caffe.Net, net_file, caffe.TEST)
@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <climits>
+#include <cstring>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -96,6 +97,10 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
     diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    if (placement_.enabled()) {
+      data_->set_placement(placement_);
+      diff_->set_placement(placement_);
+    }
   }
 }
 
@@ -261,6 +266,76 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataSlice(const Blob& other, size_t offset) {
+  CHECK_LE(offset + count_, other.count());
+  data_.reset(new SyncedMemory(other.data(), offset * sizeof(Dtype),
+                               count_ * sizeof(Dtype)));
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffSlice(const Blob& other, size_t offset) {
+  CHECK_LE(offset + count_, other.count());
+  diff_.reset(new SyncedMemory(other.diff(), offset * sizeof(Dtype),
+                               count_ * sizeof(Dtype)));
+  capacity_ = count_;
+}
+
+// A view whose base was reallocated, or whose bounds moved, does not count.
+template <typename Dtype>
+static bool IsSlice(const shared_ptr<SyncedMemory>& part,
+                    const shared_ptr<SyncedMemory>& whole, size_t offset) {
+  return part && whole && part->base() == whole &&
+      part->cpu_ptr() == static_cast<const Dtype*>(whole->cpu_ptr()) + offset;
+}
+
+template <typename Dtype>
+bool Blob<Dtype>::SharesDataSlice(const Blob& other, size_t offset) const {
+  return IsSlice<Dtype>(data_, other.data(), offset);
+}
+
+template <typename Dtype>
+bool Blob<Dtype>::SharesDiffSlice(const Blob& other, size_t offset) const {
+  return IsSlice<Dtype>(diff_, other.diff(), offset);
+}
+
+// Copies a stale view of whole into new memory of the given size.
+template <typename Dtype>
+static void UnshareStale(shared_ptr<SyncedMemory>* part,
+    const shared_ptr<SyncedMemory>& whole, size_t offset, size_t size,
+    const numa::Placement& placement) {
+  if (!*part || (*part)->base() != whole ||
+      IsSlice<Dtype>(*part, whole, offset)) {
+    return;
+  }
+  shared_ptr<SyncedMemory> own(new SyncedMemory(size));
+  if (placement.enabled()) {
+    own->set_placement(placement);
+  }
+  memcpy(own->mutable_cpu_data(), (*part)->cpu_data(), size);
+  part->swap(own);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::UnshareStaleSlice(const Blob& other, size_t offset) {
+  UnshareStale<Dtype>(&data_, other.data(), offset,
+                      capacity_ * sizeof(Dtype), placement_);
+  UnshareStale<Dtype>(&diff_, other.diff(), offset,
+                      capacity_ * sizeof(Dtype), placement_);
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_placement(const numa::Placement& placement) {
+  placement_ = placement;
+  if (data_) {
+    data_->set_placement(placement_);
+  }
+  if (diff_) {
+    diff_->set_placement(placement_);
+  }
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
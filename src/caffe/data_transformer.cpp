@@ -522,7 +522,8 @@ void DataTransformer<Dtype>::CropImage(const Datum& datum,
   crop_datum->set_encoded(false);
   const int crop_datum_size = datum_channels * height * width;
   const std::string& datum_buffer = datum.data();
-  std::string buffer(crop_datum_size, ' ');
+  std::string& buffer = *crop_datum->mutable_data();
+  buffer.assign(crop_datum_size, ' ');
   for (int h = h_off; h < h_off + height; ++h) {
     for (int w = w_off; w < w_off + width; ++w) {
       for (int c = 0; c < datum_channels; ++c) {
@@ -532,7 +533,6 @@ void DataTransformer<Dtype>::CropImage(const Datum& datum,
       }
     }
   }
-  crop_datum->set_data(buffer);
 }
 
 template<typename Dtype>
@@ -612,7 +612,9 @@ void DataTransformer<Dtype>::ExpandImage(const Datum& datum,
   expand_datum->set_encoded(false);
   const int expand_datum_size = datum_channels * height * width;
   const std::string& datum_buffer = datum.data();
-  std::string buffer(expand_datum_size, ' ');
+  // Fill the datum's own string so a recycled datum keeps its capacity.
+  std::string& buffer = *expand_datum->mutable_data();
+  buffer.assign(expand_datum_size, ' ');
   for (int h = h_off; h < h_off + datum_height; ++h) {
     for (int w = w_off; w < w_off + datum_width; ++w) {
       for (int c = 0; c < datum_channels; ++c) {
@@ -623,7 +625,6 @@ void DataTransformer<Dtype>::ExpandImage(const Datum& datum,
       }
     }
   }
-  expand_datum->set_data(buffer);
 }
 
 template<typename Dtype>
@@ -680,8 +681,14 @@ void DataTransformer<Dtype>::DistortImage(const Datum& datum,
     } else {
       cv_img = DecodeDatumToCVMatNative(datum);
     }
-    // Distort the image.
-    cv::Mat distort_img = ApplyDistort(cv_img, param_.distort_param());
+    // Distort the image. The decoded image is ours, so distort it in place.
+    cv::Mat distort_img;
+    if (param_.distort_param().fused()) {
+      ApplyDistortInPlace(param_.distort_param(), &cv_img);
+      distort_img = cv_img;
+    } else {
+      distort_img = ApplyDistort(cv_img, param_.distort_param());
+    }
     // Save the image into datum.
     EncodeCVMatToDatum(distort_img, "jpg", distort_datum);
     distort_datum->set_label(datum.label());
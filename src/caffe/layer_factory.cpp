@@ -49,13 +49,17 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/layers/concat_layer.hpp"
 #include "caffe/layers/conv_layer.hpp"
 #include "caffe/layers/deconv_layer.hpp"
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/layers/fused_lstm_layer.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
 #include "caffe/layers/lrn_layer.hpp"
+#include "caffe/layers/lstm_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/relu_layer.hpp"
 #include "caffe/layers/sigmoid_layer.hpp"
 #include "caffe/layers/softmax_layer.hpp"
 #include "caffe/layers/tanh_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
 #ifdef MKL2017_SUPPORTED
 #include "caffe/layers/mkl_layers.hpp"
 #endif
@@ -103,6 +107,10 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
 
     if (ep.isEngine("CAFFE")) {
       engine = ConvolutionParameter_Engine_CAFFE;
+    } else if (ep.isEngine("DIRECT")) {
+      engine = ConvolutionParameter_Engine_DIRECT;
+    } else if (ep.isEngine("WINOGRAD")) {
+      engine = ConvolutionParameter_Engine_WINOGRAD;
     }
 #ifdef USE_CUDNN
     else if (!use_dilation && ep.isEngine("CUDNN")) {
@@ -132,6 +140,11 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
 
   if (engine == ConvolutionParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_DIRECT) {
+    return shared_ptr<Layer<Dtype> >(new DirectConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_WINOGRAD) {
+    return shared_ptr<Layer<Dtype> >(
+        new WinogradConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
     if (use_dilation) {
@@ -735,6 +748,41 @@ shared_ptr<Layer<Dtype> > GetTanHLayer(const LayerParameter& param) {
 
 REGISTER_LAYER_CREATOR(TanH, GetTanHLayer);
 
+// Get LSTM layer according to engine.
+template <typename Dtype>
+shared_ptr<Layer<Dtype> > GetLSTMLayer(const LayerParameter& param) {
+  const RecurrentParameter& recurrent_param = param.recurrent_param();
+  RecurrentParameter_Engine engine = recurrent_param.engine();
+
+  // New, more flexible way of providing engine
+  if (engine == RecurrentParameter_Engine_DEFAULT && param.engine() != "") {
+    EngineParser ep(param.engine());
+    if (ep.isEngine("CAFFE"))
+      engine = RecurrentParameter_Engine_CAFFE;
+    else if (ep.isEngine("FUSED"))
+      engine = RecurrentParameter_Engine_FUSED;
+  }
+
+  if (engine == RecurrentParameter_Engine_DEFAULT) {
+    // The unrolled net is kept for the GPU and for its per-layer debug info.
+    engine = RecurrentParameter_Engine_FUSED;
+    if (Caffe::mode() == Caffe::GPU || recurrent_param.debug_info()) {
+      engine = RecurrentParameter_Engine_CAFFE;
+    }
+  }
+
+  if (engine == RecurrentParameter_Engine_CAFFE) {
+    return shared_ptr<Layer<Dtype> >(new LSTMLayer<Dtype>(param));
+  } else if (engine == RecurrentParameter_Engine_FUSED) {
+    return shared_ptr<Layer<Dtype> >(new FusedLSTMLayer<Dtype>(param));
+  } else {
+    LOG(FATAL) << "Layer " << param.name() << " has unknown engine.";
+  }
+  return shared_ptr<Layer<Dtype> >();
+}
+
+REGISTER_LAYER_CREATOR(LSTM, GetLSTMLayer);
+
 #ifdef WITH_PYTHON_LAYER
 template <typename Dtype>
 shared_ptr<Layer<Dtype> > GetPythonLayer(const LayerParameter& param) {
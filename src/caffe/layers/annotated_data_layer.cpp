@@ -96,8 +96,8 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -141,8 +141,20 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
       label_shape[0] = batch_size;
     }
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
+    }
+  }
+}
+
+template <typename Dtype>
+void AnnotatedDataLayer<Dtype>::PrepareItemBuffers(int batch_size) {
+  if (item_buffers_.size() < batch_size) {
+    const int old_size = item_buffers_.size();
+    item_buffers_.resize(batch_size);
+    for (int i = old_size; i < batch_size; ++i) {
+      item_buffers_[i].reset(new ItemBuffers());
+      item_buffers_[i]->expanded = NULL;
     }
   }
 }
@@ -181,10 +193,9 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     top_label = batch->label_.mutable_cpu_data();
   }
 
-  // Store transformed annotation.
-  std::vector<std::vector<AnnotationGroup>> all_anno(batch_size);
-  std::vector<boost::shared_ptr<AnnotatedDatum>> expand_data(batch_size, nullptr);
-  std::vector<std::vector<NormalizedBBox>> sampled_bboxes(batch_size);
+  // Per-item buffers are reused from the previous batch.
+  PrepareItemBuffers(batch_size);
+  vector<shared_ptr<ItemBuffers> >& items = item_buffers_;
   boost::container::vector<bool> have_samples(batch_size, false);
 
   int num_bboxes = 0;
@@ -204,41 +215,37 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       string* data = reader_.full().pop("Waiting for data");
       timer.Stop();
       read_time += timer.MicroSeconds();
-#pragma omp task firstprivate(item_id, data) shared(all_anno, expand_data, sampled_bboxes, have_samples)
+#pragma omp task firstprivate(item_id, data) shared(items, have_samples)
       {
-        std::unique_ptr<AnnotatedDatum> anno_datum(new AnnotatedDatum());
-        anno_datum->ParseFromString(*data);
+        ItemBuffers& item = *items[item_id];
+        AnnotatedDatum* cur_datum = &item.anno_datum;
+        cur_datum->ParseFromString(*data);
         reader_.free().push(data);
-        std::unique_ptr<AnnotatedDatum> distort_datum(new AnnotatedDatum());
-        boost::shared_ptr<AnnotatedDatum> expand_datum;
         if (transform_param.has_distort_param()) {
-          distort_datum->CopyFrom(*anno_datum);
-          this->data_transformer_->DistortImage(anno_datum->datum(),
-                                                distort_datum->mutable_datum());
-          if (transform_param.has_expand_param()) {
-            expand_datum.reset(new AnnotatedDatum());
-            this->data_transformer_->ExpandImage(*distort_datum, expand_datum.get());
-          } else {
-            expand_datum = std::move(distort_datum);
-          }
-        } else {
-          if (transform_param.has_expand_param()) {
-            expand_datum.reset(new AnnotatedDatum());
-            this->data_transformer_->ExpandImage(*anno_datum, expand_datum.get());
-          } else {
-            expand_datum = std::move(anno_datum);
-          }
+          item.distort_datum.CopyFrom(*cur_datum);
+          this->data_transformer_->DistortImage(cur_datum->datum(),
+              item.distort_datum.mutable_datum());
+          cur_datum = &item.distort_datum;
+        }
+        if (transform_param.has_expand_param()) {
+          // Clear() keeps the allocated buffers of the message for reuse.
+          item.expand_datum.Clear();
+          this->data_transformer_->ExpandImage(*cur_datum,
+                                               &item.expand_datum);
+          cur_datum = &item.expand_datum;
         }
+        item.expanded = cur_datum;
+        item.sampled_bboxes.clear();
         bool has_sampled = false;
         if (batch_samplers_.size() > 0) {
           // Generate sampled bboxes from expand_datum.
-          GenerateBatchSamples(*expand_datum, batch_samplers_, &sampled_bboxes[item_id]);
+          GenerateBatchSamples(*cur_datum, batch_samplers_,
+                               &item.sampled_bboxes);
 
-          if (sampled_bboxes[item_id].size() > 0) {
+          if (item.sampled_bboxes.size() > 0) {
             has_sampled = true;
           }
         }
-        expand_data[item_id] = expand_datum;
         have_samples[item_id] = has_sampled;
       }
     }
@@ -251,21 +258,21 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       PreclcRandomNumbers precalculated_rand_numbers;
       this->data_transformer_->GenerateRandNumbers(precalculated_rand_numbers, /* sample_bboxes */ have_samples[item_id]);
 
-#pragma omp task firstprivate(precalculated_rand_numbers, item_id) shared(num_bboxes, all_anno, expand_data, sampled_bboxes, have_samples)
+#pragma omp task firstprivate(precalculated_rand_numbers, item_id) shared(num_bboxes, items, have_samples)
       {
-        boost::shared_ptr<AnnotatedDatum> sampled_datum;
+        ItemBuffers& item = *items[item_id];
+        AnnotatedDatum* sampled_datum = item.expanded;
         bool has_sampled = have_samples[item_id];
         if (has_sampled) {
-          int rand_idx = precalculated_rand_numbers(sampled_bboxes[item_id].size());
-          sampled_datum.reset(new AnnotatedDatum());
-          this->data_transformer_->CropImage(*expand_data[item_id],
-                                             sampled_bboxes[item_id][rand_idx],
-                                             sampled_datum.get());
-        } else {
-          sampled_datum = expand_data[item_id];
+          int rand_idx = precalculated_rand_numbers(item.sampled_bboxes.size());
+          item.sampled_datum.Clear();
+          this->data_transformer_->CropImage(*item.expanded,
+                                             item.sampled_bboxes[rand_idx],
+                                             &item.sampled_datum);
+          sampled_datum = &item.sampled_datum;
         }
-        CHECK(sampled_datum.get()  != NULL);
-        Blob<Dtype> data_blob;
+        CHECK(sampled_datum != NULL);
+        Blob<Dtype>& data_blob = item.data_blob;
         data_blob.Reshape(top_shape);
         vector<int> shape =
           this->data_transformer_->InferBlobShape(sampled_datum->datum());
@@ -289,6 +296,7 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
         // Apply data transformations (mirror, scale, crop...)
         int offset = batch->data_.offset(item_id);
         data_blob.set_cpu_data(top_data + offset);
+        item.transformed_anno.Clear();
         if (this->output_labels_) {
           if (has_anno_type_) {
             // Make sure all data have same annotation type.
@@ -302,12 +310,12 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
             // Transform datum and annotation_group at the same time
             this->data_transformer_->Transform(*sampled_datum,
                                                &data_blob,
-                                               &all_anno[item_id],
+                                               &item.transformed_anno,
                                                precalculated_rand_numbers);
             if (anno_type_ == AnnotatedDatum_AnnotationType_BBOX) {
-              for (int g = 0; g < all_anno[item_id].size(); ++g) {
+              for (int g = 0; g < item.transformed_anno.size(); ++g) {
 #pragma omp atomic
-                num_bboxes += all_anno[item_id][g].annotation_size();
+                num_bboxes += item.transformed_anno.Get(g).annotation_size();
               }
             } else {
               LOG(FATAL) << "Unknown annotation type.";
@@ -348,9 +356,10 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
         top_label = batch->label_.mutable_cpu_data();
         int idx = 0;
         for (int item_id = 0; item_id < batch_size; ++item_id) {
-          const vector<AnnotationGroup>& anno_vec = all_anno[item_id];
+          const RepeatedPtrField<AnnotationGroup>& anno_vec =
+              items[item_id]->transformed_anno;
           for (int g = 0; g < anno_vec.size(); ++g) {
-            const AnnotationGroup& anno_group = anno_vec[g];
+            const AnnotationGroup& anno_group = anno_vec.Get(g);
             for (int a = 0; a < anno_group.annotation_size(); ++a) {
               const Annotation& anno = anno_group.annotation(a);
               const NormalizedBBox& bbox = anno.bbox();
@@ -374,6 +383,7 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   batch_timer.Stop();
 
   trans_time = trans_timer.MicroSeconds() - read_time;
+  batch->read_time_ = read_time;
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
@@ -576,6 +586,7 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   }
   timer.Stop();
   batch_timer.Stop();
+  batch->read_time_ = read_time;
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
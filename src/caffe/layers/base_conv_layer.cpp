@@ -319,6 +319,16 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     num_of_threads_ = 1;
   }
 
+  // In latency mode a batch too small to occupy every thread is processed
+  // one item at a time, with im2col/col2im split over channels and the
+  // GEMM split over output channels instead.
+  intra_threads_ = 1;
+  if (this->latency_mode() && !force_nd_im2col_ && num_spatial_axes_ == 2 &&
+      num_of_threads_ < omp_get_max_threads()) {
+    intra_threads_ = omp_get_max_threads();
+    num_of_threads_ = 1;
+  }
+
   // LOG(ERROR) << "final thread number: " << num_of_threads_;
 #endif
 
@@ -347,6 +357,10 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
                << " > OMP_num_THREADS = " << num_of_threads_;
   }
   tid = tid % num_of_threads_;  //  just to be sure
+  if (intra_threads_ > 1 && omp_get_num_threads() == 1) {
+    forward_cpu_gemm_intra(input, weights, output, skip_im2col);
+    return;
+  }
 #endif
   size_t col_data_buffer_size = col_buffer_mt_.size() / num_of_threads_;
 
@@ -386,6 +400,10 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
                << " > OMP_num_THREADS = " << num_of_threads_;
   }
   tid = tid % num_of_threads_;  // just to be sure
+  if (intra_threads_ > 1 && omp_get_num_threads() == 1) {
+    backward_cpu_gemm_intra(output, weights, input);
+    return;
+  }
 #endif
 
   size_t col_data_buffer_size = col_buffer_mt_.size() / num_of_threads_;
@@ -406,6 +424,73 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_intra(const Dtype* input,
+    const Dtype* weights, Dtype* output, bool skip_im2col) {
+  Dtype* col_buff = is_1x1_ ? const_cast<Dtype*>(input) : &col_buffer_mt_[0];
+  int threads = 1;
+#ifdef _OPENMP
+  // Within a core group of the net's branch scheduler only the group's
+  // share of the threads is available.
+  threads = std::min(intra_threads_, omp_get_max_threads());
+#endif
+  // Split each group's output channels into enough row blocks to give every
+  // thread one; the blocks write disjoint rows of the output.
+  const int out_channels = conv_out_channels_ / group_;
+  const int blocks = std::min(out_channels,
+      std::max(1, (threads + group_ - 1) / group_));
+  const int rows = (out_channels + blocks - 1) / blocks;
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(threads)
+#endif
+  {
+    if (!is_1x1_ && !skip_im2col) {
+#ifdef _OPENMP
+      #pragma omp for
+#endif
+      for (int c = 0; c < conv_in_channels_; ++c) {
+        conv_im2col_channel_cpu(input, c, col_buff);
+      }
+    }
+#ifdef _OPENMP
+    #pragma omp for collapse(2)
+#endif
+    for (int g = 0; g < group_; ++g) {
+      for (int b = 0; b < blocks; ++b) {
+        const int m = std::min(rows, out_channels - b * rows);
+        if (m <= 0) continue;
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, m,
+            conv_out_spatial_dim_, kernel_dim_, (Dtype)1.,
+            weights + weight_offset_ * g + b * rows * kernel_dim_,
+            col_buff + col_offset_ * g, (Dtype)0.,
+            output + output_offset_ * g + b * rows * conv_out_spatial_dim_);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_intra(const Dtype* output,
+    const Dtype* weights, Dtype* input) {
+  Dtype* col_buff = is_1x1_ ? input : &col_buffer_mt_[0];
+  // The transposed GEMM cannot be split by rows without a leading dimension,
+  // so it is left to the threaded BLAS; col2im is split over channels.
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
+        conv_out_spatial_dim_, conv_out_channels_ / group_,
+        (Dtype)1., weights + weight_offset_ * g, output + output_offset_ * g,
+        (Dtype)0., col_buff + col_offset_ * g);
+  }
+  if (!is_1x1_) {
+#ifdef _OPENMP
+    #pragma omp parallel for \
+        num_threads(std::min(intra_threads_, omp_get_max_threads()))
+#endif
+    for (int c = 0; c < conv_in_channels_; ++c) {
+      conv_col2im_channel_cpu(col_buff, c, input);
+    }
+  }
+}
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::clear_weight_mt(void) {
@@ -420,25 +505,38 @@ template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::sum_weight_mt(Dtype* weight_diff) {
   size_t weight_diff_size = weight_diff_mt_.size() / num_of_threads_;
   size_t col_per_thread = weight_diff_size/num_of_threads_;
+  // The team may be smaller than num_of_threads_ inside a branch group, so
+  // each thread sums every team-size-th slice.
   int tid = 0;
+  int team = 1;
 #ifdef _OPENMP
-    if (omp_in_parallel()) {
-        tid = omp_get_thread_num();
-    }
+  tid = omp_get_thread_num();
+  team = omp_get_num_threads();
 #endif
+  for (size_t part = tid; part < num_of_threads_; part += team) {
     for (size_t j = 0; j < col_per_thread; ++j) {
       for (size_t t = 0; t < num_of_threads_ ; ++t) {
-          weight_diff[tid * col_per_thread + j] +=
-            weight_diff_mt_[t * weight_diff_size + tid * col_per_thread + j];
+          weight_diff[part * col_per_thread + j] +=
+            weight_diff_mt_[t * weight_diff_size + part * col_per_thread + j];
       }
     }
 
-    size_t j = col_per_thread * num_of_threads_ + tid;
+    size_t j = col_per_thread * num_of_threads_ + part;
     if (j < weight_diff_size) {
       for (size_t t = 0; t < num_of_threads_ ; ++t) {
         weight_diff[j] += weight_diff_mt_[t * weight_diff_size + j];
       }
     }
+  }
+}
+
+template <typename Dtype>
+int BaseConvolutionLayer<Dtype>::group_threads() const {
+#ifdef _OPENMP
+  return std::min(num_of_threads_, omp_get_max_threads());
+#else
+  return 1;
+#endif
 }
 
 template <typename Dtype>
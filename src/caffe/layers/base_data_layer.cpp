@@ -35,7 +35,10 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
+#include <algorithm>
+#include <deque>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -44,7 +47,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/cpu_info.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -69,14 +75,33 @@ void BaseDataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   DataLayerSetUp(bottom, top);
 }
 
+template <typename Dtype>
+class BasePrefetchingDataLayer<Dtype>::sync {
+ public:
+  // Batches being loaded, in the order they are to be handed over.
+  std::deque<Batch<Dtype>*> order_;
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
 template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      prefetch_(param.data_param().prefetch()),
+      prefetch_free_(), prefetch_full_(),
+      prefetch_threads_(param.data_param().prefetch_threads()),
+      sync_(new sync()) {
+  CHECK_GT(prefetch_.size(), 0) << "Positive prefetch depth required";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
+  PERFORMANCE_COUNTER_ID_RESET(perf_id_queue_);
+  PERFORMANCE_EVENT_ID_RESET(perf_id_wait_);
+  PERFORMANCE_EVENT_ID_RESET(perf_id_free_wait_);
+  PERFORMANCE_EVENT_ID_RESET(perf_id_read_);
+  PERFORMANCE_EVENT_ID_RESET(perf_id_transform_);
 }
 
 template <typename Dtype>
@@ -87,18 +112,18 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
@@ -107,8 +132,18 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   DLOG(INFO) << "Initializing prefetch";
   this->data_transformer_->InitRand();
 
-  // Only if GPU mode on then we use background threads
-  if (Caffe::mode() == Caffe::GPU) {
+  // By default, background threads are only used in GPU mode. On CPU the
+  // batch is loaded by Forward so that it does not compete with the net for
+  // cores.
+  if (!this->layer_param_.data_param().has_prefetch_threads()) {
+    prefetch_threads_ = Caffe::mode() == Caffe::GPU ? 1 : 0;
+  }
+  if (prefetch_threads_ > 1 && !ConcurrentLoadBatch()) {
+    LOG(WARNING) << this->type() << " layer " << this->layer_param_.name()
+        << " loads batches on a single prefetch thread.";
+    prefetch_threads_ = 1;
+  }
+  if (prefetch_threads_ > 0) {
     StartInternalThread();
   }
   DLOG(INFO) << "Prefetch initialized.";
@@ -116,6 +151,49 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
 
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
+  // The other workers are started from here so that they inherit this
+  // thread's Caffe state, and stop with it.
+  boost::thread_group workers;
+  for (int i = 1; i < prefetch_threads_; ++i) {
+    int device = 0;
+#ifndef CPU_ONLY
+    CUDA_CHECK(cudaGetDevice(&device));
+#endif
+    workers.create_thread(boost::bind(
+        &BasePrefetchingDataLayer<Dtype>::PrefetchWorkerEntry, this, i,
+        device, Caffe::mode(), caffe_rng_rand(), Caffe::solver_count(),
+        Caffe::root_solver()));
+  }
+  PrefetchLoop();
+  boost::this_thread::disable_interruption stopping;
+  workers.interrupt_all();
+  workers.join_all();
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::PrefetchWorkerEntry(int worker,
+    int device, Caffe::Brew mode, int rand_seed, int solver_count,
+    bool root_solver) {
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaSetDevice(device));
+#endif
+  Caffe::set_mode(mode);
+  Caffe::set_random_seed(rand_seed);
+  Caffe::set_solver_count(solver_count);
+  Caffe::set_root_solver(root_solver);
+
+#ifdef _OPENMP
+  // Otherwise every worker would share the core of the first prefetch
+  // thread, whose affinity it inherits.
+  caffe::cpu::OpenMpManager::bindCurrentThreadToNonPrimaryCoreIfPossible(
+      worker);
+#endif
+
+  PrefetchLoop();
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::PrefetchLoop() {
 #ifndef CPU_ONLY
   cudaStream_t stream;
   if (Caffe::mode() == Caffe::GPU) {
@@ -124,16 +202,35 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 
   try {
+    CPUTimer timer;
     while (!must_stop()) {
+      timer.Start();
       Batch<Dtype>* batch = prefetch_free_.pop();
+      batch->wait_time_ = timer.MicroSeconds();
+      batch->read_time_ = 0;
+      timer.Start();
       load_batch(batch);
+      batch->load_time_ = timer.MicroSeconds();
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
 #endif
-      prefetch_full_.push(batch);
+      if (prefetch_threads_ > 1) {
+        // Hand the batch over after the ones sequenced before it.
+        boost::mutex::scoped_lock lock(sync_->mutex_);
+        CHECK(std::find(sync_->order_.begin(), sync_->order_.end(), batch)
+            != sync_->order_.end()) << "load_batch did not sequence the batch";
+        while (sync_->order_.front() != batch) {
+          sync_->condition_.wait(lock);
+        }
+        sync_->order_.pop_front();
+        prefetch_full_.push(batch);
+        sync_->condition_.notify_all();
+      } else {
+        prefetch_full_.push(batch);
+      }
     }
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
@@ -145,26 +242,63 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::SequenceBatch(Batch<Dtype>* batch) {
+  if (prefetch_threads_ > 1) {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->order_.push_back(batch);
+  }
+}
+
 // TODO: Make it properlly implemented/integrated with above solution
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::GetBatch() {
   try {
+      CPUTimer timer;
       Batch<Dtype>* batch = prefetch_free_.pop();
+      batch->wait_time_ = 0;
+      batch->read_time_ = 0;
+      timer.Start();
       load_batch(batch);
+      batch->load_time_ = timer.MicroSeconds();
       prefetch_full_.push(batch);
   } catch (boost::thread_interrupted&) {
     // Interrupted exception is expected on shutdown
   }
 }
 
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::NextFullBatch() {
+  PERFORMANCE_COUNTER_ID_INIT(perf_id_queue_,
+      PERFORMANCE_PREFETCH_NAME("queue"));
+  PERFORMANCE_EVENT_ID_INIT(perf_id_wait_, PERFORMANCE_PREFETCH_NAME("wait"));
+  PERFORMANCE_EVENT_ID_INIT(perf_id_free_wait_,
+      PERFORMANCE_PREFETCH_NAME("free_wait"));
+  PERFORMANCE_EVENT_ID_INIT(perf_id_read_, PERFORMANCE_PREFETCH_NAME("read"));
+  PERFORMANCE_EVENT_ID_INIT(perf_id_transform_,
+      PERFORMANCE_PREFETCH_NAME("transform"));
+  // Batches ready when Forward asks for one.
+  PERFORMANCE_COUNTER_UPDATE_ID(perf_id_queue_, prefetch_full_.size());
+  PERFORMANCE_MEASUREMENT_BEGIN();
+  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  PERFORMANCE_MEASUREMENT_END_ID(perf_id_wait_);
+  // Times taken on the prefetch threads travel with the batch and are
+  // reported once it is consumed, so that they line up with the waits above.
+  PERFORMANCE_EVENT_UPDATE_ID(perf_id_free_wait_, 1000 * batch->wait_time_);
+  PERFORMANCE_EVENT_UPDATE_ID(perf_id_read_, 1000 * batch->read_time_);
+  PERFORMANCE_EVENT_UPDATE_ID(perf_id_transform_,
+      1000 * (batch->load_time_ - batch->read_time_));
+  return batch;
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   // Here for CPU we do transformation
-  if (Caffe::mode() == Caffe::CPU) {
+  if (prefetch_threads_ == 0) {
     this->GetBatch();
   }
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = NextFullBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
   // Copy the data
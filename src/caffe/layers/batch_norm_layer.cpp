@@ -36,7 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <algorithm>
-#include <functional>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/batch_norm_layer.hpp"
@@ -116,98 +116,57 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
-template <typename Dtype>
-void BatchNormLayer<Dtype>::replicate(Dtype* buffer_to_write,
-                                      int num_batches,
-                                      unsigned int batch_offset_incr,
-                                      unsigned int channel_offset_incr,
-                                      const Dtype* data_to_be_replicated) {
-#ifdef _OPENMP
-  #pragma omp parallel for collapse(2)
-#endif
-  for (unsigned int j = 0; j< channels_; ++j) {
-    for (unsigned int n = 0; n < num_batches; ++n) {
-      caffe_set(channel_offset_incr, data_to_be_replicated[j],
-        buffer_to_write + j * channel_offset_incr + n * batch_offset_incr);
-    }
-  }
-}
-
-template <typename Dtype>
-template <typename FuncTy>
-void BatchNormLayer<Dtype>::replicate_to_op(Dtype* buffer_to_write,
-                                      int num_batches,
-                                      unsigned int batch_offset_incr,
-                                      unsigned int channel_offset_incr,
-                                      const Dtype* data_to_be_replicated,
-                                      FuncTy op_func) {
-#ifdef _OPENMP
-  #pragma omp parallel for collapse(2)
-#endif
-  for (unsigned int j = 0; j< channels_; ++j) {
-    for (unsigned int n = 0; n < num_batches; ++n) {
-      Dtype value = data_to_be_replicated[j];
-      Dtype* buffer_offsetted =
-        buffer_to_write + j * channel_offset_incr + n * batch_offset_incr;
-      for (unsigned int k = 0; k < channel_offset_incr; ++k) {
-        buffer_offsetted[k] = op_func(buffer_offsetted[k], value);
-      }
-    }
-  }
-}
-
-
-
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  int num = bottom[0]->shape(0);
-  int spatial_dim = bottom[0]->count() / (num * channels_);
-
-  if (bottom[0] != top[0]) {
-    caffe_copy(bottom[0]->count(), bottom_data, top_data);
-  }
+  const int num = bottom[0]->shape(0);
+  const int spatial_dim = bottom[0]->count() / (num * channels_);
+  const int channel_stride = channels_ * spatial_dim;
+  Dtype* mean = mean_.mutable_cpu_data();
+  Dtype* variance = variance_.mutable_cpu_data();
 
   if (use_global_stats_) {
     // use the stored mean/variance estimates.
     const Dtype scale_factor = this->blobs_[2]->cpu_data()[0] == 0 ?
         0 : 1 / this->blobs_[2]->cpu_data()[0];
     caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[0]->cpu_data(), mean_.mutable_cpu_data());
+        this->blobs_[0]->cpu_data(), mean);
     caffe_cpu_scale(variance_.count(), scale_factor,
-        this->blobs_[1]->cpu_data(), variance_.mutable_cpu_data());
+        this->blobs_[1]->cpu_data(), variance);
   } else {
-    // compute mean
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), bottom_data,
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        mean_.mutable_cpu_data());
-  }
-
-  // subtract mean
-  replicate_to_op(top_data,
-                  num,
-                  spatial_dim * channels_,
-                  spatial_dim,
-                  mean_.cpu_data(),
-                  std::minus<Dtype>());
-
-  if (!use_global_stats_) {
-    // compute variance using var(X) = E((X-EX)^2)
-    caffe_powx(top[0]->count(), top_data, Dtype(2),
-        temp_.mutable_cpu_data());  // (X-EX)^2
-    caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
-        1. / (num * spatial_dim), temp_.cpu_data(),
-        spatial_sum_multiplier_.cpu_data(), 0.,
-        num_by_chans_.mutable_cpu_data());
-    caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-        num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-        variance_.mutable_cpu_data());  // E((X_EX)^2)
+    // Mean and variance of each channel in one read of the input: each
+    // (n, c) row is small enough to stay in L1, so its mean and centered
+    // sum of squares take two cheap passes over it, and the rows are then
+    // merged with Chan's parallel update of the running mean and M2.
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int c = 0; c < channels_; ++c) {
+      Dtype channel_mean = 0;
+      Dtype channel_m2 = 0;
+      for (int n = 0; n < num; ++n) {
+        const Dtype* x = bottom_data + n * channel_stride + c * spatial_dim;
+        Dtype row_sum = 0;
+        for (int i = 0; i < spatial_dim; ++i) {
+          row_sum += x[i];
+        }
+        const Dtype row_mean = row_sum / spatial_dim;
+        Dtype row_m2 = 0;
+        for (int i = 0; i < spatial_dim; ++i) {
+          const Dtype d = x[i] - row_mean;
+          row_m2 += d * d;
+        }
+        // The first n rows hold n * spatial_dim values, the new one
+        // spatial_dim more.
+        const Dtype delta = row_mean - channel_mean;
+        channel_mean += delta / (n + 1);
+        channel_m2 += row_m2 + delta * delta * spatial_dim * n / (n + 1);
+      }
+      mean[c] = channel_mean;
+      variance[c] = channel_m2 / (num * spatial_dim);
+    }
 
     // compute and save moving average
     this->blobs_[2]->mutable_cpu_data()[0] *= moving_average_fraction_;
@@ -221,43 +180,62 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
         this->blobs_[1]->mutable_cpu_data());
   }
 
-  // normalize variance
-  caffe_add_scalar(variance_.count(), eps_, variance_.mutable_cpu_data());
-  caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
-             variance_.mutable_cpu_data());
-
-  // replicate variance to input size
-  this->replicate(temp_.mutable_cpu_data(),
-                  num,
-                  spatial_dim*channels_,
-                  spatial_dim,
-                  variance_.cpu_data());
+  // variance_ keeps sqrt(var(X) + eps) for the backward pass.
+  for (int c = 0; c < channels_; ++c) {
+    variance[c] = std::sqrt(variance[c] + eps_);
+  }
 
-  caffe_div(temp_.count(), top_data, temp_.cpu_data(), top_data);
-  // TODO(cdoersch): The caching is only needed because later in-place layers
-  //                 might clobber the data.  Can we skip this if they won't?
-  caffe_copy(x_norm_.count(), top_data, x_norm_.mutable_cpu_data());
+  // Y = X * (1 / stddev) + (-mean / stddev) in one write. An in-place layer
+  // also caches Y, since later in-place layers might clobber the data;
+  // otherwise backward recomputes it from the bottom.
+  Dtype* x_norm = bottom[0] == top[0] ? x_norm_.mutable_cpu_data() : NULL;
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2)
+#endif
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels_; ++c) {
+      const int offset = n * channel_stride + c * spatial_dim;
+      const Dtype scale = Dtype(1) / variance[c];
+      const Dtype shift = -mean[c] * scale;
+      const Dtype* x = bottom_data + offset;
+      Dtype* y = top_data + offset;
+      for (int i = 0; i < spatial_dim; ++i) {
+        y[i] = x[i] * scale + shift;
+      }
+      if (x_norm) {
+        caffe_copy(spatial_dim, y, x_norm + offset);
+      }
+    }
+  }
 }
 
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
-  const Dtype* top_diff;
-  if (bottom[0] != top[0]) {
-    top_diff = top[0]->cpu_diff();
-  } else {
-    caffe_copy(x_norm_.count(), top[0]->cpu_diff(), x_norm_.mutable_cpu_diff());
-    top_diff = x_norm_.cpu_diff();
-  }
+  // Every element of the diff is read before it is written, so the top and
+  // bottom diffs may alias.
+  const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const Dtype* stddev = variance_.cpu_data();
+  const int num = bottom[0]->shape(0);
+  const int spatial_dim = bottom[0]->count() / (num * channels_);
+  const int channel_stride = channels_ * spatial_dim;
   if (use_global_stats_) {
-    caffe_div(temp_.count(), top_diff, temp_.cpu_data(), bottom_diff);
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2)
+#endif
+    for (int n = 0; n < num; ++n) {
+      for (int c = 0; c < channels_; ++c) {
+        const int offset = n * channel_stride + c * spatial_dim;
+        const Dtype scale = Dtype(1) / stddev[c];
+        for (int i = 0; i < spatial_dim; ++i) {
+          bottom_diff[offset + i] = top_diff[offset + i] * scale;
+        }
+      }
+    }
     return;
   }
-  const Dtype* top_data = x_norm_.cpu_data();
-  int num = bottom[0]->shape()[0];
-  int spatial_dim = bottom[0]->count() / (bottom[0]->shape(0) * channels_);
   // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
   //
   // dE(Y)/dX =
@@ -269,49 +247,48 @@ void BatchNormLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   // along all dimensions except the channels dimension.  In the above
   // equation, the operations allow for expansion (i.e. broadcast) along all
   // dimensions except the channels dimension where required.
-
-  // sum(dE/dY \cdot Y)
-  caffe_mul(temp_.count(), top_data, top_diff, bottom_diff);
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      bottom_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-
-  this->replicate(bottom_diff,
-                  num,
-                  spatial_dim*channels_,
-                  spatial_dim,
-                  mean_.cpu_data());
-
-  // sum(dE/dY \cdot Y) \cdot Y
-  caffe_mul(temp_.count(), top_data, bottom_diff, bottom_diff);
-
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim, 1.,
-      top_diff, spatial_sum_multiplier_.cpu_data(), 0.,
-      num_by_chans_.mutable_cpu_data());
-  caffe_cpu_gemv<Dtype>(CblasTrans, num, channels_, 1.,
-      num_by_chans_.cpu_data(), batch_sum_multiplier_.cpu_data(), 0.,
-      mean_.mutable_cpu_data());
-  // reshape (broadcast) the above to make
-  // sum(dE/dY)-sum(dE/dY \cdot Y) \cdot Y
-
-  replicate_to_op(bottom_diff,
-                  num,
-                  spatial_dim*channels_,
-                  spatial_dim,
-                  mean_.cpu_data(),
-                  std::plus<Dtype>());
-
-  // dE/dY - mean(dE/dY)-mean(dE/dY \cdot Y) \cdot Y
-  caffe_cpu_axpby(temp_.count(), Dtype(1), top_diff,
-      Dtype(-1. / (num * spatial_dim)), bottom_diff);
-
-  // note: temp_ still contains sqrt(var(X)+eps), computed during the forward
-  // pass.
-  caffe_div(temp_.count(), bottom_diff, temp_.cpu_data(), bottom_diff);
+  //
+  // Each channel takes one pass for both means and one for dE/dX, with Y
+  // read from the cache or recomputed from X.
+  const bool in_place = bottom[0] == top[0];
+  const Dtype* data = in_place ? x_norm_.cpu_data() : bottom[0]->cpu_data();
+  const Dtype* mean = mean_.cpu_data();
+  const Dtype count = num * spatial_dim;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int c = 0; c < channels_; ++c) {
+    const Dtype scale = Dtype(1) / stddev[c];
+    const Dtype shift = in_place ? Dtype(0) : -mean[c] * scale;
+    const Dtype data_scale = in_place ? Dtype(1) : scale;
+    Dtype sum_dy = 0;
+    Dtype sum_dy_y = 0;
+    for (int n = 0; n < num; ++n) {
+      const int offset = n * channel_stride + c * spatial_dim;
+      const Dtype* dy = top_diff + offset;
+      const Dtype* x = data + offset;
+      Dtype row_dy = 0;
+      Dtype row_dy_y = 0;
+      for (int i = 0; i < spatial_dim; ++i) {
+        row_dy += dy[i];
+        row_dy_y += dy[i] * (x[i] * data_scale + shift);
+      }
+      sum_dy += row_dy;
+      sum_dy_y += row_dy_y;
+    }
+    const Dtype mean_dy = sum_dy / count;
+    const Dtype mean_dy_y = sum_dy_y / count;
+    for (int n = 0; n < num; ++n) {
+      const int offset = n * channel_stride + c * spatial_dim;
+      const Dtype* dy = top_diff + offset;
+      const Dtype* x = data + offset;
+      Dtype* dx = bottom_diff + offset;
+      for (int i = 0; i < spatial_dim; ++i) {
+        const Dtype y = x[i] * data_scale + shift;
+        dx[i] = (dy[i] - mean_dy - mean_dy_y * y) * scale;
+      }
+    }
+  }
 }
 
 
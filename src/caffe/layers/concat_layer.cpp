@@ -46,12 +46,68 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace caffe {
 
+// Copies a num x channels x spatial_dim bottom into its channels-last slice
+// of a top with top_dim elements per image.
+template <typename Dtype>
+static void ChannelsLastForward(const int num, const int channels,
+    const int spatial_dim, const int top_dim, const Dtype* bottom,
+    Dtype* top) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < num * spatial_dim; ++i) {
+    const int n = i / spatial_dim;
+    const int s = i % spatial_dim;
+    const Dtype* bottom_pixel = bottom + n * channels * spatial_dim + s;
+    Dtype* top_pixel = top + n * top_dim + s * channels;
+    for (int c = 0; c < channels; ++c) {
+      top_pixel[c] = bottom_pixel[c * spatial_dim];
+    }
+  }
+}
+
+// Copies the channels-last slice of a top back into a num x channels x
+// spatial_dim bottom; the reverse of ChannelsLastForward.
+template <typename Dtype>
+static void ChannelsLastBackward(const int num, const int channels,
+    const int spatial_dim, const int top_dim, const Dtype* top,
+    Dtype* bottom) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < num * spatial_dim; ++i) {
+    const int n = i / spatial_dim;
+    const int s = i % spatial_dim;
+    Dtype* bottom_pixel = bottom + n * channels * spatial_dim + s;
+    const Dtype* top_pixel = top + n * top_dim + s * channels;
+    for (int c = 0; c < channels; ++c) {
+      bottom_pixel[c * spatial_dim] = top_pixel[c];
+    }
+  }
+}
+
+// Net::ShareConcatSliceBuffers made the inputs views into the top. An input
+// that kept its shape while another one was resized without Net::Reshape
+// still points at its old offset, where the copies below would overwrite it
+// or copy it onto itself; such inputs get their own memory first.
+template <typename Dtype>
+void ConcatLayer<Dtype>::UnshareStaleSlices(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  int offset_concat_axis = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom[i]->UnshareStaleSlice(*top[0],
+        offset_concat_axis * concat_input_size_);
+    offset_concat_axis += bottom[i]->shape(concat_axis_);
+  }
+}
+
 template <typename Dtype>
 void ConcatLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const ConcatParameter& concat_param = this->layer_param_.concat_param();
   CHECK(!(concat_param.has_axis() && concat_param.has_concat_dim()))
       << "Either axis or concat_dim should be specified; not both.";
+  channels_last_ = concat_param.channels_last();
 }
 
 template <typename Dtype>
@@ -70,6 +126,21 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   } else {
     concat_axis_ = bottom[0]->CanonicalAxisIndex(concat_param.axis());
   }
+  if (channels_last_) {
+    CHECK_EQ(concat_axis_, 1) << "channels_last concatenates along axis 1.";
+    vector<int> top_shape(2, bottom[0]->shape(0));
+    top_shape[1] = 0;
+    for (int i = 0; i < bottom.size(); ++i) {
+      CHECK_EQ(4, bottom[i]->num_axes())
+          << "channels_last inputs must be N x C x H x W.";
+      CHECK_EQ(top_shape[0], bottom[i]->shape(0))
+          << "All inputs must have the same num.";
+      top_shape[1] += bottom[i]->count(1);
+    }
+    num_concats_ = top_shape[0];
+    top[0]->Reshape(top_shape);
+    return;
+  }
   // Initialize with the first blob.
   vector<int> top_shape = bottom[0]->shape();
   num_concats_ = bottom[0]->count(0, concat_axis_);
@@ -97,7 +168,21 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (channels_last_) {
+    // Transpose every input straight into its slice of the top.
+    Dtype* top_data = top[0]->mutable_cpu_data();
+    const int top_dim = top[0]->count(1);
+    int offset = 0;
+    for (int i = 0; i < bottom.size(); ++i) {
+      ChannelsLastForward(num_concats_, bottom[i]->shape(1),
+          bottom[i]->count(2), top_dim, bottom[i]->cpu_data(),
+          top_data + offset);
+      offset += bottom[i]->count(1);
+    }
+    return;
+  }
   if (bottom.size() == 1) { return; }
+  UnshareStaleSlices(bottom, top);
   Dtype* top_data = top[0]->mutable_cpu_data();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
@@ -106,6 +191,12 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
     const int offset_value = offset_concat_axis;
     offset_concat_axis += bottom_concat_axis;
+    // The producer wrote straight into the top, see
+    // Net::ShareConcatSliceBuffers.
+    if (num_concats_ == 1 && bottom[i]->SharesDataSlice(*top[0],
+        offset_value * concat_input_size_)) {
+      continue;
+    }
 #ifdef _OPENMP
   #pragma omp parallel for if(num_concats_ > 1)
 #endif
@@ -121,7 +212,21 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (channels_last_) {
+    const int top_dim = top[0]->count(1);
+    int offset = 0;
+    for (int i = 0; i < bottom.size(); ++i) {
+      if (propagate_down[i]) {
+        ChannelsLastBackward(num_concats_, bottom[i]->shape(1),
+            bottom[i]->count(2), top_dim, top[0]->cpu_diff() + offset,
+            bottom[i]->mutable_cpu_diff());
+      }
+      offset += bottom[i]->count(1);
+    }
+    return;
+  }
   if (bottom.size() == 1) { return; }
+  UnshareStaleSlices(bottom, top);
   const Dtype* top_diff = top[0]->cpu_diff();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
@@ -129,16 +234,22 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
     const int offset_value = offset_concat_axis;
     offset_concat_axis += bottom_concat_axis;
-    if (propagate_down[i]) {
-      Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+    if (!propagate_down[i]) { continue; }
+    if (num_concats_ == 1 && bottom[i]->SharesDiffSlice(*top[0],
+        offset_value * concat_input_size_)) {
+      // top_diff is current on the host and is the bottom diff already; drop
+      // any stale private copy of it.
+      bottom[i]->set_prv_diff_descriptor(NULL);
+      continue;
+    }
+    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
 #ifdef _OPENMP
   #pragma omp parallel for
 #endif
-      for (int n = 0; n < num_concats_; ++n) {
-        caffe_copy(bottom_concat_axis * concat_input_size_, top_diff +
-            (n * top_concat_axis + offset_value) * concat_input_size_,
-            bottom_diff + n * bottom_concat_axis * concat_input_size_);
-      }
+    for (int n = 0; n < num_concats_; ++n) {
+      caffe_copy(bottom_concat_axis * concat_input_size_, top_diff +
+          (n * top_concat_axis + offset_value) * concat_input_size_,
+          bottom_diff + n * bottom_concat_axis * concat_input_size_);
     }
   }
 }
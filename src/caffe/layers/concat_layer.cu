@@ -24,9 +24,40 @@ __global__ void Concat(const int nthreads, const Dtype* in_data,
   }
 }
 
+template <typename Dtype>
+__global__ void ChannelsLastConcat(const int nthreads, const Dtype* in_data,
+    const bool forward, const int channels, const int spatial_dim,
+    const int top_dim, const int offset, Dtype* out_data) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int n = index / (channels * spatial_dim);
+    const int c = (index / spatial_dim) % channels;
+    const int s = index % spatial_dim;
+    const int top_index = n * top_dim + offset + s * channels + c;
+    if (forward) {
+      out_data[top_index] = in_data[index];
+    } else {
+      out_data[index] = in_data[top_index];
+    }
+  }
+}
+
 template <typename Dtype>
 void ConcatLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (channels_last_) {
+    Dtype* top_data = top[0]->mutable_gpu_data();
+    const int top_dim = top[0]->count(1);
+    int offset = 0;
+    for (int i = 0; i < bottom.size(); ++i) {
+      const int nthreads = bottom[i]->count();
+      ChannelsLastConcat<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+          <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
+          nthreads, bottom[i]->gpu_data(), true, bottom[i]->shape(1),
+          bottom[i]->count(2), top_dim, offset, top_data);
+      offset += bottom[i]->count(1);
+    }
+    return;
+  }
   if (bottom.size() == 1) { return; }
   Dtype* top_data = top[0]->mutable_gpu_data();
   int offset_concat_axis = 0;
@@ -48,6 +79,23 @@ void ConcatLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConcatLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (channels_last_) {
+    const Dtype* top_diff = top[0]->gpu_diff();
+    const int top_dim = top[0]->count(1);
+    int offset = 0;
+    for (int i = 0; i < bottom.size(); ++i) {
+      if (propagate_down[i]) {
+        const int nthreads = bottom[i]->count();
+        ChannelsLastConcat<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+            <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
+            nthreads, top_diff, false, bottom[i]->shape(1),
+            bottom[i]->count(2), top_dim, offset,
+            bottom[i]->mutable_gpu_diff());
+      }
+      offset += bottom[i]->count(1);
+    }
+    return;
+  }
   if (bottom.size() == 1) { return; }
   const Dtype* top_diff = top[0]->gpu_diff();
   int offset_concat_axis = 0;
@@ -39,6 +39,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <boost/thread.hpp>
 #include <string>
 #include <vector>
 
@@ -51,7 +52,7 @@ namespace caffe {
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    reader_(param) {
+    reader_(param), read_mutex_(new boost::mutex()) {
 }
 
 template <typename Dtype>
@@ -74,8 +75,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   top_shape[0] = batch_size;
 
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -84,8 +85,8 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -98,23 +99,32 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   double read_time = 0;
   double trans_time = 0;
   CPUTimer timer;
-  CPUTimer trans_timer;
   CHECK(batch->data_.count());
 
-#ifndef _OPENMP
-  CHECK(this->transformed_data_.count());
-#endif
-
-  // Reshape according to the first datum of each batch
-  // on single input batches allows for inputs of varying dimension.
   const int batch_size = this->layer_param_.data_param().batch_size();
-  Datum datum;
-  datum.ParseFromString(*(reader_.full().peek()));
-  // Use data_transformer to infer the expected blob shape from datum.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-#ifndef _OPENMP
-  this->transformed_data_.Reshape(top_shape);
-#endif
+  vector<string*> data(batch_size);
+  vector<PreclcRandomNumbers> precalculated_rand_numbers(batch_size);
+  vector<int> top_shape;
+  // Take the whole batch off the reader at once, so that batches loaded
+  // concurrently each get consecutive data points, and are handed over in
+  // the order of the data.
+  timer.Start();
+  {
+    boost::mutex::scoped_lock lock(*read_mutex_);
+    // Reshape according to the first datum of each batch
+    // on single input batches allows for inputs of varying dimension.
+    Datum datum;
+    datum.ParseFromString(*(reader_.full().peek()));
+    // Use data_transformer to infer the expected blob shape from datum.
+    top_shape = this->data_transformer_->InferBlobShape(datum);
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      data[item_id] = reader_.full().pop("Waiting for data");
+      this->data_transformer_->GenerateRandNumbers(
+          precalculated_rand_numbers[item_id]);
+    }
+    this->SequenceBatch(batch);
+  }
+  read_time = timer.MicroSeconds();
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
@@ -126,51 +136,28 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     top_label = batch->label_.mutable_cpu_data();
   }
 
-  trans_timer.Start();
+  timer.Start();
 #ifdef _OPENMP
-  #pragma omp parallel if (batch_size > 1)
-  #pragma omp single nowait
+  #pragma omp parallel for if (batch_size > 1)
 #endif
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
-    // get a datum
-    string* data = (reader_.full().pop("Waiting for data"));
-    timer.Stop();
-    read_time += timer.MicroSeconds();
-    // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-
-#ifdef _OPENMP
-    PreclcRandomNumbers precalculated_rand_numbers;
-    this->data_transformer_->GenerateRandNumbers(precalculated_rand_numbers);
-    #pragma omp task firstprivate(offset, precalculated_rand_numbers, data, item_id)
-#endif
-    {
-      Datum datum;
-      datum.ParseFromString(*data);
-      (reader_.free()).push(data);  
-      // Copy label. We need to copy it before we release datum
-      if (this->output_labels_) {
-        top_label[item_id] = datum.label();
-      }
-#ifdef _OPENMP
-      Blob<Dtype> tmp_data;
-      tmp_data.Reshape(top_shape);
-      tmp_data.set_cpu_data(top_data + offset);
-      this->data_transformer_->Transform(datum, &tmp_data,
-                                              precalculated_rand_numbers);
-#else
-      this->transformed_data_.set_cpu_data(top_data + offset);
-      this->data_transformer_->Transform(datum, &(this->transformed_data_));
-#endif
+    Datum datum;
+    datum.ParseFromString(*data[item_id]);
+    (reader_.free()).push(data[item_id]);
+    // Copy label. We need to copy it before we release datum
+    if (this->output_labels_) {
+      top_label[item_id] = datum.label();
     }
+    // Apply data transformations (mirror, scale, crop...)
+    Blob<Dtype> tmp_data;
+    tmp_data.Reshape(top_shape);
+    tmp_data.set_cpu_data(top_data + batch->data_.offset(item_id));
+    this->data_transformer_->Transform(datum, &tmp_data,
+                                       precalculated_rand_numbers[item_id]);
   }
-  trans_timer.Stop();
+  trans_time = timer.MicroSeconds();
   batch_timer.Stop();
-  // Due to multithreaded nature of transformation,
-  // time it takes to execute them we get from subtracting
-  // read batch of images time from total batch read&transform time
-  trans_time = trans_timer.MicroSeconds() - read_time;
+  batch->read_time_ = read_time;
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
@@ -235,14 +235,14 @@ void DetectionOutputLayer<Dtype>::Forward_cpu(
 
   // Retrieve all prior bboxes. It is same within a batch since we assume all
   // images in a batch are of same dimension.
-  vector<NormalizedBBox> prior_bboxes;
-  vector<vector<float> > prior_variances;
-  GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes, &prior_variances);
+  if (PriorsChanged(prior_data, num_priors_, &last_prior_data_)) {
+    GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes_, &prior_variances_);
+  }
 
   // Decode all loc predictions to bboxes.
   vector<LabelBBox> all_decode_bboxes;
   const bool clip_bbox = false;
-  DecodeBBoxesAll(all_loc_preds, prior_bboxes, prior_variances, num,
+  DecodeBBoxesAll(all_loc_preds, prior_bboxes_, prior_variances_, num,
                   share_location_, num_loc_classes_, background_label_id_,
                   code_type_, variance_encoded_in_target_, clip_bbox,
                   &all_decode_bboxes);
@@ -0,0 +1,386 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/direct_conv_layer.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Output channels that share the input rows of a tile. Their output rows
+// have to fit in L1 together with the input rows.
+const int kChannelBlock = 16;
+
+// Range [begin, end) of output columns whose input column
+// ow * stride + offset lies inside [0, width).
+struct ColumnRange {
+  int offset;
+  int begin;
+  int end;
+};
+
+void ComputeColumnRanges(int width, int out_width, int kernel_w, int pad_w,
+    int stride_w, int dilation_w, vector<ColumnRange>* ranges) {
+  ranges->resize(kernel_w);
+  for (int kw = 0; kw < kernel_w; ++kw) {
+    ColumnRange& range = (*ranges)[kw];
+    range.offset = kw * dilation_w - pad_w;
+    range.begin = range.offset >= 0 ? 0 :
+        (-range.offset + stride_w - 1) / stride_w;
+    range.end = width - 1 - range.offset < 0 ? 0 :
+        std::min(out_width, (width - 1 - range.offset) / stride_w + 1);
+    range.begin = std::min(range.begin, range.end);
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::compute_output_shape() {
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  this->output_shape_.clear();
+  for (int i = 0; i < this->num_spatial_axes_; ++i) {
+    // i + 1 to skip channel axis
+    const int input_dim = this->input_shape(i + 1);
+    const int kernel_extent = dilation_data[i] * (kernel_shape_data[i] - 1) + 1;
+    const int output_dim = (input_dim + 2 * pad_data[i] - kernel_extent)
+        / stride_data[i] + 1;
+    this->output_shape_.push_back(output_dim);
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  this->DoReshape(bottom, top);
+  direct_ = this->num_spatial_axes_ == 2;
+  if (!direct_) {
+    // The im2col fallback runs image by image with a single column buffer,
+    // on a team of one thread.
+    this->num_of_threads_ = 1;
+    this->col_buffer_mt_size = this->col_buffer_.count();
+    this->weight_diff_mt_size = this->blobs_[0]->count();
+    this->col_buffer_mt_.resize(this->col_buffer_mt_size);
+    this->weight_diff_mt_.resize(this->weight_diff_mt_size);
+    return;
+  }
+  const int* kernel_shape_data = this->kernel_shape_.cpu_data();
+  const int* stride_data = this->stride_.cpu_data();
+  const int* pad_data = this->pad_.cpu_data();
+  const int* dilation_data = this->dilation_.cpu_data();
+  Geometry& g = geometry_;
+  g.channels = this->channels_;
+  g.height = this->input_shape(1);
+  g.width = this->input_shape(2);
+  g.num_output = this->num_output_;
+  g.out_height = this->output_shape_[0];
+  g.out_width = this->output_shape_[1];
+  g.group = this->group_;
+  g.kernel_h = kernel_shape_data[0];
+  g.kernel_w = kernel_shape_data[1];
+  g.pad_h = pad_data[0];
+  g.pad_w = pad_data[1];
+  g.stride_h = stride_data[0];
+  g.stride_w = stride_data[1];
+  g.dilation_h = dilation_data[0];
+  g.dilation_w = dilation_data[1];
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::ForwardDirect(const Dtype* input,
+    const Dtype* weight, const Dtype* bias, Dtype* output) {
+  const Geometry& g = geometry_;
+  const int in_per_group = g.channels / g.group;
+  const int out_per_group = g.num_output / g.group;
+  const int num_blocks = (out_per_group + kChannelBlock - 1) / kChannelBlock;
+  const int kernel_size = g.kernel_h * g.kernel_w;
+  const int in_plane = g.height * g.width;
+  const int out_plane = g.out_height * g.out_width;
+  vector<ColumnRange> ranges;
+  ComputeColumnRanges(g.width, g.out_width, g.kernel_w, g.pad_w, g.stride_w,
+      g.dilation_w, &ranges);
+
+#ifdef _OPENMP
+  #pragma omp parallel for collapse(4) schedule(static)
+#endif
+  for (int n = 0; n < this->num_; ++n) {
+    for (int grp = 0; grp < g.group; ++grp) {
+      for (int block = 0; block < num_blocks; ++block) {
+        for (int oh = 0; oh < g.out_height; ++oh) {
+          const int oc_begin = grp * out_per_group + block * kChannelBlock;
+          const int oc_end =
+              std::min(oc_begin + kChannelBlock, (grp + 1) * out_per_group);
+          Dtype* out_rows = output + (n * g.num_output + oc_begin) * out_plane
+              + oh * g.out_width;
+          for (int oc = oc_begin; oc < oc_end; ++oc) {
+            Dtype* out_row = out_rows + (oc - oc_begin) * out_plane;
+            const Dtype value = bias ? bias[oc] : Dtype(0);
+            for (int ow = 0; ow < g.out_width; ++ow) {
+              out_row[ow] = value;
+            }
+          }
+          for (int icg = 0; icg < in_per_group; ++icg) {
+            const Dtype* in_channel =
+                input + (n * g.channels + grp * in_per_group + icg) * in_plane;
+            for (int kh = 0; kh < g.kernel_h; ++kh) {
+              const int ih = oh * g.stride_h - g.pad_h + kh * g.dilation_h;
+              if (ih < 0 || ih >= g.height) {
+                continue;
+              }
+              const Dtype* in_row = in_channel + ih * g.width;
+              for (int kw = 0; kw < g.kernel_w; ++kw) {
+                const ColumnRange& range = ranges[kw];
+                const Dtype* w = weight + (oc_begin * in_per_group + icg)
+                    * kernel_size + kh * g.kernel_w + kw;
+                for (int oc = oc_begin; oc < oc_end; ++oc) {
+                  const Dtype coeff = *w;
+                  w += in_per_group * kernel_size;
+                  Dtype* out_row = out_rows + (oc - oc_begin) * out_plane;
+                  if (g.stride_w == 1) {
+                    const Dtype* src = in_row + range.offset;
+                    for (int ow = range.begin; ow < range.end; ++ow) {
+                      out_row[ow] += coeff * src[ow];
+                    }
+                  } else {
+                    for (int ow = range.begin; ow < range.end; ++ow) {
+                      out_row[ow] +=
+                          coeff * in_row[ow * g.stride_w + range.offset];
+                    }
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::BackwardDataDirect(const Dtype* top_diff,
+    const Dtype* weight, Dtype* bottom_diff) {
+  const Geometry& g = geometry_;
+  const int in_per_group = g.channels / g.group;
+  const int out_per_group = g.num_output / g.group;
+  const int kernel_size = g.kernel_h * g.kernel_w;
+  const int in_plane = g.height * g.width;
+  const int out_plane = g.out_height * g.out_width;
+  vector<ColumnRange> ranges;
+  ComputeColumnRanges(g.width, g.out_width, g.kernel_w, g.pad_w, g.stride_w,
+      g.dilation_w, &ranges);
+
+  // Every tile gathers the contributions to one input row, so the rows are
+  // written by a single thread.
+#ifdef _OPENMP
+  #pragma omp parallel for collapse(3) schedule(static)
+#endif
+  for (int n = 0; n < this->num_; ++n) {
+    for (int ic = 0; ic < g.channels; ++ic) {
+      for (int ih = 0; ih < g.height; ++ih) {
+        const int grp = ic / in_per_group;
+        const int icg = ic % in_per_group;
+        Dtype* in_row =
+            bottom_diff + (n * g.channels + ic) * in_plane + ih * g.width;
+        for (int iw = 0; iw < g.width; ++iw) {
+          in_row[iw] = 0;
+        }
+        for (int kh = 0; kh < g.kernel_h; ++kh) {
+          const int oh_stride = ih + g.pad_h - kh * g.dilation_h;
+          if (oh_stride < 0 || oh_stride % g.stride_h) {
+            continue;
+          }
+          const int oh = oh_stride / g.stride_h;
+          if (oh >= g.out_height) {
+            continue;
+          }
+          for (int kw = 0; kw < g.kernel_w; ++kw) {
+            const ColumnRange& range = ranges[kw];
+            Dtype* dst = in_row + range.offset;
+            for (int ocg = 0; ocg < out_per_group; ++ocg) {
+              const int oc = grp * out_per_group + ocg;
+              const Dtype coeff = weight[(oc * in_per_group + icg)
+                  * kernel_size + kh * g.kernel_w + kw];
+              const Dtype* top_row =
+                  top_diff + (n * g.num_output + oc) * out_plane
+                  + oh * g.out_width;
+              if (g.stride_w == 1) {
+                for (int ow = range.begin; ow < range.end; ++ow) {
+                  dst[ow] += coeff * top_row[ow];
+                }
+              } else {
+                for (int ow = range.begin; ow < range.end; ++ow) {
+                  dst[ow * g.stride_w] += coeff * top_row[ow];
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::BackwardWeightDirect(
+    const Dtype* top_diff, const Dtype* input, Dtype* weight_diff) {
+  const Geometry& g = geometry_;
+  const int in_per_group = g.channels / g.group;
+  const int out_per_group = g.num_output / g.group;
+  const int kernel_size = g.kernel_h * g.kernel_w;
+  const int in_plane = g.height * g.width;
+  const int out_plane = g.out_height * g.out_width;
+  vector<ColumnRange> ranges;
+  ComputeColumnRanges(g.width, g.out_width, g.kernel_w, g.pad_w, g.stride_w,
+      g.dilation_w, &ranges);
+
+  // Every tile accumulates the coefficients of one filter plane, over all
+  // images, straight into weight_diff.
+#ifdef _OPENMP
+  #pragma omp parallel for collapse(2) schedule(static)
+#endif
+  for (int oc = 0; oc < g.num_output; ++oc) {
+    for (int icg = 0; icg < in_per_group; ++icg) {
+      const int ic = (oc / out_per_group) * in_per_group + icg;
+      Dtype* coeffs = weight_diff + (oc * in_per_group + icg) * kernel_size;
+      for (int n = 0; n < this->num_; ++n) {
+        const Dtype* in_channel = input + (n * g.channels + ic) * in_plane;
+        const Dtype* top_channel =
+            top_diff + (n * g.num_output + oc) * out_plane;
+        for (int oh = 0; oh < g.out_height; ++oh) {
+          const Dtype* top_row = top_channel + oh * g.out_width;
+          for (int kh = 0; kh < g.kernel_h; ++kh) {
+            const int ih = oh * g.stride_h - g.pad_h + kh * g.dilation_h;
+            if (ih < 0 || ih >= g.height) {
+              continue;
+            }
+            const Dtype* in_row = in_channel + ih * g.width;
+            for (int kw = 0; kw < g.kernel_w; ++kw) {
+              const ColumnRange& range = ranges[kw];
+              Dtype sum = 0;
+              for (int ow = range.begin; ow < range.end; ++ow) {
+                sum += top_row[ow] * in_row[ow * g.stride_w + range.offset];
+              }
+              coeffs[kh * g.kernel_w + kw] += sum;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    if (direct_) {
+      ForwardDirect(bottom_data, weight, bias, top_data);
+      continue;
+    }
+    // The gemm helpers pick their column buffer by OpenMP thread number,
+    // which in a branch group task may be that of any outer team thread.
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(1)
+#endif
+    for (int n = 0; n < this->num_; ++n) {
+      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+          top_data + n * this->top_dim_);
+      if (this->bias_term_) {
+        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+  for (int i = 0; i < top.size(); ++i) {
+    const Dtype* top_diff = top[i]->cpu_diff();
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+    // Bias gradient, if necessary.
+    if (this->bias_term_ && this->param_propagate_down_[1]) {
+      Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
+      for (int n = 0; n < this->num_; ++n) {
+        this->backward_cpu_bias(bias_diff, top_diff + n * this->top_dim_);
+      }
+    }
+    if (direct_) {
+      if (this->param_propagate_down_[0]) {
+        BackwardWeightDirect(top_diff, bottom_data, weight_diff);
+      }
+      if (propagate_down[i]) {
+        BackwardDataDirect(top_diff, weight, bottom_diff);
+      }
+      continue;
+    }
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(1)
+#endif
+    for (int n = 0; n < this->num_; ++n) {
+      // gradient w.r.t. weight. Note that we will accumulate diffs.
+      if (this->param_propagate_down_[0]) {
+        this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+            top_diff + n * this->top_dim_, weight_diff);
+      }
+      // gradient w.r.t. bottom data, if necessary.
+      if (propagate_down[i]) {
+        this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+            bottom_diff + n * this->bottom_dim_);
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DirectConvolutionLayer);
+
+}  // namespace caffe
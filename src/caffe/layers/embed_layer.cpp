@@ -35,6 +35,7 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -51,6 +52,8 @@ void EmbedLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   K_ = this->layer_param_.embed_param().input_dim();
   CHECK_GT(K_, 0) << "EmbedLayer input_dim must be positive.";
   bias_term_ = this->layer_param_.embed_param().bias_term();
+  sparse_update_ = this->layer_param_.embed_param().sparse_update();
+  touched_rows_.clear();
   // Check if we need to set up the weights
   if (this->blobs_.size() > 0) {
     LOG(INFO) << "Skipping parameter initialization";
@@ -137,6 +140,19 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
           << "non-integer input";
       caffe_axpy(N_, Dtype(1), top_diff + n * N_, weight_diff + index * N_);
     }
+    if (sparse_update_) {
+      // Merge this batch's rows into the ones accumulated so far.
+      const int previous = touched_rows_.size();
+      for (int n = 0; n < M_; ++n) {
+        touched_rows_.push_back(static_cast<int>(bottom_data[n]));
+      }
+      std::sort(touched_rows_.begin() + previous, touched_rows_.end());
+      std::inplace_merge(touched_rows_.begin(),
+          touched_rows_.begin() + previous, touched_rows_.end());
+      touched_rows_.erase(
+          std::unique(touched_rows_.begin(), touched_rows_.end()),
+          touched_rows_.end());
+    }
   }
   if (bias_term_ && this->param_propagate_down_[1]) {
     const Dtype* top_diff = top[0]->cpu_diff();
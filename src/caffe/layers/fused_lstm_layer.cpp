@@ -0,0 +1,352 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <vector>
+
+#include "caffe/filler.hpp"
+#include "caffe/layers/fused_lstm_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+template <typename Dtype>
+inline Dtype sigmoid(Dtype x) {
+  return Dtype(1) / (Dtype(1) + std::exp(-x));
+}
+
+// One timestep of LSTMUnitLayer::Forward_cpu for all streams: replaces the
+// gate inputs with the gate activations and writes the new cell and hidden
+// states. Elements rather than streams are split over the threads, so that
+// a few streams still keep all of them busy.
+template <typename Dtype>
+void lstm_step_forward(const int num, const int dim, const Dtype* cont,
+    const Dtype* c_prev, Dtype* gates, Dtype* c, Dtype* h) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int index = 0; index < num * dim; ++index) {
+    const int n = index / dim;
+    const int d = index % dim;
+    Dtype* gate = gates + n * 4 * dim + d;
+    const Dtype i = sigmoid(gate[0]);
+    const Dtype f = (cont[n] == 0) ? 0 : (cont[n] * sigmoid(gate[dim]));
+    const Dtype o = sigmoid(gate[2 * dim]);
+    const Dtype g = std::tanh(gate[3 * dim]);
+    gate[0] = i;
+    gate[dim] = f;
+    gate[2 * dim] = o;
+    gate[3 * dim] = g;
+    const Dtype c_new = f * c_prev[index] + i * g;
+    c[index] = c_new;
+    h[index] = o * std::tanh(c_new);
+  }
+}
+
+// One timestep of LSTMUnitLayer::Backward_cpu, given the gate activations.
+// h_diff holds the gradient reaching h_t from the next timestep, to which
+// the output gradient is added. c_diff is the gradient w.r.t. c_t on entry
+// and w.r.t. c_{t-1} on exit.
+template <typename Dtype>
+void lstm_step_backward(const int num, const int dim, const Dtype* c_prev,
+    const Dtype* gates, const Dtype* c, const Dtype* top_diff,
+    const Dtype* h_diff, Dtype* c_diff, Dtype* gates_diff) {
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int index = 0; index < num * dim; ++index) {
+    const int n = index / dim;
+    const int d = index % dim;
+    const Dtype* gate = gates + n * 4 * dim + d;
+    const Dtype i = gate[0];
+    const Dtype f = gate[dim];
+    const Dtype o = gate[2 * dim];
+    const Dtype g = gate[3 * dim];
+    const Dtype tanh_c = std::tanh(c[index]);
+    const Dtype dh = top_diff[index] + h_diff[index];
+    const Dtype c_term_diff = c_diff[index] + dh * o * (1 - tanh_c * tanh_c);
+    c_diff[index] = c_term_diff * f;
+    Dtype* gate_diff = gates_diff + n * 4 * dim + d;
+    gate_diff[0] = c_term_diff * g * i * (1 - i);
+    gate_diff[dim] = c_term_diff * c_prev[index] * f * (1 - f);
+    gate_diff[2 * dim] = dh * tanh_c * o * (1 - o);
+    gate_diff[3 * dim] = c_term_diff * i * (1 - g * g);
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const RecurrentParameter& recurrent_param =
+      this->layer_param_.recurrent_param();
+  hidden_dim_ = recurrent_param.num_output();
+  CHECK_GT(hidden_dim_, 0) << "num_output must be positive";
+  CHECK_GE(bottom[0]->num_axes(), 2)
+      << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
+  input_dim_ = bottom[0]->count(2);
+  expose_hidden_ = recurrent_param.expose_hidden();
+  static_input_ = (bottom.size() > 2 + 2 * expose_hidden_);
+  static_dim_ = 0;
+  if (static_input_) {
+    CHECK_GE(bottom[2]->num_axes(), 1);
+    static_dim_ = bottom[2]->count(1);
+  }
+  const int gate_dim = 4 * hidden_dim_;
+  if (this->blobs_.size() > 0) {
+    LOG(INFO) << "Skipping parameter initialization";
+  } else {
+    // The same parameters, in the same order, as the unrolled LSTMLayer.
+    this->blobs_.resize(3 + static_input_);
+    shared_ptr<Filler<Dtype> > weight_filler(
+        GetFiller<Dtype>(recurrent_param.weight_filler()));
+    shared_ptr<Filler<Dtype> > bias_filler(
+        GetFiller<Dtype>(recurrent_param.bias_filler()));
+    vector<int> weight_shape(2);
+    weight_shape[0] = gate_dim;
+    weight_shape[1] = input_dim_;
+    this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+    weight_filler->Fill(this->blobs_[0].get());
+    vector<int> bias_shape(1, gate_dim);
+    this->blobs_[1].reset(new Blob<Dtype>(bias_shape));
+    bias_filler->Fill(this->blobs_[1].get());
+    if (static_input_) {
+      weight_shape[1] = static_dim_;
+      this->blobs_[2].reset(new Blob<Dtype>(weight_shape));
+      weight_filler->Fill(this->blobs_[2].get());
+    }
+    weight_shape[1] = hidden_dim_;
+    this->blobs_[2 + static_input_].reset(new Blob<Dtype>(weight_shape));
+    weight_filler->Fill(this->blobs_[2 + static_input_].get());
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_GE(bottom[0]->num_axes(), 2)
+      << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
+  T_ = bottom[0]->shape(0);
+  N_ = bottom[0]->shape(1);
+  CHECK_EQ(input_dim_, bottom[0]->count(2)) << "input size changed";
+  CHECK_EQ(bottom[1]->num_axes(), 2)
+      << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
+  CHECK_EQ(T_, bottom[1]->shape(0));
+  CHECK_EQ(N_, bottom[1]->shape(1));
+  if (static_input_) {
+    CHECK_EQ(N_, bottom[2]->shape(0));
+    CHECK_EQ(static_dim_, bottom[2]->count(1)) << "static input size changed";
+  }
+  vector<int> shape(3);
+  shape[0] = T_;
+  shape[1] = N_;
+  shape[2] = 4 * hidden_dim_;
+  gates_.Reshape(shape);
+  shape[2] = hidden_dim_;
+  cell_.Reshape(shape);
+  h_conted_.Reshape(shape);
+  top[0]->Reshape(shape);
+  shape[0] = 1;
+  h_0_.Reshape(shape);
+  c_0_.Reshape(shape);
+  h_T_.Reshape(shape);
+  c_T_.Reshape(shape);
+  if (expose_hidden_) {
+    const int bottom_offset = 2 + static_input_;
+    for (int i = bottom_offset; i < bottom.size(); ++i) {
+      CHECK(bottom[i]->shape() == shape)
+          << "bottom[" << i << "] shape must match hidden state input shape: "
+          << h_0_.shape_string();
+    }
+    top[1]->Reshape(shape);
+    top[2]->Reshape(shape);
+  }
+  shape.resize(2);
+  shape[0] = N_;
+  shape[1] = 4 * hidden_dim_;
+  static_gates_.Reshape(shape);
+  vector<int> multiplier_shape(1, T_ * N_);
+  bias_multiplier_.Reshape(multiplier_shape);
+  caffe_set(bias_multiplier_.count(), Dtype(1),
+            bias_multiplier_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::Reset() {
+  caffe_set(h_T_.count(), Dtype(0), h_T_.mutable_cpu_data());
+  caffe_set(c_T_.count(), Dtype(0), c_T_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const int gate_dim = 4 * hidden_dim_;
+  const int step = N_ * hidden_dim_;
+  if (expose_hidden_) {
+    const int bottom_offset = 2 + static_input_;
+    h_0_.CopyFrom(*bottom[bottom_offset]);
+    c_0_.CopyFrom(*bottom[bottom_offset + 1]);
+  } else {
+    h_0_.CopyFrom(h_T_);
+    c_0_.CopyFrom(c_T_);
+  }
+
+  // Input projection of all timesteps: W_xc * x_t + b_c.
+  Dtype* gates = gates_.mutable_cpu_data();
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T_ * N_, gate_dim, 1,
+      Dtype(1), bias_multiplier_.cpu_data(), this->blobs_[1]->cpu_data(),
+      Dtype(0), gates);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, T_ * N_, gate_dim,
+      input_dim_, Dtype(1), bottom[0]->cpu_data(),
+      this->blobs_[0]->cpu_data(), Dtype(1), gates);
+  if (static_input_) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N_, gate_dim,
+        static_dim_, Dtype(1), bottom[2]->cpu_data(),
+        this->blobs_[2]->cpu_data(), Dtype(0),
+        static_gates_.mutable_cpu_data());
+  }
+
+  const Dtype* W_hc = this->blobs_[2 + static_input_]->cpu_data();
+  const Dtype* cont = bottom[1]->cpu_data();
+  Dtype* h = top[0]->mutable_cpu_data();
+  Dtype* c = cell_.mutable_cpu_data();
+  Dtype* h_conted = h_conted_.mutable_cpu_data();
+  for (int t = 0; t < T_; ++t) {
+    const Dtype* h_prev = t ? h + (t - 1) * step : h_0_.cpu_data();
+    const Dtype* c_prev = t ? c + (t - 1) * step : c_0_.cpu_data();
+    Dtype* gates_t = gates + t * N_ * gate_dim;
+    Dtype* h_conted_t = h_conted + t * step;
+    for (int n = 0; n < N_; ++n) {
+      caffe_cpu_scale(hidden_dim_, cont[t * N_ + n],
+          h_prev + n * hidden_dim_, h_conted_t + n * hidden_dim_);
+    }
+    if (static_input_) {
+      caffe_axpy(N_ * gate_dim, Dtype(1), static_gates_.cpu_data(), gates_t);
+    }
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N_, gate_dim,
+        hidden_dim_, Dtype(1), h_conted_t, W_hc, Dtype(1), gates_t);
+    lstm_step_forward(N_, hidden_dim_, cont + t * N_, c_prev, gates_t,
+        c + t * step, h + t * step);
+  }
+
+  caffe_copy(step, h + (T_ - 1) * step, h_T_.mutable_cpu_data());
+  caffe_copy(step, c + (T_ - 1) * step, c_T_.mutable_cpu_data());
+  if (expose_hidden_) {
+    top[1]->CopyFrom(h_T_);
+    top[2]->CopyFrom(c_T_);
+  }
+}
+
+template <typename Dtype>
+void FusedLSTMLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!propagate_down[1]) << "Cannot backpropagate to sequence indicators.";
+  const int gate_dim = 4 * hidden_dim_;
+  const int step = N_ * hidden_dim_;
+  const Dtype* W_hc = this->blobs_[2 + static_input_]->cpu_data();
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* gates = gates_.cpu_data();
+  const Dtype* c = cell_.cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* gates_diff = gates_.mutable_cpu_diff();
+  // Gradients flowing back from the following timestep; as in LSTMLayer,
+  // none arrives from the next batch.
+  Dtype* h_diff = h_0_.mutable_cpu_diff();
+  Dtype* c_diff = c_0_.mutable_cpu_diff();
+  caffe_set(step, Dtype(0), h_diff);
+  caffe_set(step, Dtype(0), c_diff);
+  for (int t = T_ - 1; t >= 0; --t) {
+    const Dtype* c_prev = t ? c + (t - 1) * step : c_0_.cpu_data();
+    Dtype* gates_diff_t = gates_diff + t * N_ * gate_dim;
+    lstm_step_backward(N_, hidden_dim_, c_prev, gates + t * N_ * gate_dim,
+        c + t * step, top_diff + t * step, h_diff, c_diff, gates_diff_t);
+    if (t > 0) {
+      // h_diff := cont_t * (W_hc' * gates_diff_t)
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N_, hidden_dim_,
+          gate_dim, Dtype(1), gates_diff_t, W_hc, Dtype(0), h_diff);
+      for (int n = 0; n < N_; ++n) {
+        caffe_scal(hidden_dim_, cont[t * N_ + n], h_diff + n * hidden_dim_);
+      }
+    }
+  }
+
+  // Gradients w.r.t. the parameters, summed over all timesteps.
+  if (this->param_propagate_down_[0]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, gate_dim, input_dim_,
+        T_ * N_, Dtype(1), gates_diff, bottom[0]->cpu_data(), Dtype(1),
+        this->blobs_[0]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[1]) {
+    caffe_cpu_gemv<Dtype>(CblasTrans, T_ * N_, gate_dim, Dtype(1),
+        gates_diff, bias_multiplier_.cpu_data(), Dtype(1),
+        this->blobs_[1]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[2 + static_input_]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, gate_dim, hidden_dim_,
+        T_ * N_, Dtype(1), gates_diff, h_conted_.cpu_data(), Dtype(1),
+        this->blobs_[2 + static_input_]->mutable_cpu_diff());
+  }
+  if (static_input_) {
+    // The static input contributes to every timestep.
+    Dtype* static_gates_diff = static_gates_.mutable_cpu_diff();
+    caffe_cpu_gemv<Dtype>(CblasTrans, T_, N_ * gate_dim, Dtype(1),
+        gates_diff, bias_multiplier_.cpu_data(), Dtype(0), static_gates_diff);
+    if (this->param_propagate_down_[2]) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, gate_dim, static_dim_,
+          N_, Dtype(1), static_gates_diff, bottom[2]->cpu_data(), Dtype(1),
+          this->blobs_[2]->mutable_cpu_diff());
+    }
+    if (propagate_down[2]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N_, static_dim_,
+          gate_dim, Dtype(1), static_gates_diff, this->blobs_[2]->cpu_data(),
+          Dtype(0), bottom[2]->mutable_cpu_diff());
+    }
+  }
+  if (propagate_down[0]) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T_ * N_, input_dim_,
+        gate_dim, Dtype(1), gates_diff, this->blobs_[0]->cpu_data(),
+        Dtype(0), bottom[0]->mutable_cpu_diff());
+  }
+}
+
+INSTANTIATE_CLASS(FusedLSTMLayer);
+
+}  // namespace caffe
@@ -0,0 +1,724 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "caffe/engine_parser.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/fused_neuron_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Elements per tile: every operation of the chain runs over a tile before
+// the next tile is loaded, so the intermediate values stay in L1.
+const int kForwardTile = 1024;
+const int kBackwardTile = 256;
+
+template <typename Dtype>
+FusedNeuronOp<Dtype> ParseNeuronOp(const LayerParameter& param) {
+  FusedNeuronOp<Dtype> op;
+  op.a = 0;
+  op.b = 0;
+  op.c = 0;
+  op.scale_blob = -1;
+  op.shift_blob = -1;
+  op.scale = NULL;
+  op.shift = NULL;
+  op.channels = 0;
+  op.inner_dim = 0;
+  const string& type = param.type();
+  if (type == "ReLU") {
+    op.type = FusedNeuronOp<Dtype>::RELU;
+    op.a = param.relu_param().negative_slope();
+  } else if (type == "Sigmoid") {
+    op.type = FusedNeuronOp<Dtype>::SIGMOID;
+  } else if (type == "TanH") {
+    op.type = FusedNeuronOp<Dtype>::TANH;
+  } else if (type == "AbsVal") {
+    op.type = FusedNeuronOp<Dtype>::ABSVAL;
+  } else if (type == "Power") {
+    op.type = FusedNeuronOp<Dtype>::POWER;
+    op.a = param.power_param().power();
+    op.b = param.power_param().scale();
+    op.c = param.power_param().shift();
+  } else if (type == "Exp") {
+    // Same coefficients as ExpLayer::LayerSetUp.
+    const Dtype base = param.exp_param().base();
+    if (base != Dtype(-1)) {
+      CHECK_GT(base, 0) << "base must be strictly positive.";
+    }
+    const Dtype log_base = (base == Dtype(-1)) ? Dtype(1) : log(base);
+    const Dtype input_scale = param.exp_param().scale();
+    const Dtype input_shift = param.exp_param().shift();
+    op.type = FusedNeuronOp<Dtype>::EXP;
+    op.a = log_base * input_scale;
+    op.b = (input_shift == Dtype(0)) ? Dtype(1) :
+        ((base != Dtype(-1)) ? pow(base, input_shift) : exp(input_shift));
+  } else if (type == "Log") {
+    // Same coefficients as LogLayer::LayerSetUp.
+    const Dtype base = param.log_param().base();
+    if (base != Dtype(-1)) {
+      CHECK_GT(base, 0) << "base must be strictly positive.";
+    }
+    const Dtype log_base = (base == Dtype(-1)) ? Dtype(1) : log(base);
+    CHECK(!std::isnan(log_base))
+        << "NaN result: log(base) = log(" << base << ") = " << log_base;
+    CHECK(!std::isinf(log_base))
+        << "Inf result: log(base) = log(" << base << ") = " << log_base;
+    op.type = FusedNeuronOp<Dtype>::LOG;
+    op.a = param.log_param().scale();
+    op.b = param.log_param().shift();
+    op.c = Dtype(1) / log_base;
+  } else if (type == "BNLL") {
+    op.type = FusedNeuronOp<Dtype>::BNLL;
+  } else if (type == "ELU") {
+    op.type = FusedNeuronOp<Dtype>::ELU;
+    op.a = param.elu_param().alpha();
+  } else if (type == "Scale" || type == "Bias") {
+    // The coefficients are blobs, assigned by FusedNeuronLayer::LayerSetUp.
+    op.type = FusedNeuronOp<Dtype>::SCALE;
+  } else {
+    LOG(FATAL) << "Layer " << param.name() << " of type " << type
+        << " cannot be fused.";
+  }
+  return op;
+}
+
+// y = op(x) for the n elements starting at offset of the blob; x and y may
+// alias.
+template <typename Dtype>
+void NeuronOpForward(const FusedNeuronOp<Dtype>& op, const int offset,
+    const int n, const Dtype* x, Dtype* y) {
+  switch (op.type) {
+  case FusedNeuronOp<Dtype>::RELU:
+    for (int i = 0; i < n; ++i) {
+      y[i] = std::max(x[i], Dtype(0)) + op.a * std::min(x[i], Dtype(0));
+    }
+    break;
+  case FusedNeuronOp<Dtype>::SIGMOID:
+    for (int i = 0; i < n; ++i) {
+      y[i] = 0.5 * tanh(0.5 * x[i]) + 0.5;
+    }
+    break;
+  case FusedNeuronOp<Dtype>::TANH:
+    for (int i = 0; i < n; ++i) {
+      y[i] = tanh(x[i]);
+    }
+    break;
+  case FusedNeuronOp<Dtype>::ABSVAL:
+    for (int i = 0; i < n; ++i) {
+      y[i] = std::abs(x[i]);
+    }
+    break;
+  case FusedNeuronOp<Dtype>::POWER:
+    if (op.a == Dtype(1)) {
+      for (int i = 0; i < n; ++i) {
+        y[i] = op.b * x[i] + op.c;
+      }
+    } else if (op.a == Dtype(2)) {
+      for (int i = 0; i < n; ++i) {
+        const Dtype t = op.b * x[i] + op.c;
+        y[i] = t * t;
+      }
+    } else {
+      for (int i = 0; i < n; ++i) {
+        y[i] = pow(op.b * x[i] + op.c, op.a);
+      }
+    }
+    break;
+  case FusedNeuronOp<Dtype>::EXP:
+    for (int i = 0; i < n; ++i) {
+      y[i] = op.b * exp(op.a * x[i]);
+    }
+    break;
+  case FusedNeuronOp<Dtype>::LOG:
+    for (int i = 0; i < n; ++i) {
+      y[i] = op.c * log(op.a * x[i] + op.b);
+    }
+    break;
+  case FusedNeuronOp<Dtype>::BNLL:
+    for (int i = 0; i < n; ++i) {
+      y[i] = x[i] > 0 ? x[i] + log(1. + exp(-x[i])) : log(1. + exp(x[i]));
+    }
+    break;
+  case FusedNeuronOp<Dtype>::ELU:
+    for (int i = 0; i < n; ++i) {
+      y[i] = std::max(x[i], Dtype(0)) +
+          op.a * (exp(std::min(x[i], Dtype(0))) - Dtype(1));
+    }
+    break;
+  case FusedNeuronOp<Dtype>::SCALE:
+    // In runs of elements of the same channel.
+    for (int i = 0; i < n;) {
+      const int channel = (offset + i) / op.inner_dim % op.channels;
+      const int end = i + std::min(n - i,
+          op.inner_dim - (offset + i) % op.inner_dim);
+      const Dtype scale = op.scale ? op.scale[channel] : Dtype(1);
+      const Dtype shift = op.shift ? op.shift[channel] : Dtype(0);
+      for (; i < end; ++i) {
+        y[i] = scale * x[i] + shift;
+      }
+    }
+    break;
+  }
+}
+
+// g *= dy/dx, given the input x and output y of op for the n elements
+// starting at offset of the blob. For SCALE, the diffs of the coefficients
+// are added to scale_diff and shift_diff unless they are NULL.
+template <typename Dtype>
+void NeuronOpBackward(const FusedNeuronOp<Dtype>& op, const int offset,
+    const int n, const Dtype* x, const Dtype* y, Dtype* g,
+    Dtype* scale_diff, Dtype* shift_diff) {
+  switch (op.type) {
+  case FusedNeuronOp<Dtype>::RELU:
+    for (int i = 0; i < n; ++i) {
+      g[i] *= (x[i] > 0) + op.a * (x[i] <= 0);
+    }
+    break;
+  case FusedNeuronOp<Dtype>::SIGMOID:
+    for (int i = 0; i < n; ++i) {
+      g[i] *= y[i] * (1. - y[i]);
+    }
+    break;
+  case FusedNeuronOp<Dtype>::TANH:
+    for (int i = 0; i < n; ++i) {
+      g[i] *= 1 - y[i] * y[i];
+    }
+    break;
+  case FusedNeuronOp<Dtype>::ABSVAL:
+    for (int i = 0; i < n; ++i) {
+      g[i] *= (Dtype(0) < x[i]) - (x[i] < Dtype(0));
+    }
+    break;
+  case FusedNeuronOp<Dtype>::POWER:
+    if (op.a == Dtype(0) || op.b == Dtype(0)) {
+      std::fill(g, g + n, Dtype(0));
+    } else if (op.a == Dtype(1)) {
+      for (int i = 0; i < n; ++i) {
+        g[i] *= op.b;
+      }
+    } else if (op.a == Dtype(2)) {
+      for (int i = 0; i < n; ++i) {
+        g[i] *= 2 * op.b * (op.b * x[i] + op.c);
+      }
+    } else {
+      for (int i = 0; i < n; ++i) {
+        g[i] *= op.a * op.b * pow(op.b * x[i] + op.c, op.a - 1);
+      }
+    }
+    break;
+  case FusedNeuronOp<Dtype>::EXP:
+    for (int i = 0; i < n; ++i) {
+      g[i] *= y[i] * op.a;
+    }
+    break;
+  case FusedNeuronOp<Dtype>::LOG:
+    for (int i = 0; i < n; ++i) {
+      g[i] *= op.a * op.c / (op.a * x[i] + op.b);
+    }
+    break;
+  case FusedNeuronOp<Dtype>::BNLL:
+    for (int i = 0; i < n; ++i) {
+      const Dtype e = exp(std::min(x[i], Dtype(50)));
+      g[i] *= e / (e + 1.);
+    }
+    break;
+  case FusedNeuronOp<Dtype>::ELU:
+    for (int i = 0; i < n; ++i) {
+      g[i] *= x[i] > 0 ? Dtype(1) : y[i] + op.a;
+    }
+    break;
+  case FusedNeuronOp<Dtype>::SCALE:
+    for (int i = 0; i < n;) {
+      const int channel = (offset + i) / op.inner_dim % op.channels;
+      const int end = i + std::min(n - i,
+          op.inner_dim - (offset + i) % op.inner_dim);
+      const Dtype scale = op.scale ? op.scale[channel] : Dtype(1);
+      Dtype scale_sum = 0;
+      Dtype shift_sum = 0;
+      for (; i < end; ++i) {
+        scale_sum += g[i] * x[i];
+        shift_sum += g[i];
+        g[i] *= scale;
+      }
+      if (scale_diff) {
+        scale_diff[channel] += scale_sum;
+      }
+      if (shift_diff) {
+        shift_diff[channel] += shift_sum;
+      }
+    }
+    break;
+  }
+}
+
+template <typename Dtype>
+void NeuronChainForward(const vector<FusedNeuronOp<Dtype> >& ops,
+    const int offset, const int n, const Dtype* x, Dtype* y) {
+  NeuronOpForward(ops[0], offset, n, x, y);
+  for (int k = 1; k < ops.size(); ++k) {
+    NeuronOpForward(ops[k], offset, n, y, y);
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+FusedNeuronCodeGenerator<Dtype>::FusedNeuronCodeGenerator() {
+  Callback = NULL;
+  Generated = false;
+}
+
+template <typename Dtype>
+FusedNeuronCodeGenerator<Dtype>::~FusedNeuronCodeGenerator() {}
+
+template <typename Dtype>
+typename FusedNeuronCodeGenerator<Dtype>::Callback_t*
+    FusedNeuronCodeGenerator<Dtype>::Get_callback(
+  const vector<FusedNeuronOp<Dtype> >& ops) {
+  if (!Generated) {
+    Create_callback(ops);
+    Generated = true;
+  }
+  return Callback;
+}
+
+template <typename Dtype>
+void FusedNeuronCodeGenerator<Dtype>::Create_callback(
+  const vector<FusedNeuronOp<Dtype> >& ops) {
+  Callback = NULL;
+}
+
+#if defined __x86_64__ || defined _M_X64
+template <>
+void FusedNeuronCodeGenerator<float>::Create_callback(
+  const vector<FusedNeuronOp<float> >& ops) {
+  using Xbyak::util::Cpu;
+  using Xbyak::Ymm;
+  typedef FusedNeuronOp<float> Op;
+
+  Callback = NULL;
+  Cpu Current_cpu;
+  if (!Current_cpu.has(Cpu::tAVX)) {
+    return;
+  }
+
+  // The operands of the chain are broadcast to ymm2..ymm13 once; ymm14
+  // holds the AbsVal mask and ymm15 zero. Other operations keep the C++
+  // implementation.
+  const int kFirstOperand = 2;
+  const int kMaxOperands = 12;
+  Constants.clear();
+  vector<int> operand(ops.size(), 0);
+  bool use_abs_mask = false;
+  for (int k = 0; k < ops.size(); ++k) {
+    operand[k] = kFirstOperand + Constants.size();
+    switch (ops[k].type) {
+    case Op::RELU:
+      Constants.push_back(ops[k].a);
+      break;
+    case Op::ABSVAL:
+      use_abs_mask = true;
+      break;
+    case Op::POWER:
+      if (ops[k].a != 1.f && ops[k].a != 2.f) {
+        return;
+      }
+      Constants.push_back(ops[k].b);
+      Constants.push_back(ops[k].c);
+      break;
+    default:
+      return;
+    }
+  }
+  if (Constants.size() > kMaxOperands) {
+    return;
+  }
+  const int num_operands = Constants.size();
+  if (use_abs_mask) {
+    const uint32_t abs_mask = 0x7fffffff;
+    float abs_mask_value;
+    memcpy(&abs_mask_value, &abs_mask, sizeof(abs_mask_value));
+    Constants.push_back(abs_mask_value);
+  }
+
+  if (Generated) {
+    reset();
+  }
+
+  const Xbyak::Reg64& reg_bottom = rdi;
+  const Xbyak::Reg64& reg_top = rsi;
+  const Xbyak::Reg64& reg_blocks = rdx;
+  const Xbyak::Reg64& reg_constants = rax;
+  const Ymm value = ymm0;
+  const Ymm temp = ymm1;
+  const Ymm abs_mask = ymm14;
+  const Ymm zero = ymm15;
+
+  if (!Constants.empty()) {
+    mov(reg_constants, reinterpret_cast<size_t>(&Constants[0]));
+  }
+  for (int c = 0; c < num_operands; ++c) {
+    vbroadcastss(Ymm(kFirstOperand + c), dword[reg_constants + 4 * c]);
+  }
+  if (use_abs_mask) {
+    vbroadcastss(abs_mask, dword[reg_constants + 4 * num_operands]);
+  }
+  vxorps(zero, zero, zero);
+
+  Xbyak::Label loop, done;
+  test(reg_blocks, reg_blocks);
+  jz(done, T_NEAR);
+  L(loop);
+  vmovups(value, ptr[reg_bottom]);
+  for (int k = 0; k < ops.size(); ++k) {
+    switch (ops[k].type) {
+    case Op::RELU:
+      if (ops[k].a == 0.f) {
+        vmaxps(value, value, zero);
+      } else {
+        vminps(temp, value, zero);
+        vmaxps(value, value, zero);
+        vmulps(temp, temp, Ymm(operand[k]));
+        vaddps(value, value, temp);
+      }
+      break;
+    case Op::ABSVAL:
+      vandps(value, value, abs_mask);
+      break;
+    case Op::POWER:
+      if (ops[k].b != 1.f) {
+        vmulps(value, value, Ymm(operand[k]));
+      }
+      if (ops[k].c != 0.f) {
+        vaddps(value, value, Ymm(operand[k] + 1));
+      }
+      if (ops[k].a == 2.f) {
+        vmulps(value, value, value);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  vmovups(ptr[reg_top], value);
+  add(reg_bottom, kBlock * sizeof(float));
+  add(reg_top, kBlock * sizeof(float));
+  dec(reg_blocks);
+  jnz(loop, T_NEAR);
+  L(done);
+  vzeroupper();
+  ret();
+
+  Callback = getCode<Callback_t*>();
+}
+#endif
+
+template <typename Dtype>
+const int FusedNeuronLayer<Dtype>::kMaxOps;
+
+template <typename Dtype>
+bool FusedNeuronLayer<Dtype>::CanFuse(const LayerParameter& param) {
+  if (param.bottom_size() != 1 || param.top_size() != 1 ||
+      param.loss_weight_size() > 0 ||
+      param.param_size() > NumParamBlobs(param) ||
+      param.blobs_size() > 0 || param.propagate_down_size() > 0) {
+    return false;
+  }
+  // Layers of the other engines keep their own implementation.
+  if (param.engine() != "" && !EngineParser(param.engine()).isEngine("CAFFE")) {
+    return false;
+  }
+  const string& type = param.type();
+  if (type == "ReLU") {
+    return param.relu_param().engine() == ReLUParameter_Engine_DEFAULT ||
+        param.relu_param().engine() == ReLUParameter_Engine_CAFFE;
+  }
+  if (type == "Sigmoid") {
+    return param.sigmoid_param().engine() == SigmoidParameter_Engine_DEFAULT ||
+        param.sigmoid_param().engine() == SigmoidParameter_Engine_CAFFE;
+  }
+  if (type == "TanH") {
+    return param.tanh_param().engine() == TanHParameter_Engine_DEFAULT ||
+        param.tanh_param().engine() == TanHParameter_Engine_CAFFE;
+  }
+  // Only one coefficient per channel, as after a convolution or BatchNorm.
+  if (type == "Scale") {
+    return param.scale_param().axis() == 1 &&
+        param.scale_param().num_axes() == 1;
+  }
+  if (type == "Bias") {
+    return param.bias_param().axis() == 1 &&
+        param.bias_param().num_axes() == 1;
+  }
+  return type == "AbsVal" || type == "Power" || type == "Exp" ||
+      type == "Log" || type == "BNLL" || type == "ELU";
+}
+
+template <typename Dtype>
+int FusedNeuronLayer<Dtype>::NumParamBlobs(const LayerParameter& param) {
+  if (param.type() == "Scale") {
+    return param.scale_param().bias_term() ? 2 : 1;
+  }
+  return param.type() == "Bias" ? 1 : 0;
+}
+
+template <typename Dtype>
+void FusedNeuronLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const FusedNeuronParameter& fused_param =
+      this->layer_param_.fused_neuron_param();
+  CHECK_GT(fused_param.layer_size(), 0) << "Nothing to fuse.";
+  CHECK_LE(fused_param.layer_size(), kMaxOps)
+      << "At most " << kMaxOps << " layers can be fused.";
+  const bool init_params = this->blobs_.empty();
+  int num_blobs = 0;
+  ops_.clear();
+  for (int i = 0; i < fused_param.layer_size(); ++i) {
+    const LayerParameter& layer_param = fused_param.layer(i);
+    FusedNeuronOp<Dtype> op = ParseNeuronOp<Dtype>(layer_param);
+    if (op.type == FusedNeuronOp<Dtype>::SCALE) {
+      CHECK_GE(bottom[0]->num_axes(), 2)
+          << layer_param.type() << " layer " << layer_param.name()
+          << " needs a channel axis.";
+      // Fillers as in ScaleLayer and BiasLayer.
+      vector<FillerParameter> fillers;
+      if (layer_param.type() == "Scale") {
+        op.scale_blob = num_blobs++;
+        FillerParameter filler_param(layer_param.scale_param().filler());
+        if (!layer_param.scale_param().has_filler()) {
+          filler_param.set_type("constant");
+          filler_param.set_value(1);
+        }
+        fillers.push_back(filler_param);
+        if (layer_param.scale_param().bias_term()) {
+          op.shift_blob = num_blobs++;
+          fillers.push_back(layer_param.scale_param().bias_filler());
+        }
+      } else {
+        op.shift_blob = num_blobs++;
+        fillers.push_back(layer_param.bias_param().filler());
+      }
+      for (int j = 0; init_params && j < fillers.size(); ++j) {
+        const vector<int> shape(1, bottom[0]->shape(1));
+        this->blobs_.push_back(
+            shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+        shared_ptr<Filler<Dtype> > filler(GetFiller<Dtype>(fillers[j]));
+        filler->Fill(this->blobs_.back().get());
+      }
+    }
+    ops_.push_back(op);
+  }
+  if (!init_params) {
+    LOG(INFO) << "Skipping parameter initialization";
+    CHECK_EQ(this->blobs_.size(), num_blobs)
+        << "Incorrect number of weight blobs.";
+  }
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+  forward_code_ = code_generator_.Get_callback(ops_);
+}
+
+template <typename Dtype>
+void FusedNeuronLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  NeuronLayer<Dtype>::Reshape(bottom, top);
+  for (int k = 0; k < ops_.size(); ++k) {
+    FusedNeuronOp<Dtype>& op = ops_[k];
+    if (op.type != FusedNeuronOp<Dtype>::SCALE) {
+      continue;
+    }
+    op.channels = bottom[0]->shape(1);
+    op.inner_dim = bottom[0]->count(2);
+    const int blob = op.scale_blob >= 0 ? op.scale_blob : op.shift_blob;
+    CHECK_EQ(this->blobs_[blob]->count(), op.channels)
+        << "The coefficients of " << this->layer_param_.name()
+        << " do not match the channels of its input.";
+  }
+  if (bottom[0] == top[0] && need_backward_) {
+    bottom_copy_.ReshapeLike(*bottom[0]);
+  }
+}
+
+template <typename Dtype>
+void FusedNeuronLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const int count = bottom[0]->count();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  for (int k = 0; k < ops_.size(); ++k) {
+    FusedNeuronOp<Dtype>& op = ops_[k];
+    op.scale = op.scale_blob >= 0 ?
+        this->blobs_[op.scale_blob]->cpu_data() : NULL;
+    op.shift = op.shift_blob >= 0 ?
+        this->blobs_[op.shift_blob]->cpu_data() : NULL;
+  }
+  // Backward needs the input, which an in-place forward overwrites.
+  Dtype* bottom_copy = (bottom[0] == top[0] && need_backward_) ?
+      bottom_copy_.mutable_cpu_data() : NULL;
+  const int num_tiles = (count + kForwardTile - 1) / kForwardTile;
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int tile = 0; tile < num_tiles; ++tile) {
+    const int start = tile * kForwardTile;
+    const int n = std::min(kForwardTile, count - start);
+    if (bottom_copy) {
+      std::copy(bottom_data + start, bottom_data + start + n,
+                bottom_copy + start);
+    }
+    int done = 0;
+    if (forward_code_) {
+      const int blocks = n / FusedNeuronCodeGenerator<Dtype>::kBlock;
+      forward_code_(bottom_data + start, top_data + start, blocks);
+      done = blocks * FusedNeuronCodeGenerator<Dtype>::kBlock;
+    }
+    if (done < n) {
+      NeuronChainForward(ops_, start + done, n - done,
+                         bottom_data + start + done, top_data + start + done);
+    }
+  }
+}
+
+template <typename Dtype>
+void FusedNeuronLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  // Where the diffs of each blob start in the per-thread sums, or -1 for
+  // blobs that need none.
+  vector<int> diff_offset(this->blobs_.size(), -1);
+  int num_diffs = 0;
+  for (int i = 0; i < this->blobs_.size(); ++i) {
+    if (this->param_propagate_down(i)) {
+      diff_offset[i] = num_diffs;
+      num_diffs += this->blobs_[i]->count();
+    }
+  }
+  if (!propagate_down[0] && num_diffs == 0) {
+    return;
+  }
+  CHECK(bottom[0] != top[0] || need_backward_)
+      << "In-place " << this->type() << " " << this->layer_param_.name()
+      << " did not keep its input for backward.";
+  const int count = bottom[0]->count();
+  const Dtype* bottom_data = (bottom[0] == top[0]) ?
+      bottom_copy_.cpu_data() : bottom[0]->cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff =
+      propagate_down[0] ? bottom[0]->mutable_cpu_diff() : NULL;
+  const int num_ops = ops_.size();
+  for (int k = 0; k < num_ops; ++k) {
+    FusedNeuronOp<Dtype>& op = ops_[k];
+    op.scale = op.scale_blob >= 0 ?
+        this->blobs_[op.scale_blob]->cpu_data() : NULL;
+    op.shift = op.shift_blob >= 0 ?
+        this->blobs_[op.shift_blob]->cpu_data() : NULL;
+  }
+#ifdef _OPENMP
+  const int num_threads = omp_get_max_threads();
+#else
+  const int num_threads = 1;
+#endif
+  param_diff_buffer_.assign(num_threads * num_diffs, Dtype(0));
+  const int num_tiles = (count + kBackwardTile - 1) / kBackwardTile;
+#ifdef _OPENMP
+  #pragma omp parallel num_threads(num_threads)
+#endif
+  {
+#ifdef _OPENMP
+    Dtype* diffs = param_diff_buffer_.data() + omp_get_thread_num() * num_diffs;
+    #pragma omp for
+#else
+    Dtype* diffs = param_diff_buffer_.data();
+#endif
+    for (int tile = 0; tile < num_tiles; ++tile) {
+      // The outputs of every operation are recomputed for the tile, then the
+      // diff is propagated through the chain in reverse.
+      Dtype values[kMaxOps][kBackwardTile];
+      Dtype grad[kBackwardTile];
+      const int start = tile * kBackwardTile;
+      const int n = std::min(kBackwardTile, count - start);
+      const Dtype* x = bottom_data + start;
+      NeuronOpForward(ops_[0], start, n, x, values[0]);
+      for (int k = 1; k < num_ops; ++k) {
+        NeuronOpForward(ops_[k], start, n, values[k - 1], values[k]);
+      }
+      std::copy(top_diff + start, top_diff + start + n, grad);
+      for (int k = num_ops - 1; k >= 0; --k) {
+        const FusedNeuronOp<Dtype>& op = ops_[k];
+        Dtype* scale_diff = (op.scale_blob >= 0 &&
+            diff_offset[op.scale_blob] >= 0) ?
+            diffs + diff_offset[op.scale_blob] : NULL;
+        Dtype* shift_diff = (op.shift_blob >= 0 &&
+            diff_offset[op.shift_blob] >= 0) ?
+            diffs + diff_offset[op.shift_blob] : NULL;
+        NeuronOpBackward(op, start, n, k > 0 ? values[k - 1] : x, values[k],
+                         grad, scale_diff, shift_diff);
+      }
+      if (bottom_diff) {
+        std::copy(grad, grad + n, bottom_diff + start);
+      }
+    }
+  }
+  for (int i = 0; i < this->blobs_.size(); ++i) {
+    if (diff_offset[i] < 0) {
+      continue;
+    }
+    Dtype* blob_diff = this->blobs_[i]->mutable_cpu_diff();
+    for (int t = 0; t < num_threads; ++t) {
+      caffe_axpy(this->blobs_[i]->count(), Dtype(1),
+          param_diff_buffer_.data() + t * num_diffs + diff_offset[i],
+          blob_diff);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(FusedNeuronCodeGenerator);
+INSTANTIATE_CLASS(FusedNeuronLayer);
+REGISTER_LAYER_CLASS(FusedNeuron);
+
+}  // namespace caffe
@@ -65,6 +65,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int new_height = this->layer_param_.image_data_param().new_height();
   const int new_width  = this->layer_param_.image_data_param().new_width();
   const bool is_color  = this->layer_param_.image_data_param().is_color();
+  const bool reduced_decode =
+      this->layer_param_.image_data_param().reduced_decode();
   string root_folder = this->layer_param_.image_data_param().root_folder();
 
   CHECK((new_height == 0 && new_width == 0) ||
@@ -105,7 +107,7 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   // Read an image, and use it to initialize the top blob.
   cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-                                    new_height, new_width, is_color);
+      new_height, new_width, is_color, reduced_decode);
   CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
   // Use data_transformer to infer the expected blob shape from a cv_image.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
@@ -114,8 +116,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.image_data_param().batch_size();
   CHECK_GT(batch_size, 0) << "Positive batch size required";
   top_shape[0] = batch_size;
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   top[0]->Reshape(top_shape);
 
@@ -125,8 +127,8 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // label
   vector<int> label_shape(1, batch_size);
   top[1]->Reshape(label_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].label_.Reshape(label_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->label_.Reshape(label_shape);
   }
 }
 
@@ -151,16 +153,23 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   const int new_height = image_data_param.new_height();
   const int new_width = image_data_param.new_width();
   const bool is_color = image_data_param.is_color();
+  const bool reduced_decode = image_data_param.reduced_decode();
   string root_folder = image_data_param.root_folder();
 
   // Reshape according to the first image of each batch
   // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-  // Use data_transformer to infer the expected blob shape from a cv_img.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
-  this->transformed_data_.Reshape(top_shape);
+  // That takes decoding it on its own, which is not needed when the resize
+  // or the crop fix the shape.
+  if ((new_height == 0 || new_width == 0) &&
+      this->layer_param_.transform_param().crop_size() == 0) {
+    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
+        new_height, new_width, is_color);
+    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
+    // Use data_transformer to infer the expected blob shape from a cv_img.
+    this->transformed_data_.Reshape(
+        this->data_transformer_->InferBlobShape(cv_img));
+  }
+  vector<int> top_shape = this->transformed_data_.shape();
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
@@ -171,6 +180,13 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   // datum scales
   const int lines_size = lines_.size();
 
+  // Have the OS read the files of the next batch while this one decodes.
+  if (image_data_param.readahead()) {
+    for (int i = batch_size; i < 2 * batch_size; ++i) {
+      ReadFileAhead(root_folder + lines_[(lines_id_ + i) % lines_size].first);
+    }
+  }
+
 #ifdef _OPENMP
   #pragma omp parallel if (batch_size > 1)
   #pragma omp single nowait
@@ -181,7 +197,7 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     CHECK_GT(lines_size, lines_id_);
 #ifndef _OPENMP
     cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
+        new_height, new_width, is_color, reduced_decode);
     CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
     read_time += timer.MicroSeconds();
     timer.Start();
@@ -203,7 +219,7 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
                                                     precalculated_rand_numbers)
     {
         cv::Mat cv_img = ReadImageToCVMat(root_folder + img_file_name,
-            new_height, new_width, is_color);
+            new_height, new_width, is_color, reduced_decode);
         CHECK(cv_img.data) << "Could not load " << img_file_name;
 
         Blob<Dtype> tmp_data;
@@ -228,6 +244,7 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   }
 
   batch_timer.Stop();
+  batch->read_time_ = read_time;
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
@@ -35,6 +35,8 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/lrn_layer.hpp"
@@ -45,6 +47,78 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace caffe {
 
+namespace {
+
+// Spatial positions handled together by the fused CPU kernels; the running
+// window sums of a tile stay in L1 and the inner loops vectorize over it.
+const int kLRNTile = 64;
+
+// out[i] = in[i] * s[i]^-beta. The exponents used in practice avoid the
+// exp/log pair of pow so that the loops stay vectorized.
+template <typename Dtype>
+inline void scale_by_negative_power(const int n, const Dtype* in,
+    const Dtype* s, const Dtype beta, Dtype* out) {
+  if (beta == Dtype(0.75)) {
+    for (int i = 0; i < n; ++i) {
+      const Dtype root = std::sqrt(s[i]);
+      out[i] = in[i] / (root * std::sqrt(root));
+    }
+  } else if (beta == Dtype(0.5)) {
+    for (int i = 0; i < n; ++i) {
+      out[i] = in[i] / std::sqrt(s[i]);
+    }
+  } else if (beta == Dtype(1)) {
+    for (int i = 0; i < n; ++i) {
+      out[i] = in[i] / s[i];
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      out[i] = in[i] * std::pow(s[i], -beta);
+    }
+  }
+}
+
+// Sums in over the (2 * half + 1)^2 window around each position of a
+// height x width plane, clipped to the plane: running sums along the rows
+// into rows, then along the columns into out, a whole row at a time.
+template <typename Dtype>
+void box_sum_plane(const int height, const int width, const int half,
+    const Dtype* in, Dtype* rows, Dtype* out) {
+  for (int h = 0; h < height; ++h) {
+    const Dtype* in_row = in + h * width;
+    Dtype* row = rows + h * width;
+    Dtype sum = 0;
+    for (int w = 0; w < std::min(half, width); ++w) {
+      sum += in_row[w];
+    }
+    for (int w = 0; w < width; ++w) {
+      if (w + half < width) { sum += in_row[w + half]; }
+      if (w - half - 1 >= 0) { sum -= in_row[w - half - 1]; }
+      row[w] = sum;
+    }
+  }
+  caffe_set(width, Dtype(0), out);
+  for (int h = 0; h < std::min(half, height); ++h) {
+    caffe_axpy(width, Dtype(1), rows + h * width, out);
+  }
+  for (int h = 0; h < height; ++h) {
+    Dtype* out_row = out + h * width;
+    if (h > 0) {
+      caffe_copy(width, out_row - width, out_row);
+    }
+    if (h + half < height) {
+      const Dtype* add = rows + (h + half) * width;
+      for (int w = 0; w < width; ++w) { out_row[w] += add[w]; }
+    }
+    if (h - half - 1 >= 0) {
+      const Dtype* sub = rows + (h - half - 1) * width;
+      for (int w = 0; w < width; ++w) { out_row[w] -= sub[w]; }
+    }
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -54,6 +128,9 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   alpha_ = this->layer_param_.lrn_param().alpha();
   beta_ = this->layer_param_.lrn_param().beta();
   k_ = this->layer_param_.lrn_param().k();
+#ifndef CPU_ONLY
+  // The CPU computes WITHIN_CHANNEL normalization in one fused pass; the
+  // GPU composes it from a split/square/pool/power/product sub-net.
   if (this->layer_param_.lrn_param().norm_region() ==
       LRNParameter_NormRegion_WITHIN_CHANNEL) {
     // Set up split_layer_ to use inputs in the numerator and denominator.
@@ -103,6 +180,7 @@ void LRNLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     product_layer_.reset(new EltwiseLayer<Dtype>(product_param));
     product_layer_->SetUp(product_bottom_vec_, top);
   }
+#endif
 }
 
 template <typename Dtype>
@@ -114,31 +192,19 @@ void LRNLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   channels_ = bottom[0]->channels();
   height_ = bottom[0]->height();
   width_ = bottom[0]->width();
-  //  ---- openmp ----
-  num_of_threads_ = 1;
-#ifdef _OPENMP
-  num_of_threads_ = omp_get_max_threads() < num_ ? omp_get_max_threads() : num_;
-  if (num_of_threads_ < 1) {
-     LOG(WARNING) << "LRN layer: omp_get_max_threads() =" << num_of_threads_;
-     num_of_threads_ = 1;
-  }
-#endif
-  switch (this->layer_param_.lrn_param().norm_region()) {
-  case LRNParameter_NormRegion_ACROSS_CHANNELS:
-    top[0]->Reshape(num_, channels_, height_, width_);
-    scale_.Reshape(num_, channels_, height_, width_);
-    padded_ratio_.Reshape(num_of_threads_, channels_ + size_ - 1,
-                          height_, width_);
-    accum_ratio_.Reshape(num_of_threads_, 1, height_, width_);
-    break;
-  case LRNParameter_NormRegion_WITHIN_CHANNEL:
+  top[0]->Reshape(num_, channels_, height_, width_);
+  // scale_ keeps the denominators for backward in both modes.
+  scale_.Reshape(num_, channels_, height_, width_);
+#ifndef CPU_ONLY
+  if (this->layer_param_.lrn_param().norm_region() ==
+      LRNParameter_NormRegion_WITHIN_CHANNEL) {
     split_layer_->Reshape(bottom, split_top_vec_);
     square_layer_->Reshape(square_bottom_vec_, square_top_vec_);
     pool_layer_->Reshape(square_top_vec_, pool_top_vec_);
     power_layer_->Reshape(pool_top_vec_, power_top_vec_);
     product_layer_->Reshape(product_bottom_vec_, top);
-    break;
   }
+#endif
 }
 
 template <typename Dtype>
@@ -149,7 +215,7 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     CrossChannelForward_cpu(bottom, top);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelForward(bottom, top);
+    WithinChannelForward_cpu(bottom, top);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -162,28 +228,79 @@ void LRNLayer<Dtype>::CrossChannelForward_cpu(
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   Dtype* scale_data = scale_.mutable_cpu_data();
-  Dtype alpha_over_size = alpha_ / size_;
-
-  caffe_sqr(num_ * channels_ * height_ * width_, bottom_data, top_data);
-  caffe_set(num_ * channels_ * height_ * width_, Dtype(k_), scale_data);
+  const Dtype alpha_over_size = alpha_ / size_;
+  const int spatial_dim = height_ * width_;
+  const int tiles = (spatial_dim + kLRNTile - 1) / kLRNTile;
 
+  // Slide the channel window: each step adds the square of the channel
+  // entering it and subtracts the one leaving it.
 #ifdef _OPENMP
 #pragma omp parallel for collapse(2)
 #endif
-  for (int n = 0; n < num_; n++) {
-    for (int c = 0; c < channels_; c++) {
-      for (int i = c - pre_pad_; i <= c + pre_pad_; i++) {
-        if ((i >= 0) && (i < channels_)) {
-          caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-            top_data + scale_.offset(n, i),
-            scale_data + scale_.offset(n, c));
+  for (int n = 0; n < num_; ++n) {
+    for (int t = 0; t < tiles; ++t) {
+      const int begin = t * kLRNTile;
+      const int len = std::min(kLRNTile, spatial_dim - begin);
+      const int offset = scale_.offset(n) + begin;
+      Dtype sum[kLRNTile];
+      for (int i = 0; i < len; ++i) { sum[i] = 0; }
+      for (int c = 0; c < std::min(pre_pad_, channels_); ++c) {
+        const Dtype* x = bottom_data + offset + c * spatial_dim;
+        for (int i = 0; i < len; ++i) { sum[i] += x[i] * x[i]; }
+      }
+      for (int c = 0; c < channels_; ++c) {
+        if (c + pre_pad_ < channels_) {
+          const Dtype* x = bottom_data + offset + (c + pre_pad_) * spatial_dim;
+          for (int i = 0; i < len; ++i) { sum[i] += x[i] * x[i]; }
+        }
+        if (c - pre_pad_ - 1 >= 0) {
+          const Dtype* x =
+              bottom_data + offset + (c - pre_pad_ - 1) * spatial_dim;
+          for (int i = 0; i < len; ++i) { sum[i] -= x[i] * x[i]; }
+        }
+        Dtype* scale = scale_data + offset + c * spatial_dim;
+        for (int i = 0; i < len; ++i) {
+          scale[i] = k_ + alpha_over_size * sum[i];
         }
+        scale_by_negative_power(len, bottom_data + offset + c * spatial_dim,
+            scale, beta_, top_data + offset + c * spatial_dim);
       }
     }
   }
+}
 
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelForward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  Dtype* scale_data = scale_.mutable_cpu_data();
+  const Dtype alpha_over_size = alpha_ / (size_ * size_);
+  const int spatial_dim = height_ * width_;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    vector<Dtype> squares(spatial_dim);
+    vector<Dtype> rows(spatial_dim);
+#ifdef _OPENMP
+#pragma omp for collapse(2)
+#endif
+    for (int n = 0; n < num_; ++n) {
+      for (int c = 0; c < channels_; ++c) {
+        const int offset = scale_.offset(n, c);
+        const Dtype* x = bottom_data + offset;
+        Dtype* scale = scale_data + offset;
+        caffe_sqr(spatial_dim, x, &squares[0]);
+        box_sum_plane(height_, width_, pre_pad_, &squares[0], &rows[0], scale);
+        for (int i = 0; i < spatial_dim; ++i) {
+          scale[i] = Dtype(1) + alpha_over_size * scale[i];
+        }
+        scale_by_negative_power(spatial_dim, x, scale, beta_,
+            top_data + offset);
+      }
+    }
+  }
 }
 
 template <typename Dtype>
@@ -204,7 +321,7 @@ void LRNLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     CrossChannelBackward_cpu(top, propagate_down, bottom);
     break;
   case LRNParameter_NormRegion_WITHIN_CHANNEL:
-    WithinChannelBackward(top, propagate_down, bottom);
+    WithinChannelBackward_cpu(top, propagate_down, bottom);
     break;
   default:
     LOG(FATAL) << "Unknown normalization region.";
@@ -220,66 +337,95 @@ void LRNLayer<Dtype>::CrossChannelBackward_cpu(
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* scale_data = scale_.cpu_data();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  Dtype* padded_ratio_data = padded_ratio_.mutable_cpu_data();
-  Dtype* accum_ratio_data = accum_ratio_.mutable_cpu_data();
-  // We hack a little bit by using the diff() to store an additional result
-  Dtype* accum_ratio_times_bottom = accum_ratio_.mutable_cpu_diff();
-  caffe_set(padded_ratio_.count(), Dtype(0), padded_ratio_data);
-  Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
+  const Dtype cache_ratio_value = 2. * alpha_ * beta_ / size_;
+  const int spatial_dim = height_ * width_;
+  const int tiles = (spatial_dim + kLRNTile - 1) / kLRNTile;
 
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, bottom_diff);
-  caffe_mul<Dtype>(scale_.count(), top_diff, bottom_diff, bottom_diff);
+  // bottom_diff_c = top_diff_c * s_c^-beta
+  //     - cache_ratio_value * x_c * sum_{|j - c| <= pre_pad} ratio_j,
+  // with ratio_j = top_diff_j * y_j / s_j summed by a sliding window like
+  // the forward pass.
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2)
+#endif
+  for (int n = 0; n < num_; ++n) {
+    for (int t = 0; t < tiles; ++t) {
+      const int begin = t * kLRNTile;
+      const int len = std::min(kLRNTile, spatial_dim - begin);
+      const int offset = scale_.offset(n) + begin;
+      Dtype accum[kLRNTile];
+      for (int i = 0; i < len; ++i) { accum[i] = 0; }
+      for (int c = 0; c < std::min(pre_pad_, channels_); ++c) {
+        const int o = offset + c * spatial_dim;
+        for (int i = 0; i < len; ++i) {
+          accum[i] += top_diff[o + i] * top_data[o + i] / scale_data[o + i];
+        }
+      }
+      for (int c = 0; c < channels_; ++c) {
+        if (c + pre_pad_ < channels_) {
+          const int o = offset + (c + pre_pad_) * spatial_dim;
+          for (int i = 0; i < len; ++i) {
+            accum[i] += top_diff[o + i] * top_data[o + i] / scale_data[o + i];
+          }
+        }
+        if (c - pre_pad_ - 1 >= 0) {
+          const int o = offset + (c - pre_pad_ - 1) * spatial_dim;
+          for (int i = 0; i < len; ++i) {
+            accum[i] -= top_diff[o + i] * top_data[o + i] / scale_data[o + i];
+          }
+        }
+        const int o = offset + c * spatial_dim;
+        scale_by_negative_power(len, top_diff + o, scale_data + o, beta_,
+            bottom_diff + o);
+        for (int i = 0; i < len; ++i) {
+          bottom_diff[o + i] -=
+              cache_ratio_value * bottom_data[o + i] * accum[i];
+        }
+      }
+    }
+  }
+}
 
-  // go through individual data
-  int inverse_pre_pad = size_ - (size_ + 1) / 2;
+template <typename Dtype>
+void LRNLayer<Dtype>::WithinChannelBackward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    const vector<Blob<Dtype>*>& bottom) {
+  if (!propagate_down[0]) { return; }
+  const Dtype* top_diff = top[0]->cpu_diff();
+  const Dtype* top_data = top[0]->cpu_data();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype* scale_data = scale_.cpu_data();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  const Dtype cache_ratio_value = 2. * alpha_ * beta_ / (size_ * size_);
+  const int spatial_dim = height_ * width_;
 #ifdef _OPENMP
-    #pragma omp parallel for num_threads(this->num_of_threads_)
+#pragma omp parallel
 #endif
-    for (int n = 0; n < num_; ++n) {
-      int tid = 0;
+  {
+    vector<Dtype> ratio(spatial_dim);
+    vector<Dtype> rows(spatial_dim);
+    vector<Dtype> accum(spatial_dim);
 #ifdef _OPENMP
-      tid = omp_get_thread_num();
+#pragma omp for collapse(2)
 #endif
-      int block_offset = scale_.offset(n);
-      // first, compute diff_i * y_i / s_i
-      caffe_mul<Dtype>(channels_ * height_ * width_,
-          top_diff + block_offset,
-          top_data + block_offset,
-          padded_ratio_data + padded_ratio_.offset(tid, inverse_pre_pad));
-      caffe_div<Dtype>(channels_ * height_ * width_,
-          padded_ratio_data + padded_ratio_.offset(tid, inverse_pre_pad),
-          scale_data + block_offset,
-          padded_ratio_data + padded_ratio_.offset(tid, inverse_pre_pad));
-      // Now, compute the accumulated ratios and the bottom diff
-      caffe_set(height_*width_,
-                Dtype(0),
-                accum_ratio_data + accum_ratio_.offset(tid, 0));
-      for (int c = 0; c < size_ - 1; ++c) {
-        caffe_add<Dtype>(height_ * width_,
-                          accum_ratio_data + accum_ratio_.offset(tid, 0),
-                          padded_ratio_data + padded_ratio_.offset(tid, c),
-                          accum_ratio_data + accum_ratio_.offset(tid, 0));
-      }
+    for (int n = 0; n < num_; ++n) {
       for (int c = 0; c < channels_; ++c) {
-        caffe_add<Dtype>(height_ * width_,
-            accum_ratio_data + accum_ratio_.offset(tid, 0),
-            padded_ratio_data + padded_ratio_.offset(tid, c + size_ - 1),
-            accum_ratio_data + accum_ratio_.offset(tid, 0));
-        // compute bottom diff
-        caffe_mul<Dtype>(height_ * width_,
-                         bottom_data + top[0]->offset(n, c),
-                         accum_ratio_data + accum_ratio_.offset(tid, 0),
-                         accum_ratio_times_bottom +
-                         accum_ratio_.offset(tid, 0));
-        caffe_axpy<Dtype>(height_ * width_, -cache_ratio_value,
-            accum_ratio_times_bottom + accum_ratio_.offset(tid, 0),
-            bottom_diff + top[0]->offset(n, c));
-        caffe_sub<Dtype>(height_ * width_,
-            accum_ratio_data + accum_ratio_.offset(tid, 0),
-            padded_ratio_data + padded_ratio_.offset(tid, c),
-            accum_ratio_data + accum_ratio_.offset(tid, 0));
+        const int offset = scale_.offset(n, c);
+        for (int i = 0; i < spatial_dim; ++i) {
+          ratio[i] = top_diff[offset + i] * top_data[offset + i] /
+              scale_data[offset + i];
+        }
+        box_sum_plane(height_, width_, pre_pad_, &ratio[0], &rows[0],
+            &accum[0]);
+        scale_by_negative_power(spatial_dim, top_diff + offset,
+            scale_data + offset, beta_, bottom_diff + offset);
+        for (int i = 0; i < spatial_dim; ++i) {
+          bottom_diff[offset + i] -=
+              cache_ratio_value * bottom_data[offset + i] * accum[i];
+        }
       }
     }
+  }
 }
 
 template <typename Dtype>
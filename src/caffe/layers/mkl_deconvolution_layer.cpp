@@ -412,7 +412,7 @@ void MKLDeconvolutionLayer<Dtype>::Forward_cpu(
       Dtype* top_data = top[0]->mutable_cpu_data();
 
 #ifdef _OPENMP
-#   pragma omp parallel for num_threads(this->num_of_threads_)
+#   pragma omp parallel for num_threads(this->group_threads())
 #endif
       for (int n = 0; n < this->num_; ++n) {
           this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
@@ -36,6 +36,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <map>
 #include <utility>
 #include <vector>
@@ -46,6 +48,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace caffe {
 
+namespace {
+
+bool SortLossIndexDescend(const pair<float, int>& pair1,
+                          const pair<float, int>& pair2) {
+  return pair1.first > pair2.first ||
+      (pair1.first == pair2.first && pair1.second < pair2.second);
+}
+
+}  // namespace
+
 template <typename Dtype>
 void MultiBoxLossLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -164,6 +176,12 @@ void MultiBoxLossLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   } else {
     LOG(FATAL) << "Unknown confidence loss type.";
   }
+  flat_matching_ = share_location_ &&
+      multibox_loss_param.use_prior_for_matching() &&
+      mining_type_ != MultiBoxLossParameter_MiningType_HARD_EXAMPLE &&
+      !(multibox_loss_param.has_nms_param() &&
+        multibox_loss_param.nms_param().nms_threshold() > 0) &&
+      conf_loss_type_ == MultiBoxLossParameter_ConfLossType_SOFTMAX;
 }
 
 template <typename Dtype>
@@ -219,34 +237,44 @@ void MultiBoxLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* prior_data = bottom[2]->cpu_data();
   const Dtype* gt_data = bottom[3]->cpu_data();
 
-  // Retrieve all ground truth.
   map<int, vector<NormalizedBBox> > all_gt_bboxes;
-  GetGroundTruth(gt_data, num_gt_, background_label_id_, use_difficult_gt_,
-                 &all_gt_bboxes);
-
-  // Retrieve all prior bboxes. It is same within a batch since we assume all
-  // images in a batch are of same dimension.
-  vector<NormalizedBBox> prior_bboxes;
-  vector<vector<float> > prior_variances;
-  GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes, &prior_variances);
-
-  // Retrieve all predictions.
+  const vector<NormalizedBBox>& prior_bboxes = cached_prior_bboxes_;
+  const vector<vector<float> >& prior_variances = cached_prior_variances_;
   vector<LabelBBox> all_loc_preds;
-  GetLocPredictions(loc_data, num_, num_priors_, loc_classes_, share_location_,
-                    &all_loc_preds);
-
-  // Find matches between source bboxes and ground truth bboxes.
-  vector<map<int, vector<float> > > all_match_overlaps;
-  FindMatches(all_loc_preds, all_gt_bboxes, prior_bboxes, prior_variances,
-              multibox_loss_param_, &all_match_overlaps, &all_match_indices_);
-
-  num_matches_ = 0;
   int num_negs = 0;
-  // Sample hard negative (and positive) examples based on mining type.
-  MineHardExamples(*bottom[1], all_loc_preds, all_gt_bboxes, prior_bboxes,
-                   prior_variances, all_match_overlaps, multibox_loss_param_,
-                   &num_matches_, &num_negs, &all_match_indices_,
-                   &all_neg_indices_);
+  if (flat_matching_) {
+    FlatMatch(bottom, &num_negs);
+  } else {
+    // Retrieve all ground truth.
+    GetGroundTruth(gt_data, num_gt_, background_label_id_, use_difficult_gt_,
+                   &all_gt_bboxes);
+
+    // Retrieve all prior bboxes. It is same within a batch since we assume
+    // all images in a batch are of same dimension.
+    if (PriorsChanged(prior_data, num_priors_, &last_prior_data_)) {
+      GetPriorBBoxes(prior_data, num_priors_, &cached_prior_bboxes_,
+                     &cached_prior_variances_);
+    }
+
+    // Retrieve all predictions.
+    GetLocPredictions(loc_data, num_, num_priors_, loc_classes_,
+                      share_location_, &all_loc_preds);
+
+    // Find matches between source bboxes and ground truth bboxes.
+    all_match_indices_.clear();
+    all_neg_indices_.clear();
+    vector<map<int, vector<float> > > all_match_overlaps;
+    FindMatches(all_loc_preds, all_gt_bboxes, prior_bboxes, prior_variances,
+                multibox_loss_param_, &all_match_overlaps,
+                &all_match_indices_);
+
+    num_matches_ = 0;
+    // Sample hard negative (and positive) examples based on mining type.
+    MineHardExamples(*bottom[1], all_loc_preds, all_gt_bboxes, prior_bboxes,
+                     prior_variances, all_match_overlaps, multibox_loss_param_,
+                     &num_matches_, &num_negs, &all_match_indices_,
+                     &all_neg_indices_);
+  }
 
   if (num_matches_ >= 1) {
     // Form data to pass on to loc_loss_layer_.
@@ -257,9 +285,13 @@ void MultiBoxLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     loc_gt_.Reshape(loc_shape);
     Dtype* loc_pred_data = loc_pred_.mutable_cpu_data();
     Dtype* loc_gt_data = loc_gt_.mutable_cpu_data();
-    EncodeLocPrediction(all_loc_preds, all_gt_bboxes, all_match_indices_,
-                        prior_bboxes, prior_variances, multibox_loss_param_,
-                        loc_pred_data, loc_gt_data);
+    if (flat_matching_) {
+      FlatEncodeLocPrediction(loc_data, loc_pred_data, loc_gt_data);
+    } else {
+      EncodeLocPrediction(all_loc_preds, all_gt_bboxes, all_match_indices_,
+                          prior_bboxes, prior_variances, multibox_loss_param_,
+                          loc_pred_data, loc_gt_data);
+    }
     {PERFORMANCE_MEASUREMENT_BEGIN();
     loc_loss_layer_->Reshape(loc_bottom_vec_, loc_top_vec_);
     loc_loss_layer_->Forward(loc_bottom_vec_, loc_top_vec_);
@@ -300,9 +332,13 @@ void MultiBoxLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     Dtype* conf_pred_data = conf_pred_.mutable_cpu_data();
     Dtype* conf_gt_data = conf_gt_.mutable_cpu_data();
     caffe_set(conf_gt_.count(), Dtype(background_label_id_), conf_gt_data);
-    EncodeConfPrediction(conf_data, num_, num_priors_, multibox_loss_param_,
-                         all_match_indices_, all_neg_indices_, all_gt_bboxes,
-                         conf_pred_data, conf_gt_data);
+    if (flat_matching_) {
+      FlatEncodeConfPrediction(conf_data, conf_pred_data, conf_gt_data);
+    } else {
+      EncodeConfPrediction(conf_data, num_, num_priors_, multibox_loss_param_,
+                           all_match_indices_, all_neg_indices_,
+                           all_gt_bboxes, conf_pred_data, conf_gt_data);
+    }
     {PERFORMANCE_MEASUREMENT_BEGIN();
     conf_loss_layer_->Reshape(conf_bottom_vec_, conf_top_vec_);
     conf_loss_layer_->Forward(conf_bottom_vec_, conf_top_vec_);
@@ -321,6 +357,268 @@ void MultiBoxLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+template <typename Dtype>
+void MultiBoxLossLayer<Dtype>::FlatMatch(const vector<Blob<Dtype>*>& bottom,
+    int* num_negs) {
+  const Dtype* conf_data = bottom[1]->cpu_data();
+  const Dtype* prior_data = bottom[2]->cpu_data();
+  const Dtype* gt_data = bottom[3]->cpu_data();
+
+  // Priors and ground truth are rounded to float as in GetPriorBBoxes and
+  // GetGroundTruth, so that the overlaps are the same.
+  if (PriorsChanged(prior_data, num_priors_, &last_prior_data_)) {
+    prior_bboxes_.resize(num_priors_ * 4);
+    prior_sizes_.resize(num_priors_);
+    prior_variances_.resize(num_priors_ * 4);
+    for (int p = 0; p < num_priors_; ++p) {
+      float bbox[4];
+      for (int k = 0; k < 4; ++k) {
+        bbox[k] = prior_data[p * 4 + k];
+        prior_bboxes_[k * num_priors_ + p] = bbox[k];
+        prior_variances_[p * 4 + k] = prior_data[(num_priors_ + p) * 4 + k];
+      }
+      prior_sizes_[p] = BBoxSize(bbox);
+    }
+  }
+
+  // Group the ground truth by image, keeping their order.
+  gt_offsets_.assign(num_ + 1, 0);
+  vector<int> gt_item(num_gt_, -1);
+  for (int g = 0; g < num_gt_; ++g) {
+    const Dtype* gt = gt_data + g * 8;
+    const int item_id = gt[0];
+    if (item_id == -1) {
+      continue;
+    }
+    const int label = gt[1];
+    CHECK_NE(background_label_id_, label)
+        << "Found background label in the dataset.";
+    const bool difficult = static_cast<bool>(gt[7]);
+    if ((!use_difficult_gt_ && difficult) || item_id < 0 || item_id >= num_) {
+      continue;
+    }
+    gt_item[g] = item_id;
+    ++gt_offsets_[item_id + 1];
+  }
+  for (int i = 0; i < num_; ++i) {
+    gt_offsets_[i + 1] += gt_offsets_[i];
+  }
+  gt_bboxes_.resize(gt_offsets_[num_] * 4);
+  gt_sizes_.resize(gt_offsets_[num_]);
+  gt_labels_.resize(gt_offsets_[num_]);
+  vector<int> gt_next(gt_offsets_.begin(), gt_offsets_.end() - 1);
+  for (int g = 0; g < num_gt_; ++g) {
+    if (gt_item[g] == -1) {
+      continue;
+    }
+    const Dtype* gt = gt_data + g * 8;
+    const int n = gt_next[gt_item[g]]++;
+    for (int k = 0; k < 4; ++k) {
+      gt_bboxes_[n * 4 + k] = gt[3 + k];
+    }
+    gt_sizes_[n] = BBoxSize(&gt_bboxes_[n * 4]);
+    gt_labels_[n] = gt[1];
+  }
+
+  all_match_indices_.clear();
+  all_match_indices_.resize(num_);
+  all_neg_indices_.clear();
+  all_neg_indices_.resize(num_);
+  vector<int> num_negs_per_image(num_, 0);
+  match_offsets_.assign(num_ + 1, 0);
+  const MultiBoxLossParameter& param = multibox_loss_param_;
+  const bool max_negative =
+      mining_type_ == MultiBoxLossParameter_MiningType_MAX_NEGATIVE;
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic)
+#endif
+  for (int i = 0; i < num_; ++i) {
+    const int num_gt = gt_offsets_[i + 1] - gt_offsets_[i];
+    if (num_gt == 0) {
+      // There is no gt for current image. No matches and no negatives.
+      continue;
+    }
+    vector<int>& match_index = all_match_indices_[i][-1];
+    match_index.resize(num_priors_);
+    vector<float> match_overlaps(num_priors_);
+    vector<float> overlaps;
+    MatchBBox(&gt_bboxes_[gt_offsets_[i] * 4], &gt_sizes_[gt_offsets_[i]],
+              num_gt, &prior_bboxes_[0], &prior_sizes_[0], num_priors_,
+              param.match_type(), param.overlap_threshold(),
+              param.ignore_cross_boundary_bbox(), &overlaps, &match_index[0],
+              &match_overlaps[0]);
+    int num_pos = 0;
+    for (int m = 0; m < num_priors_; ++m) {
+      num_pos += match_index[m] > -1;
+    }
+    match_offsets_[i + 1] = num_pos;
+    if (!max_negative) {
+      continue;
+    }
+
+    // Softmax loss of the unmatched priors against the background, as in
+    // ComputeConfLoss.
+    const float neg_overlap = param.neg_overlap();
+    const Dtype* image_conf_data = conf_data + i * num_priors_ * num_classes_;
+    vector<pair<float, int> > loss_indices;
+    for (int m = 0; m < num_priors_; ++m) {
+      if (match_index[m] != -1 || match_overlaps[m] >= neg_overlap) {
+        continue;
+      }
+      const Dtype* scores = image_conf_data + m * num_classes_;
+      Dtype maxval = scores[0];
+      for (int c = 1; c < num_classes_; ++c) {
+        maxval = std::max<Dtype>(scores[c], maxval);
+      }
+      Dtype sum = 0.;
+      for (int c = 0; c < num_classes_; ++c) {
+        sum += std::exp(scores[c] - maxval);
+      }
+      Dtype prob = std::exp(scores[background_label_id_] - maxval) / sum;
+      Dtype loss = -log(std::max(prob, Dtype(FLT_MIN)));
+      loss_indices.push_back(std::make_pair(static_cast<float>(loss), m));
+    }
+    // Select the largest losses; ties go to the lower prior index.
+    const int num_sel = std::min(
+        static_cast<int>(num_pos * param.neg_pos_ratio()),
+        static_cast<int>(loss_indices.size()));
+    std::nth_element(loss_indices.begin(), loss_indices.begin() + num_sel,
+                     loss_indices.end(), SortLossIndexDescend);
+    vector<int>& neg_indices = all_neg_indices_[i];
+    neg_indices.resize(num_sel);
+    for (int n = 0; n < num_sel; ++n) {
+      neg_indices[n] = loss_indices[n].second;
+    }
+    std::sort(neg_indices.begin(), neg_indices.end());
+    num_negs_per_image[i] = num_sel;
+  }
+
+  conf_offsets_.assign(num_ + 1, 0);
+  *num_negs = 0;
+  for (int i = 0; i < num_; ++i) {
+    conf_offsets_[i + 1] =
+        conf_offsets_[i] + match_offsets_[i + 1] + num_negs_per_image[i];
+    match_offsets_[i + 1] += match_offsets_[i];
+    *num_negs += num_negs_per_image[i];
+  }
+  num_matches_ = match_offsets_[num_];
+}
+
+template <typename Dtype>
+void MultiBoxLossLayer<Dtype>::FlatEncodeLocPrediction(const Dtype* loc_data,
+    Dtype* loc_pred_data, Dtype* loc_gt_data) {
+  const CodeType code_type = multibox_loss_param_.code_type();
+  const bool encode_variance_in_target =
+      multibox_loss_param_.encode_variance_in_target();
+  const bool bp_inside = multibox_loss_param_.bp_inside();
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < num_; ++i) {
+    if (all_match_indices_[i].empty()) {
+      continue;
+    }
+    const vector<int>& match_index = all_match_indices_[i].begin()->second;
+    const Dtype* image_loc_data = loc_data + i * num_priors_ * 4;
+    int count = match_offsets_[i];
+    NormalizedBBox prior_bbox, gt_bbox, gt_encode;
+    vector<float> prior_variance(4);
+    for (int j = 0; j < num_priors_; ++j) {
+      if (match_index[j] <= -1) {
+        continue;
+      }
+      const float* gt = &gt_bboxes_[(gt_offsets_[i] + match_index[j]) * 4];
+      gt_bbox.set_xmin(gt[0]);
+      gt_bbox.set_ymin(gt[1]);
+      gt_bbox.set_xmax(gt[2]);
+      gt_bbox.set_ymax(gt[3]);
+      prior_bbox.set_xmin(prior_bboxes_[j]);
+      prior_bbox.set_ymin(prior_bboxes_[num_priors_ + j]);
+      prior_bbox.set_xmax(prior_bboxes_[2 * num_priors_ + j]);
+      prior_bbox.set_ymax(prior_bboxes_[3 * num_priors_ + j]);
+      std::copy(&prior_variances_[j * 4], &prior_variances_[j * 4] + 4,
+                prior_variance.begin());
+      EncodeBBox(prior_bbox, prior_variance, code_type,
+                 encode_variance_in_target, gt_bbox, &gt_encode);
+      const float encoded[4] = {gt_encode.xmin(), gt_encode.ymin(),
+                                gt_encode.xmax(), gt_encode.ymax()};
+      for (int k = 0; k < 4; ++k) {
+        loc_gt_data[count * 4 + k] = encoded[k];
+        // Predictions pass through NormalizedBBox in EncodeLocPrediction.
+        loc_pred_data[count * 4 + k] =
+            static_cast<float>(image_loc_data[j * 4 + k]);
+        if (bp_inside) {
+          // When a dimension of the prior is outside of image region, use
+          // gt_encode to simulate zero gradient.
+          const float coord = prior_bboxes_[k * num_priors_ + j];
+          if (coord < 0 || coord > 1) {
+            loc_pred_data[count * 4 + k] = encoded[k];
+          }
+        }
+        if (encode_variance_in_target) {
+          CHECK_GT(prior_variance[k], 0);
+          loc_pred_data[count * 4 + k] /= prior_variance[k];
+          loc_gt_data[count * 4 + k] /= prior_variance[k];
+        }
+      }
+      ++count;
+    }
+  }
+}
+
+template <typename Dtype>
+void MultiBoxLossLayer<Dtype>::FlatEncodeConfPrediction(
+    const Dtype* conf_data, Dtype* conf_pred_data, Dtype* conf_gt_data) {
+  const bool map_object_to_agnostic =
+      multibox_loss_param_.map_object_to_agnostic();
+  if (map_object_to_agnostic) {
+    if (background_label_id_ >= 0) {
+      CHECK_EQ(num_classes_, 2);
+    } else {
+      CHECK_EQ(num_classes_, 1);
+    }
+  }
+#ifdef _OPENMP
+  #pragma omp parallel for
+#endif
+  for (int i = 0; i < num_; ++i) {
+    if (all_match_indices_[i].empty()) {
+      continue;
+    }
+    const vector<int>& match_index = all_match_indices_[i].begin()->second;
+    const Dtype* image_conf_data = conf_data + i * num_priors_ * num_classes_;
+    int count = conf_offsets_[i];
+    for (int j = 0; j < num_priors_; ++j) {
+      if (match_index[j] <= -1) {
+        continue;
+      }
+      const int gt_label = map_object_to_agnostic ? background_label_id_ + 1 :
+          gt_labels_[gt_offsets_[i] + match_index[j]];
+      if (do_neg_mining_) {
+        // Copy scores for matched bboxes.
+        conf_gt_data[count] = gt_label;
+        std::copy(image_conf_data + j * num_classes_,
+                  image_conf_data + (j + 1) * num_classes_,
+                  conf_pred_data + count * num_classes_);
+        ++count;
+      } else {
+        conf_gt_data[i * num_priors_ + j] = gt_label;
+      }
+    }
+    if (do_neg_mining_) {
+      // Save negative bboxes scores and labels.
+      const vector<int>& neg_indices = all_neg_indices_[i];
+      for (int n = 0; n < neg_indices.size(); ++n) {
+        conf_gt_data[count] = background_label_id_;
+        std::copy(image_conf_data + neg_indices[n] * num_classes_,
+                  image_conf_data + (neg_indices[n] + 1) * num_classes_,
+                  conf_pred_data + count * num_classes_);
+        ++count;
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void MultiBoxLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
@@ -333,7 +333,10 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   } else if (num_spatial_axes_ == 3) {
       /* Process 3D Pooling */
       int* kernel_shape_data = kernel_shape_.mutable_cpu_data();
-      const int* input_shape_data = this->input_shape_.cpu_data();
+      int* input_shape_data = this->input_shape_.mutable_cpu_data();
+      for (int i = 0; i < num_spatial_axes_ + 1; ++i) {
+        input_shape_data[i] = bottom[0]->shape(channel_axis_ + i);
+      }
       if (global_pooling_) {
         for (int i = 0; i < num_spatial_axes_; ++i) {
           kernel_shape_data[i] = input_shape_data[i + 1];
@@ -403,8 +406,7 @@ void PoolingLayer<Dtype>::Forward_cpu(
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
 
-  if (num_spatial_axes_ == 2) {
-      /* Process 2D Pooling */
+  if (num_spatial_axes_ == 2 || num_spatial_axes_ == 3) {
       typename PoolingCodeGeneratorForward<Dtype>::Callback_t* generator_func =
                Forward_code_generator.Get_callback(this, top[0], use_top_mask);
       // We are getting top_mask here as mutable_cpu_data is not thread safe
@@ -416,8 +418,8 @@ void PoolingLayer<Dtype>::Forward_cpu(
                                 static_cast<void*>(max_idx_.mutable_cpu_data());
       }
 
-      const int batch_size = bottom[0]->num();
-      const int num_channels = bottom[0]->channels();
+      const int batch_size = num_;
+      const int num_channels = channels_;
 
 #ifdef _OPENMP
       #pragma omp parallel for collapse(2)
@@ -434,159 +436,9 @@ void PoolingLayer<Dtype>::Forward_cpu(
                          channel+1,
                          this,
                          use_top_mask);
-  } else if (num_spatial_axes_ == 3) {
-      // Process 3D Pooling
-      vector<int> offset(2, 0);
-      offset[1] = 1;
-
-      const int* kernel_shape = kernel_shape_.cpu_data();
-      const int* pad_data = this->pad_.cpu_data();
-      const int* stride_data = this->stride_.cpu_data();
-      const int* input_shape_data = this->input_shape_.cpu_data();
-      const int* output_shape_data = this->output_shape_.cpu_data();
-
-      long bottom_offset = bottom[0]->offset(offset);
-      long top_offset = top[0]->offset(offset);
-
-      // Different pooling methods. We explicitly do the switch outside the for
-      // loop to save time, although this results in more code.
-      switch (this->layer_param_.pooling_param().pool()) {
-      case PoolingParameter_PoolMethod_MAX:
-        if (use_top_mask) {
-          caffe_set(top_count, Dtype(-1), top[1]->mutable_cpu_data());
-        } else {
-          caffe_set(top_count, -1, max_idx_.mutable_cpu_data());
-        }
-        caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-
-        // LOG(INFO) << num_ << " " << " channel:" << channels_;
-        // LOG(INFO) << "output_shape_data: " << output_shape_data[0]
-        //    << " " << output_shape_data[1] << " " << output_shape_data[2];
-
-        // LOG(INFO) << "input_shape_data: " << input_shape_data[0]
-        //    << " " << input_shape_data[1] << " " << input_shape_data[2];
-
-        // LOG(INFO) << "kernel_shape: " << kernel_shape[0]
-        //    << " " << kernel_shape[1] << " " << kernel_shape[2];
-
-        // LOG(INFO) << "stride_data: " << stride_data[0]
-        //    << " " << stride_data[1] << " "  <<stride_data[2];
-
-        // LOG(INFO) << "pad_data: " << pad_data[0]
-        //    << " " << pad_data[1] << " " << pad_data[2];
-
-#ifdef _OPENMP
-        #pragma omp parallel for collapse(2)
-#endif
-        for (int n = 0; n < num_; ++n) {
-          for (int c = 0; c < channels_; ++c) {
-            long nc = n * channels_ + c;
-            const Dtype *bottom_data2 = bottom[0]->cpu_data() + nc * bottom_offset;
-            Dtype *top_data2 = top[0]->mutable_cpu_data() + nc * top_offset;
-            Dtype *top_mask = NULL;
-            int *mask = NULL;
-            if (use_top_mask) {
-              top_mask = top[1]->mutable_cpu_data() + nc * top_offset;
-            } else {
-              mask = max_idx_.mutable_cpu_data() + nc * top_offset;
-            }
-
-            for (int pz = 0; pz < output_shape_data[0]; ++pz) {
-              for (int ph = 0; ph < output_shape_data[1]; ++ph) {
-                for (int pw = 0; pw < output_shape_data[2]; ++pw) {
-                    int zstart = pz * stride_data[0] - pad_data[0];
-                    int hstart = ph * stride_data[1] - pad_data[1];
-                    int wstart = pw * stride_data[2] - pad_data[2];
-
-                    int zend = min(zstart + kernel_shape[0], input_shape_data[1]);
-                    int hend = min(hstart + kernel_shape[1], input_shape_data[2]);
-                    int wend = min(wstart + kernel_shape[2], input_shape_data[3]);
-
-                    hstart = max(hstart, 0);
-                    wstart = max(wstart, 0);
-                    zstart = max(zstart, 0);
-                    const int pool_index = (pz * output_shape_data[1] + ph) * output_shape_data[2] + pw;
-                    for (int z = zstart; z < zend; ++z) {
-                      for (int h = hstart; h < hend; ++h) {
-                        for (int w = wstart; w < wend; ++w) {
-                          const int index = (z * input_shape_data[2] + h) * input_shape_data[3] + w;
-                          if (bottom_data2[index] > top_data2[pool_index]) {
-                            top_data2[pool_index] = bottom_data2[index];
-                            if (use_top_mask) {
-                              top_mask[pool_index] = static_cast<Dtype>(index);
-                            } else {
-                              mask[pool_index] = index;
-                            }
-                          }
-                        }
-                      }
-                    }
-                }
-              }
-            }
-          }
-        }
-        break;
-      case PoolingParameter_PoolMethod_AVE:
-        caffe_set(top_count, Dtype(0), top_data);
-#ifdef _OPENMP
-        #pragma omp parallel for collapse(2)
-#endif
-        for (int n = 0; n < num_; ++n) {
-          for (int c = 0; c < channels_; ++c) {
-            long nc = n * channels_ + c;
-            const Dtype *bottom_data2 = bottom[0]->cpu_data() + nc * bottom_offset;
-            Dtype *top_data2 = top[0]->mutable_cpu_data() + nc * top_offset;
-
-            for (int pz = 0; pz < output_shape_data[0]; ++pz) {
-              for (int ph = 0; ph < output_shape_data[1]; ++ph) {
-                for (int pw = 0; pw < output_shape_data[2]; ++pw) {
-                  int zstart = pz * stride_data[0] - pad_data[0];
-                  int hstart = ph * stride_data[1] - pad_data[1];
-                  int wstart = pw * stride_data[2] - pad_data[2];
-
-                  int zend = min(zstart + kernel_shape[0],
-                           input_shape_data[1] + pad_data[0]);
-                  int hend = min(hstart + kernel_shape[1],
-                            input_shape_data[2] + pad_data[1]);
-                  int wend = min(wstart + kernel_shape[2],
-                          input_shape_data[3] + pad_data[2]);
-
-                  int pool_size = (hend - hstart) *
-                                  (wend - wstart) *
-                                  (zend - zstart);
-                  hstart = max(hstart, 0);
-                  wstart = max(wstart, 0);
-                  zstart = max(zstart, 0);
-                  zend = min(zend, input_shape_data[1]);
-                  hend = min(hend, input_shape_data[2]);
-                  wend = min(wend, input_shape_data[3]);
-
-                  const int pool_index = (pz * output_shape_data[1] + ph) * output_shape_data[2] + pw;
-                  for (int z = zstart; z < zend; ++z) {
-                    for (int h = hstart; h < hend; ++h) {
-                      for (int w = wstart; w < wend; ++w) {
-                        const int index = (z * input_shape_data[2] + h) * input_shape_data[3] + w;
-                        top_data2[pool_index] += bottom_data2[index];
-                      }
-                    }
-                  }
-                  top_data2[pool_index] /= pool_size;
-                }
-              }
-            }
-          }
-        }
-        break;
-      case PoolingParameter_PoolMethod_STOCHASTIC:
-        NOT_IMPLEMENTED;
-        break;
-      default:
-        LOG(FATAL) << "Unknown pooling method.";
-      }
-    } else {
-      NOT_IMPLEMENTED;
-    }
+  } else {
+    NOT_IMPLEMENTED;
+  }
 }
 
 template <typename Dtype>
@@ -601,8 +453,7 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   // We'll output the mask to top[1] if it's of size > 1.
   const bool use_top_mask = top.size() > 1;
 
-  if (num_spatial_axes_ == 2) {
-      // Process 2D pooling
+  if (num_spatial_axes_ == 2 || num_spatial_axes_ == 3) {
       typename PoolingCodeGeneratorBackward<Dtype>::Callback_t* generator_func =
                           Backward_code_generator.Get_callback(this, top[0]);
 
@@ -615,8 +466,8 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                                 static_cast<void*>(max_idx_.mutable_cpu_data());
       }
 
-      const int batch_size = bottom[0]->num();
-      const int num_channels = bottom[0]->channels();
+      const int batch_size = num_;
+      const int num_channels = channels_;
 
 #ifdef _OPENMP
       #pragma omp parallel for collapse(2)
@@ -632,102 +483,23 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                          use_top_mask,
                          mask,
                          this);
-      } else if (num_spatial_axes_ == 3) {
-        /* Process 3D pooling */
-        const int* kernel_shape = this->kernel_shape_.cpu_data();
-        const int* pad_data = this->pad_.cpu_data();
-        const int* stride_data = this->stride_.cpu_data();
-        const int* input_shape_data = this->input_shape_.cpu_data();
-        const int* output_shape_data = this->output_shape_.cpu_data();
-        int top_num = top[0]->count(0, channel_axis_);
-        vector<int> offset(2, 0);
-        offset[1] = 1;
-
-        long bottom_offset = bottom[0]->offset(offset);
-        long top_offset = top[0]->offset(offset);
-
-        switch (this->layer_param_.pooling_param().pool()) {
-        case PoolingParameter_PoolMethod_MAX:
-#ifdef _OPENMP
-      #pragma omp parallel for collapse(2)
-#endif
-          for (int n = 0; n < top_num; ++n) {
-            for (int c = 0; c < channels_; ++c) {
-              long nc = n * channels_ + c;
-              Dtype *bottom_diff2 = bottom[0]->mutable_cpu_diff() + nc * bottom_offset;
-              const Dtype *top_diff2 = top[0]->cpu_diff() + nc * top_offset;
-              const Dtype *top_mask = NULL;
-              const int *mask = NULL;
-              if (use_top_mask) {
-                top_mask = top[1]->cpu_data() + nc * top_offset;
-              } else {
-                mask = max_idx_.cpu_data() + nc * top_offset;
-              }
-
-              for (int pz = 0; pz < output_shape_data[0]; ++pz) {
-                for (int ph = 0; ph < output_shape_data[1]; ++ph) {
-                  for (int pw = 0; pw < output_shape_data[2]; ++pw) {
-                    const int index = (pz * output_shape_data[1] + ph) * output_shape_data[2] + pw;
-                    const int bottom_index = use_top_mask ? top_mask[index] : mask[index];
-                    bottom_diff2[bottom_index] += top_diff2[index];
-                  }
-                }
-              }
-            }
-          }
-          break;
-        case PoolingParameter_PoolMethod_AVE:
-#ifdef _OPENMP
-      #pragma omp parallel for collapse(2)
-#endif
-          for (int n = 0; n < top_num; ++n) {
-            for (int c = 0; c < channels_; ++c) {
-              long nc = n * channels_ + c;
-              Dtype *bottom_diff2 = bottom[0]->mutable_cpu_diff() + nc * bottom_offset;
-              const Dtype *top_diff2 = top[0]->cpu_diff() + nc * top_offset;
-
-              for (int pz = 0; pz < output_shape_data[0]; ++pz) {
-                for (int ph = 0; ph < output_shape_data[1]; ++ph) {
-                  for (int pw = 0; pw < output_shape_data[2]; ++pw) {
-                    int zstart = pz * stride_data[0] - pad_data[0];
-                    int hstart = ph * stride_data[1] - pad_data[1];
-                    int wstart = pw * stride_data[2] - pad_data[2];
-
-                    int zend = min(zstart + kernel_shape[0], input_shape_data[1] + pad_data[0]);
-                    int hend = min(hstart + kernel_shape[1], input_shape_data[2] + pad_data[1]);
-                    int wend = min(wstart + kernel_shape[2], input_shape_data[3] + pad_data[2]);
-                    int pool_size = (hend - hstart) * (wend - wstart) * (zend - zstart);
-                    hstart = max(hstart, 0);
-                    wstart = max(wstart, 0);
-                    zstart = max(zstart, 0);
-                    zend = min(zend, input_shape_data[1]);
-                    hend = min(hend, input_shape_data[2]);
-                    wend = min(wend, input_shape_data[3]);
-
-                    const int pool_index = (pz * output_shape_data[1] + ph) * output_shape_data[2] + pw;
-                    for (int z = zstart; z < zend; ++z) {
-                      for (int h = hstart; h < hend; ++h) {
-                        for (int w = wstart; w < wend; ++w) {
-                          const int index = (z * input_shape_data[2] + h) * input_shape_data[3] + w;
-                          bottom_diff2[index] += top_diff2[pool_index] / pool_size;
-                        }
-                      }
-                    }
-                  }
-                }
-              }
-            }
-          }
-          break;
-        case PoolingParameter_PoolMethod_STOCHASTIC:
-          NOT_IMPLEMENTED;
-          break;
-        default:
-          LOG(FATAL) << "Unknown pooling method.";
-      }
-    } else {
-      NOT_IMPLEMENTED;
-    }
+  } else {
+    NOT_IMPLEMENTED;
+  }
+}
+
+template <typename Dtype>
+vector<int> PoolingLayer<Dtype>::code_signature(const Blob<Dtype>* top) const {
+  vector<int> signature = top->shape();
+  if (num_spatial_axes_ == 3) {
+    const int* input_shape_data = input_shape_.cpu_data();
+    signature.insert(signature.end(), input_shape_data + 1,
+                     input_shape_data + 4);
+  } else {
+    signature.push_back(height_);
+    signature.push_back(width_);
+  }
+  return signature;
 }
 
 
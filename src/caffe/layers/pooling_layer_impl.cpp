@@ -37,6 +37,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
 #include <cfloat>
+#include <cstddef>
+#include <cstring>
+#include <vector>
 
 #include "caffe/layers/pooling_layer.hpp"
 
@@ -47,6 +50,7 @@ using std::max;
 template <typename Dtype>
 PoolingCodeGeneratorForward<Dtype>::PoolingCodeGeneratorForward() {
   Callback = NULL;
+  Row_callback = NULL;
 }
 
 template <typename Dtype>
@@ -64,12 +68,12 @@ typename PoolingCodeGeneratorForward<Dtype>::Callback_t*
   // In future we may add cache for all already found options.
   // Currently there is only one code for last used shape.
   if (Callback == NULL ||
-      top->shape() != Layer_output_shape_signature ||
+      layer->code_signature(top) != Layer_output_shape_signature ||
       Use_top_mask != use_top_mask ||
       Method != layer->layer_param_.pooling_param().pool()) {
     Method = layer->layer_param_.pooling_param().pool();
     Use_top_mask = use_top_mask;
-    Layer_output_shape_signature = top->shape();
+    Layer_output_shape_signature = layer->code_signature(top);
     Create_callback(layer);
   }
   return Callback;
@@ -197,15 +201,339 @@ void PoolingCodeGeneratorForward<Dtype>::Naive(
   }
 }
 
+template <typename Dtype>
+void PoolingCodeGeneratorForward<Dtype>::Forward3D(
+  const Dtype* bottom_data,
+  Dtype* top_data,
+  int top_count,
+  int batch_start,
+  int batch_end,
+  void* mask_ptr,
+  int64_t channel_start,
+  int64_t channel_end,
+  PoolingLayer<Dtype>* layer,
+  bool use_top_mask) {
+  const PoolingParameter_PoolMethod method =
+    layer->layer_param_.pooling_param().pool();
+  if (method == PoolingParameter_PoolMethod_STOCHASTIC) {
+    NOT_IMPLEMENTED;
+  } else if (method != PoolingParameter_PoolMethod_MAX &&
+             method != PoolingParameter_PoolMethod_AVE) {
+    LOG(FATAL) << "Unknown pooling method.";
+  }
+  const bool max_pool = method == PoolingParameter_PoolMethod_MAX;
+
+  const int* kernel = layer->kernel_shape_.cpu_data();
+  const int* stride = layer->stride_.cpu_data();
+  const int* pad = layer->pad_.cpu_data();
+  const int* input = layer->input_shape_.cpu_data() + 1;
+  const int* output = layer->output_shape_.cpu_data();
+  const int fm_size = input[0] * input[1] * input[2];
+  const int pooled_fm_size = output[0] * output[1] * output[2];
+
+  // Outputs [pw_begin, pw_end) have their windows inside the input width;
+  // the generated code takes them 8 at a time.
+  Row_callback_t* row_callback = layer->Forward_code_generator.Row_callback;
+  const int pw_begin = min(output[2], (pad[2] + stride[2] - 1) / stride[2]);
+  const int pw_end = input[2] + pad[2] < kernel[2] ? pw_begin :
+    max(pw_begin, min(output[2], (input[2] + pad[2] - kernel[2]) / stride[2]
+                                 + 1));
+  const int blocks = row_callback ? (pw_end - pw_begin) / 8 : 0;
+  Row_args args;
+
+  for (int n = batch_start; n < batch_end; ++n) {
+    for (int c = channel_start; c < channel_end; ++c) {
+      const int64_t offset = static_cast<int64_t>(n) * layer->channels_ + c;
+      const Dtype* bottom = bottom_data + offset * fm_size;
+      Dtype* top = top_data + offset * pooled_fm_size;
+      Dtype* top_mask = NULL;
+      int* mask = NULL;
+      if (max_pool && use_top_mask) {
+        top_mask = static_cast<Dtype*>(mask_ptr) + offset * pooled_fm_size;
+      } else if (max_pool) {
+        mask = static_cast<int*>(mask_ptr) + offset * pooled_fm_size;
+      }
+      for (int pz = 0; pz < output[0]; ++pz) {
+        for (int ph = 0; ph < output[1]; ++ph) {
+          int zstart = pz * stride[0] - pad[0];
+          int hstart = ph * stride[1] - pad[1];
+          int zend = min(zstart + kernel[0], input[0] + pad[0]);
+          int hend = min(hstart + kernel[1], input[1] + pad[1]);
+          const int pool_area = (zend - zstart) * (hend - hstart);
+          zstart = max(zstart, 0);
+          hstart = max(hstart, 0);
+          zend = min(zend, input[0]);
+          hend = min(hend, input[1]);
+          const int row = (pz * output[1] + ph) * output[2];
+          for (int pw = 0; pw < output[2]; ++pw) {
+            int wstart = pw * stride[2] - pad[2];
+            if (pw == pw_begin && blocks > 0 && zend > zstart &&
+                hend > hstart) {
+              const int index = (zstart * input[1] + hstart) * input[2]
+                                + wstart;
+              args.bottom = bottom + index;
+              args.top = top + row + pw;
+              args.mask = NULL;
+              if (max_pool) {
+                args.mask = use_top_mask ?
+                  static_cast<void*>(top_mask + row + pw) :
+                  static_cast<void*>(mask + row + pw);
+              }
+              args.blocks = blocks;
+              args.depth = zend - zstart;
+              args.height = hend - hstart;
+              args.index = index;
+              args.pool_size = pool_area * kernel[2];
+              row_callback(&args);
+              pw += blocks * 8 - 1;
+              continue;
+            }
+            int wend = min(wstart + kernel[2], input[2] + pad[2]);
+            const int pool_size = pool_area * (wend - wstart);
+            wstart = max(wstart, 0);
+            wend = min(wend, input[2]);
+            const int pool_index = row + pw;
+            if (max_pool) {
+              Dtype acc = -FLT_MAX;
+              int acc_index = -1;
+              for (int z = zstart; z < zend; ++z) {
+                for (int h = hstart; h < hend; ++h) {
+                  for (int w = wstart; w < wend; ++w) {
+                    const int index = (z * input[1] + h) * input[2] + w;
+                    if (bottom[index] > acc) {
+                      acc = bottom[index];
+                      acc_index = index;
+                    }
+                  }
+                }
+              }
+              top[pool_index] = acc;
+              if (use_top_mask) {
+                top_mask[pool_index] = static_cast<Dtype>(acc_index);
+              } else {
+                mask[pool_index] = acc_index;
+              }
+            } else {
+              Dtype acc = 0;
+              for (int z = zstart; z < zend; ++z) {
+                for (int h = hstart; h < hend; ++h) {
+                  for (int w = wstart; w < wend; ++w) {
+                    acc += bottom[(z * input[1] + h) * input[2] + w];
+                  }
+                }
+              }
+              top[pool_index] = acc / pool_size;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 // Generic datatypes - use naive versions.
 template <typename Dtype>
 void PoolingCodeGeneratorForward<Dtype>::Create_callback(
   PoolingLayer<Dtype>* layer) {
-  Callback = Naive;
+  if (layer->num_spatial_axes_ == 3) {
+    Create_row_callback(layer);
+    Callback = Forward3D;
+  } else {
+    Callback = Naive;
+  }
+}
+
+template <typename Dtype>
+void PoolingCodeGeneratorForward<Dtype>::Create_row_callback(
+  PoolingLayer<Dtype>* layer) {
+  Row_callback = NULL;
 }
 
 #if defined __x86_64__ || defined _M_X64
+namespace {
+
+uint32_t Float_bits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+}  // namespace
+
 // Here we have specialized versions for supported formats in x64 architectures.
+template <>
+void PoolingCodeGeneratorForward<float>::Create_row_callback(
+  PoolingLayer<float>* layer) {
+  using Xbyak::util::Cpu;
+  using Xbyak::Reg64;
+  using Xbyak::Ymm;
+  Cpu Current_cpu;
+  const PoolingParameter_PoolMethod method =
+    layer->layer_param_.pooling_param().pool();
+  const bool max_pool = method == PoolingParameter_PoolMethod_MAX;
+  const int* kernel = layer->kernel_shape_.cpu_data();
+  const int* stride = layer->stride_.cpu_data();
+  const int* input = layer->input_shape_.cpu_data() + 1;
+  const int64_t fm_size = static_cast<int64_t>(input[0]) * input[1] * input[2];
+
+  Row_callback = NULL;
+  // Mask indices are computed as floats, which are exact up to 2^24.
+  if (!Current_cpu.has(Cpu::tAVX2) ||
+      !(max_pool || method == PoolingParameter_PoolMethod_AVE) ||
+      (max_pool && fm_size >= (1 << 24))) {
+    return;
+  }
+  const int kernel_w = kernel[2];
+  const int stride_w = stride[2];
+  const int width = input[2];
+  const int plane = input[1] * input[2];
+  for (int i = 0; i < 8; ++i) {
+    Lane_offsets[i] = i * stride_w;
+    Lane_indices[i] = i * stride_w;
+  }
+
+  // Register names.
+  const Reg64& reg_args = rdi;
+  const Reg64& reg_bottom = r8;
+  const Reg64& reg_top = r9;
+  const Reg64& reg_mask = r10;
+  const Reg64& reg_blocks = r11;
+  const Reg64& reg_plane = rax;
+  const Reg64& reg_z_cnt = rcx;
+  const Reg64& reg_row = rdx;
+  const Reg64& reg_h_cnt = rsi;
+
+  const Ymm& ymm_acc = ymm0;
+  const Ymm& ymm_acc_index = ymm1;
+  const Ymm& ymm_plane_index = ymm2;
+  const Ymm& ymm_row_index = ymm3;
+  const Ymm& ymm_index = ymm4;
+  const Ymm& ymm_data = ymm5;
+  const Ymm& ymm_greater = ymm6;
+  const Ymm& ymm_lane_offsets = ymm7;
+  const Ymm& ymm_minus_one = ymm8;
+  const Ymm& ymm_plane_size = ymm9;
+  const Ymm& ymm_width = ymm10;
+  const Ymm& ymm_one = ymm11;
+  const Ymm& ymm_block_step = ymm12;  // Pool size for average pooling.
+  const Ymm& ymm_min_float = ymm15;
+  const Ymm& ymm_block_index = ymm14;
+
+  // ASSEMBLY STARTS HERE.
+  if (Callback)
+    reset();
+
+  // Float constants are broadcast from the red zone.
+  const Xbyak::Address& stack_float = dword[rsp - 8];
+
+  mov(reg_bottom, ptr[reg_args + offsetof(Row_args, bottom)]);
+  mov(reg_top, ptr[reg_args + offsetof(Row_args, top)]);
+  mov(reg_mask, ptr[reg_args + offsetof(Row_args, mask)]);
+  mov(reg_blocks, ptr[reg_args + offsetof(Row_args, blocks)]);
+  if (max_pool) {
+    mov(stack_float, Float_bits(-FLT_MAX));
+    vbroadcastss(ymm_min_float, stack_float);
+    mov(stack_float, Float_bits(-1.f));
+    vbroadcastss(ymm_minus_one, stack_float);
+    mov(stack_float, Float_bits(plane));
+    vbroadcastss(ymm_plane_size, stack_float);
+    mov(stack_float, Float_bits(width));
+    vbroadcastss(ymm_width, stack_float);
+    mov(stack_float, Float_bits(1.f));
+    vbroadcastss(ymm_one, stack_float);
+    mov(stack_float, Float_bits(8.f * stride_w));
+    vbroadcastss(ymm_block_step, stack_float);
+    // Index of the window origin of each lane.
+    mov(reg_plane, reinterpret_cast<size_t>(Lane_indices));
+    vbroadcastss(ymm_block_index,
+                 dword[reg_args + offsetof(Row_args, index)]);
+    vaddps(ymm_block_index, ymm_block_index, ptr[reg_plane]);
+  } else {
+    vbroadcastss(ymm_block_step,
+                 dword[reg_args + offsetof(Row_args, pool_size)]);
+  }
+  if (stride_w != 1) {
+    mov(reg_plane, reinterpret_cast<size_t>(Lane_offsets));
+    vmovdqu(ymm_lane_offsets, ptr[reg_plane]);
+  }
+
+  L("row_block_loop");
+  test(reg_blocks, reg_blocks);
+  jz("row_done", T_NEAR);
+    if (max_pool) {
+      vmovaps(ymm_acc, ymm_min_float);
+      vmovaps(ymm_acc_index, ymm_minus_one);
+      vmovaps(ymm_plane_index, ymm_block_index);
+    } else {
+      vxorps(ymm_acc, ymm_acc, ymm_acc);
+    }
+    mov(reg_plane, reg_bottom);
+    mov(reg_z_cnt, ptr[reg_args + offsetof(Row_args, depth)]);
+    L("row_z_loop");
+      mov(reg_row, reg_plane);
+      mov(reg_h_cnt, ptr[reg_args + offsetof(Row_args, height)]);
+      if (max_pool)
+        vmovaps(ymm_row_index, ymm_plane_index);
+      L("row_h_loop");
+        if (max_pool)
+          vmovaps(ymm_index, ymm_row_index);
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          if (stride_w == 1) {
+            vmovups(ymm_data, ptr[reg_row + kw * sizeof(float)]);
+          } else {
+            vpcmpeqd(ymm_greater, ymm_greater, ymm_greater);
+            vgatherdps(ymm_data,
+                ptr[reg_row + ymm_lane_offsets * 4 + kw * sizeof(float)],
+                ymm_greater);
+          }
+          if (max_pool) {
+            // Strictly greater, so that the first maximum is kept.
+            vcmpps(ymm_greater, ymm_data, ymm_acc, 0x1E);  // _CMP_GT_OQ
+            vblendvps(ymm_acc, ymm_acc, ymm_data, ymm_greater);
+            vblendvps(ymm_acc_index, ymm_acc_index, ymm_index, ymm_greater);
+            if (kw + 1 < kernel_w)
+              vaddps(ymm_index, ymm_index, ymm_one);
+          } else {
+            vaddps(ymm_acc, ymm_acc, ymm_data);
+          }
+        }
+        add(reg_row, width * sizeof(float));
+        if (max_pool)
+          vaddps(ymm_row_index, ymm_row_index, ymm_width);
+        dec(reg_h_cnt);
+        jnz("row_h_loop", T_NEAR);
+      add(reg_plane, plane * sizeof(float));
+      if (max_pool)
+        vaddps(ymm_plane_index, ymm_plane_index, ymm_plane_size);
+      dec(reg_z_cnt);
+      jnz("row_z_loop", T_NEAR);
+
+    if (max_pool) {
+      vmovups(ptr[reg_top], ymm_acc);
+      if (Use_top_mask) {
+        vmovups(ptr[reg_mask], ymm_acc_index);
+      } else {
+        vcvttps2dq(ymm_acc_index, ymm_acc_index);
+        vmovdqu(ptr[reg_mask], ymm_acc_index);
+      }
+      add(reg_mask, 8 * sizeof(float));
+      vaddps(ymm_block_index, ymm_block_index, ymm_block_step);
+    } else {
+      vdivps(ymm_acc, ymm_acc, ymm_block_step);
+      vmovups(ptr[reg_top], ymm_acc);
+    }
+    add(reg_bottom, 8 * stride_w * sizeof(float));
+    add(reg_top, 8 * sizeof(float));
+    dec(reg_blocks);
+    jmp("row_block_loop", T_NEAR);
+  L("row_done");
+
+  vzeroupper();
+  ret();
+
+  Row_callback = getCode<Row_callback_t*>();
+}
+
 template <>
 void PoolingCodeGeneratorForward<float>::Create_callback(
   PoolingLayer<float>* layer) {
@@ -213,6 +541,11 @@ void PoolingCodeGeneratorForward<float>::Create_callback(
   using Xbyak::Reg64;
   using Xbyak::Reg32;
   using Xbyak::Address;
+  if (layer->num_spatial_axes_ == 3) {
+    Create_row_callback(layer);
+    Callback = Forward3D;
+    return;
+  }
   Cpu Current_cpu;
   const LayerParameter& param = layer->layer_param();
   if (Current_cpu.has(Cpu::tAVX2) &&
@@ -702,6 +1035,7 @@ void PoolingCodeGeneratorForward<float>::Create_callback(
 template <typename Dtype>
 PoolingCodeGeneratorBackward<Dtype>::PoolingCodeGeneratorBackward() {
   Callback = NULL;
+  Row_callback = NULL;
 }
 
 template <typename Dtype>
@@ -717,8 +1051,9 @@ typename PoolingCodeGeneratorBackward<Dtype>::Callback_t*
   // TODO: do we need to check all blobs' shapes?
   // In future we may add cache for all already found options.
   // Currently there is only one code for last used shape.
-  if (Callback == NULL || top->shape() != layer_output_shape_signature) {
-    layer_output_shape_signature = top->shape();
+  if (Callback == NULL ||
+      layer->code_signature(top) != layer_output_shape_signature) {
+    layer_output_shape_signature = layer->code_signature(top);
     Create_callback(layer);
   }
 
@@ -834,37 +1169,217 @@ void PoolingCodeGeneratorBackward<Dtype>::Naive(
   }
 }
 
+template <typename Dtype>
+void PoolingCodeGeneratorBackward<Dtype>::Backward3D(
+  const Dtype* top_diff,
+  Dtype* bottom_diff,
+  int batch_start,
+  int batch_end,
+  int64_t channel_start,
+  int64_t channel_end,
+  bool use_top_mask,
+  const void* mask_ptr,
+  PoolingLayer<Dtype>* layer) {
+  const PoolingParameter_PoolMethod method =
+    layer->layer_param_.pooling_param().pool();
+  if (method == PoolingParameter_PoolMethod_STOCHASTIC) {
+    NOT_IMPLEMENTED;
+  } else if (method != PoolingParameter_PoolMethod_MAX &&
+             method != PoolingParameter_PoolMethod_AVE) {
+    LOG(FATAL) << "Unknown pooling method.";
+  }
+
+  const int* kernel = layer->kernel_shape_.cpu_data();
+  const int* stride = layer->stride_.cpu_data();
+  const int* pad = layer->pad_.cpu_data();
+  const int* input = layer->input_shape_.cpu_data() + 1;
+  const int* output = layer->output_shape_.cpu_data();
+  const int fm_size = input[0] * input[1] * input[2];
+  const int pooled_fm_size = output[0] * output[1] * output[2];
+
+  if (method == PoolingParameter_PoolMethod_MAX) {
+    for (int n = batch_start; n < batch_end; ++n) {
+      for (int c = channel_start; c < channel_end; ++c) {
+        const int64_t offset = static_cast<int64_t>(n) * layer->channels_ + c;
+        Dtype* bottom = bottom_diff + offset * fm_size;
+        const Dtype* top = top_diff + offset * pooled_fm_size;
+        if (use_top_mask) {
+          const Dtype* top_mask =
+            static_cast<const Dtype*>(mask_ptr) + offset * pooled_fm_size;
+          for (int index = 0; index < pooled_fm_size; ++index) {
+            bottom[static_cast<int>(top_mask[index])] += top[index];
+          }
+        } else {
+          const int* mask =
+            static_cast<const int*>(mask_ptr) + offset * pooled_fm_size;
+          for (int index = 0; index < pooled_fm_size; ++index) {
+            bottom[mask[index]] += top[index];
+          }
+        }
+      }
+    }
+    return;
+  }
+
+  // Average pooling, by rows as in Forward3D.
+  Row_callback_t* row_callback = layer->Backward_code_generator.Row_callback;
+  const int pw_begin = min(output[2], (pad[2] + stride[2] - 1) / stride[2]);
+  const int pw_end = input[2] + pad[2] < kernel[2] ? pw_begin :
+    max(pw_begin, min(output[2], (input[2] + pad[2] - kernel[2]) / stride[2]
+                                 + 1));
+  const int blocks = row_callback ? (pw_end - pw_begin) / 8 : 0;
+  Row_args args;
+
+  for (int n = batch_start; n < batch_end; ++n) {
+    for (int c = channel_start; c < channel_end; ++c) {
+      const int64_t offset = static_cast<int64_t>(n) * layer->channels_ + c;
+      Dtype* bottom = bottom_diff + offset * fm_size;
+      const Dtype* top = top_diff + offset * pooled_fm_size;
+      for (int pz = 0; pz < output[0]; ++pz) {
+        for (int ph = 0; ph < output[1]; ++ph) {
+          int zstart = pz * stride[0] - pad[0];
+          int hstart = ph * stride[1] - pad[1];
+          int zend = min(zstart + kernel[0], input[0] + pad[0]);
+          int hend = min(hstart + kernel[1], input[1] + pad[1]);
+          const int pool_area = (zend - zstart) * (hend - hstart);
+          zstart = max(zstart, 0);
+          hstart = max(hstart, 0);
+          zend = min(zend, input[0]);
+          hend = min(hend, input[1]);
+          const int row = (pz * output[1] + ph) * output[2];
+          for (int pw = 0; pw < output[2]; ++pw) {
+            int wstart = pw * stride[2] - pad[2];
+            if (pw == pw_begin && blocks > 0 && zend > zstart &&
+                hend > hstart) {
+              args.bottom_diff =
+                bottom + (zstart * input[1] + hstart) * input[2] + wstart;
+              args.top_diff = top + row + pw;
+              args.blocks = blocks;
+              args.depth = zend - zstart;
+              args.height = hend - hstart;
+              args.pool_size = pool_area * kernel[2];
+              row_callback(&args);
+              pw += blocks * 8 - 1;
+              continue;
+            }
+            int wend = min(wstart + kernel[2], input[2] + pad[2]);
+            const int pool_size = pool_area * (wend - wstart);
+            wstart = max(wstart, 0);
+            wend = min(wend, input[2]);
+            const Dtype diff = top[row + pw] / pool_size;
+            for (int z = zstart; z < zend; ++z) {
+              for (int h = hstart; h < hend; ++h) {
+                for (int w = wstart; w < wend; ++w) {
+                  bottom[(z * input[1] + h) * input[2] + w] += diff;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void PoolingCodeGeneratorBackward<Dtype>::Create_callback(
   PoolingLayer<Dtype>* layer) {
-  Callback = Naive;
+  if (layer->num_spatial_axes_ == 3) {
+    Create_row_callback(layer);
+    Callback = Backward3D;
+  } else {
+    Callback = Naive;
+  }
+}
+
+template <typename Dtype>
+void PoolingCodeGeneratorBackward<Dtype>::Create_row_callback(
+  PoolingLayer<Dtype>* layer) {
+  Row_callback = NULL;
 }
 
 #if defined __x86_64__ || defined _M_X64
 // Here we have specialized versions for supported formats in x64 architectures.
-/*
 template <>
-void PoolingCodeGeneratorBackward<float>::Create_callback(
-  PoolingLayer<float>* layer)
-{
-  using namespace ::Xbyak;
-  util::Cpu Current_cpu;
-  if (Current_cpu.has(util::Cpu::tAVX2))
-  { // AVX2 optimized version.
-    const LayerParameter& param = layer->layer_param();
-
-    // It seems we are regenerating the code due to output reshape.
-    if (Callback)
-      reset();
-
-    Callback = getCode<Callback_t*>();
-  }
-  else
-  { // Take naive path.
-    Callback = Naive;
+void PoolingCodeGeneratorBackward<float>::Create_row_callback(
+  PoolingLayer<float>* layer) {
+  using Xbyak::util::Cpu;
+  using Xbyak::Reg64;
+  using Xbyak::Ymm;
+  Cpu Current_cpu;
+  const int* kernel = layer->kernel_shape_.cpu_data();
+  const int* stride = layer->stride_.cpu_data();
+  const int* input = layer->input_shape_.cpu_data() + 1;
+
+  Row_callback = NULL;
+  // Windows of neighbouring lanes are disjoint or shifted by one element;
+  // other strides would need scatters.
+  if (!Current_cpu.has(Cpu::tAVX2) ||
+      layer->layer_param_.pooling_param().pool()
+        != PoolingParameter_PoolMethod_AVE ||
+      stride[2] != 1) {
+    return;
   }
-}*/
-
+  const int kernel_w = kernel[2];
+  const int width = input[2];
+  const int plane = input[1] * input[2];
+
+  // Register names.
+  const Reg64& reg_args = rdi;
+  const Reg64& reg_bottom = r8;
+  const Reg64& reg_top = r9;
+  const Reg64& reg_blocks = r11;
+  const Reg64& reg_plane = rax;
+  const Reg64& reg_z_cnt = rcx;
+  const Reg64& reg_row = rdx;
+  const Reg64& reg_h_cnt = rsi;
+
+  const Ymm& ymm_diff = ymm0;
+  const Ymm& ymm_data = ymm1;
+  const Ymm& ymm_pool_size = ymm2;
+
+  // ASSEMBLY STARTS HERE.
+  if (Callback)
+    reset();
+
+  mov(reg_bottom, ptr[reg_args + offsetof(Row_args, bottom_diff)]);
+  mov(reg_top, ptr[reg_args + offsetof(Row_args, top_diff)]);
+  mov(reg_blocks, ptr[reg_args + offsetof(Row_args, blocks)]);
+  vbroadcastss(ymm_pool_size, dword[reg_args + offsetof(Row_args, pool_size)]);
+
+  L("row_block_loop");
+  test(reg_blocks, reg_blocks);
+  jz("row_done", T_NEAR);
+    vmovups(ymm_diff, ptr[reg_top]);
+    vdivps(ymm_diff, ymm_diff, ymm_pool_size);
+    mov(reg_plane, reg_bottom);
+    mov(reg_z_cnt, ptr[reg_args + offsetof(Row_args, depth)]);
+    L("row_z_loop");
+      mov(reg_row, reg_plane);
+      mov(reg_h_cnt, ptr[reg_args + offsetof(Row_args, height)]);
+      L("row_h_loop");
+        // Each shift by kw reads back what the previous one stored.
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          vaddps(ymm_data, ymm_diff, ptr[reg_row + kw * sizeof(float)]);
+          vmovups(ptr[reg_row + kw * sizeof(float)], ymm_data);
+        }
+        add(reg_row, width * sizeof(float));
+        dec(reg_h_cnt);
+        jnz("row_h_loop", T_NEAR);
+      add(reg_plane, plane * sizeof(float));
+      dec(reg_z_cnt);
+      jnz("row_z_loop", T_NEAR);
+    add(reg_bottom, 8 * sizeof(float));
+    add(reg_top, 8 * sizeof(float));
+    dec(reg_blocks);
+    jmp("row_block_loop", T_NEAR);
+  L("row_done");
+
+  vzeroupper();
+  ret();
+
+  Row_callback = getCode<Row_callback_t*>();
+}
 #endif
 
 INSTANTIATE_CLASS(PoolingCodeGeneratorForward);
@@ -35,8 +35,11 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <functional>
+#include <map>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -44,6 +47,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace caffe {
 
+template <typename Dtype>
+map<const string, boost::weak_ptr<Blob<Dtype> > >
+    PriorBoxLayer<Dtype>::cached_priors_;
+static boost::mutex cached_priors_mutex_;
+
 template <typename Dtype>
 void PriorBoxLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -134,6 +142,9 @@ void PriorBoxLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 
   offset_ = prior_box_param.offset();
+
+  param_key_ = prior_box_param.SerializeAsString();
+  priors_.reset();
 }
 
 template <typename Dtype>
@@ -166,6 +177,52 @@ void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     img_width = img_w_;
     img_height = img_h_;
   }
+  if (!priors_ || layer_width != cached_layer_width_ ||
+      layer_height != cached_layer_height_ ||
+      img_width != cached_img_width_ || img_height != cached_img_height_) {
+    ostringstream key;
+    key << param_key_ << ":" << layer_width << "x" << layer_height << ":"
+        << img_width << "x" << img_height;
+#ifndef CPU_ONLY
+    if (Caffe::mode() == Caffe::GPU) {
+      // Blobs are not shared across devices.
+      int device;
+      CUDA_CHECK(cudaGetDevice(&device));
+      key << ":" << device;
+    }
+#endif
+    boost::mutex::scoped_lock lock(cached_priors_mutex_);
+    boost::weak_ptr<Blob<Dtype> >& weak = cached_priors_[key.str()];
+    priors_ = weak.lock();
+    if (!priors_) {
+      priors_.reset(new Blob<Dtype>(top[0]->shape()));
+      GeneratePriors(layer_width, layer_height, img_width, img_height,
+                     priors_->mutable_cpu_data());
+      weak = priors_;
+      // Drop the priors of shapes no longer in use.
+      typename map<const string, boost::weak_ptr<Blob<Dtype> > >::iterator it =
+          cached_priors_.begin();
+      while (it != cached_priors_.end()) {
+        if (it->second.expired()) {
+          cached_priors_.erase(it++);
+        } else {
+          ++it;
+        }
+      }
+    }
+    cached_layer_width_ = layer_width;
+    cached_layer_height_ = layer_height;
+    cached_img_width_ = img_width;
+    cached_img_height_ = img_height;
+  }
+  if (top[0]->data() != priors_->data()) {
+    top[0]->ShareData(*priors_);
+  }
+}
+
+template <typename Dtype>
+void PriorBoxLayer<Dtype>::GeneratePriors(int layer_width, int layer_height,
+    int img_width, int img_height, Dtype* top_data) {
   float step_w, step_h;
   if (step_w_ == 0 || step_h_ == 0) {
     step_w = static_cast<float>(img_width) / layer_width;
@@ -174,7 +231,6 @@ void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     step_w = step_w_;
     step_h = step_h_;
   }
-  Dtype* top_data = top[0]->mutable_cpu_data();
   int dim = layer_height * layer_width * num_priors_ * 4;
   int idx = 0;
   for (int h = 0; h < layer_height; ++h) {
@@ -237,7 +293,7 @@ void PriorBoxLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     }
   }
   // set the variance.
-  top_data += top[0]->offset(0, 1);
+  top_data += dim;
   if (variance_.size() == 1) {
     caffe_set<Dtype>(dim, Dtype(variance_[0]), top_data);
   } else {
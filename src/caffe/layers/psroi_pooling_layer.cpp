@@ -47,6 +47,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include "caffe/layers/psroi_pooling_layer.hpp"
+#include "caffe/util/bbox_util.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #ifdef _OPENMP
@@ -91,17 +92,19 @@ namespace caffe {
       bottom[1]->num(), output_dim_, pooled_height_, pooled_width_);
     mapping_channel_.Reshape(
       bottom[1]->num(), output_dim_, pooled_height_, pooled_width_);
+    bottom_nhwc_.Reshape(bottom[0]->num(), height_, width_, channels_);
   }
 
   template <typename Dtype>
   static void PSROIPoolingForward(
     const int num,
-    const Dtype* bottom_data,
+    const Dtype* bottom_nhwc,
     const Dtype spatial_scale,
     const int channels,
     const int height, const int width,
     const int pooled_height, const int pooled_width,
     const Dtype* bottom_rois,
+    const int* roi_order,
     const int output_dim,
     const int group_size,
     Dtype* top_data,
@@ -109,10 +112,17 @@ namespace caffe {
       // LOG(INFO) << "psroi pooling cpu_forward";
       int pixels = width * height;
 #ifdef _OPENMP
-      #pragma omp parallel for
+      #pragma omp parallel
 #endif
-      for (int n = 0; n < num; ++n) {
+      {
+      vector<Dtype> bin_sum(output_dim);
+      Dtype* out_sum = &bin_sum[0];
+#ifdef _OPENMP
+      #pragma omp for schedule(dynamic)
+#endif
+      for (int i = 0; i < num; ++i) {
         // per roi
+        int n = roi_order[i];
         int roi_add = n * 5;
         // [start, end) interval for spatial sampling
         int roi_batch_ind = bottom_rois[roi_add];
@@ -133,49 +143,52 @@ namespace caffe {
         Dtype bin_size_h = roi_height / static_cast<Dtype>(pooled_height);
         Dtype bin_size_w = roi_width / static_cast<Dtype>(pooled_width);
 
+        const Dtype* batch_data =
+          bottom_nhwc + static_cast<size_t>(roi_batch_ind) * pixels * channels;
         int top_roi_offset = n * output_dim * pooled_height * pooled_width;
-        for (int ctop = 0; ctop < output_dim; ++ctop) {
-          // per category
-          int top_plane_offset = top_roi_offset + ctop * pooled_height * pooled_width;
-          for (int ph = 0; ph < pooled_height; ++ph) {
-            int top_row_offset = top_plane_offset + ph * pooled_width;
-            for (int pw = 0; pw < pooled_width; ++pw) {
-              int index = top_row_offset + pw;
-              // The output is in order (n, ctop, ph, pw)
-              int hstart = floor(static_cast<Dtype>(ph) * bin_size_h + roi_start_h);
-              int wstart = floor(static_cast<Dtype>(pw) * bin_size_w + roi_start_w);
-              int hend = ceil(static_cast<Dtype>(ph + 1) * bin_size_h + roi_start_h);
-              int wend = ceil(static_cast<Dtype>(pw + 1) * bin_size_w + roi_start_w);
-              // Add roi offsets and clip to input boundaries
-              hstart = min(max(hstart, 0), height);
-              hend = min(max(hend, 0), height);
-              wstart = min(max(wstart, 0), width);
-              wend = min(max(wend, 0), width);
-
-              bool is_empty = (hend <= hstart) || (wend <= wstart);
-              int gw = pw;
-              int gh = ph;
-              int c = (ctop * group_size + gh) * group_size + gw;
-
-              Dtype out_sum = 0;
-              int bottom_base_offset = (roi_batch_ind * channels + c) * pixels;
-              const Dtype *current_bottom = bottom_data + bottom_base_offset;
-              for (int h = hstart; h < hend; ++h) {
-                int roi_row_offset = h * width;
-                for (int w = wstart; w < wend; ++w) {
-                  int bottom_index = roi_row_offset + w;
-                  out_sum += current_bottom[bottom_index];
+        for (int ph = 0; ph < pooled_height; ++ph) {
+          for (int pw = 0; pw < pooled_width; ++pw) {
+            // The output is in order (n, ctop, ph, pw)
+            int hstart = floor(static_cast<Dtype>(ph) * bin_size_h + roi_start_h);
+            int wstart = floor(static_cast<Dtype>(pw) * bin_size_w + roi_start_w);
+            int hend = ceil(static_cast<Dtype>(ph + 1) * bin_size_h + roi_start_h);
+            int wend = ceil(static_cast<Dtype>(pw + 1) * bin_size_w + roi_start_w);
+            // Add roi offsets and clip to input boundaries
+            hstart = min(max(hstart, 0), height);
+            hend = min(max(hend, 0), height);
+            wstart = min(max(wstart, 0), width);
+            wend = min(max(wend, 0), width);
+
+            bool is_empty = (hend <= hstart) || (wend <= wstart);
+            int gw = pw;
+            int gh = ph;
+            // Channels (ctop * group_size + gh) * group_size + gw of every
+            // category are adjacent in bottom_nhwc, so one bin is averaged
+            // for all categories at once.
+            int bin_channel = (gh * group_size + gw) * output_dim;
+
+            std::fill(out_sum, out_sum + output_dim, Dtype(0));
+            for (int h = hstart; h < hend; ++h) {
+              for (int w = wstart; w < wend; ++w) {
+                const Dtype* pixel =
+                  batch_data + (h * width + w) * channels + bin_channel;
+                for (int ctop = 0; ctop < output_dim; ++ctop) {
+                  out_sum[ctop] += pixel[ctop];
                 }
               }
+            }
 
-              Dtype bin_area = (hend - hstart) * (wend - wstart);
-              top_data[index] = is_empty ? 0. : out_sum / bin_area;
-
-              mapping_channel[index] = c;
+            Dtype bin_area = (hend - hstart) * (wend - wstart);
+            for (int ctop = 0; ctop < output_dim; ++ctop) {
+              int index = top_roi_offset +
+                (ctop * pooled_height + ph) * pooled_width + pw;
+              top_data[index] = is_empty ? 0. : out_sum[ctop] / bin_area;
+              mapping_channel[index] = (ctop * group_size + gh) * group_size + gw;
             }
           }
         }
-    }
+      }
+      }
   }
 
 
@@ -186,13 +199,32 @@ namespace caffe {
     const Dtype* bottom_rois = bottom[1]->cpu_data();
     Dtype* top_data = top[0]->mutable_cpu_data();
     int* mapping_channel_ptr = mapping_channel_.mutable_cpu_data();
-    int count = top[0]->count();
-    caffe_set(count, Dtype(0), top_data);
-    caffe_set(count, -1, mapping_channel_ptr);
-    
-    PSROIPoolingForward(bottom[1]->num(), bottom_data, spatial_scale_,
+
+    // Transpose to channels-last, moving channel c to the slot
+    // (c % bins) * output_dim + c / bins so that the channels pooled into
+    // one bin are contiguous.
+    const int bins = group_size_ * group_size_;
+    const int pixels = height_ * width_;
+    Dtype* bottom_nhwc = bottom_nhwc_.mutable_cpu_data();
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for (int i = 0; i < bottom[0]->num() * height_; ++i) {
+      const Dtype* src = bottom_data +
+        bottom[0]->offset(i / height_, 0, i % height_);
+      Dtype* dst = bottom_nhwc + static_cast<size_t>(i) * width_ * channels_;
+      for (int w = 0; w < width_; ++w) {
+        for (int c = 0; c < channels_; ++c) {
+          dst[w * channels_ + (c % bins) * output_dim_ + c / bins] =
+            src[c * pixels + w];
+        }
+      }
+    }
+
+    SortROIsByArea(bottom_rois, bottom[1]->num(), 2, &roi_order_);
+    PSROIPoolingForward(bottom[1]->num(), bottom_nhwc, spatial_scale_,
       channels_, height_, width_, pooled_height_,
-      pooled_width_, bottom_rois, output_dim_, group_size_,
+      pooled_width_, bottom_rois, roi_order_.data(), output_dim_, group_size_,
       top_data, mapping_channel_ptr);
   }
 
@@ -200,65 +232,78 @@ namespace caffe {
     static void PSROIPoolingBackward(
     const int num,
     const Dtype* top_diff,
-    const int* mapping_channel,
     const int num_rois,
     const Dtype spatial_scale,
     const int channels,
     const int height, const int width,
     const int pooled_height, const int pooled_width,
     const int output_dim,
+    const int group_size,
     Dtype* bottom_diff,
     const Dtype* bottom_rois) {
 	// LOG(INFO) << "psroipooling backward cpu";
     int pixels = height * width;
+    // Each bottom channel c receives gradient from a single bin
+    // (ctop, gh, gw) of every ROI, so one thread per (image, channel) plane
+    // accumulates all ROIs into it without any write conflicts.
 #ifdef _OPENMP
     #pragma omp parallel for
 #endif
-    for (int i = 0; i < num; ++i) {
-      // The output is in order (n, ctop, ph, pw)
-      int pw = i % pooled_width;
-      int ph = (i / pooled_width) % pooled_height;
-      int n = i / pooled_width / pooled_height / output_dim;
-
-      // [start, end) interval for spatial sampling
-      int roi_add = n * 5;
-      int roi_batch_ind = bottom_rois[roi_add];
-      Dtype roi_start_w =
-        static_cast<Dtype>(round(bottom_rois[roi_add + 1])) * spatial_scale;
-      Dtype roi_start_h =
-        static_cast<Dtype>(round(bottom_rois[roi_add + 2])) * spatial_scale;
-      Dtype roi_end_w =
-        static_cast<Dtype>(round(bottom_rois[roi_add + 3]) + 1.) * spatial_scale;
-      Dtype roi_end_h =
-        static_cast<Dtype>(round(bottom_rois[roi_add + 4]) + 1.) * spatial_scale;
-
-      // Force too small ROIs to be 1x1
-      Dtype roi_width = max(roi_end_w - roi_start_w, (Dtype)0.1);  // avoid 0
-      Dtype roi_height = max(roi_end_h - roi_start_h, (Dtype)0.1);
-
-      // Compute w and h at bottom
-      Dtype bin_size_h = roi_height / static_cast<Dtype>(pooled_height);
-      Dtype bin_size_w = roi_width / static_cast<Dtype>(pooled_width);
-
-      int hstart = floor(static_cast<Dtype>(ph)* bin_size_h + roi_start_h);
-      int wstart = floor(static_cast<Dtype>(pw)* bin_size_w + roi_start_w);
-      int hend = ceil(static_cast<Dtype>(ph + 1) * bin_size_h + roi_start_h);
-      int wend = ceil(static_cast<Dtype>(pw + 1) * bin_size_w + roi_start_w);
-      // Add roi offsets and clip to input boundaries
-      hstart = min(max(hstart, 0), height);
-      hend = min(max(hend, 0), height);
-      wstart = min(max(wstart, 0), width);
-      wend = min(max(wend, 0), width);
-      bool is_empty = (hend <= hstart) || (wend <= wstart);
-
-      // Compute c at bottom
-      int c = mapping_channel[i];
-      Dtype* offset_bottom_diff = bottom_diff + (roi_batch_ind * channels + c) * pixels;
-      Dtype bin_area = (hend - hstart) * (wend - wstart);
-      Dtype diff_val = is_empty ? 0. : top_diff[i] / bin_area;
-      for (int h = hstart; h < hend; ++h) {
-        for (int w = wstart; w < wend; ++w) {
-          offset_bottom_diff[h * width + w] += diff_val;
+    for (int plane = 0; plane < num * channels; ++plane) {
+      int b = plane / channels;
+      int c = plane % channels;
+      int gw = c % group_size;
+      int gh = (c / group_size) % group_size;
+      int ctop = c / group_size / group_size;
+      int ph = gh;
+      int pw = gw;
+      Dtype* offset_bottom_diff = bottom_diff + static_cast<size_t>(plane) * pixels;
+      for (int n = 0; n < num_rois; ++n) {
+        // [start, end) interval for spatial sampling
+        int roi_add = n * 5;
+        int roi_batch_ind = bottom_rois[roi_add];
+        if (roi_batch_ind != b) {
+          continue;
+        }
+        Dtype roi_start_w =
+          static_cast<Dtype>(round(bottom_rois[roi_add + 1])) * spatial_scale;
+        Dtype roi_start_h =
+          static_cast<Dtype>(round(bottom_rois[roi_add + 2])) * spatial_scale;
+        Dtype roi_end_w =
+          static_cast<Dtype>(round(bottom_rois[roi_add + 3]) + 1.) * spatial_scale;
+        Dtype roi_end_h =
+          static_cast<Dtype>(round(bottom_rois[roi_add + 4]) + 1.) * spatial_scale;
+
+        // Force too small ROIs to be 1x1
+        Dtype roi_width = max(roi_end_w - roi_start_w, (Dtype)0.1);  // avoid 0
+        Dtype roi_height = max(roi_end_h - roi_start_h, (Dtype)0.1);
+
+        // Compute w and h at bottom
+        Dtype bin_size_h = roi_height / static_cast<Dtype>(pooled_height);
+        Dtype bin_size_w = roi_width / static_cast<Dtype>(pooled_width);
+
+        int hstart = floor(static_cast<Dtype>(ph)* bin_size_h + roi_start_h);
+        int wstart = floor(static_cast<Dtype>(pw)* bin_size_w + roi_start_w);
+        int hend = ceil(static_cast<Dtype>(ph + 1) * bin_size_h + roi_start_h);
+        int wend = ceil(static_cast<Dtype>(pw + 1) * bin_size_w + roi_start_w);
+        // Add roi offsets and clip to input boundaries
+        hstart = min(max(hstart, 0), height);
+        hend = min(max(hend, 0), height);
+        wstart = min(max(wstart, 0), width);
+        wend = min(max(wend, 0), width);
+        bool is_empty = (hend <= hstart) || (wend <= wstart);
+        if (is_empty) {
+          continue;
+        }
+
+        // The output is in order (n, ctop, ph, pw)
+        int index = ((n * output_dim + ctop) * pooled_height + ph) * pooled_width + pw;
+        Dtype bin_area = (hend - hstart) * (wend - wstart);
+        Dtype diff_val = top_diff[index] / bin_area;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            offset_bottom_diff[h * width + w] += diff_val;
+          }
         }
       }
     }
@@ -275,13 +320,11 @@ namespace caffe {
     const Dtype* top_diff = top[0]->cpu_diff();
     Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
     const int bottom_count = bottom[0]->count();
-    const int* mapping_channel_ptr = mapping_channel_.cpu_data();
     caffe_set(bottom[1]->count(), Dtype(0), bottom[1]->mutable_cpu_diff());
     caffe_set(bottom_count, Dtype(0), bottom_diff);
-    const int count = top[0]->count();
-    PSROIPoolingBackward(count, top_diff, mapping_channel_ptr,
+    PSROIPoolingBackward(bottom[0]->num(), top_diff,
       top[0]->num(), spatial_scale_, channels_, height_, width_,
-      pooled_height_, pooled_width_, output_dim_, bottom_diff,
+      pooled_height_, pooled_width_, output_dim_, group_size_, bottom_diff,
       bottom_rois);
   }
 
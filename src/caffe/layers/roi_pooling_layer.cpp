@@ -40,6 +40,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 
 #include "caffe/layers/roi_pooling_layer.hpp"
+#include "caffe/util/bbox_util.hpp"
 
 using std::max;
 using std::min;
@@ -114,6 +115,7 @@ void ROIPoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     width_ = bottom[0]->width();
     top[0]->Reshape(bottom[1]->shape(0), channels_, pooled_h_, pooled_w_);
     max_idx_.Reshape(bottom[1]->shape(0), channels_, pooled_h_, pooled_w_);
+    bottom_nhwc_.Reshape(bottom[0]->num(), height_, width_, channels_);
   } else {
     depth_ = bottom[0]->shape(2);
     height_ = bottom[0]->shape(3);
@@ -141,37 +143,65 @@ void ROIPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   size_t top_count = top[0]->count();
 
   Dtype* top_data = top[0]->mutable_cpu_data();
-  caffe_set(top_count, Dtype(-FLT_MAX), top_data);
   int* argmax_data = max_idx_.mutable_cpu_data();
-  caffe_set(top_count, -1, argmax_data);
 
   if (num_spatial_axes_ == 2) {
     int roi_offset = bottom[1]->offset(1);
     size_t top_offset = top[0]->offset(1);
-    // For each ROI R = [batch_index x1 y1 x2 y2]: max pool over R
+    const int pooled_count = pooled_h_ * pooled_w_;
+    const int spatial_count = height_ * width_;
+
+    // Transpose to channels-last once, so that every bin below is pooled
+    // over all channels in a single pass of unit-stride loads.
+    Dtype* bottom_nhwc = bottom_nhwc_.mutable_cpu_data();
 #ifdef _OPENMP
     #pragma omp parallel for
 #endif
-    for (int n = 0; n < num_rois; ++n) {
-      Dtype* cur_top = top_data + n * top_offset;
-      int* cur_argmax = argmax_data + n * top_offset;
-      const Dtype* roi = bottom_rois + n * roi_offset;
-      int roi_batch_ind = roi[0];
-      int roi_start_w = round(roi[1] * spatial_scale_);
-      int roi_start_h = round(roi[2] * spatial_scale_);
-      int roi_end_w = round(roi[3] * spatial_scale_);
-      int roi_end_h = round(roi[4] * spatial_scale_);
-      CHECK_GE(roi_batch_ind, 0);
-      CHECK_LT(roi_batch_ind, batch_size);
-
-      int roi_height = max(roi_end_h - roi_start_h + 1, 1);
-      int roi_width = max(roi_end_w - roi_start_w + 1, 1);
-      const Dtype bin_size_h = static_cast<Dtype>(roi_height) / static_cast<Dtype>(pooled_h_);
-      const Dtype bin_size_w = static_cast<Dtype>(roi_width) / static_cast<Dtype>(pooled_w_);
+    for (int i = 0; i < batch_size * height_; ++i) {
+      const Dtype* src = bottom_data +
+          bottom[0]->offset(i / height_, 0, i % height_);
+      Dtype* dst = bottom_nhwc + static_cast<size_t>(i) * width_ * channels_;
+      for (int w = 0; w < width_; ++w) {
+        for (int c = 0; c < channels_; ++c) {
+          dst[w * channels_ + c] = src[c * spatial_count + w];
+        }
+      }
+    }
 
-      const Dtype* batch_data = bottom_data + bottom[0]->offset(roi_batch_ind);
+    SortROIsByArea(bottom_rois, num_rois, 2, &roi_order_);
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+      vector<Dtype> bin_max(channels_);
+      vector<int> bin_argmax(channels_);
+      Dtype* maxval = &bin_max[0];
+      int* maxidx = &bin_argmax[0];
+      // For each ROI R = [batch_index x1 y1 x2 y2]: max pool over R
+#ifdef _OPENMP
+      #pragma omp for schedule(dynamic)
+#endif
+      for (int i = 0; i < num_rois; ++i) {
+        const int n = roi_order_[i];
+        Dtype* cur_top = top_data + n * top_offset;
+        int* cur_argmax = argmax_data + n * top_offset;
+        const Dtype* roi = bottom_rois + n * roi_offset;
+        int roi_batch_ind = roi[0];
+        int roi_start_w = round(roi[1] * spatial_scale_);
+        int roi_start_h = round(roi[2] * spatial_scale_);
+        int roi_end_w = round(roi[3] * spatial_scale_);
+        int roi_end_h = round(roi[4] * spatial_scale_);
+        CHECK_GE(roi_batch_ind, 0);
+        CHECK_LT(roi_batch_ind, batch_size);
+
+        int roi_height = max(roi_end_h - roi_start_h + 1, 1);
+        int roi_width = max(roi_end_w - roi_start_w + 1, 1);
+        const Dtype bin_size_h = static_cast<Dtype>(roi_height) / static_cast<Dtype>(pooled_h_);
+        const Dtype bin_size_w = static_cast<Dtype>(roi_width) / static_cast<Dtype>(pooled_w_);
+
+        const Dtype* batch_data = bottom_nhwc +
+            static_cast<size_t>(roi_batch_ind) * spatial_count * channels_;
 
-      for (int c = 0; c < channels_; ++c) {
         for (int ph = 0; ph < pooled_h_; ++ph) {
           for (int pw = 0; pw < pooled_w_; ++pw) {
             // Compute pooling region for this output unit:
@@ -191,27 +221,33 @@ void ROIPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 
             const int pool_index = ph * pooled_w_ + pw;
             if (is_empty) {
-              cur_top[pool_index] = 0;
-              cur_argmax[pool_index] = -1;
+              for (int c = 0; c < channels_; ++c) {
+                cur_top[c * pooled_count + pool_index] = 0;
+                cur_argmax[c * pooled_count + pool_index] = -1;
+              }
               continue;
             }
 
+            std::fill(maxval, maxval + channels_, Dtype(-FLT_MAX));
+            std::fill(maxidx, maxidx + channels_, -1);
             for (int h = hstart; h < hend; ++h) {
               for (int w = wstart; w < wend; ++w) {
                 const int index = h * width_ + w;
-                if (batch_data[index] > cur_top[pool_index]) {
-                  cur_top[pool_index] = batch_data[index];
-                  cur_argmax[pool_index] = index;
+                const Dtype* pixel = batch_data + index * channels_;
+                // Branch-free select so the channel loop vectorizes.
+                for (int c = 0; c < channels_; ++c) {
+                  const bool greater = pixel[c] > maxval[c];
+                  maxval[c] = greater ? pixel[c] : maxval[c];
+                  maxidx[c] = greater ? index : maxidx[c];
                 }
               }
             }
+            for (int c = 0; c < channels_; ++c) {
+              cur_top[c * pooled_count + pool_index] = maxval[c];
+              cur_argmax[c * pooled_count + pool_index] = maxidx[c];
+            }
           }
         }
-
-        // Increment all data pointers by one channel
-        batch_data += bottom[0]->offset(0, 1);
-        cur_top += top[0]->offset(0, 1);
-        cur_argmax += max_idx_.offset(0, 1);
       }
     }
   } else if (num_spatial_axes_ == 3) {
@@ -223,10 +259,14 @@ void ROIPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     top_offset_vec[0] = 1;
     size_t top_offset = top[0]->offset(top_offset_vec);
 
+    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
+    caffe_set(top_count, -1, argmax_data);
+    SortROIsByArea(bottom_rois, num_rois, 3, &roi_order_);
 #ifdef _OPENMP
-    #pragma omp parallel for
+    #pragma omp parallel for schedule(dynamic)
 #endif
-    for (int n = 0; n < num_rois; ++n) {
+    for (int i = 0; i < num_rois; ++i) {
+      const int n = roi_order_[i];
       Dtype* cur_top = top_data + n * top_offset;
       int* cur_argmax = argmax_data + n * top_offset;
       const Dtype* roi = bottom_rois + n * roi_offset;
@@ -318,48 +358,32 @@ void ROIPoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   caffe_set(bottom[0]->count(), Dtype(0.), bottom_diff);
   const int* argmax_data = max_idx_.cpu_data();
   const int num_rois = top[0]->shape(0);
-
-  if (num_spatial_axes_ == 2) {
-    // Accumulate gradient over all ROIs
-    for (int roi_n = 0; roi_n < num_rois; ++roi_n) {
-      int roi_batch_ind = bottom_rois[roi_n * 5];
-      // Accumulate gradients over each bin in this ROI
+  const int roi_size = 1 + 2 * num_spatial_axes_;
+  const int planes = bottom[0]->count(0, 2);
+  const int plane_count = bottom[0]->count(2);
+  const int pooled_count = top[0]->count(2);
+
+  // Each (image, channel) plane of bottom_diff is owned by one thread, which
+  // accumulates every ROI into it in ROI order: no two threads ever write the
+  // same element, and the sums match a serial pass bit for bit.
 #ifdef _OPENMP
-      #pragma omp parallel for
+  #pragma omp parallel for
 #endif
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_h_; ++ph) {
-          for (int pw = 0; pw < pooled_w_; ++pw) {
-            int offset_top = ((roi_n * channels_ + c) * pooled_h_ + ph) * pooled_w_ + pw;
-            int argmax_index = argmax_data[offset_top];
-            if (argmax_index >= 0) {
-              int offset_bottom = (roi_batch_ind * channels_ + c) * height_ * width_ + argmax_index;
-              bottom_diff[offset_bottom] += top_diff[offset_top];
-            }
-          }
-        }
-      }
-    }
-  } else if (num_spatial_axes_ == 3) {
-     // Accumulate gradient over all ROIs
+  for (int i = 0; i < planes; ++i) {
+    const int b = i / channels_;
+    const int c = i % channels_;
+    Dtype* plane_diff = bottom_diff + static_cast<size_t>(i) * plane_count;
     for (int roi_n = 0; roi_n < num_rois; ++roi_n) {
-      int roi_batch_ind = bottom_rois[roi_n * 7];
-      // Accumulate gradients over each bin in this ROI
-#ifdef _OPENMP
-      #pragma omp parallel for
-#endif
-      for (int c = 0; c < channels_; ++c) {
-        for (int pd = 0; pd < pooled_d_; ++pd) {
-          for (int ph = 0; ph < pooled_h_; ++ph) {
-            for (int pw = 0; pw < pooled_w_; ++pw) {
-              int offset_top = (((roi_n * channels_ + c) * pooled_d_ + pd) * pooled_h_ + ph) * pooled_w_ + pw;
-              int argmax_index = argmax_data[offset_top];
-              if (argmax_index >= 0) {
-                int offset_bottom = (roi_batch_ind * channels_ + c) * depth_ * height_ * width_ + argmax_index;
-                bottom_diff[offset_bottom] += top_diff[offset_top];
-              }
-            }
-          }
+      int roi_batch_ind = bottom_rois[roi_n * roi_size];
+      if (roi_batch_ind != b) {
+        continue;
+      }
+      const size_t offset_top =
+          static_cast<size_t>(roi_n * channels_ + c) * pooled_count;
+      for (int k = 0; k < pooled_count; ++k) {
+        int argmax_index = argmax_data[offset_top + k];
+        if (argmax_index >= 0) {
+          plane_diff[argmax_index] += top_diff[offset_top + k];
         }
       }
     }
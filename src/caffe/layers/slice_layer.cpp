@@ -119,6 +119,12 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < top.size(); ++i) {
     Dtype* top_data = top[i]->mutable_cpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    // The top is a view into the bottom, see Net::ShareConcatSliceBuffers.
+    if (num_slices_ == 1 &&
+        top[i]->SharesDataSlice(*bottom[0], offset_slice_axis * slice_size_)) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
@@ -134,12 +140,29 @@ template <typename Dtype>
 void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
   if (!propagate_down[0] || top.size() == 1) { return; }
+  // Tops that are views into the bottom diff bring it up to date on the host
+  // first; any private copy of the bottom diff is stale then.
+  vector<bool> shared(top.size(), false);
   int offset_slice_axis = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    shared[i] = num_slices_ == 1 &&
+        top[i]->SharesDiffSlice(*bottom[0], offset_slice_axis * slice_size_);
+    if (shared[i]) {
+      top[i]->cpu_diff();
+      bottom[0]->set_prv_diff_descriptor(NULL);
+    }
+    offset_slice_axis += top[i]->shape(slice_axis_);
+  }
+  offset_slice_axis = 0;
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const int top_slice_axis = top[i]->shape(slice_axis_);
+    if (shared[i]) {
+      offset_slice_axis += top_slice_axis;
+      continue;
+    }
     for (int n = 0; n < num_slices_; ++n) {
       const int top_offset = n * top_slice_axis * slice_size_;
       const int bottom_offset =
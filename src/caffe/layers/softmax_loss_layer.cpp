@@ -41,9 +41,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "caffe/layers/softmax_loss_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/softmax.hpp"
 
 namespace caffe {
 
+// Positions summed by one thread before the partial sums are combined. The
+// blocks do not depend on the number of threads and are combined in order,
+// so the loss and its normalizer are reproducible from run to run.
+static const int kSumBlock = 4096;
+
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
@@ -86,6 +92,7 @@ void SoftmaxWithLossLayer<Dtype>::Reshape(
       << "e.g., if softmax axis == 1 and prediction shape is (N, C, H, W), "
       << "label count (number of labels) must be N*H*W, "
       << "with integer values in {0, 1, ..., C-1}.";
+  log_norm_.ReshapeLike(*bottom[1]);
   if (top.size() >= 2) {
     // softmax output
     top[1]->ReshapeLike(*bottom[0]);
@@ -126,87 +133,67 @@ Dtype SoftmaxWithLossLayer<Dtype>::get_normalizer(
 template <typename Dtype>
 void SoftmaxWithLossLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
+  // The forward pass computes the softmax prob values together with the
+  // log normalizers, so the loss is taken from the scores directly.
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const int channels = bottom[0]->shape(softmax_axis_);
+  softmax_cpu(bottom_data, outer_num_, channels, inner_num_,
+      prob_.mutable_cpu_data(), log_norm_.mutable_cpu_data());
+  const Dtype* log_norm = log_norm_.cpu_data();
   const Dtype* label = bottom[1]->cpu_data();
-  int dim = prob_.count() / outer_num_;
+  const Dtype* weights = bottom.size() == 3 ? bottom[2]->cpu_data() : NULL;
+  const Dtype log_min = log(Dtype(FLT_MIN));
+  const Dtype log_max = log(Dtype(1.0 - FLT_MIN));
+  const int dim = channels * inner_num_;
+  const int positions = outer_num_ * inner_num_;
+  const int num_blocks = (positions + kSumBlock - 1) / kSumBlock;
+  vector<Dtype> block_loss(num_blocks), block_weight(num_blocks);
   int count = 0;
-  Dtype loss = 0;
-  if (bottom.size() == 3) {
-      const Dtype* weights = bottom[2]->cpu_data();
-      Dtype weighted_sum = 0;
-      Dtype weighted_sum_local = 0;
-      Dtype loss_local = 0;
-
-      for (int i = 0; i < outer_num_; ++i) {
-        weighted_sum_local = 0;
-        loss_local = 0;
-
-        #ifdef _OPENMP
-        #pragma omp parallel for reduction(+: loss_local, weighted_sum_local) if(inner_num_ > 1)
-        #endif
-        for (int j = 0; j < inner_num_; j++) {
-          const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-          if (has_ignore_label_ && label_value == ignore_label_) {
-            continue;
-          }
-
-          DCHECK_GE(label_value, 0);
-          DCHECK_LT(label_value, prob_.shape(softmax_axis_));
-          Dtype p = prob_data[i * dim + label_value * inner_num_ + j];
-          loss_local += weights[i * inner_num_ + j] * log(std::max(Dtype(FLT_MIN), std::min(p, Dtype(1.0 - FLT_MIN))));
-          weighted_sum_local += weights[i * inner_num_ + j];
-        }
-
-        weighted_sum += weighted_sum_local;
-        loss -= loss_local;
-      }
-      // LOG(ERROR) << "outer num: " << outer_num_ << ", inner_num_: " << inner_num_;
-      // LOG(ERROR) << "count: " << count << ", loss: " << loss;
-
-      top[0]->mutable_cpu_data()[0] = loss / weighted_sum;
-      if (top.size() == 2) {
-        top[1]->ShareData(prob_);
-      }
-  } else {
-      int count_local = 0;
-      Dtype loss_local = 0;
-
-      for (int i = 0; i < outer_num_; ++i) {
-        count_local = 0;
-        loss_local = 0;
-
-        #ifdef _OPENMP
-        #pragma omp parallel for reduction(+: loss_local, count_local) if(inner_num_ > 1)
-        #endif
-        for (int j = 0; j < inner_num_; j++) {
-          const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-          if (has_ignore_label_ && label_value == ignore_label_) {
-            continue;
-          }
-
-          DCHECK_GE(label_value, 0);
-          DCHECK_LT(label_value, prob_.shape(softmax_axis_));
-          Dtype p = prob_data[i * dim + label_value * inner_num_ + j];
-          loss_local += log(std::max(Dtype(FLT_MIN), std::min(p, Dtype(1.0 - FLT_MIN))));
-          ++count_local;
-        }
-
-        count += count_local;
-        loss -= loss_local;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+: count) if (num_blocks > 1)
+#endif
+  for (int block = 0; block < num_blocks; ++block) {
+    const int end = std::min(positions, (block + 1) * kSumBlock);
+    Dtype loss = 0;
+    Dtype weight = 0;
+    for (int index = block * kSumBlock; index < end; ++index) {
+      const int label_value = static_cast<int>(label[index]);
+      if (has_ignore_label_ && label_value == ignore_label_) {
+        continue;
       }
-      // LOG(ERROR) << "outer num: " << outer_num_ << ", inner_num_: " << inner_num_;
-      // LOG(ERROR) << "count: " << count << ", loss: " << loss;
-
-      top[0]->mutable_cpu_data()[0] = loss / get_normalizer(normalization_, count);;
-      if (top.size() == 2) {
-        top[1]->ShareData(prob_);
+      DCHECK_GE(label_value, 0);
+      DCHECK_LT(label_value, channels);
+      const int i = index / inner_num_;
+      const int j = index % inner_num_;
+      const Dtype log_prob = std::min(log_max, std::max(log_min,
+          bottom_data[i * dim + label_value * inner_num_ + j] -
+          log_norm[index]));
+      if (weights) {
+        loss -= weights[index] * log_prob;
+        weight += weights[index];
+      } else {
+        loss -= log_prob;
+        ++count;
       }
+    }
+    block_loss[block] = loss;
+    block_weight[block] = weight;
+  }
+  Dtype loss = 0;
+  Dtype weighted_sum = 0;
+  for (int block = 0; block < num_blocks; ++block) {
+    loss += block_loss[block];
+    weighted_sum += block_weight[block];
+  }
+  top[0]->mutable_cpu_data()[0] = weights ? loss / weighted_sum :
+      loss / get_normalizer(normalization_, count);
+  if (top.size() == 2) {
+    top[1]->ShareData(prob_);
   }
 
 #if DUMP_LAYER_IO
   // LOG(ERROR) << "softmax loss";
+  const Dtype* prob_data = prob_.cpu_data();
   FILE *fp = NULL;
   char dump_name[256] = {0};
 
@@ -251,58 +238,64 @@ void SoftmaxWithLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                << " Layer cannot backpropagate to label inputs.";
   }
   if (propagate_down[0]) {
-    if (bottom.size() == 3) {
-        Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-        const Dtype* prob_data = prob_.cpu_data();
-        caffe_copy(prob_.count(), prob_data, bottom_diff);
-        const Dtype* label = bottom[1]->cpu_data();
-        int dim = prob_.count() / outer_num_;
-        Dtype weight_sum = Dtype(0);
-        const Dtype* weights = bottom[2]->cpu_data();
-        for (int i = 0; i < outer_num_; ++i) {
-          for (int j = 0; j < inner_num_; ++j) {
-            const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-            if (has_ignore_label_ && label_value == ignore_label_) {
-              for (int c = 0; c < bottom[0]->shape(softmax_axis_); ++c) {
-                bottom_diff[i * dim + c * inner_num_ + j] = 0;
-              }
-            } else {
-              bottom_diff[i * dim + label_value * inner_num_ + j] -= 1;
-              for (int c = 0; c < bottom[0]->shape(1); ++c) {
-                bottom_diff[i * dim + c * inner_num_ + j] *= weights[i * inner_num_ + j];
-              }
-              weight_sum += weights[i * inner_num_ + j];
-            }
-          }
+    const Dtype* label = bottom[1]->cpu_data();
+    const Dtype* weights = bottom.size() == 3 ? bottom[2]->cpu_data() : NULL;
+    const int positions = outer_num_ * inner_num_;
+    const int num_blocks = (positions + kSumBlock - 1) / kSumBlock;
+    vector<Dtype> block_weight(num_blocks);
+    int count = 0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+: count) if (num_blocks > 1)
+#endif
+    for (int block = 0; block < num_blocks; ++block) {
+      const int end = std::min(positions, (block + 1) * kSumBlock);
+      Dtype weight = 0;
+      for (int index = block * kSumBlock; index < end; ++index) {
+        const int label_value = static_cast<int>(label[index]);
+        if (has_ignore_label_ && label_value == ignore_label_) {
+          continue;
+        }
+        if (weights) {
+          weight += weights[index];
+        } else {
+          ++count;
         }
-        // Scale gradient
-        Dtype loss_weight = top[0]->cpu_diff()[0] / weight_sum;
-        caffe_scal(prob_.count(), loss_weight, bottom_diff);
-    } else {
-        Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-        const Dtype* prob_data = prob_.cpu_data();
-        caffe_copy(prob_.count(), prob_data, bottom_diff);
-        const Dtype* label = bottom[1]->cpu_data();
-        int dim = prob_.count() / outer_num_;
-        int count = 0;
-        for (int i = 0; i < outer_num_; ++i) {
-          for (int j = 0; j < inner_num_; ++j) {
-            const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-            if (has_ignore_label_ && label_value == ignore_label_) {
-              for (int c = 0; c < bottom[0]->shape(softmax_axis_); ++c) {
-                bottom_diff[i * dim + c * inner_num_ + j] = 0;
-              }
-            } else {
-              bottom_diff[i * dim + label_value * inner_num_ + j] -= 1;
-              ++count;
-            }
+      }
+      block_weight[block] = weight;
+    }
+    Dtype weight_sum = 0;
+    for (int block = 0; block < num_blocks; ++block) {
+      weight_sum += block_weight[block];
+    }
+    const Dtype loss_weight = weights ? top[0]->cpu_diff()[0] / weight_sum :
+        top[0]->cpu_diff()[0] / get_normalizer(normalization_, count);
+
+    // bottom_diff = (prob - onehot(label)) * weight * loss_weight in one
+    // pass over each channel row.
+    const Dtype* prob_data = prob_.cpu_data();
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    const int channels = bottom[0]->shape(softmax_axis_);
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2)
+#endif
+    for (int i = 0; i < outer_num_; ++i) {
+      for (int c = 0; c < channels; ++c) {
+        const int offset = (i * channels + c) * inner_num_;
+        const Dtype* label_row = label + i * inner_num_;
+        for (int j = 0; j < inner_num_; ++j) {
+          const int label_value = static_cast<int>(label_row[j]);
+          Dtype scale = loss_weight;
+          if (has_ignore_label_ && label_value == ignore_label_) {
+            scale = 0;
+          } else if (weights) {
+            scale *= weights[i * inner_num_ + j];
           }
+          bottom_diff[offset + j] = scale *
+              (prob_data[offset + j] - (label_value == c ? 1 : 0));
         }
-        // Scale gradient
-        Dtype loss_weight = top[0]->cpu_diff()[0] / get_normalizer(normalization_, count);
-        caffe_scal(prob_.count(), loss_weight, bottom_diff);
+      }
     }
-}
+  }
 
 #if DUMP_LAYER_IO
   FILE *fp = NULL;
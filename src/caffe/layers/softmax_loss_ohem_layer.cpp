@@ -42,6 +42,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "caffe/layers/softmax_loss_ohem_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/softmax.hpp"
 
 namespace caffe {
 
@@ -94,6 +95,8 @@ void SoftmaxWithLossOHEMLayer<Dtype>::Reshape(
     top[1]->ReshapeLike(*bottom[0]);
   }
 
+  log_norm_.ReshapeLike(*bottom[1]);
+
   // top[2] stores per-instance loss, which takes the shape of N*1*H*W
   if (top.size() >= 3) {
     top[2]->ReshapeLike(*bottom[1]);
@@ -133,34 +136,40 @@ Dtype SoftmaxWithLossOHEMLayer<Dtype>::get_normalizer(
 template <typename Dtype>
 void SoftmaxWithLossOHEMLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
+  // The forward pass computes the softmax prob values together with the
+  // log normalizers, so the per-instance loss is taken from the scores.
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const int channels = bottom[0]->shape(softmax_axis_);
+  softmax_cpu(bottom_data, outer_num_, channels, inner_num_,
+      prob_.mutable_cpu_data(), log_norm_.mutable_cpu_data());
+  const Dtype* log_norm = log_norm_.cpu_data();
   const Dtype* label = bottom[1]->cpu_data();
-  int dim = prob_.count() / outer_num_;
+  const Dtype log_min = log(Dtype(FLT_MIN));
+  const int dim = channels * inner_num_;
+  const int positions = outer_num_ * inner_num_;
   Dtype* loss_data = bottom[0]->mutable_cpu_diff();
   int count = 0;
   Dtype loss = 0;
-
-  for (int i = 0; i < outer_num_; ++i) {
-    for (int j = 0; j < inner_num_; j++) {
-      const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-      if (has_ignore_label_ && label_value == ignore_label_) {
-        continue;
-      }
-      DCHECK_GE(label_value, 0);
-      DCHECK_LT(label_value, prob_.shape(softmax_axis_));
-
-      // loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
-      //                      Dtype(FLT_MIN)));
-      loss_data[i * inner_num_ + j] = -log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
-                                           Dtype(FLT_MIN)));
-      ++count;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+: loss, count) if (inner_num_ > 1)
+#endif
+  for (int index = 0; index < positions; ++index) {
+    const int label_value = static_cast<int>(label[index]);
+    if (has_ignore_label_ && label_value == ignore_label_) {
+      loss_data[index] = 0;
+      continue;
     }
+    DCHECK_GE(label_value, 0);
+    DCHECK_LT(label_value, channels);
+    const int i = index / inner_num_;
+    const int j = index % inner_num_;
+    loss_data[index] = -std::max(log_min,
+        bottom_data[i * dim + label_value * inner_num_ + j] -
+        log_norm[index]);
+    loss += loss_data[index];
+    ++count;
   }
 
-  loss = caffe_cpu_asum(count, loss_data);
   top[0]->mutable_cpu_data()[0] = loss / get_normalizer(normalization_, count);
   if (top.size() == 2) {
     top[1]->ShareData(prob_);
@@ -185,29 +194,43 @@ void SoftmaxWithLossOHEMLayer<Dtype>::Backward_cpu(
   }
 
   if (propagate_down[0]) {
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const Dtype* prob_data = prob_.cpu_data();
-    caffe_copy(prob_.count(), prob_data, bottom_diff);
     const Dtype* label = bottom[1]->cpu_data();
-    int dim = prob_.count() / outer_num_;
+    const int positions = outer_num_ * inner_num_;
     int count = 0;
+#ifdef _OPENMP
+#pragma omp parallel for reduction(+: count)
+#endif
+    for (int index = 0; index < positions; ++index) {
+      if (!has_ignore_label_ ||
+          static_cast<int>(label[index]) != ignore_label_) {
+        ++count;
+      }
+    }
+    const Dtype loss_weight =
+        top[0]->cpu_diff()[0] / get_normalizer(normalization_, count);
+
+    // bottom_diff = (prob - onehot(label)) * loss_weight in one pass over
+    // each channel row.
+    const Dtype* prob_data = prob_.cpu_data();
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    const int channels = bottom[0]->shape(softmax_axis_);
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2)
+#endif
     for (int i = 0; i < outer_num_; ++i) {
-      for (int j = 0; j < inner_num_; ++j) {
-        const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-        if (has_ignore_label_ && label_value == ignore_label_) {
-          for (int c = 0; c < bottom[0]->shape(softmax_axis_); ++c) {
-            bottom_diff[i * dim + c * inner_num_ + j] = 0;
-          }
-        } else {
-          bottom_diff[i * dim + label_value * inner_num_ + j] -= 1;
-          ++count;
+      for (int c = 0; c < channels; ++c) {
+        const int offset = (i * channels + c) * inner_num_;
+        const Dtype* label_row = label + i * inner_num_;
+        for (int j = 0; j < inner_num_; ++j) {
+          const int label_value = static_cast<int>(label_row[j]);
+          const Dtype scale =
+              (has_ignore_label_ && label_value == ignore_label_) ?
+              Dtype(0) : loss_weight;
+          bottom_diff[offset + j] = scale *
+              (prob_data[offset + j] - (label_value == c ? 1 : 0));
         }
       }
     }
-
-    // Scale gradient
-    Dtype loss_weight = top[0]->cpu_diff()[0] / get_normalizer(normalization_, count);
-    caffe_scal(prob_.count(), loss_weight, bottom_diff);
   }
 }
 
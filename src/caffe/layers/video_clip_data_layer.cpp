@@ -0,0 +1,305 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/data_transformer.hpp"
+#include "caffe/layers/video_clip_data_layer.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+VideoClipDataLayer<Dtype>::~VideoClipDataLayer<Dtype>() {
+  this->StopInternalThread();
+}
+
+template <typename Dtype>
+void VideoClipDataLayer<Dtype>::DataLayerSetUp(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  const VideoClipDataParameter& clip_param =
+      this->layer_param_.video_clip_data_param();
+  const int new_height = clip_param.new_height();
+  const int new_width  = clip_param.new_width();
+  const int clip_length = clip_param.clip_length();
+  string root_folder = clip_param.root_folder();
+
+  CHECK((new_height == 0 && new_width == 0) ||
+      (new_height > 0 && new_width > 0)) << "Current implementation requires "
+      "new_height and new_width to be set at the same time.";
+  CHECK_GT(clip_length, 0) << "Positive clip length required";
+  CHECK_GT(clip_param.temporal_stride(), 0)
+      << "Positive temporal stride required";
+  // Read the file with video paths and labels
+  const string& source = clip_param.source();
+  LOG(INFO) << "Opening file " << source;
+  std::ifstream infile(source.c_str());
+  string line;
+  size_t pos;
+  int label;
+  while (std::getline(infile, line)) {
+    pos = line.find_last_of(' ');
+    label = atoi(line.substr(pos + 1).c_str());
+    lines_.push_back(std::make_pair(line.substr(0, pos), label));
+  }
+
+  CHECK(!lines_.empty()) << "File is empty";
+
+  if (clip_param.shuffle()) {
+    // randomly shuffle data
+    LOG(INFO) << "Shuffling data";
+    const unsigned int prefetch_rng_seed = caffe_rng_rand();
+    prefetch_rng_.reset(new Caffe::RNG(prefetch_rng_seed));
+    ShuffleVideos();
+  }
+  LOG(INFO) << "A total of " << lines_.size() << " videos.";
+  lines_id_ = 0;
+
+  // Read a clip, and use its first frame to initialize the top blob.
+  vector<cv::Mat> frames;
+  ReadClip(root_folder + lines_[lines_id_].first, 0, &frames);
+  // Use data_transformer to infer the shape of a transformed frame.
+  frame_shape_ = this->data_transformer_->InferBlobShape(frames[0]);
+  const int batch_size = clip_param.batch_size();
+  CHECK_GT(batch_size, 0) << "Positive batch size required";
+  vector<int> top_shape(5);
+  top_shape[0] = batch_size;
+  top_shape[1] = frame_shape_[1];
+  top_shape[2] = clip_length;
+  top_shape[3] = frame_shape_[2];
+  top_shape[4] = frame_shape_[3];
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
+  }
+  top[0]->Reshape(top_shape);
+
+  LOG(INFO) << "output data size: " << top[0]->shape_string();
+  // label
+  vector<int> label_shape(1, batch_size);
+  top[1]->Reshape(label_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->label_.Reshape(label_shape);
+  }
+}
+
+template <typename Dtype>
+void VideoClipDataLayer<Dtype>::ShuffleVideos() {
+  caffe::rng_t* prefetch_rng =
+      static_cast<caffe::rng_t*>(prefetch_rng_->generator());
+  shuffle(lines_.begin(), lines_.end(), prefetch_rng);
+}
+
+template <typename Dtype>
+void VideoClipDataLayer<Dtype>::ReadClip(const string& path,
+      unsigned int offset_rand, vector<cv::Mat>* frames) {
+  const VideoClipDataParameter& clip_param =
+      this->layer_param_.video_clip_data_param();
+  const int new_height = clip_param.new_height();
+  const int new_width = clip_param.new_width();
+  const bool is_color = clip_param.is_color();
+  const int clip_length = clip_param.clip_length();
+  const int stride = clip_param.temporal_stride();
+  const bool random_offset =
+      clip_param.random_offset() && this->phase_ == TRAIN;
+
+  const bool is_dir = boost::filesystem::is_directory(path);
+  vector<string> frame_files;
+  cv::VideoCapture cap;
+  int num_frames;
+  if (is_dir) {
+    boost::filesystem::directory_iterator it(path), end;
+    for (; it != end; ++it) {
+      if (boost::filesystem::is_regular_file(it->status())) {
+        frame_files.push_back(it->path().string());
+      }
+    }
+    std::sort(frame_files.begin(), frame_files.end());
+    num_frames = frame_files.size();
+  } else {
+    CHECK(cap.open(path)) << "Could not open " << path;
+    num_frames = cap.get(CV_CAP_PROP_FRAME_COUNT);
+  }
+  CHECK_GT(num_frames, 0) << "No frames in " << path;
+
+  const int span = (clip_length - 1) * stride + 1;
+  const int starts = std::max(num_frames - span, 0) + 1;
+  const int start = random_offset ? offset_rand % starts : (starts - 1) / 2;
+  int next_frame = start;
+  if (!is_dir && start > 0) {
+    // Backends may seek to a nearby keyframe instead of the frame asked for.
+    // Go on from where the capture reports to be, or from the beginning if
+    // it went past the start.
+    cap.set(CV_CAP_PROP_POS_FRAMES, start);
+    next_frame = cap.get(CV_CAP_PROP_POS_FRAMES);
+    if (next_frame < 0 || next_frame > start) {
+      CHECK(cap.open(path)) << "Could not open " << path;
+      next_frame = 0;
+    }
+  }
+
+  frames->resize(clip_length);
+  for (int d = 0; d < clip_length; ++d) {
+    const int frame_id = std::min(start + d * stride, num_frames - 1);
+    if (d > 0 && frame_id < next_frame) {
+      // Past the end of the video: repeat the last frame.
+      (*frames)[d] = (*frames)[d - 1];
+      continue;
+    }
+    cv::Mat& frame = (*frames)[d];
+    if (is_dir) {
+      frame = ReadImageToCVMat(frame_files[frame_id], new_height, new_width,
+          is_color);
+      CHECK(frame.data) << "Could not load " << frame_files[frame_id];
+    } else {
+      // Only grab the frames in between, they are not needed decoded.
+      bool ok = true;
+      for (; next_frame < frame_id && ok; ++next_frame) {
+        ok = cap.grab();
+      }
+      cv::Mat cv_img;
+      if (!ok || !cap.read(cv_img) || !cv_img.data) {
+        // The frame count of a container may be an estimate.
+        CHECK_GT(d, 0) << "Could not read frame " << frame_id << " of "
+            << path;
+        (*frames)[d] = (*frames)[d - 1];
+        next_frame = num_frames;
+        continue;
+      }
+      if (!is_color && cv_img.channels() == 3) {
+        cv::cvtColor(cv_img, cv_img, cv::COLOR_BGR2GRAY);
+      }
+      if (new_height > 0 && new_width > 0) {
+        cv::resize(cv_img, frame, cv::Size(new_width, new_height));
+      } else {
+        frame = cv_img;
+      }
+    }
+    next_frame = frame_id + 1;
+  }
+}
+
+// This function is called on prefetch thread
+template <typename Dtype>
+void VideoClipDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
+  CHECK(batch->data_.count());
+  const VideoClipDataParameter& clip_param =
+      this->layer_param_.video_clip_data_param();
+  const int batch_size = clip_param.batch_size();
+  const bool random_offset =
+      clip_param.random_offset() && this->phase_ == TRAIN;
+  string root_folder = clip_param.root_folder();
+
+  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
+  Dtype* prefetch_label = batch->label_.mutable_cpu_data();
+  const int channels = batch->data_.shape(1);
+  const int clip_length = batch->data_.shape(2);
+  const int frame_size = batch->data_.count(3);
+  const vector<int>& frame_shape = frame_shape_;
+
+  const int lines_size = lines_.size();
+#ifdef _OPENMP
+  #pragma omp parallel if (batch_size > 1)
+  #pragma omp single nowait
+#endif
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    CHECK_GT(lines_size, lines_id_);
+    int offset = batch->data_.offset(item_id);
+    std::string video_path = root_folder + lines_[lines_id_].first;
+    unsigned int offset_rand = random_offset ? caffe_rng_rand() : 0;
+    // One draw per clip: every frame gets the same crop and mirror.
+    PreclcRandomNumbers precalculated_rand_numbers;
+    this->data_transformer_->GenerateRandNumbers(precalculated_rand_numbers);
+#ifdef _OPENMP
+    #pragma omp task firstprivate(offset, video_path, offset_rand, \
+                                                    precalculated_rand_numbers)
+#endif
+    {
+      vector<cv::Mat> frames;
+      ReadClip(video_path, offset_rand, &frames);
+
+      // Transform each frame, then scatter its channels into the
+      // C x L x H x W clip.
+      Blob<Dtype> frame_data(frame_shape);
+      for (int d = 0; d < clip_length; ++d) {
+        PreclcRandomNumbers rand_numbers = precalculated_rand_numbers;
+        this->data_transformer_->Transform(frames[d], &frame_data,
+            rand_numbers);
+        const Dtype* frame_ptr = frame_data.cpu_data();
+        for (int c = 0; c < channels; ++c) {
+          caffe_copy(frame_size, frame_ptr + c * frame_size, prefetch_data
+              + offset + (c * clip_length + d) * frame_size);
+        }
+      }
+    }
+
+    prefetch_label[item_id] = lines_[lines_id_].second;
+    // go to the next iter
+    lines_id_++;
+    if (lines_id_ >= lines_size) {
+      // We have reached the end. Restart from the first.
+      DLOG(INFO) << "Restarting data prefetching from start.";
+      lines_id_ = 0;
+      if (clip_param.shuffle()) {
+        ShuffleVideos();
+      }
+    }
+  }
+
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+}
+
+INSTANTIATE_CLASS(VideoClipDataLayer);
+REGISTER_LAYER_CLASS(VideoClipData);
+
+}  // namespace caffe
+#endif  // USE_OPENCV
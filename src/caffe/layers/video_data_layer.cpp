@@ -42,6 +42,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 #include <algorithm>
 #include <csignal>
+#include <fstream>  // NOLINT(readability/streams)
 #include <map>
 #include <string>
 #include <vector>
@@ -49,9 +50,54 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/video_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+VideoFrameReader::VideoFrameReader(const string& video_file, int device_id,
+    int skip_frames, int ring_size)
+  : skip_frames_(skip_frames), ring_(ring_size) {
+  if (video_file.empty()) {
+    if (!cap_.open(device_id)) {
+      LOG(FATAL) << "Failed to open webcam: " << device_id;
+    }
+  } else if (!cap_.open(video_file)) {
+    LOG(FATAL) << "Failed to open video: " << video_file;
+  }
+  for (int i = 0; i < ring_size; ++i) {
+    free_.push(i);
+  }
+  StartInternalThread();
+}
+
+VideoFrameReader::~VideoFrameReader() {
+  StopInternalThread();
+  if (cap_.isOpened()) {
+    cap_.release();
+  }
+}
+
+void VideoFrameReader::InternalThreadEntry() {
+  try {
+    bool ended = false;
+    while (!must_stop() && !ended) {
+      const int slot = free_.pop();
+      // Skipped frames are demuxed and decoded but never converted.
+      for (int i = 0; i < skip_frames_ && !ended; ++i) {
+        ended = !cap_.grab();
+      }
+      // Reading into the recycled cv::Mat reuses its buffer.
+      ended = ended || !cap_.read(ring_[slot]) || !ring_[slot].data;
+      if (ended) {
+        ring_[slot].release();
+      }
+      full_.push(slot);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
 template <typename Dtype>
 VideoDataLayer<Dtype>::VideoDataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param) {
@@ -60,9 +106,25 @@ VideoDataLayer<Dtype>::VideoDataLayer(const LayerParameter& param)
 template <typename Dtype>
 VideoDataLayer<Dtype>::~VideoDataLayer() {
   this->StopInternalThread();
-  if (cap_.isOpened()) {
-    cap_.release();
+  readers_.clear();
+}
+
+template <typename Dtype>
+shared_ptr<VideoFrameReader> VideoDataLayer<Dtype>::NextReader() {
+  shared_ptr<VideoFrameReader> reader;
+  const VideoDataParameter& video_data_param =
+      this->layer_param_.video_data_param();
+  if (video_type_ == VideoDataParameter_VideoType_WEBCAM) {
+    if (videos_id_ == 0) {
+      reader.reset(new VideoFrameReader("", video_data_param.device_id(),
+                                        skip_frames_, ring_size_));
+      ++videos_id_;
+    }
+  } else if (videos_id_ < videos_.size()) {
+    reader.reset(new VideoFrameReader(videos_[videos_id_++], 0, skip_frames_,
+                                      ring_size_));
   }
+  return reader;
 }
 
 template <typename Dtype>
@@ -74,38 +136,53 @@ void VideoDataLayer<Dtype>::DataLayerSetUp(
   video_type_ = video_data_param.video_type();
   skip_frames_ = video_data_param.skip_frames();
   CHECK_GE(skip_frames_, 0);
+  // Room for the frames of a whole batch, so that taking them never waits on
+  // their transformation, and for decode_ahead more.
+  ring_size_ = batch_size + video_data_param.decode_ahead();
 
-  // Read an image, and use it to initialize the top blob.
-  cv::Mat cv_img;
-  if (video_type_ == VideoDataParameter_VideoType_WEBCAM) {
-    const int device_id = video_data_param.device_id();
-    if (!cap_.open(device_id)) {
-      LOG(FATAL) << "Failed to open webcam: " << device_id;
-    }
-    cap_ >> cv_img;
-  } else if (video_type_ == VideoDataParameter_VideoType_VIDEO) {
-    CHECK(video_data_param.has_video_file()) << "Must provide video file!";
-    const string& video_file = video_data_param.video_file();
-    if (!cap_.open(video_file)) {
-      LOG(FATAL) << "Failed to open video: " << video_file;
+  int decode_threads = 1;
+  videos_.clear();
+  videos_id_ = 0;
+  if (video_type_ == VideoDataParameter_VideoType_VIDEO) {
+    if (video_data_param.has_source()) {
+      const string& source = video_data_param.source();
+      LOG(INFO) << "Opening file " << source;
+      std::ifstream infile(source.c_str());
+      CHECK(infile.good()) << "Failed to open source file: " << source;
+      string line;
+      while (std::getline(infile, line)) {
+        if (!line.empty()) {
+          videos_.push_back(line);
+        }
+      }
+      CHECK(!videos_.empty()) << "File is empty: " << source;
+      LOG(INFO) << "A total of " << videos_.size() << " videos.";
+      decode_threads = std::min<int>(video_data_param.decode_threads(),
+                                     videos_.size());
+      CHECK_GT(decode_threads, 0);
+    } else {
+      CHECK(video_data_param.has_video_file()) << "Must provide video file!";
+      videos_.push_back(video_data_param.video_file());
     }
-    total_frames_ = cap_.get(CV_CAP_PROP_FRAME_COUNT);
-    processed_frames_ = 0;
-    // Read image to infer shape.
-    cap_ >> cv_img;
-    // Set index back to the first frame.
-    cap_.set(CV_CAP_PROP_POS_FRAMES, 0);
-  } else {
+  } else if (video_type_ != VideoDataParameter_VideoType_WEBCAM) {
     LOG(FATAL) << "Unknow video type!";
   }
+  readers_.clear();
+  readers_id_ = 0;
+  for (int i = 0; i < decode_threads; ++i) {
+    readers_.push_back(NextReader());
+  }
+
+  // Use the first frame to initialize the top blob.
+  const cv::Mat& cv_img = readers_[0]->peek();
   CHECK(cv_img.data) << "Could not load image!";
   // Use data_transformer to infer the expected blob shape from a cv_image.
   top_shape_ = this->data_transformer_->InferBlobShape(cv_img);
   this->transformed_data_.Reshape(top_shape_);
   top_shape_[0] = batch_size;
   top[0]->Reshape(top_shape_);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape_);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape_);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -114,8 +191,8 @@ void VideoDataLayer<Dtype>::DataLayerSetUp(
   if (this->output_labels_) {
     vector<int> label_shape(1, batch_size);
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
 }
@@ -128,6 +205,7 @@ void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   double read_time = 0;
   double trans_time = 0;
   CPUTimer timer;
+  CPUTimer trans_timer;
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
 
@@ -136,6 +214,7 @@ void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   const int batch_size = this->layer_param_.data_param().batch_size();
   top_shape_[0] = 1;
   this->transformed_data_.Reshape(top_shape_);
+  const vector<int> item_shape = top_shape_;
   // Reshape batch according to the batch_size.
   top_shape_[0] = batch_size;
   batch->data_.Reshape(top_shape_);
@@ -146,50 +225,68 @@ void VideoDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
     top_label = batch->label_.mutable_cpu_data();
   }
 
-  int skip_frames = skip_frames_;
-  for (int item_id = 0; item_id < batch_size; ++item_id) {
+  // Frames are taken in turn from the videos being decoded and transformed
+  // while the next ones are being waited for.
+  int num_items = 0;
+  trans_timer.Start();
+#ifdef _OPENMP
+  #pragma omp parallel if (batch_size > 1)
+  #pragma omp single nowait
+#endif
+  while (num_items < batch_size && !readers_.empty()) {
     timer.Start();
-    cv::Mat cv_img;
-    if (video_type_ == VideoDataParameter_VideoType_WEBCAM) {
-      cap_ >> cv_img;
-    } else if (video_type_ == VideoDataParameter_VideoType_VIDEO) {
-      if (processed_frames_ >= total_frames_) {
-        LOG(INFO) << "Finished processing video.";
-        raise(SIGINT);
+    readers_id_ %= readers_.size();
+    shared_ptr<VideoFrameReader> reader = readers_[readers_id_];
+    int slot = reader->pop();
+    read_time += timer.MicroSeconds();
+    if (!reader->frame(slot).data) {
+      // The next video of the list takes the place of the finished one.
+      readers_[readers_id_] = NextReader();
+      if (!readers_[readers_id_]) {
+        readers_.erase(readers_.begin() + readers_id_);
       }
-      ++processed_frames_;
-      cap_ >> cv_img;
-    } else {
-      LOG(FATAL) << "Unknown video type.";
+      continue;
     }
-    CHECK(cv_img.data) << "Could not load image!";
-    read_time += timer.MicroSeconds();
-    if (skip_frames > 0) {
-      --skip_frames;
-      --item_id;
-    } else {
-      skip_frames = skip_frames_;
-      timer.Start();
+    ++readers_id_;
+    const int item_id = num_items++;
+    int offset = batch->data_.offset(item_id);
+    if (this->output_labels_) {
+      top_label[item_id] = 0;
+    }
+#ifdef _OPENMP
+    PreclcRandomNumbers precalculated_rand_numbers;
+    this->data_transformer_->GenerateRandNumbers(precalculated_rand_numbers);
+    #pragma omp task firstprivate(offset, reader, slot, \
+                                  precalculated_rand_numbers)
+#endif
+    {
       // Apply transformations (mirror, crop...) to the image
-      int offset = batch->data_.offset(item_id);
+#ifdef _OPENMP
+      Blob<Dtype> tmp_data(item_shape);
+      tmp_data.set_cpu_data(top_data + offset);
+      this->data_transformer_->Transform(reader->frame(slot), &tmp_data,
+                                         precalculated_rand_numbers);
+#else
       this->transformed_data_.set_cpu_data(top_data + offset);
-      this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-      trans_time += timer.MicroSeconds();
+      this->data_transformer_->Transform(reader->frame(slot),
+                                         &(this->transformed_data_));
+#endif
+      reader->push(slot);
     }
-    CHECK(cv_img.data) << "Could not load image!";
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
+  }
+  trans_timer.Stop();
+  if (num_items < batch_size) {
+    LOG(INFO) << "Finished processing video.";
+    caffe_set(batch->data_.count(num_items), Dtype(0),
+              top_data + batch->data_.offset(num_items));
     if (this->output_labels_) {
-      top_label[item_id] = 0;
+      caffe_set(batch_size - num_items, Dtype(0), top_label + num_items);
     }
+    raise(SIGINT);
   }
-  timer.Stop();
   batch_timer.Stop();
+  // The frames are transformed while the next ones are read.
+  trans_time = trans_timer.MicroSeconds() - read_time;
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
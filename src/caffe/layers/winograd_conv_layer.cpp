@@ -0,0 +1,315 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Tiles transformed together; their transformed inputs and outputs are the
+// GEMM operands and should stay in L2.
+const int kTileBlock = 16;
+
+// Transformation matrices of F(2x2,3x3) and F(4x4,3x3), as in Lavin and
+// Gray, "Fast Algorithms for Convolutional Neural Networks".
+const float kInputTransform2[4 * 4] = {
+  1,  0, -1,  0,
+  0,  1,  1,  0,
+  0, -1,  1,  0,
+  0,  1,  0, -1
+};
+const float kFilterTransform2[4 * 3] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1
+};
+const float kOutputTransform2[2 * 4] = {
+  1, 1,  1,  0,
+  0, 1, -1, -1
+};
+const float kInputTransform4[6 * 6] = {
+  4,  0, -5,  0, 1, 0,
+  0, -4, -4,  1, 1, 0,
+  0,  4, -4, -1, 1, 0,
+  0, -2, -1,  2, 1, 0,
+  0,  2, -1, -2, 1, 0,
+  0,  4,  0, -5, 0, 1
+};
+const float kFilterTransform4[6 * 3] = {
+  1 / 4.f,   0,         0,
+  -1 / 6.f,  -1 / 6.f,  -1 / 6.f,
+  -1 / 6.f,  1 / 6.f,   -1 / 6.f,
+  1 / 24.f,  1 / 12.f,  1 / 6.f,
+  1 / 24.f,  -1 / 12.f, 1 / 6.f,
+  0,         0,         1
+};
+const float kOutputTransform4[4 * 6] = {
+  1, 1,  1, 1,  1, 0,
+  0, 1, -1, 2, -2, 0,
+  0, 1,  1, 4,  4, 0,
+  0, 1, -1, 8, -8, 1
+};
+
+// out (rows x cols) = left (rows x inner) * x (inner x inner2)
+//                     * right^T (inner2 x cols)
+template <typename Dtype>
+void Sandwich(const float* left, int rows, int inner, const Dtype* x,
+    int inner2, const float* right, int cols, Dtype* out) {
+  Dtype tmp[6 * 6];
+  for (int r = 0; r < rows; ++r) {
+    for (int j = 0; j < inner2; ++j) {
+      Dtype sum = 0;
+      for (int k = 0; k < inner; ++k) {
+        sum += left[r * inner + k] * x[k * inner2 + j];
+      }
+      tmp[r * inner2 + j] = sum;
+    }
+  }
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      Dtype sum = 0;
+      for (int j = 0; j < inner2; ++j) {
+        sum += tmp[r * inner2 + j] * right[c * inner2 + j];
+      }
+      out[r * cols + c] = sum;
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  DirectConvolutionLayer<Dtype>::Reshape(bottom, top);
+  const typename DirectConvolutionLayer<Dtype>::Geometry& g =
+      this->geometry_;
+  const int previous_tile = tile_;
+  tile_ = 0;
+  if (this->direct_ && g.kernel_h == 3 && g.kernel_w == 3 &&
+      g.stride_h == 1 && g.stride_w == 1 &&
+      g.dilation_h == 1 && g.dilation_w == 1) {
+    tile_ = g.out_height >= 8 && g.out_width >= 8 ? 4 : 2;
+  }
+  if (tile_ != previous_tile) {
+    cached_weights_.clear();
+  }
+  if (!tile_) {
+    return;
+  }
+  alpha_ = tile_ + 2;
+  tiles_h_ = (g.out_height + tile_ - 1) / tile_;
+  tiles_w_ = (g.out_width + tile_ - 1) / tile_;
+  num_threads_ = 1;
+#ifdef _OPENMP
+  num_threads_ = omp_get_max_threads();
+#endif
+  const int in_per_group = g.channels / g.group;
+  const int out_per_group = g.num_output / g.group;
+  transformed_weights_.resize(
+      alpha_ * alpha_ * g.num_output * in_per_group);
+  scratch_.resize(static_cast<size_t>(num_threads_) * alpha_ * alpha_
+      * (in_per_group + out_per_group) * kTileBlock);
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformWeights(const Dtype* weight) {
+  const typename DirectConvolutionLayer<Dtype>::Geometry& g =
+      this->geometry_;
+  const float* filter_transform =
+      tile_ == 4 ? kFilterTransform4 : kFilterTransform2;
+  const int in_per_group = g.channels / g.group;
+  const int out_per_group = g.num_output / g.group;
+  const int elements = alpha_ * alpha_;
+#ifdef _OPENMP
+  #pragma omp parallel for collapse(2)
+#endif
+  for (int oc = 0; oc < g.num_output; ++oc) {
+    for (int icg = 0; icg < in_per_group; ++icg) {
+      const int grp = oc / out_per_group;
+      const int ocg = oc % out_per_group;
+      Dtype u[6 * 6];
+      Sandwich(filter_transform, alpha_, 3, weight + (oc * in_per_group + icg)
+          * 9, 3, filter_transform, alpha_, u);
+      for (int xi = 0; xi < elements; ++xi) {
+        transformed_weights_[((grp * elements + xi) * out_per_group + ocg)
+            * in_per_group + icg] = u[xi];
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!tile_) {
+    DirectConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int weight_count = this->blobs_[0]->count();
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  if (cached_weights_.size() != weight_count ||
+      !std::equal(weight, weight + weight_count, cached_weights_.begin())) {
+    TransformWeights(weight);
+    cached_weights_.assign(weight, weight + weight_count);
+  }
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+
+  const typename DirectConvolutionLayer<Dtype>::Geometry& g =
+      this->geometry_;
+  const float* input_transform =
+      tile_ == 4 ? kInputTransform4 : kInputTransform2;
+  const float* output_transform =
+      tile_ == 4 ? kOutputTransform4 : kOutputTransform2;
+  const int in_per_group = g.channels / g.group;
+  const int out_per_group = g.num_output / g.group;
+  const int elements = alpha_ * alpha_;
+  const int in_plane = g.height * g.width;
+  const int out_plane = g.out_height * g.out_width;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int num_blocks = (num_tiles + kTileBlock - 1) / kTileBlock;
+  const size_t scratch_size = scratch_.size() / num_threads_;
+  // Taken now rather than at Reshape, so that a branch group's share of the
+  // threads is respected.
+  int num_threads = 1;
+#ifdef _OPENMP
+  num_threads = std::min(omp_get_max_threads(), num_threads_);
+#endif
+
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+#ifdef _OPENMP
+    #pragma omp parallel for collapse(3) num_threads(num_threads)
+#endif
+    for (int n = 0; n < this->num_; ++n) {
+      for (int grp = 0; grp < g.group; ++grp) {
+        for (int block = 0; block < num_blocks; ++block) {
+          int tid = 0;
+#ifdef _OPENMP
+          tid = omp_get_thread_num();
+#endif
+          Dtype* transformed_input = &scratch_[tid * scratch_size];
+          Dtype* transformed_output =
+              transformed_input + elements * in_per_group * kTileBlock;
+          const int tile_begin = block * kTileBlock;
+          const int block_tiles = std::min(kTileBlock, num_tiles - tile_begin);
+
+          // Input tiles, zero outside of the image, laid out as one
+          // in_per_group x block_tiles matrix per tile element.
+          for (int icg = 0; icg < in_per_group; ++icg) {
+            const Dtype* in_channel = bottom_data
+                + (n * g.channels + grp * in_per_group + icg) * in_plane;
+            for (int t = 0; t < block_tiles; ++t) {
+              const int y0 = (tile_begin + t) / tiles_w_ * tile_ - g.pad_h;
+              const int x0 = (tile_begin + t) % tiles_w_ * tile_ - g.pad_w;
+              Dtype d[6 * 6];
+              for (int y = 0; y < alpha_; ++y) {
+                for (int x = 0; x < alpha_; ++x) {
+                  const int h = y0 + y;
+                  const int w = x0 + x;
+                  d[y * alpha_ + x] =
+                      h >= 0 && h < g.height && w >= 0 && w < g.width ?
+                      in_channel[h * g.width + w] : Dtype(0);
+                }
+              }
+              Dtype v[6 * 6];
+              Sandwich(input_transform, alpha_, alpha_, d, alpha_,
+                  input_transform, alpha_, v);
+              for (int xi = 0; xi < elements; ++xi) {
+                transformed_input[(xi * in_per_group + icg) * block_tiles + t]
+                    = v[xi];
+              }
+            }
+          }
+
+          // Element-wise products, summed over the input channels.
+          for (int xi = 0; xi < elements; ++xi) {
+            caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_per_group,
+                block_tiles, in_per_group, (Dtype)1.,
+                &transformed_weights_[(grp * elements + xi) * out_per_group
+                    * in_per_group],
+                transformed_input + xi * in_per_group * block_tiles,
+                (Dtype)0.,
+                transformed_output + xi * out_per_group * block_tiles);
+          }
+
+          // Output tiles, clipped to the output.
+          for (int ocg = 0; ocg < out_per_group; ++ocg) {
+            const int oc = grp * out_per_group + ocg;
+            Dtype* out_channel = top_data + (n * g.num_output + oc) * out_plane;
+            const Dtype value = bias ? bias[oc] : Dtype(0);
+            for (int t = 0; t < block_tiles; ++t) {
+              Dtype m[6 * 6];
+              for (int xi = 0; xi < elements; ++xi) {
+                m[xi] = transformed_output[(xi * out_per_group + ocg)
+                    * block_tiles + t];
+              }
+              Dtype y[4 * 4];
+              Sandwich(output_transform, tile_, alpha_, m, alpha_,
+                  output_transform, tile_, y);
+              const int y0 = (tile_begin + t) / tiles_w_ * tile_;
+              const int x0 = (tile_begin + t) % tiles_w_ * tile_;
+              const int rows = std::min(tile_, g.out_height - y0);
+              const int cols = std::min(tile_, g.out_width - x0);
+              for (int r = 0; r < rows; ++r) {
+                for (int c = 0; c < cols; ++c) {
+                  out_channel[(y0 + r) * g.out_width + x0 + c] =
+                      y[r * tile_ + c] + value;
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -45,7 +45,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "hdf5.h"
 
 #include "caffe/common.hpp"
+#include "caffe/engine_parser.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/concat_layer.hpp"
+#include "caffe/layers/fused_neuron_layer.hpp"
+#include "caffe/layers/slice_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
@@ -60,6 +64,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/util/benchmark.hpp"
 #include "caffe/multinode/mlsl.hpp"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 PERFORMANCE_CREATE_MONITOR();
 
 namespace caffe {
@@ -122,6 +130,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
 
   // Set phase from the state.
   phase_ = in_param.state().phase();
+  latency_mode_ = in_param.latency_mode();
+  sparse_updates_ = false;
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
@@ -207,7 +217,8 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     } else {
       layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
     }
- 
+    layers_[layer_id]->set_latency_mode(latency_mode_);
+
     layer_names_.push_back(layer_param.name());
     LOG_IF(INFO, Caffe::root_solver())
         << "Creating Layer " << layer_param.name();
@@ -436,9 +447,29 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
+  for (size_t layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    FusedNeuronLayer<Dtype>* fused_layer =
+        dynamic_cast<FusedNeuronLayer<Dtype>*>(layers_[layer_id].get());
+    if (fused_layer == NULL) {
+      continue;
+    }
+    // In place, the layer keeps a copy of its input only for backward.
+    fused_layer->set_need_backward(layer_need_backward_[layer_id]);
+    const FusedNeuronParameter& fused_param =
+        fused_layer->layer_param().fused_neuron_param();
+    for (int j = 0; j < fused_param.layer_size(); ++j) {
+      fused_layer_names_index_[fused_param.layer(j).name()] = layer_id;
+    }
+  }
   ShareWeights();
+  if (param.has_numa_param()) {
+    SetUpNumaPlacement(param.numa_param());
+  }
   debug_info_ = param.debug_info();
   time_info_ = param.time_info();
+  set_branch_groups(std::max(1, param.branch_groups()));
+  BuildLayerDependencies();
+  ShareConcatSliceBuffers();
   
 
   // LOG(ERROR) << "init done with time_info " << time_info_;
@@ -476,6 +507,24 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
+template <typename Dtype>
+void Net<Dtype>::SetUpNumaPlacement(const NumaParameter& numa_param) {
+  LOG_IF(INFO, Caffe::root_solver()) << "NUMA nodes: " << numa::NumNodes()
+      << ", weights: " << NumaParameter_Policy_Name(numa_param.weight_policy())
+      << ", activations: "
+      << NumaParameter_Policy_Name(numa_param.activation_policy());
+  const numa::Placement activations(numa_param,
+                                    numa_param.activation_policy());
+  for (int i = 0; i < blobs_.size(); ++i) {
+    blobs_[i]->set_placement(activations);
+  }
+  // Parameters come last so that they win over activations sharing them.
+  const numa::Placement weights(numa_param, numa_param.weight_policy());
+  for (int i = 0; i < params_.size(); ++i) {
+    params_[i]->set_placement(weights);
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::SetPhase(Phase phase) {
   // set all layers
@@ -486,6 +535,164 @@ void Net<Dtype>::SetPhase(Phase phase) {
   phase_ = phase;
 }
 
+template <typename Dtype>
+void Net<Dtype>::SetLatencyMode(bool latency_mode) {
+  for (int i = 0; i < layers_.size(); ++i) {
+    layers_[i]->set_latency_mode(latency_mode);
+  }
+  latency_mode_ = latency_mode;
+  // Layers choose their threading in Reshape.
+  Reshape();
+}
+
+template <typename Dtype>
+void Net<Dtype>::BuildLayerDependencies() {
+  // A layer waits for the last writer of every blob it reads or writes, for
+  // the readers of every blob it overwrites (in-place layers) and for the
+  // previous user of each of its parameters, as shared parameters
+  // accumulate their diffs into one blob. Blobs sharing memory (e.g. the
+  // tops of Split, Flatten or Reshape) count as one.
+  const int num_layers = layers_.size();
+  layer_deps_.assign(num_layers, vector<int>());
+  layer_users_.assign(num_layers, vector<int>());
+  map<const SyncedMemory*, int> storage_ids;
+  vector<int> storage(blobs_.size());
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    storage[blob_id] = blob_id;
+    if (blobs_[blob_id]->count() > 0) {
+      const SyncedMemory* data = blobs_[blob_id]->data().get();
+      storage[blob_id] =
+          storage_ids.insert(std::make_pair(data, blob_id)).first->second;
+    }
+  }
+  vector<int> last_writer(blobs_.size(), -1);
+  vector<vector<int> > readers(blobs_.size());
+  vector<int> last_param_user(learnable_params_.size(), -1);
+  for (int i = 0; i < num_layers; ++i) {
+    set<int> deps;
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      const int id = storage[bottom_id_vecs_[i][j]];
+      if (last_writer[id] >= 0) { deps.insert(last_writer[id]); }
+    }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int id = storage[top_id_vecs_[i][j]];
+      if (last_writer[id] >= 0) { deps.insert(last_writer[id]); }
+      deps.insert(readers[id].begin(), readers[id].end());
+    }
+    for (int j = 0; j < param_id_vecs_[i].size(); ++j) {
+      const int id = learnable_param_ids_[param_id_vecs_[i][j]];
+      if (last_param_user[id] >= 0) { deps.insert(last_param_user[id]); }
+      last_param_user[id] = i;
+    }
+    deps.erase(i);
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      readers[storage[bottom_id_vecs_[i][j]]].push_back(i);
+    }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int id = storage[top_id_vecs_[i][j]];
+      last_writer[id] = i;
+      readers[id].clear();
+    }
+    layer_deps_[i].assign(deps.begin(), deps.end());
+    for (set<int>::const_iterator it = deps.begin(); it != deps.end(); ++it) {
+      layer_users_[*it].push_back(i);
+    }
+  }
+}
+
+template <typename Dtype>
+bool Net<Dtype>::UseBranchGroups() const {
+#if defined(_OPENMP) && !defined(USE_MLSL)
+  // Debug and timing output is collected per layer in index order.
+  return branch_groups_ > 1 && !debug_info_ && !time_info_ &&
+      Caffe::mode() == Caffe::CPU;
+#else
+  return false;
+#endif
+}
+
+template <typename Dtype>
+void Net<Dtype>::RunLayerGraph(int lo, int hi, bool forward,
+    vector<Dtype>* losses) {
+#ifdef _OPENMP
+  // A layer is ready once its predecessors within [lo, hi] have run;
+  // Backward follows the edges in reverse. The OpenMP tasks are picked up
+  // by whichever group is idle, and each layer parallelizes over its
+  // group's share of the threads.
+  vector<int> pending(layers_.size(), 0);
+  vector<int> ready;
+  for (int i = lo; i <= hi; ++i) {
+    const vector<int>& before = forward ? layer_deps_[i] : layer_users_[i];
+    for (int j = 0; j < before.size(); ++j) {
+      if (before[j] >= lo && before[j] <= hi) { ++pending[i]; }
+    }
+    if (pending[i] == 0) { ready.push_back(i); }
+  }
+  // Layers run on worker threads whose own generators are not seeded by
+  // Caffe::set_random_seed. Each layer gets a seed drawn here in index
+  // order, so a seeded net stays reproducible whatever the schedule.
+  vector<unsigned int> seeds(layers_.size(), 0);
+  for (int i = lo; i <= hi; ++i) {
+    seeds[i] = caffe_rng_rand();
+  }
+  const int groups = std::min(branch_groups_, omp_get_max_threads());
+  const int group_threads = std::max(1, omp_get_max_threads() / groups);
+  const int max_active_levels = omp_get_max_active_levels();
+  omp_set_max_active_levels(std::max(max_active_levels, 2));
+  #pragma omp parallel num_threads(groups)
+  #pragma omp single
+  {
+    for (int i = 0; i < ready.size(); ++i) {
+      #pragma omp task
+      RunLayerTask(ready[i], lo, hi, forward, group_threads, &seeds,
+                   &pending, losses);
+    }
+  }
+  omp_set_max_active_levels(max_active_levels);
+#endif
+}
+
+template <typename Dtype>
+void Net<Dtype>::RunLayerTask(int layer_id, int lo, int hi, bool forward,
+    int group_threads, const vector<unsigned int>* seeds,
+    vector<int>* pending, vector<Dtype>* losses) {
+#ifdef _OPENMP
+  omp_set_num_threads(group_threads);
+  // The task may run on the master thread, whose generator is restored.
+  shared_ptr<Caffe::RNG> thread_rng = Caffe::swap_rng_stream(
+      shared_ptr<Caffe::RNG>(new Caffe::RNG((*seeds)[layer_id])));
+  if (forward) {
+    PERFORMANCE_MEASUREMENT_BEGIN();
+    (*losses)[layer_id] =
+        layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+    PERFORMANCE_MEASUREMENT_END(
+        (std::string("FW_") + layer_names_[layer_id]).c_str());
+  } else if (layer_need_backward_[layer_id]) {
+    PERFORMANCE_MEASUREMENT_BEGIN();
+    layers_[layer_id]->Backward(top_vecs_[layer_id],
+        bottom_need_backward_[layer_id], bottom_vecs_[layer_id]);
+    PERFORMANCE_MEASUREMENT_END(
+        (std::string("BW_") + layer_names_[layer_id]).c_str());
+  }
+  Caffe::swap_rng_stream(thread_rng);
+  #pragma omp flush
+  const vector<int>& after =
+      forward ? layer_users_[layer_id] : layer_deps_[layer_id];
+  for (int j = 0; j < after.size(); ++j) {
+    const int next = after[j];
+    if (next < lo || next > hi) { continue; }
+    int left;
+    #pragma omp atomic capture
+    left = --(*pending)[next];
+    if (left == 0) {
+      #pragma omp task
+      RunLayerTask(next, lo, hi, forward, group_threads, seeds, pending,
+                   losses);
+    }
+  }
+#endif
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
@@ -529,9 +736,19 @@ void Net<Dtype>::CompileNet(const NetParameter& param,
   param_temp2.clear_layer();   // Remove layers
   CompilationRuleTwo(param_temp, &param_temp2);
 
-  param_compiled->CopyFrom(param_temp2);
+  NetParameter param_temp3;  // temporary compiled param
+  param_temp3.CopyFrom(param_temp2);
+  param_temp3.clear_layer();   // Remove layers
+  CompilationRuleThree(param_temp2, &param_temp3);
+
+  NetParameter param_temp4;  // temporary compiled param
+  param_temp4.CopyFrom(param_temp3);
+  param_temp4.clear_layer();   // Remove layers
+  CompilationRuleFour(param_temp3, &param_temp4);
+
+  param_compiled->CopyFrom(param_temp4);
   param_compiled->clear_layer();    // Remove layers
-  CompilationRuleThree(param_temp2, param_compiled);
+  CompilationRuleFive(param_temp4, param_compiled);
 }
 
 template <typename Dtype>
@@ -826,6 +1043,192 @@ void Net<Dtype>::CompilationRuleThree(const NetParameter& param,
   return;
 }
 
+template <typename Dtype>
+void Net<Dtype>::CompilationRuleFour(const NetParameter& param,
+                             NetParameter* param_compiled) {
+  // Optimization rule 4:
+  // - If we are running on CPU and element-wise layers of CAFFE engine
+  // follow each other, each one consuming the top of the previous one,
+  // then we replace them with one FusedNeuron layer which applies
+  // them all in a single pass over the data.
+  // Splits are already inserted, so the tops inside such a chain
+  // have no other consumers. Per layer debug info would be lost,
+  // so then the layers are kept as well, as they are unless the net
+  // opts in with fuse_neurons: true. The parameter specs of Scale
+  // and Bias layers move to the fused layer along with their blobs.
+  // - A chain computed in place would have to keep a copy of its input
+  // for backward, which costs the memory traffic fusing saves, so such
+  // chains are only fused when the net cannot run backward.
+  const bool fuse = Caffe::mode() == Caffe::CPU && !param.debug_info() &&
+      param.fuse_neurons();
+  const bool backward = param.state().phase() == TRAIN ||
+      param.force_backward();
+  int i = 0;
+  while (i < param.layer_size()) {
+    int chain_end = i + 1;
+    if (fuse && IsFusableNeuron(param, i)) {
+      while (chain_end < param.layer_size() &&
+             chain_end - i < FusedNeuronLayer<Dtype>::kMaxOps &&
+             IsFusableNeuron(param, chain_end) &&
+             param.layer(chain_end).bottom(0) ==
+                 param.layer(chain_end - 1).top(0)) {
+        ++chain_end;
+      }
+    }
+    if (chain_end - i < 2) {
+      param_compiled->add_layer()->CopyFrom(param.layer(i));
+      ++i;
+      continue;
+    }
+    if (backward &&
+        param.layer(i).bottom(0) == param.layer(chain_end - 1).top(0)) {
+      for (; i < chain_end; ++i) {
+        param_compiled->add_layer()->CopyFrom(param.layer(i));
+      }
+      continue;
+    }
+
+    LayerParameter* fused_layer_param = param_compiled->add_layer();
+    string fused_name = param.layer(i).name();
+    for (int j = i + 1; j < chain_end; ++j) {
+      fused_name += "+" + param.layer(j).name();
+    }
+    fused_layer_param->set_name(fused_name);
+    fused_layer_param->set_type("FusedNeuron");
+    fused_layer_param->add_bottom(param.layer(i).bottom(0));
+    fused_layer_param->add_top(param.layer(chain_end - 1).top(0));
+    for (int j = i; j < chain_end; ++j) {
+      fused_layer_param->mutable_fused_neuron_param()->add_layer()->CopyFrom(
+          param.layer(j));
+      const int num_blobs =
+          FusedNeuronLayer<Dtype>::NumParamBlobs(param.layer(j));
+      for (int k = 0; k < num_blobs; ++k) {
+        ParamSpec* param_spec = fused_layer_param->add_param();
+        if (k < param.layer(j).param_size()) {
+          param_spec->CopyFrom(param.layer(j).param(k));
+        }
+      }
+    }
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Fusing element-wise layers " << fused_name;
+    i = chain_end;
+  }
+}
+
+template <typename Dtype>
+bool Net<Dtype>::IsFusableNeuron(const NetParameter& param, int layer_id) {
+  // Layers inherit the engine of the net when they have none of their own.
+  LayerParameter layer_param(param.layer(layer_id));
+  if (layer_param.engine() == "") {
+    layer_param.set_engine(param.engine());
+  }
+  return FusedNeuronLayer<Dtype>::CanFuse(layer_param);
+}
+
+template <typename Dtype>
+void Net<Dtype>::CompilationRuleFive(const NetParameter& param,
+                             NetParameter* param_compiled) {
+  // Optimization rule 5:
+  // - If every bottom of a Concat layer of CAFFE engine along axis 1 is
+  // the top of a Flatten layer (axis 1 to the end), whose bottom is the
+  // top of a Permute layer to order (0, 2, 3, 1), then we drop those
+  // Permute and Flatten layers, feed the Permute bottoms to the Concat
+  // and let it write them in channels-last order itself. That saves the
+  // permuted copy and the concatenated copy of every SSD prediction head.
+  // Splits are already inserted, so the Permute and Flatten tops have
+  // no other consumers. Per layer debug info would be lost, so then the
+  // layers are kept as well, as they are unless the net opts in with
+  // fold_permute_flatten: true.
+  const bool fold = !param.debug_info() && param.fold_permute_flatten();
+  std::set<int> layers_to_drop;
+  std::map<int, vector<string> > concat_bottoms;
+  for (int i = 0; fold && i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    if (layer_param.type() != "Concat" || layer_param.bottom_size() == 0) {
+      continue;
+    }
+    const ConcatParameter& concat_param = layer_param.concat_param();
+    const string& engine = layer_param.engine() != "" ?
+        layer_param.engine() : param.engine();
+    if (!((concat_param.engine() == ConcatParameter_Engine_CAFFE) ||
+          (concat_param.engine() == ConcatParameter_Engine_DEFAULT &&
+           (engine == "" || EngineParser(engine).isEngine("CAFFE")))) ||
+        (concat_param.has_axis() ? concat_param.axis() :
+            static_cast<int>(concat_param.concat_dim())) != 1 ||
+        concat_param.channels_last()) {
+      continue;
+    }
+    vector<int> folded;
+    vector<string> bottoms;
+    for (int j = 0; j < layer_param.bottom_size(); ++j) {
+      const int flatten_id = GetBlobProducer(layer_param.bottom(j), param, i);
+      if (flatten_id < 0) {
+        break;
+      }
+      const LayerParameter& flatten_param = param.layer(flatten_id);
+      if (flatten_param.type() != "Flatten" ||
+          flatten_param.bottom_size() != 1 || flatten_param.top_size() != 1 ||
+          flatten_param.bottom(0) == flatten_param.top(0) ||
+          flatten_param.flatten_param().axis() != 1 ||
+          flatten_param.flatten_param().end_axis() != -1) {
+        break;
+      }
+      const int permute_id =
+          GetBlobProducer(flatten_param.bottom(0), param, flatten_id);
+      if (permute_id < 0) {
+        break;
+      }
+      const LayerParameter& permute_param = param.layer(permute_id);
+      const PermuteParameter& order = permute_param.permute_param();
+      if (permute_param.type() != "Permute" ||
+          permute_param.bottom_size() != 1 || permute_param.top_size() != 1 ||
+          permute_param.bottom(0) == permute_param.top(0) ||
+          order.order_size() != 4 || order.order(0) != 0 ||
+          order.order(1) != 2 || order.order(2) != 3 || order.order(3) != 1) {
+        break;
+      }
+      folded.push_back(permute_id);
+      folded.push_back(flatten_id);
+      bottoms.push_back(permute_param.bottom(0));
+    }
+    if (static_cast<int>(bottoms.size()) != layer_param.bottom_size()) {
+      continue;
+    }
+    layers_to_drop.insert(folded.begin(), folded.end());
+    concat_bottoms[i] = bottoms;
+  }
+
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (layers_to_drop.count(i)) {
+      LOG_IF(INFO, Caffe::root_solver()) << "Dropped layer: "
+             << param.layer(i).name() << std::endl;
+      continue;
+    }
+    LayerParameter* layer_param = param_compiled->add_layer();
+    layer_param->CopyFrom(param.layer(i));
+    if (concat_bottoms.count(i)) {
+      layer_param->clear_bottom();
+      for (int j = 0; j < concat_bottoms[i].size(); ++j) {
+        layer_param->add_bottom(concat_bottoms[i][j]);
+      }
+      layer_param->mutable_concat_param()->set_channels_last(true);
+    }
+  }
+}
+
+template <typename Dtype>
+int Net<Dtype>::GetBlobProducer(const string& blob_name,
+                                const NetParameter& param, int layer_id) {
+  for (int i = layer_id - 1; i >= 0; --i) {
+    for (int j = 0; j < param.layer(i).top_size(); ++j) {
+      if (param.layer(i).top(j) == blob_name) {
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
 template <typename Dtype>
 void Net<Dtype>::GetBlobConsumers(
                   std::vector<const LayerParameter*>& consumer_blobs,
@@ -1016,6 +1419,8 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
     }
     learnable_params_.push_back(params_[net_param_id].get());
     learnable_param_ids_.push_back(learnable_param_id);
+    learnable_param_rows_.push_back(
+        layers_[layer_id]->sparse_param_rows(param_id));
     has_params_lr_.push_back(param_spec->has_lr_mult());
     has_params_decay_.push_back(param_spec->has_decay_mult());
     params_lr_.push_back(param_spec->lr_mult());
@@ -1056,6 +1461,8 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
     }
     const int learnable_param_id = learnable_param_ids_[owner_net_param_id];
     learnable_param_ids_.push_back(learnable_param_id);
+    // Only the owner's rows are tracked, so a shared param stays dense.
+    learnable_param_rows_[learnable_param_id] = NULL;
     if (param_spec->has_lr_mult()) {
       if (has_params_lr_[learnable_param_id]) {
         CHECK_EQ(param_spec->lr_mult(), params_lr_[learnable_param_id])
@@ -1093,6 +1500,14 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   }
   
   Dtype loss = 0;
+  if (UseBranchGroups()) {
+    vector<Dtype> losses(layers_.size(), Dtype(0));
+    RunLayerGraph(start, end, true, &losses);
+    for (int i = start; i <= end; ++i) {
+      loss += losses[i];
+    }
+    return loss;
+  }
   for (int i = start; i <= end; ++i) {
     if (time_info_ && iter_cnt >= 1) {
         forward_iter_timer.Start();
@@ -1162,6 +1577,10 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
 
+  if (UseBranchGroups()) {
+    RunLayerGraph(end, start, false, NULL);
+    return;
+  }
   if (time_info_ && iter_cnt >= 1) {
     backward_timer.Start();
   }
@@ -1295,33 +1714,87 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     Layer<Dtype>* source_layer = other->layers()[i].get();
-    const string& source_layer_name = other->layer_names()[i];
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-        layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
-    }
-    if (target_layer_id == layer_names_.size()) {
-      LOG(INFO) << "Ignoring source layer " << source_layer_name;
-      continue;
-    }
-    DLOG(INFO) << "Copying source layer " << source_layer_name;
-    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
-        layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
-        << "Incompatible number of blobs for layer " << source_layer_name;
-    for (int j = 0; j < target_blobs.size(); ++j) {
-      Blob<Dtype>* source_blob = source_layer->blobs()[j].get();
-      CHECK(target_blobs[j]->shape() == source_blob->shape())
-          << "Cannot share param " << j << " weights from layer '"
-          << source_layer_name << "'; shape mismatch.  Source param shape is "
-          << source_blob->shape_string() << "; target param shape is "
-          << target_blobs[j]->shape_string();
-      target_blobs[j]->ShareData(*source_blob);
+    // Fused layers are matched by the layers they replaced, so that nets
+    // fused differently share their weights.
+    vector<string> source_layer_names;
+    vector<int> source_first_blobs;
+    UnfusedLayers(source_layer->layer_param(), source_layer->blobs().size(),
+                  &source_layer_names, &source_first_blobs);
+    for (int k = 0; k < source_layer_names.size(); ++k) {
+      const string& source_layer_name = source_layer_names[k];
+      int target_layer_id, target_first_blob, target_num_blobs;
+      if (!FindUnfusedLayer(source_layer_name, &target_layer_id,
+                            &target_first_blob, &target_num_blobs)) {
+        LOG(INFO) << "Ignoring source layer " << source_layer_name;
+        continue;
+      }
+      DLOG(INFO) << "Copying source layer " << source_layer_name;
+      vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+          layers_[target_layer_id]->blobs();
+      CHECK_EQ(target_num_blobs,
+               source_first_blobs[k + 1] - source_first_blobs[k])
+          << "Incompatible number of blobs for layer " << source_layer_name;
+      for (int j = 0; j < target_num_blobs; ++j) {
+        Blob<Dtype>* source_blob =
+            source_layer->blobs()[source_first_blobs[k] + j].get();
+        Blob<Dtype>* target_blob = target_blobs[target_first_blob + j].get();
+        CHECK(target_blob->shape() == source_blob->shape())
+            << "Cannot share param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape "
+            << "is " << source_blob->shape_string() << "; target param shape "
+            << "is " << target_blob->shape_string();
+        target_blob->ShareData(*source_blob);
+      }
     }
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::UnfusedLayers(const LayerParameter& layer_param,
+    int num_blobs, vector<string>* names, vector<int>* first_blobs) {
+  names->clear();
+  first_blobs->assign(1, 0);
+  if (layer_param.type() != "FusedNeuron") {
+    names->push_back(layer_param.name());
+    first_blobs->push_back(num_blobs);
+    return;
+  }
+  const FusedNeuronParameter& fused_param = layer_param.fused_neuron_param();
+  for (int j = 0; j < fused_param.layer_size(); ++j) {
+    names->push_back(fused_param.layer(j).name());
+    first_blobs->push_back(first_blobs->back() +
+        FusedNeuronLayer<Dtype>::NumParamBlobs(fused_param.layer(j)));
+  }
+  CHECK_EQ(first_blobs->back(), num_blobs)
+      << "Incompatible number of blobs for layer " << layer_param.name();
+}
+
+template <typename Dtype>
+bool Net<Dtype>::FindUnfusedLayer(const string& layer_name, int* layer_id,
+    int* first_blob, int* num_blobs) const {
+  map<string, int>::const_iterator it = layer_names_index_.find(layer_name);
+  if (it != layer_names_index_.end()) {
+    *layer_id = it->second;
+    *first_blob = 0;
+    *num_blobs = layers_[*layer_id]->blobs().size();
+    return true;
+  }
+  it = fused_layer_names_index_.find(layer_name);
+  if (it == fused_layer_names_index_.end()) {
+    return false;
+  }
+  *layer_id = it->second;
+  vector<string> names;
+  vector<int> first_blobs;
+  UnfusedLayers(layers_[*layer_id]->layer_param(),
+                layers_[*layer_id]->blobs().size(), &names, &first_blobs);
+  const int j = std::find(names.begin(), names.end(), layer_name) -
+      names.begin();
+  *first_blob = first_blobs[j];
+  *num_blobs = first_blobs[j + 1] - first_blobs[j];
+  return true;
+}
+
 template <typename Dtype>
 void Net<Dtype>::BackwardFrom(int start) {
   BackwardFromTo(start, 0);
@@ -1356,12 +1829,134 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  ShareConcatSliceBuffers();
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareConcatSliceBuffers() {
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  // Net blobs holding each memory: Split, Flatten, Reshape, ... tops share
+  // the memory of their bottom.
+  map<const SyncedMemory*, int> holders;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    ++holders[blobs_[i]->data().get()];
+    ++holders[blobs_[i]->diff().get()];
+  }
+  // Memory that a layer overwrites in place, and memory that data layers and
+  // callers swap out with set_cpu_data, which would free it under a view.
+  set<const SyncedMemory*> in_place_data;
+  set<const SyncedMemory*> external_data;
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    external_data.insert(blobs_[net_input_blob_indices_[i]]->data().get());
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < top_vecs_[i].size(); ++j) {
+      const SyncedMemory* data = top_vecs_[i][j]->data().get();
+      if (bottom_vecs_[i].empty()) {
+        external_data.insert(data);
+      }
+      for (int k = 0; k < bottom_id_vecs_[i].size(); ++k) {
+        if (bottom_id_vecs_[i][k] == top_id_vecs_[i][j]) {
+          in_place_data.insert(data);
+        }
+      }
+    }
+  }
+  // Blobs a layer shares with memory of its own in Reshape, e.g. with the
+  // unrolled net of a RecurrentLayer. Until its next Forward reshapes it, the
+  // layer would work on its own memory and a Backward on stale gradients.
+  vector<bool> aliased(blobs_.size());
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (!layers_[i]->AliasesBlobsInReshape()) {
+      continue;
+    }
+    for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+      aliased[bottom_id_vecs_[i][j]] = true;
+    }
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      aliased[top_id_vecs_[i][j]] = true;
+    }
+  }
+  // Taken per blob before any of them turns into a view.
+  vector<bool> owned(blobs_.size()), in_place(blobs_.size()),
+      external(blobs_.size());
+  for (int i = 0; i < blobs_.size(); ++i) {
+    const SyncedMemory* data = blobs_[i]->data().get();
+    owned[i] = holders[data] == 1 && holders[blobs_[i]->diff().get()] == 1;
+    in_place[i] = in_place_data.count(data) > 0;
+    external[i] = external_data.count(data) > 0;
+  }
+  // A blob that becomes a view has to be owned by nobody else. Blobs already
+  // made views in this pass are not taken twice.
+  set<int> claimed;
+  const vector<Dtype>& loss_weights = blob_loss_weights_;
+  // Later layers first, so that a Concat feeding a Concat nests its inputs
+  // into the outer output.
+  for (int i = layers_.size() - 1; i >= 0; --i) {
+    const bool concat =
+        dynamic_cast<ConcatLayer<Dtype>*>(layers_[i].get()) != NULL;
+    const bool slice =
+        dynamic_cast<SliceLayer<Dtype>*>(layers_[i].get()) != NULL;
+    if (!concat && !slice) {
+      continue;
+    }
+    const LayerParameter& layer_param = layers_[i]->layer_param();
+    const vector<Blob<Dtype>*>& whole_vec =
+        concat ? top_vecs_[i] : bottom_vecs_[i];
+    const vector<Blob<Dtype>*>& parts = concat ? bottom_vecs_[i] : top_vecs_[i];
+    const vector<int>& part_ids =
+        concat ? bottom_id_vecs_[i] : top_id_vecs_[i];
+    if (whole_vec.size() != 1 || parts.size() < 2 ||
+        (concat && layer_param.concat_param().channels_last())) {
+      continue;
+    }
+    Blob<Dtype>* whole = whole_vec[0];
+    const int whole_id = concat ? top_id_vecs_[i][0] : bottom_id_vecs_[i][0];
+    int axis;
+    if (concat) {
+      const ConcatParameter& concat_param = layer_param.concat_param();
+      axis = concat_param.has_concat_dim() ? concat_param.concat_dim() :
+          whole->CanonicalAxisIndex(concat_param.axis());
+    } else {
+      const SliceParameter& slice_param = layer_param.slice_param();
+      axis = slice_param.has_slice_dim() ? slice_param.slice_dim() :
+          whole->CanonicalAxisIndex(slice_param.axis());
+    }
+    // The parts are contiguous only when nothing varies outside the axis.
+    // The output of a Concat must not be overwritten in place, since the
+    // producers of its inputs may still need them in Backward.
+    if (whole->count(0, axis) != 1 || loss_weights[whole_id] != 0 ||
+        external[whole_id] || (concat && in_place[whole_id])) {
+      continue;
+    }
+    size_t offset = 0;
+    for (int j = 0; j < parts.size(); ++j) {
+      Blob<Dtype>* part = parts[j];
+      const int part_id = part_ids[j];
+      // The outputs of a Slice must not be overwritten in place either.
+      if (!claimed.count(part_id) && owned[part_id] && !aliased[part_id] &&
+          loss_weights[part_id] == 0 && !external[part_id] &&
+          (concat || !in_place[part_id])) {
+        if (!part->SharesDataSlice(*whole, offset) ||
+            !part->SharesDiffSlice(*whole, offset)) {
+          part->ShareDataSlice(*whole, offset);
+          part->ShareDiffSlice(*whole, offset);
+        }
+        claimed.insert(part_id);
+      }
+      offset += part->count();
+    }
+  }
 }
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param_inp) {
   NetParameter param_tmp = param_inp;
   param_tmp.set_engine(engine_name_);
+  // The source layers are matched with the layers they were fused into.
+  param_tmp.set_fuse_neurons(false);
   NetParameter param;
   CompileNet(param_tmp, &param);
 
@@ -1369,18 +1964,17 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param_inp) {
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
     const string& source_layer_name = source_layer.name();
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-        layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
-    }
-    if (target_layer_id == layer_names_.size()) {
+    int target_layer_id, target_first_blob, target_num_blobs;
+    if (!FindUnfusedLayer(source_layer_name, &target_layer_id,
+                          &target_first_blob, &target_num_blobs)) {
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
     DLOG(INFO) << "Copying source layer " << source_layer_name;
-    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
-        layers_[target_layer_id]->blobs();
+    vector<shared_ptr<Blob<Dtype> > > target_blobs(
+        layers_[target_layer_id]->blobs().begin() + target_first_blob,
+        layers_[target_layer_id]->blobs().begin() + target_first_blob +
+            target_num_blobs);
     CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
         << "Incompatible number of blobs for layer " << source_layer_name;
     for (int j = 0; j < target_blobs.size(); ++j) {
@@ -1429,14 +2023,17 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   int num_layers = hdf5_get_num_links(data_hid);
   for (int i = 0; i < num_layers; ++i) {
     string source_layer_name = hdf5_get_name_by_idx(data_hid, i);
-    if (!layer_names_index_.count(source_layer_name)) {
+    int target_layer_id, target_first_blob, target_num_blobs;
+    if (!FindUnfusedLayer(source_layer_name, &target_layer_id,
+                          &target_first_blob, &target_num_blobs)) {
       LOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
-    int target_layer_id = layer_names_index_[source_layer_name];
     DLOG(INFO) << "Copying source layer " << source_layer_name;
-    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
-        layers_[target_layer_id]->blobs();
+    vector<shared_ptr<Blob<Dtype> > > target_blobs(
+        layers_[target_layer_id]->blobs().begin() + target_first_blob,
+        layers_[target_layer_id]->blobs().begin() + target_first_blob +
+            target_num_blobs);
     hid_t layer_hid = H5Gopen2(data_hid, source_layer_name.c_str(),
         H5P_DEFAULT);
     CHECK_GE(layer_hid, 0)
@@ -1449,7 +2046,8 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
       ostringstream oss;
       oss << j;
       string dataset_name = oss.str();
-      int target_net_param_id = param_id_vecs_[target_layer_id][j];
+      int target_net_param_id =
+          param_id_vecs_[target_layer_id][target_first_blob + j];
       if (!H5Lexists(layer_hid, dataset_name.c_str(), H5P_DEFAULT)) {
         // Target param doesn't exist in source weights...
         if (param_owners_[target_net_param_id] != -1) {
@@ -1476,8 +2074,27 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   // Add bottom and top
   DLOG(INFO) << "Serializing " << layers_.size() << " layers";
   for (int i = 0; i < layers_.size(); ++i) {
-    LayerParameter* layer_param = param->add_layer();
-    layers_[i]->ToProto(layer_param, write_diff);
+    if (layers_[i]->layer_param().type() != "FusedNeuron") {
+      LayerParameter* layer_param = param->add_layer();
+      layers_[i]->ToProto(layer_param, write_diff);
+      continue;
+    }
+    // Fused layers are written as the layers they replaced, so the weights
+    // load into nets that do not fuse them.
+    const FusedNeuronParameter& fused_param =
+        layers_[i]->layer_param().fused_neuron_param();
+    int blob_id = 0;
+    for (int j = 0; j < fused_param.layer_size(); ++j) {
+      LayerParameter* layer_param = param->add_layer();
+      layer_param->CopyFrom(fused_param.layer(j));
+      layer_param->clear_blobs();
+      const int num_blobs =
+          FusedNeuronLayer<Dtype>::NumParamBlobs(fused_param.layer(j));
+      for (int k = 0; k < num_blobs; ++k, ++blob_id) {
+        layers_[i]->blobs()[blob_id]->ToProto(layer_param->add_blobs(),
+                                              write_diff);
+      }
+    }
   }
 }
 
@@ -1497,39 +2114,46 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
     CHECK_GE(diff_hid, 0) << "Error saving weights to " << filename << ".";
   }
   for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
-    const LayerParameter& layer_param = layers_[layer_id]->layer_param();
-    string layer_name = layer_param.name();
-    hid_t layer_data_hid = H5Gcreate2(data_hid, layer_name.c_str(),
-        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    CHECK_GE(layer_data_hid, 0)
-        << "Error saving weights to " << filename << ".";
-    hid_t layer_diff_hid = -1;
-    if (write_diff) {
-      layer_diff_hid = H5Gcreate2(diff_hid, layer_name.c_str(),
+    // Fused layers are written as the layers they replaced.
+    vector<string> layer_names;
+    vector<int> first_params;
+    UnfusedLayers(layers_[layer_id]->layer_param(),
+                  layers_[layer_id]->blobs().size(), &layer_names,
+                  &first_params);
+    for (int k = 0; k < layer_names.size(); ++k) {
+      const string& layer_name = layer_names[k];
+      hid_t layer_data_hid = H5Gcreate2(data_hid, layer_name.c_str(),
           H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-      CHECK_GE(layer_diff_hid, 0)
+      CHECK_GE(layer_data_hid, 0)
           << "Error saving weights to " << filename << ".";
-    }
-    int num_params = layers_[layer_id]->blobs().size();
-    for (int param_id = 0; param_id < num_params; ++param_id) {
-      ostringstream dataset_name;
-      dataset_name << param_id;
-      const int net_param_id = param_id_vecs_[layer_id][param_id];
-      if (param_owners_[net_param_id] == -1) {
-        // Only save params that own themselves
-        hdf5_save_nd_dataset<Dtype>(layer_data_hid, dataset_name.str(),
-            *params_[net_param_id]);
+      hid_t layer_diff_hid = -1;
+      if (write_diff) {
+        layer_diff_hid = H5Gcreate2(diff_hid, layer_name.c_str(),
+            H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        CHECK_GE(layer_diff_hid, 0)
+            << "Error saving weights to " << filename << ".";
       }
+      for (int param_id = first_params[k]; param_id < first_params[k + 1];
+           ++param_id) {
+        ostringstream dataset_name;
+        dataset_name << param_id - first_params[k];
+        const int net_param_id = param_id_vecs_[layer_id][param_id];
+        if (param_owners_[net_param_id] == -1) {
+          // Only save params that own themselves
+          hdf5_save_nd_dataset<Dtype>(layer_data_hid, dataset_name.str(),
+              *params_[net_param_id]);
+        }
+        if (write_diff) {
+          // Write diffs regardless of weight-sharing
+          hdf5_save_nd_dataset<Dtype>(layer_diff_hid, dataset_name.str(),
+              *params_[net_param_id], true);
+        }
+      }
+      H5Gclose(layer_data_hid);
       if (write_diff) {
-        // Write diffs regardless of weight-sharing
-        hdf5_save_nd_dataset<Dtype>(layer_diff_hid, dataset_name.str(),
-            *params_[net_param_id], true);
+        H5Gclose(layer_diff_hid);
       }
     }
-    H5Gclose(layer_data_hid);
-    if (write_diff) {
-      H5Gclose(layer_diff_hid);
-    }
   }
   H5Gclose(data_hid);
   if (write_diff) {
@@ -1541,13 +2165,67 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 template <typename Dtype>
 void Net<Dtype>::Update() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
-    learnable_params_[i]->Update();
+    Update(i);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::Update(int learnable_param_id) {
+  Blob<Dtype>* blob = learnable_params_[learnable_param_id];
+  const vector<int>* rows = learnable_param_rows(learnable_param_id);
+  if (!rows) {
+    blob->Update();
+    return;
+  }
+  const int width = blob->count(1);
+  const Dtype* diff = blob->cpu_diff();
+  Dtype* data = blob->mutable_cpu_data();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int i = 0; i < rows->size(); ++i) {
+    const int offset = (*rows)[i] * width;
+    caffe_axpy(width, Dtype(-1), diff + offset, data + offset);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::set_sparse_updates(bool value) {
+#ifdef USE_MLSL
+  // The reduced gradients hold rows touched on other nodes as well.
+  value = false;
+#endif
+  if (value == sparse_updates_) { return; }
+  sparse_updates_ = value;
+  // Start from zero diffs so that only the listed rows can be nonzero.
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    if (learnable_param_rows_[i]) {
+      learnable_param_rows_[i]->clear();
+      caffe_set(learnable_params_[i]->count(), Dtype(0),
+                learnable_params_[i]->mutable_cpu_diff());
+    }
   }
 }
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs(int learnable_param_id) {
   Blob<Dtype>* blob = learnable_params_[learnable_param_id];
+  vector<int>* rows = learnable_param_rows(learnable_param_id);
+  if (rows) {
+    const int width = blob->count(1);
+    Dtype* diff = blob->mutable_cpu_diff();
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < rows->size(); ++i) {
+      caffe_set(width, Dtype(0), diff + (*rows)[i] * width);
+    }
+    rows->clear();
+    return;
+  }
+  if (learnable_param_rows_[learnable_param_id]) {
+    learnable_param_rows_[learnable_param_id]->clear();
+  }
   switch (Caffe::mode()) {
   case Caffe::CPU:
       if (blob->prv_diff())
@@ -50,6 +50,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/util/bbox_util.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/host_allocator.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/performance.hpp"
 #include "caffe/util/upgrade_proto.hpp"
@@ -160,6 +161,8 @@ void Solver<Dtype>::InitTrainNet() {
 
   if (param_.engine() != "")
     net_param.set_engine(param_.engine());
+  if (param_.has_numa_param())
+    net_param.mutable_numa_param()->CopyFrom(param_.numa_param());
   // Set the correct NetState.  We start with the solver defaults (lowest
   // precedence); then, merge in any NetState specified by the net_param itself;
   // finally, merge in any NetState specified by the train_state (highest
@@ -251,6 +254,8 @@ void Solver<Dtype>::InitTestNets() {
 
     if (param_.engine() != "")
       net_params[i].set_engine(param_.engine());
+    if (param_.has_numa_param())
+      net_params[i].mutable_numa_param()->CopyFrom(param_.numa_param());
 
     LOG(INFO)
         << "Creating test net (#" << i << ") specified by " << sources[i];
@@ -287,6 +292,8 @@ void Solver<Dtype>::Step(int iters) {
   int average_loss = this->param_.average_loss();
   losses_.clear();
   smoothed_loss_ = 0;
+  // Callbacks may exchange the whole diff, so only update rows without them.
+  net_->set_sparse_updates(SupportsSparseUpdates() && callbacks_.empty());
 
   while (iter_ < stop_iter) {
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
@@ -341,6 +348,12 @@ void Solver<Dtype>::Step(int iters) {
               << result_vec[k] << loss_msg_stream.str();
         }
       }
+      const host_allocator::Stats host_stats = host_allocator::GetStats();
+      LOG_IF(INFO, Caffe::root_solver()) << "    Host memory: "
+          << (host_stats.live_bytes >> 20) << " MB live, "
+          << (host_stats.peak_bytes >> 20) << " MB peak, "
+          << (host_stats.cached_bytes >> 20) << " MB cached, hit rate "
+          << host_stats.hit_rate();
 
 #ifdef CAFFE_PER_LAYER_TIMINGS
       PrintTimers(false);
@@ -35,6 +35,7 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cmath>
 #include <vector>
 
 #include "caffe/sgd_solvers.hpp"
@@ -56,6 +57,21 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   Dtype local_rate = rate * net_params_lr[param_id];
   switch (Caffe::mode()) {
   case Caffe::CPU: {
+    const vector<int>* rows = this->net_->learnable_param_rows(param_id);
+    if (rows) {
+      // Only the touched rows accumulate history and get an update.
+      const int width = net_params[param_id]->count(1);
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      Dtype* history = this->history_[param_id]->mutable_cpu_data();
+      for (int r = 0; r < rows->size(); ++r) {
+        const int offset = (*rows)[r] * width;
+        for (int i = offset; i < offset + width; ++i) {
+          history[i] += diff[i] * diff[i];
+          diff[i] = local_rate * diff[i] / (std::sqrt(history[i]) + delta);
+        }
+      }
+      break;
+    }
     // compute square of gradient in update
     caffe_powx(net_params[param_id]->count(),
         net_params[param_id]->cpu_diff(), Dtype(2),
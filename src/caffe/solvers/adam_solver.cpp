@@ -81,6 +81,26 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
 
   switch (Caffe::mode()) {
     case Caffe::CPU: {
+    const vector<int>* rows = this->net_->learnable_param_rows(param_id);
+    if (rows) {
+      // Lazy Adam: the moments of untouched rows are not decayed, while
+      // the bias correction follows the global step.
+      const int width = net_params[param_id]->count(1);
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      Dtype* m = val_m->mutable_cpu_data();
+      Dtype* v = val_v->mutable_cpu_data();
+      const Dtype scale = local_rate * correction;
+      for (int r = 0; r < rows->size(); ++r) {
+        const int offset = (*rows)[r] * width;
+        for (int i = offset; i < offset + width; ++i) {
+          const Dtype g = diff[i];
+          m[i] = beta1 * m[i] + (Dtype(1) - beta1) * g;
+          v[i] = beta2 * v[i] + (Dtype(1) - beta2) * g * g;
+          diff[i] = scale * m[i] / (std::sqrt(v[i]) + eps_hat);
+        }
+      }
+      break;
+    }
     // update m <- \beta_1 m_{t-1} + (1-\beta_1)g_t
     caffe_cpu_axpby(N, Dtype(1)-beta1,
         net_params[param_id]->cpu_diff(), beta1,
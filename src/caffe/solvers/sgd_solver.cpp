@@ -154,7 +154,17 @@ void SGDSolver<Dtype>::ClipGradients() {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+    const vector<int>* rows = this->net_->learnable_param_rows(i);
+    if (rows) {
+      const int width = net_params[i]->count(1);
+      const Dtype* diff = net_params[i]->cpu_diff();
+      for (int r = 0; r < rows->size(); ++r) {
+        const Dtype* row_diff = diff + (*rows)[r] * width;
+        sumsq_diff += caffe_cpu_dot(width, row_diff, row_diff);
+      }
+    } else {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -163,7 +173,16 @@ void SGDSolver<Dtype>::ClipGradients() {
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
     for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
+      const vector<int>* rows = this->net_->learnable_param_rows(i);
+      if (rows) {
+        const int width = net_params[i]->count(1);
+        Dtype* diff = net_params[i]->mutable_cpu_diff();
+        for (int r = 0; r < rows->size(); ++r) {
+          caffe_scal(width, scale_factor, diff + (*rows)[r] * width);
+        }
+      } else {
+        net_params[i]->scale_diff(scale_factor);
+      }
     }
   }
 }
@@ -206,7 +225,7 @@ void SGDSolver<Dtype>::ApplyUpdate(int param_id) {
 
   LOG_PARAM_BLOB(this->net_->learnable_params()[param_id], data, param_id, "ApplyUpdate: weight before update:");
 
-  this->net_->learnable_params()[param_id]->Update();
+  this->net_->Update(param_id);
 
   LOG_PARAM_BLOB(this->net_->learnable_params()[param_id], data, param_id, "ApplyUpdate: weight after update:");
 }
@@ -233,6 +252,15 @@ void SGDSolver<Dtype>::Normalize(int param_id) {
 
   switch (Caffe::mode()) {
   case Caffe::CPU: {
+    const vector<int>* rows = this->net_->learnable_param_rows(param_id);
+    if (rows) {
+      const int width = net_params[param_id]->count(1);
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      for (int r = 0; r < rows->size(); ++r) {
+        caffe_scal(width, accum_normalization, diff + (*rows)[r] * width);
+      }
+      break;
+    }
 
     if (net_params[param_id]->prv_diff()
         && (net_params[param_id]->prv_diff_count()
@@ -272,7 +300,26 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   Dtype local_decay = weight_decay * net_params_weight_decay[param_id];
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    if (local_decay) {
+    const vector<int>* rows = this->net_->learnable_param_rows(param_id);
+    if (local_decay && rows) {
+      // Lazy decay: only the rows with a gradient this iteration.
+      if (regularization_type != "L2" && regularization_type != "L1") {
+        LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+      }
+      const int width = net_params[param_id]->count(1);
+      const Dtype* data = net_params[param_id]->cpu_data();
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      Dtype* sign = temp_[param_id]->mutable_cpu_data();
+      for (int r = 0; r < rows->size(); ++r) {
+        const int offset = (*rows)[r] * width;
+        if (regularization_type == "L2") {
+          caffe_axpy(width, local_decay, data + offset, diff + offset);
+        } else {
+          caffe_cpu_sign(width, data + offset, sign + offset);
+          caffe_axpy(width, local_decay, sign + offset, diff + offset);
+        }
+      }
+    } else if (local_decay) {
       if (regularization_type == "L2") {
         // add weight decay
         if (net_params[param_id]->prv_data()
@@ -352,7 +399,19 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   // Compute the update to history, then copy it to the parameter diff.
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    if (net_params[param_id]->prv_diff()
+    const vector<int>* rows = this->net_->learnable_param_rows(param_id);
+    if (rows) {
+      // Lazy momentum: the history of untouched rows is left as it is.
+      const int width = net_params[param_id]->count(1);
+      Dtype* diff = net_params[param_id]->mutable_cpu_diff();
+      Dtype* history = history_[param_id]->mutable_cpu_data();
+      for (int r = 0; r < rows->size(); ++r) {
+        const int offset = (*rows)[r] * width;
+        caffe_cpu_axpby(width, local_rate, diff + offset, momentum,
+                        history + offset);
+        caffe_copy(width, history + offset, diff + offset);
+      }
+    } else if (net_params[param_id]->prv_diff()
         && (net_params[param_id]->prv_diff_count()
             == net_params[param_id]->count())) {
 
@@ -41,9 +41,22 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 namespace caffe {
 
+SyncedMemory::SyncedMemory(const shared_ptr<SyncedMemory>& base,
+                           size_t offset, size_t size)
+    : cpu_ptr_(NULL), gpu_ptr_(NULL),
+      size_(size), head_(HEAD_AT_CPU), own_cpu_data_(false),
+      cpu_malloc_use_cuda_(false), cpu_malloc_use_numa_(false),
+      own_gpu_data_(false), own_prv_data_(false), gpu_device_(-1),
+      base_(base) {
+  CHECK(base_);
+  CHECK_LE(offset + size, base_->size()) << "view exceeds its base";
+  cpu_ptr_ = static_cast<char*>(base_->mutable_cpu_data()) + offset;
+  placement_ = base_->placement();
+}
+
 SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    free_cpu();
   }
 
 #ifndef CPU_ONLY
@@ -59,19 +72,46 @@ SyncedMemory::~SyncedMemory() {
 #endif  // CPU_ONLY
 }
 
+// Host buffers with a NUMA placement are mapped page by page, so that the
+// policy covers all of their pages and the first touch can be spread over
+// the OpenMP threads. Buffers smaller than a page are not worth it.
+inline void SyncedMemory::alloc_cpu() {
+  cpu_malloc_use_numa_ = placement_.enabled() && size_ >= numa::PageSize() &&
+      Caffe::mode() == Caffe::CPU;
+#ifdef USE_MLSL
+  cpu_malloc_use_numa_ = cpu_malloc_use_numa_ && !mn::is_multinode();
+#endif
+  if (cpu_malloc_use_numa_) {
+    cpu_ptr_ = numa::Allocate(size_, placement_);
+    cpu_malloc_use_cuda_ = false;
+  } else {
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+  }
+  own_cpu_data_ = true;
+}
+
+inline void SyncedMemory::free_cpu() {
+  if (cpu_malloc_use_numa_) {
+    numa::Free(cpu_ptr_, size_);
+  } else {
+    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+  }
+}
+
 inline void SyncedMemory::to_cpu() {
   switch (head_) {
   case UNINITIALIZED:
-    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
-    caffe_memset(size_, 0, cpu_ptr_);
+    alloc_cpu();
+    // Mapped pages are zero already.
+    if (!cpu_malloc_use_numa_) {
+      caffe_memset(size_, 0, cpu_ptr_);
+    }
     head_ = HEAD_AT_CPU;
-    own_cpu_data_ = true;
     break;
   case HEAD_AT_GPU:
 #ifndef CPU_ONLY
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
-      own_cpu_data_ = true;
+      alloc_cpu();
     }
     caffe_gpu_memcpy(size_, gpu_ptr_, cpu_ptr_);
     head_ = SYNCED;
@@ -81,8 +121,7 @@ inline void SyncedMemory::to_cpu() {
     break;
   case HEAD_AT_PRV:
     if (cpu_ptr_ == NULL) {
-      CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
-      own_cpu_data_ = true;
+      alloc_cpu();
     }
     CHECK(prv_descriptor_.get());
     prv_descriptor_->convert_from_prv(cpu_ptr_);
@@ -143,13 +182,21 @@ void SyncedMemory::set_cpu_data(void* data) {
   boost::mutex::scoped_lock lock(mtx);
   CHECK(data);
   if (own_cpu_data_) {
-    CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+    free_cpu();
   }
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
 }
 
+void SyncedMemory::set_placement(const numa::Placement& placement) {
+  boost::mutex::scoped_lock lock(mtx);
+  placement_ = placement;
+  if (cpu_ptr_ && own_cpu_data_) {
+    numa::Migrate(cpu_ptr_, size_, placement_);
+  }
+}
+
 const void* SyncedMemory::gpu_data() {
   boost::mutex::scoped_lock lock(mtx);
 #ifndef CPU_ONLY
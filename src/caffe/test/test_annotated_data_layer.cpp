@@ -256,6 +256,70 @@ class AnnotatedDataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // The per-item buffers are recycled across batches. With a batch size that
+  // does not divide the dataset, every batch slot sees a different datum and a
+  // different number of annotations from one batch to the next, so leftovers
+  // from the previous batch would show up in the data or the labels.
+  void TestReadRecycled() {
+    const int batch_size = 4;
+    LayerParameter param;
+    param.set_phase(TEST);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+
+    const Dtype scale = 3;
+    param.mutable_transform_param()->set_scale(scale);
+
+    AnnotatedDataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+
+    for (int iter = 0; iter < 6; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      EXPECT_EQ(blob_top_data_->num(), batch_size);
+      const Dtype* label_data = blob_top_label_->cpu_data();
+      int num_bboxes = 0;
+      for (int i = 0; i < batch_size; ++i) {
+        num_bboxes += OneBBoxNum((iter * batch_size + i) % num_);
+      }
+      if (use_rich_annotation_) {
+        EXPECT_EQ(blob_top_label_->height(), std::max(num_bboxes, 1));
+        if (num_bboxes == 0) {
+          for (int p = 0; p < 8; ++p) {
+            EXPECT_EQ(-1, label_data[p]);
+          }
+        }
+      }
+      int cur_bbox = 0;
+      for (int i = 0; i < batch_size; ++i) {
+        const int index = (iter * batch_size + i) % num_;
+        if (use_rich_annotation_) {
+          for (int g = 0; g < index; ++g) {
+            for (int a = 0; a < g; ++a) {
+              EXPECT_EQ(i, label_data[cur_bbox*8]);
+              EXPECT_EQ(g, label_data[cur_bbox*8+1]);
+              EXPECT_EQ(a, label_data[cur_bbox*8+2]);
+              int b = unique_annotation_ ? a : g;
+              EXPECT_NEAR(b*0.1, label_data[cur_bbox*8+3], this->eps_);
+              EXPECT_NEAR(std::min(b*0.1 + 0.2, 1.0),
+                          label_data[cur_bbox*8+6], this->eps_);
+              EXPECT_EQ(a % 2, label_data[cur_bbox*8+7]);
+              cur_bbox++;
+            }
+          }
+        } else {
+          EXPECT_EQ(index, label_data[i]);
+        }
+        for (int j = 0; j < size_; ++j) {
+          EXPECT_EQ(scale * (unique_pixel_ ? j : index),
+                    blob_top_data_->cpu_data()[i * size_ + j])
+              << "debug: iter " << iter << " i " << i << " j " << j;
+        }
+      }
+    }
+  }
+
   void TestReshape(DataParameter_DB backend, bool unique_pixel,
                    bool unique_annotation, bool use_rich_annotation,
                    AnnotatedDatum_AnnotationType type) {
@@ -621,6 +685,19 @@ TYPED_TEST(AnnotatedDataLayerTest, TestReadLevelDB) {
   }
 }
 
+TYPED_TEST(AnnotatedDataLayerTest, TestReadRecycledLevelDB) {
+  const AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
+  for (int p = 0; p < kNumChoices; ++p) {
+    bool unique_pixel = kBoolChoices[p];
+    for (int r = 0; r < kNumChoices; ++r) {
+      bool use_rich_annotation = kBoolChoices[r];
+      this->Fill(DataParameter_DB_LEVELDB, unique_pixel, false,
+                 use_rich_annotation, type);
+      this->TestReadRecycled();
+    }
+  }
+}
+
 TYPED_TEST(AnnotatedDataLayerTest, TestReshapeLevelDB) {
   const AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
   for (int p = 0; p < kNumChoices; ++p) {
@@ -704,6 +781,19 @@ TYPED_TEST(AnnotatedDataLayerTest, TestReadLMDB) {
   }
 }
 
+TYPED_TEST(AnnotatedDataLayerTest, TestReadRecycledLMDB) {
+  const AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
+  for (int p = 0; p < kNumChoices; ++p) {
+    bool unique_pixel = kBoolChoices[p];
+    for (int r = 0; r < kNumChoices; ++r) {
+      bool use_rich_annotation = kBoolChoices[r];
+      this->Fill(DataParameter_DB_LMDB, unique_pixel, false,
+                 use_rich_annotation, type);
+      this->TestReadRecycled();
+    }
+  }
+}
+
 TYPED_TEST(AnnotatedDataLayerTest, TestReshapeLMDB) {
   const AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
   for (int p = 0; p < kNumChoices; ++p) {
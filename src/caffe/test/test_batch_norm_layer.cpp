@@ -45,6 +45,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/batch_norm_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -167,4 +168,74 @@ namespace caffe {
         this->blob_top_vec_);
   }
 
+  TYPED_TEST(BatchNormLayerTest, TestForwardLargeMean) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    // A mean far from zero must not cancel the variance out.
+    caffe_add_scalar(this->blob_bottom_->count(), Dtype(1000),
+        this->blob_bottom_->mutable_cpu_data());
+
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+    int num = this->blob_bottom_->num();
+    int channels = this->blob_bottom_->channels();
+    int spatial_dim = this->blob_bottom_->count(2);
+    for (int j = 0; j < channels; ++j) {
+      Dtype sum = 0, var = 0;
+      for (int i = 0; i < num; ++i) {
+        for (int k = 0; k < spatial_dim; ++k) {
+          Dtype data = this->blob_top_->cpu_data()[
+              this->blob_top_->offset(i, j) + k];
+          sum += data;
+          var += data * data;
+        }
+      }
+      sum /= spatial_dim * num;
+      var /= spatial_dim * num;
+
+      const Dtype kErrorBound = 0.01;
+      EXPECT_NEAR(0, sum, kErrorBound);
+      EXPECT_NEAR(1, var, kErrorBound);
+    }
+  }
+
+  TYPED_TEST(BatchNormLayerTest, TestBackwardInplace) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    Blob<Dtype> top_diff;
+    top_diff.ReshapeLike(*this->blob_bottom_);
+    filler.Fill(&top_diff);
+
+    BatchNormLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    vector<bool> propagate_down(1, true);
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+
+    Blob<Dtype> blob_inplace;
+    blob_inplace.CopyFrom(*this->blob_bottom_, false, true);
+    vector<Blob<Dtype>*> blob_inplace_vec(1, &blob_inplace);
+    BatchNormLayer<Dtype> layer_inplace(layer_param);
+    layer_inplace.SetUp(blob_inplace_vec, blob_inplace_vec);
+    layer_inplace.Forward(blob_inplace_vec, blob_inplace_vec);
+    // Clobber the output the way a following in-place layer would.
+    caffe_set(blob_inplace.count(), Dtype(0), blob_inplace.mutable_cpu_data());
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        blob_inplace.mutable_cpu_diff());
+    layer_inplace.Backward(blob_inplace_vec, propagate_down,
+        blob_inplace_vec);
+
+    for (int i = 0; i < blob_inplace.count(); ++i) {
+      EXPECT_NEAR(this->blob_bottom_->cpu_diff()[i],
+          blob_inplace.cpu_diff()[i], 1e-4);
+    }
+  }
+
 }  // namespace caffe
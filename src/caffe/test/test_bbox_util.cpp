@@ -43,6 +43,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "caffe/common.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -774,6 +775,72 @@ TEST_F(CPUBBoxUtilTest, TestMatchBBoxLableAllPerPredictionEx) {
   EXPECT_NEAR(match_overlaps[5], 0., eps);
 }
 
+TEST_F(CPUBBoxUtilTest, TestMatchBBoxFlat) {
+  const int num_gt = 5;
+  const int num_pred = 300;
+  Caffe::set_random_seed(1701);
+  vector<float> centers(2 * (num_gt + num_pred));
+  vector<float> sizes(2 * (num_gt + num_pred));
+  caffe_rng_uniform<float>(centers.size(), 0, 1, &centers[0]);
+  caffe_rng_uniform<float>(sizes.size(), 0.05, 0.5, &sizes[0]);
+  vector<NormalizedBBox> gt_bboxes(num_gt);
+  vector<NormalizedBBox> pred_bboxes(num_pred);
+  vector<float> gt_flat(num_gt * 4);
+  vector<float> gt_sizes(num_gt);
+  vector<float> pred_flat(num_pred * 4);
+  vector<float> pred_sizes(num_pred);
+  for (int i = 0; i < num_gt + num_pred; ++i) {
+    NormalizedBBox& bbox =
+        i < num_gt ? gt_bboxes[i] : pred_bboxes[i - num_gt];
+    bbox.set_xmin(centers[2 * i] - sizes[2 * i] / 2);
+    bbox.set_ymin(centers[2 * i + 1] - sizes[2 * i + 1] / 2);
+    bbox.set_xmax(centers[2 * i] + sizes[2 * i] / 2);
+    bbox.set_ymax(centers[2 * i + 1] + sizes[2 * i + 1] / 2);
+    bbox.set_size(BBoxSize(bbox));
+    if (i < num_gt) {
+      gt_flat[i * 4] = bbox.xmin();
+      gt_flat[i * 4 + 1] = bbox.ymin();
+      gt_flat[i * 4 + 2] = bbox.xmax();
+      gt_flat[i * 4 + 3] = bbox.ymax();
+      gt_sizes[i] = bbox.size();
+    } else {
+      const int p = i - num_gt;
+      pred_flat[p] = bbox.xmin();
+      pred_flat[num_pred + p] = bbox.ymin();
+      pred_flat[2 * num_pred + p] = bbox.xmax();
+      pred_flat[3 * num_pred + p] = bbox.ymax();
+      pred_sizes[p] = bbox.size();
+    }
+  }
+
+  for (int t = 0; t < 2; ++t) {
+    MatchType match_type = t == 0 ?
+        MultiBoxLossParameter_MatchType_BIPARTITE :
+        MultiBoxLossParameter_MatchType_PER_PREDICTION;
+    for (int c = 0; c < 2; ++c) {
+      const bool ignore_cross_boundary_bbox = c == 1;
+      vector<int> match_indices;
+      vector<float> match_overlaps;
+      MatchBBox(gt_bboxes, pred_bboxes, -1, match_type, 0.3,
+                ignore_cross_boundary_bbox, &match_indices, &match_overlaps);
+      vector<int> flat_match_indices(num_pred);
+      vector<float> flat_match_overlaps(num_pred);
+      vector<float> overlaps;
+      MatchBBox(&gt_flat[0], &gt_sizes[0], num_gt, &pred_flat[0],
+                &pred_sizes[0], num_pred, match_type, 0.3,
+                ignore_cross_boundary_bbox, &overlaps, &flat_match_indices[0],
+                &flat_match_overlaps[0]);
+      int num_matches = 0;
+      for (int i = 0; i < num_pred; ++i) {
+        EXPECT_EQ(match_indices[i], flat_match_indices[i]);
+        EXPECT_EQ(match_overlaps[i], flat_match_overlaps[i]);
+        num_matches += match_indices[i] > -1;
+      }
+      EXPECT_GE(num_matches, num_gt);
+    }
+  }
+}
+
 TEST_F(CPUBBoxUtilTest, TestGetGroundTruth) {
   const int num_gt = 4;
   Blob<float> gt_blob(1, 1, num_gt, 8);
@@ -203,6 +203,40 @@ TYPED_TEST(ConcatLayerTest, TestForwardChannels) {
   }
 }
 
+TYPED_TEST(ConcatLayerTest, TestForwardChannelsLast) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_channels_last(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  Blob<Dtype> blob_bottom_3(2, 4, 3, 2);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_0_);
+  filler.Fill(&blob_bottom_3);
+  vector<Blob<Dtype>*> blob_bottom_vec(1, this->blob_bottom_0_);
+  blob_bottom_vec.push_back(&blob_bottom_3);
+  layer.SetUp(blob_bottom_vec, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num_axes(), 2);
+  EXPECT_EQ(this->blob_top_->shape(0), 2);
+  EXPECT_EQ(this->blob_top_->shape(1), 3 * 6 * 5 + 4 * 3 * 2);
+  layer.Forward(blob_bottom_vec, this->blob_top_vec_);
+  // Each bottom lands permuted to N x H x W x C and flattened.
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  for (int n = 0; n < 2; ++n) {
+    int offset = n * this->blob_top_->shape(1);
+    for (int i = 0; i < blob_bottom_vec.size(); ++i) {
+      const Blob<Dtype>& bottom = *blob_bottom_vec[i];
+      for (int h = 0; h < bottom.height(); ++h) {
+        for (int w = 0; w < bottom.width(); ++w) {
+          for (int c = 0; c < bottom.channels(); ++c) {
+            EXPECT_EQ(top_data[offset++], bottom.data_at(n, c, h, w));
+          }
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(ConcatLayerTest, TestGradientTrivial) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -241,4 +275,19 @@ TYPED_TEST(ConcatLayerTest, TestGradientChannelsBottomOneOnly) {
     this->blob_top_vec_, 1);
 }
 
+TYPED_TEST(ConcatLayerTest, TestGradientChannelsLast) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.mutable_concat_param()->set_channels_last(true);
+  ConcatLayer<Dtype> layer(layer_param);
+  Blob<Dtype> blob_bottom_3(2, 4, 3, 2);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&blob_bottom_3);
+  vector<Blob<Dtype>*> blob_bottom_vec(1, this->blob_bottom_0_);
+  blob_bottom_vec.push_back(&blob_bottom_3);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradient(&layer, blob_bottom_vec, this->blob_top_vec_);
+}
+
 }  // namespace caffe
@@ -142,6 +142,38 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // Loads batches smaller than the DB on several prefetch threads and checks
+  // that they come in the order of the DB.
+  void TestReadConcurrent() {
+    const int batch_size = 2;
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_prefetch(2);
+    data_param->set_prefetch_threads(3);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), batch_size);
+    EXPECT_EQ(blob_top_label_->num(), batch_size);
+
+    for (int iter = 0; iter < 50; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        const int label = (iter * batch_size + i) % 5;
+        EXPECT_EQ(label, blob_top_label_->cpu_data()[i])
+            << "debug: iter " << iter << " i " << i;
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24 + j])
+              << "debug: iter " << iter << " i " << i << " j " << j;
+        }
+      }
+    }
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -393,6 +425,12 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadConcurrentLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadConcurrent();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -433,6 +471,12 @@ TYPED_TEST(DataLayerTest, TestReadLMDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadConcurrentLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadConcurrent();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
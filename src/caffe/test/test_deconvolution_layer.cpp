@@ -191,6 +191,50 @@ TYPED_TEST(DeconvolutionLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(DeconvolutionLayerTest, TestLatencyMode) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  DeconvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> top_reference;
+  top_reference.CopyFrom(*this->blob_top_, false, true);
+  Blob<Dtype> top_diff;
+  top_diff.ReshapeLike(*this->blob_top_);
+  filler.Fill(&top_diff);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  Blob<Dtype> bottom_diff_reference;
+  bottom_diff_reference.CopyFrom(*this->blob_bottom_, true, true);
+  // Splitting each item over threads must not change the results.
+  layer.set_latency_mode(true);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < top_reference.count(); ++i) {
+    EXPECT_NEAR(top_reference.cpu_data()[i], this->blob_top_->cpu_data()[i],
+        1e-4);
+  }
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+      this->blob_top_->mutable_cpu_diff());
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  for (int i = 0; i < bottom_diff_reference.count(); ++i) {
+    EXPECT_NEAR(bottom_diff_reference.cpu_diff()[i],
+        this->blob_bottom_->cpu_diff()[i], 1e-4);
+  }
+}
+
 TYPED_TEST(DeconvolutionLayerTest, TestNDAgainst2D) {
   typedef typename TypeParam::Dtype Dtype;
   const int kernel_h = 11;
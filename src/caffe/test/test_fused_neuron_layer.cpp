@@ -0,0 +1,381 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/layers/fused_neuron_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class FusedNeuronLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  FusedNeuronLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 17, 19)),
+        blob_top_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_std(2);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~FusedNeuronLayerTest() { delete blob_bottom_; delete blob_top_; }
+
+  // Adds the layers, given as text protos, to the fused layer.
+  void SetChain(const vector<string>& layers, LayerParameter* param) {
+    param->set_type("FusedNeuron");
+    for (int i = 0; i < layers.size(); ++i) {
+      LayerParameter* layer = param->mutable_fused_neuron_param()->add_layer();
+      CHECK(google::protobuf::TextFormat::ParseFromString(
+          layers[i] + " bottom: 'in' top: 'out'", layer));
+      EXPECT_TRUE(FusedNeuronLayer<Dtype>::CanFuse(*layer));
+    }
+  }
+
+  // Applies the layers of the chain one after the other, with the
+  // coefficients of the fused layer.
+  void ForwardReference(const LayerParameter& param,
+      const vector<shared_ptr<Blob<Dtype> > >& blobs, Blob<Dtype>* top) {
+    Blob<Dtype> current;
+    current.CopyFrom(*blob_bottom_, false, true);
+    int blob_id = 0;
+    for (int i = 0; i < param.fused_neuron_param().layer_size(); ++i) {
+      shared_ptr<Layer<Dtype> > layer = LayerRegistry<Dtype>::CreateLayer(
+          param.fused_neuron_param().layer(i));
+      Blob<Dtype> next;
+      vector<Blob<Dtype>*> bottom(1, &current);
+      vector<Blob<Dtype>*> top(1, &next);
+      layer->SetUp(bottom, top);
+      for (int j = 0; j < layer->blobs().size(); ++j) {
+        layer->blobs()[j]->CopyFrom(*blobs[blob_id++]);
+      }
+      layer->Forward(bottom, top);
+      current.CopyFrom(next, false, true);
+    }
+    top->CopyFrom(current, false, true);
+  }
+
+  void TestForward(const vector<string>& layers) {
+    LayerParameter param;
+    SetChain(layers, &param);
+    FusedNeuronLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    Blob<Dtype> expected;
+    ForwardReference(param, layer.blobs(), &expected);
+    ASSERT_EQ(expected.count(), blob_top_->count());
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], blob_top_->cpu_data()[i],
+                  1e-4 * std::max(Dtype(1), std::fabs(expected.cpu_data()[i])));
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(FusedNeuronLayerTest, TestDtypes);
+
+TYPED_TEST(FusedNeuronLayerTest, TestForwardMixedChain) {
+  vector<string> layers;
+  layers.push_back("type: 'ReLU' relu_param { negative_slope: 0.1 }");
+  layers.push_back("type: 'Power' "
+                   "power_param { power: 2 scale: 0.5 shift: 1 }");
+  layers.push_back("type: 'Log' log_param { base: 2 shift: 1 }");
+  layers.push_back("type: 'TanH'");
+  layers.push_back("type: 'Sigmoid'");
+  layers.push_back("type: 'ELU' elu_param { alpha: 0.5 }");
+  layers.push_back("type: 'Exp' exp_param { scale: 0.5 shift: 0.2 }");
+  layers.push_back("type: 'BNLL'");
+  this->TestForward(layers);
+}
+
+TYPED_TEST(FusedNeuronLayerTest, TestForwardPiecewiseLinearChain) {
+  // Compiled to AVX code for float on CPUs supporting it.
+  vector<string> layers;
+  layers.push_back("type: 'ReLU' relu_param { negative_slope: 0.1 }");
+  layers.push_back("type: 'AbsVal'");
+  layers.push_back("type: 'Power' "
+                   "power_param { power: 2 scale: 0.5 shift: -0.2 }");
+  layers.push_back("type: 'Power' power_param { scale: -2 shift: 1 }");
+  layers.push_back("type: 'ReLU'");
+  this->TestForward(layers);
+}
+
+TYPED_TEST(FusedNeuronLayerTest, TestForwardScaleChain) {
+  vector<string> layers;
+  layers.push_back("type: 'Scale' scale_param { "
+                   "filler { type: 'gaussian' } bias_term: true "
+                   "bias_filler { type: 'gaussian' } }");
+  layers.push_back("type: 'ReLU' relu_param { negative_slope: 0.1 }");
+  layers.push_back("type: 'Bias' bias_param { filler { type: 'gaussian' } }");
+  layers.push_back("type: 'Scale' scale_param { filler { type: 'gaussian' } }");
+  layers.push_back("type: 'TanH'");
+  this->TestForward(layers);
+}
+
+TYPED_TEST(FusedNeuronLayerTest, TestInPlace) {
+  typedef TypeParam Dtype;
+  vector<string> layers;
+  layers.push_back("type: 'ReLU' relu_param { negative_slope: 0.1 }");
+  layers.push_back("type: 'Sigmoid'");
+  layers.push_back("type: 'Power' "
+                   "power_param { power: 2 scale: 2 shift: -0.5 }");
+  LayerParameter param;
+  this->SetChain(layers, &param);
+  FusedNeuronLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> top_diff(this->blob_top_->shape());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&top_diff);
+  caffe_copy(top_diff.count(), top_diff.cpu_data(),
+             this->blob_top_->mutable_cpu_diff());
+  layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+                 this->blob_bottom_vec_);
+
+  Blob<Dtype> blob_in_place;
+  blob_in_place.CopyFrom(*this->blob_bottom_, false, true);
+  vector<Blob<Dtype>*> blob_in_place_vec(1, &blob_in_place);
+  FusedNeuronLayer<Dtype> layer_in_place(param);
+  layer_in_place.SetUp(blob_in_place_vec, blob_in_place_vec);
+  layer_in_place.Forward(blob_in_place_vec, blob_in_place_vec);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(this->blob_top_->cpu_data()[i], blob_in_place.cpu_data()[i]);
+  }
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_diff(),
+             blob_in_place.mutable_cpu_diff());
+  layer_in_place.Backward(blob_in_place_vec, vector<bool>(1, true),
+                          blob_in_place_vec);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_diff()[i], blob_in_place.cpu_diff()[i]);
+  }
+}
+
+TYPED_TEST(FusedNeuronLayerTest, TestGradient) {
+  typedef TypeParam Dtype;
+  vector<string> layers;
+  layers.push_back("type: 'ReLU' relu_param { negative_slope: 0.1 }");
+  layers.push_back("type: 'Sigmoid'");
+  layers.push_back("type: 'Power' "
+                   "power_param { power: 2 scale: 2 shift: -0.5 }");
+  layers.push_back("type: 'TanH'");
+  layers.push_back("type: 'ELU'");
+  layers.push_back("type: 'Exp' exp_param { base: 2 scale: 0.5 }");
+  layers.push_back("type: 'BNLL'");
+  LayerParameter param;
+  this->SetChain(layers, &param);
+  this->blob_bottom_->Reshape(2, 3, 4, 5);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  FusedNeuronLayer<Dtype> layer(param);
+  GradientChecker<Dtype> checker(1e-3, 1e-2, 1701, 0., 0.01);
+  checker.CheckGradientEltwise(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(FusedNeuronLayerTest, TestGradientScale) {
+  typedef TypeParam Dtype;
+  vector<string> layers;
+  layers.push_back("type: 'Scale' scale_param { "
+                   "filler { type: 'gaussian' } bias_term: true "
+                   "bias_filler { type: 'gaussian' } }");
+  layers.push_back("type: 'ReLU' relu_param { negative_slope: 0.1 }");
+  layers.push_back("type: 'Bias' bias_param { filler { type: 'gaussian' } }");
+  layers.push_back("type: 'TanH'");
+  LayerParameter param;
+  this->SetChain(layers, &param);
+  this->blob_bottom_->Reshape(2, 3, 2, 3);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  FusedNeuronLayer<Dtype> layer(param);
+  GradientChecker<Dtype> checker(1e-3, 1e-2, 1701, 0., 0.01);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(FusedNeuronLayerTest, TestNetFusesChain) {
+  typedef TypeParam Dtype;
+  const string proto =
+      "name: 'FusedNeuronTestNetwork' "
+      "fuse_neurons: true "
+      "layer { "
+      "  name: 'data' type: 'DummyData' top: 'data' "
+      "  dummy_data_param { "
+      "    shape { dim: 2 dim: 3 dim: 4 dim: 5 } "
+      "    data_filler { type: 'constant' value: 0.7 } "
+      "  } "
+      "} "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'data' top: 'data' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' bottom: 'data' top: 's' } "
+      "layer { name: 'tanh' type: 'TanH' bottom: 's' top: 't' } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  ASSERT_EQ(2, net.layers().size());
+  EXPECT_EQ(string("FusedNeuron"), net.layers()[1]->type());
+  EXPECT_EQ("relu+sigmoid+tanh", net.layer_names()[1]);
+  net.Forward();
+  const shared_ptr<Blob<Dtype> > top = net.blob_by_name("t");
+  ASSERT_TRUE(top != NULL);
+  const Dtype expected = tanh(1. / (1. + exp(-0.7)));
+  for (int i = 0; i < top->count(); ++i) {
+    EXPECT_NEAR(expected, top->cpu_data()[i], 1e-5);
+  }
+}
+
+TYPED_TEST(FusedNeuronLayerTest, TestNetFusesScaleForBackward) {
+  typedef TypeParam Dtype;
+  // A chain with learned coefficients, run backward in the TEST phase,
+  // against the same layers without fusion.
+  const string proto =
+      "name: 'FusedScaleTestNetwork' "
+      "force_backward: true "
+      "fuse_neurons: true "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'scale' type: 'Scale' bottom: 'data' top: 'out' "
+      "  param { lr_mult: 2 } "
+      "  scale_param { filler { type: 'gaussian' } bias_term: true "
+      "                bias_filler { type: 'gaussian' } } "
+      "} "
+      "layer { "
+      "  name: 'relu' type: 'ReLU' bottom: 'out' top: 'out' "
+      "  relu_param { negative_slope: 0.1 } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  ASSERT_TRUE(net.has_layer("scale+relu"));
+  EXPECT_FALSE(net.has_layer("scale"));
+  ASSERT_EQ(2, net.learnable_params().size());
+  EXPECT_EQ(2, net.params_lr()[0]);
+  EXPECT_EQ(1, net.params_lr()[1]);
+
+  param.set_fuse_neurons(false);
+  Net<Dtype> unfused_net(param);
+  ASSERT_TRUE(unfused_net.has_layer("scale"));
+  // Saved weights name the layers as written.
+  NetParameter weights;
+  net.ToProto(&weights);
+  unfused_net.CopyTrainedLayersFrom(weights);
+
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype>* data = net.blob_by_name("data").get();
+  Blob<Dtype>* unfused_data = unfused_net.blob_by_name("data").get();
+  Blob<Dtype>* out = net.blob_by_name("out").get();
+  Blob<Dtype>* unfused_out = unfused_net.blob_by_name("out").get();
+  filler.Fill(data);
+  unfused_data->CopyFrom(*data);
+  net.Forward();
+  unfused_net.Forward();
+  for (int i = 0; i < out->count(); ++i) {
+    EXPECT_NEAR(unfused_out->cpu_data()[i], out->cpu_data()[i], 1e-5);
+  }
+  filler.Fill(out);
+  caffe_copy(out->count(), out->cpu_data(), out->mutable_cpu_diff());
+  caffe_copy(out->count(), out->cpu_data(), unfused_out->mutable_cpu_diff());
+  net.ClearParamDiffs();
+  unfused_net.ClearParamDiffs();
+  net.Backward();
+  unfused_net.Backward();
+  for (int i = 0; i < data->count(); ++i) {
+    EXPECT_NEAR(unfused_data->cpu_diff()[i], data->cpu_diff()[i], 1e-4);
+  }
+  for (int i = 0; i < net.learnable_params().size(); ++i) {
+    const Blob<Dtype>* param_blob = net.learnable_params()[i];
+    const Blob<Dtype>* unfused_param_blob = unfused_net.learnable_params()[i];
+    ASSERT_EQ(unfused_param_blob->count(), param_blob->count());
+    for (int j = 0; j < param_blob->count(); ++j) {
+      EXPECT_NEAR(unfused_param_blob->cpu_diff()[j],
+                  param_blob->cpu_diff()[j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(FusedNeuronLayerTest, TestNetFusesInPlaceChainOnlyForward) {
+  typedef TypeParam Dtype;
+  const string proto =
+      "name: 'FusedNeuronTestNetwork' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 5 } } "
+      "} "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'data' top: 'data' } "
+      "layer { name: 'sigmoid' type: 'Sigmoid' bottom: 'data' top: 'data' } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  // Fusion is opt-in.
+  EXPECT_TRUE(Net<Dtype>(param).has_layer("relu"));
+  param.set_fuse_neurons(true);
+  EXPECT_TRUE(Net<Dtype>(param).has_layer("relu+sigmoid"));
+  // Backward would need a copy of the input.
+  param.set_force_backward(true);
+  EXPECT_TRUE(Net<Dtype>(param).has_layer("relu"));
+  param.set_force_backward(false);
+  param.mutable_state()->set_phase(TRAIN);
+  EXPECT_TRUE(Net<Dtype>(param).has_layer("relu"));
+}
+
+}  // namespace caffe
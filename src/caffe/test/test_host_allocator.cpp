@@ -0,0 +1,169 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cstring>
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class HostAllocatorTest : public ::testing::Test {
+ protected:
+  HostAllocatorTest() : cache_limit_(host_allocator::CacheLimit()) {}
+  virtual ~HostAllocatorTest() {
+    host_allocator::SetCacheLimit(cache_limit_);
+  }
+
+  const size_t cache_limit_;
+};
+
+TEST_F(HostAllocatorTest, TestReuse) {
+  host_allocator::SetCacheLimit(size_t(64) << 20);
+  void* ptr = host_allocator::Allocate(1000);
+  ASSERT_TRUE(ptr);
+  memset(ptr, 1, 1000);
+  host_allocator::Free(ptr);
+  const host_allocator::Stats before = host_allocator::GetStats();
+  // Sizes of the same class are served from the freed block.
+  void* reused = host_allocator::Allocate(1010);
+  EXPECT_EQ(ptr, reused);
+  const host_allocator::Stats after = host_allocator::GetStats();
+  EXPECT_EQ(before.hits + 1, after.hits);
+  EXPECT_EQ(before.misses, after.misses);
+  EXPECT_EQ(before.live_bytes + 1010, after.live_bytes);
+  host_allocator::Free(reused);
+  EXPECT_EQ(before.live_bytes, host_allocator::GetStats().live_bytes);
+}
+
+TEST_F(HostAllocatorTest, TestSizes) {
+  host_allocator::SetCacheLimit(size_t(64) << 20);
+  std::vector<void*> ptrs;
+  for (size_t size = 0; size < 100000; size = size * 3 / 2 + 1) {
+    char* ptr = static_cast<char*>(host_allocator::Allocate(size));
+    ASSERT_TRUE(ptr);
+    EXPECT_EQ(0, reinterpret_cast<size_t>(ptr) % 16);
+    memset(ptr, 2, size);
+    ptrs.push_back(ptr);
+  }
+  for (int i = 0; i < ptrs.size(); ++i) {
+    host_allocator::Free(ptrs[i]);
+  }
+  host_allocator::Free(NULL);
+}
+
+TEST_F(HostAllocatorTest, TestPeak) {
+  host_allocator::ResetPeak();
+  const size_t live = host_allocator::GetStats().live_bytes;
+  void* first = host_allocator::Allocate(5000);
+  void* second = host_allocator::Allocate(3000);
+  host_allocator::Free(first);
+  host_allocator::Free(second);
+  const host_allocator::Stats stats = host_allocator::GetStats();
+  EXPECT_EQ(live, stats.live_bytes);
+  EXPECT_EQ(live + 8000, stats.peak_bytes);
+  EXPECT_GT(stats.hit_rate(), -1e-6);
+  EXPECT_LE(stats.hit_rate(), 1.);
+}
+
+TEST_F(HostAllocatorTest, TestRelease) {
+  host_allocator::SetCacheLimit(size_t(64) << 20);
+  host_allocator::Free(host_allocator::Allocate(size_t(1) << 20));
+  EXPECT_GE(host_allocator::GetStats().cached_bytes, size_t(1) << 20);
+  host_allocator::ReleaseCached();
+  EXPECT_EQ(0, host_allocator::GetStats().cached_bytes);
+}
+
+// Frees a small block into the cache of its own thread and keeps the thread
+// alive until the test has released it.
+static void CacheBlockAndWait(boost::barrier* barrier) {
+  host_allocator::Free(host_allocator::Allocate(4000));
+  barrier->wait();
+  barrier->wait();
+}
+
+TEST_F(HostAllocatorTest, TestReleaseOtherThreads) {
+  host_allocator::SetCacheLimit(size_t(64) << 20);
+  host_allocator::ReleaseCached();
+  boost::barrier barrier(2);
+  boost::thread thread(CacheBlockAndWait, &barrier);
+  barrier.wait();
+  EXPECT_GE(host_allocator::GetStats().cached_bytes, 4000);
+  host_allocator::ReleaseCached();
+  EXPECT_EQ(0, host_allocator::GetStats().cached_bytes);
+  barrier.wait();
+  thread.join();
+  // The exited thread did not hand any block back to the shared cache.
+  EXPECT_EQ(0, host_allocator::GetStats().cached_bytes);
+}
+
+TEST_F(HostAllocatorTest, TestCacheLimit) {
+  host_allocator::SetCacheLimit(0);
+  const host_allocator::Stats before = host_allocator::GetStats();
+  host_allocator::Free(host_allocator::Allocate(4000));
+  host_allocator::Free(host_allocator::Allocate(4000));
+  const host_allocator::Stats after = host_allocator::GetStats();
+  EXPECT_EQ(before.hits, after.hits);
+  EXPECT_EQ(before.misses + 2, after.misses);
+  EXPECT_EQ(0, after.cached_bytes);
+}
+
+TEST_F(HostAllocatorTest, TestSyncedMemoryReuse) {
+  Caffe::set_mode(Caffe::CPU);
+  host_allocator::SetCacheLimit(size_t(64) << 20);
+  {
+    SyncedMemory mem(10000);
+    memset(mem.mutable_cpu_data(), 3, mem.size());
+  }
+  // A recycled block is zeroed like a fresh one.
+  const uint64_t hits = host_allocator::GetStats().hits;
+  SyncedMemory mem(10000);
+  const char* cpu_data = static_cast<const char*>(mem.cpu_data());
+  EXPECT_EQ(hits + 1, host_allocator::GetStats().hits);
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(0, cpu_data[i]);
+  }
+}
+
+}  // namespace caffe
@@ -129,6 +129,84 @@ TEST_F(ImTransformsTest, TestApplyResize) {
   CHECK_EQ(out_img.cols, 30);
   CHECK_EQ(out_img.rows, 30);
 }
+
+// Runs ApplyDistort and ApplyDistortInPlace with the same seeds and returns
+// the largest and the mean absolute difference of their outputs.
+static void CompareDistort(const DistortionParameter& param,
+                           const cv::Mat& in_img, int* max_diff,
+                           float* mean_diff) {
+  const unsigned int seed = 1701;
+  Caffe::set_random_seed(seed);
+  srand(seed);
+  cv::Mat ref_img = ApplyDistort(in_img, param);
+  Caffe::set_random_seed(seed);
+  srand(seed);
+  cv::Mat fused_img = in_img.clone();
+  ApplyDistortInPlace(param, &fused_img);
+  ASSERT_EQ(ref_img.type(), fused_img.type());
+  cv::Mat diff;
+  cv::absdiff(ref_img, fused_img, diff);
+  double max_val;
+  cv::minMaxLoc(diff.reshape(1), NULL, &max_val);
+  *max_diff = static_cast<int>(max_val);
+  cv::Scalar mean = cv::mean(diff);
+  *mean_diff = (mean[0] + mean[1] + mean[2]) / 3;
+}
+
+TEST_F(ImTransformsTest, TestApplyDistortInPlace) {
+  cv::Mat in_img(37, 53, CV_8UC3);
+  cv::randu(in_img, cv::Scalar::all(0), cv::Scalar::all(256));
+  int max_diff;
+  float mean_diff;
+
+  // Each distortion alone matches the OpenCV based path.
+  DistortionParameter brightness;
+  brightness.set_brightness_prob(1.);
+  brightness.set_brightness_delta(32);
+  CompareDistort(brightness, in_img, &max_diff, &mean_diff);
+  EXPECT_EQ(max_diff, 0);
+
+  DistortionParameter contrast;
+  contrast.set_contrast_prob(1.);
+  contrast.set_contrast_lower(0.5);
+  contrast.set_contrast_upper(1.5);
+  CompareDistort(contrast, in_img, &max_diff, &mean_diff);
+  EXPECT_EQ(max_diff, 0);
+
+  DistortionParameter saturation;
+  saturation.set_saturation_prob(1.);
+  saturation.set_saturation_lower(0.5);
+  saturation.set_saturation_upper(1.5);
+  CompareDistort(saturation, in_img, &max_diff, &mean_diff);
+  EXPECT_LE(max_diff, 1);
+
+  DistortionParameter hue;
+  hue.set_hue_prob(1.);
+  hue.set_hue_delta(18);
+  CompareDistort(hue, in_img, &max_diff, &mean_diff);
+  EXPECT_LE(max_diff, 1);
+
+  DistortionParameter order;
+  order.set_random_order_prob(1.);
+  CompareDistort(order, in_img, &max_diff, &mean_diff);
+  EXPECT_EQ(max_diff, 0);
+
+  // Combined, the distortions still match step by step.
+  DistortionParameter all;
+  all.MergeFrom(brightness);
+  all.MergeFrom(contrast);
+  all.MergeFrom(saturation);
+  all.MergeFrom(hue);
+  all.MergeFrom(order);
+  CompareDistort(all, in_img, &max_diff, &mean_diff);
+  EXPECT_LE(max_diff, 1);
+
+  // Non color images go through the unfused path.
+  cv::Mat gray_img(37, 53, CV_8UC1);
+  cv::randu(gray_img, cv::Scalar::all(0), cv::Scalar::all(256));
+  CompareDistort(brightness, gray_img, &max_diff, &mean_diff);
+  EXPECT_EQ(max_diff, 0);
+}
 #endif  // USE_OPENCV
 
 }  // namespace caffe
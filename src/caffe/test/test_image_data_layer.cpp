@@ -36,6 +36,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #ifdef USE_OPENCV
+#include <cmath>
 #include <fstream>
 #include <map>
 #include <string>
@@ -222,6 +223,45 @@ TYPED_TEST(ImageDataLayerTest, TestResize) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestReducedDecode) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_new_height(120);
+  image_data_param->set_new_width(160);
+  image_data_param->set_shuffle(false);
+  image_data_param->set_readahead(true);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> full_decode;
+  full_decode.CopyFrom(*this->blob_top_data_, false, true);
+
+  // The 360 x 480 image is decoded at half size before resizing.
+  image_data_param->set_reduced_decode(true);
+  ImageDataLayer<Dtype> reduced_layer(param);
+  reduced_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 5);
+  EXPECT_EQ(this->blob_top_data_->channels(), 3);
+  EXPECT_EQ(this->blob_top_data_->height(), 120);
+  EXPECT_EQ(this->blob_top_data_->width(), 160);
+  for (int iter = 0; iter < 2; ++iter) {
+    reduced_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+    }
+    // Close to the full size decode on average.
+    Dtype diff = 0;
+    for (int i = 0; i < full_decode.count(); ++i) {
+      diff += std::abs(this->blob_top_data_->cpu_data()[i] -
+                       full_decode.cpu_data()[i]);
+    }
+    EXPECT_LT(diff / full_decode.count(), 16);
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestReshape) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
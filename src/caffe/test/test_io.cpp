@@ -41,7 +41,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/highgui/highgui_c.h>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -457,5 +460,38 @@ TEST_F(IOTest, TestDecodeDatumToCVMatContentNative) {
   }
 }
 
+TEST_F(IOTest, TestReadJPEGSizeLargeAPP1) {
+  // A 60 KiB EXIF segment ahead of the frame header, as cameras write with
+  // their thumbnails.
+  cv::Mat cv_img(30, 40, CV_8UC3, cv::Scalar(10, 20, 30));
+  vector<uchar> jpeg;
+  ASSERT_TRUE(cv::imencode(".jpg", cv_img, jpeg));
+  const int length = 60000;
+  vector<uchar> app1(length + 2, 0);
+  app1[0] = 0xFF;
+  app1[1] = 0xE1;
+  app1[2] = length >> 8;
+  app1[3] = length & 0xFF;
+  jpeg.insert(jpeg.begin() + 2, app1.begin(), app1.end());
+  string filename;
+  MakeTempFilename(&filename);
+  filename += ".jpg";
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&jpeg[0]), jpeg.size());
+  file.close();
+  int height = 0, width = 0;
+  EXPECT_TRUE(ReadJPEGSize(filename, &height, &width));
+  EXPECT_EQ(30, height);
+  EXPECT_EQ(40, width);
+  cv::Mat cv_img_reduced = ReadImageToCVMat(filename, 15, 20, true, true);
+  EXPECT_EQ(15, cv_img_reduced.rows);
+  EXPECT_EQ(20, cv_img_reduced.cols);
+  std::remove(filename.c_str());
+  EXPECT_TRUE(ReadJPEGSize(EXAMPLES_SOURCE_DIR "images/cat.jpg", &height,
+                           &width));
+  EXPECT_EQ(360, height);
+  EXPECT_EQ(480, width);
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -43,6 +43,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layers/fused_lstm_layer.hpp"
 #include "caffe/layers/lstm_layer.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -321,5 +322,109 @@ TYPED_TEST(LSTMLayerTest, TestGradientNonZeroContBufferSize2WithStaticInput) {
       this->blob_top_vec_, 2);
 }
 
+TYPED_TEST(LSTMLayerTest, TestFusedMatchesUnrolled) {
+  typedef typename TypeParam::Dtype Dtype;
+  for (int with_static = 0; with_static < 2; ++with_static) {
+    this->ReshapeBlobs(3, 3);
+    FillerParameter filler_param;
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(&this->blob_bottom_static_);
+    this->blob_bottom_vec_.resize(2);
+    if (with_static) {
+      this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+    }
+    for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+      this->blob_bottom_cont_.mutable_cpu_data()[i] = i > 2 && i != 5;
+    }
+    Blob<Dtype> fused_top;
+    vector<Blob<Dtype>*> fused_top_vec(1, &fused_top);
+    LSTMLayer<Dtype> layer(this->layer_param_);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    FusedLSTMLayer<Dtype> fused_layer(this->layer_param_);
+    fused_layer.SetUp(this->blob_bottom_vec_, fused_top_vec);
+    ASSERT_EQ(layer.blobs().size(), fused_layer.blobs().size());
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      ASSERT_TRUE(layer.blobs()[i]->shape() ==
+                  fused_layer.blobs()[i]->shape());
+      fused_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+    }
+    const Dtype kEpsilon = 1e-5;
+    // The second batch continues from the hidden state of the first.
+    for (int batch = 0; batch < 2; ++batch) {
+      filler.Fill(&this->blob_bottom_);
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      fused_layer.Forward(this->blob_bottom_vec_, fused_top_vec);
+      ASSERT_EQ(this->blob_top_.count(), fused_top.count());
+      for (int i = 0; i < fused_top.count(); ++i) {
+        EXPECT_NEAR(this->blob_top_.cpu_data()[i], fused_top.cpu_data()[i],
+                    kEpsilon) << "batch " << batch << " at " << i;
+      }
+    }
+    filler.Fill(&fused_top);
+    caffe_copy(fused_top.count(), fused_top.cpu_data(),
+               this->blob_top_.mutable_cpu_diff());
+    caffe_copy(fused_top.count(), fused_top.cpu_data(),
+               fused_top.mutable_cpu_diff());
+    vector<bool> propagate_down(this->blob_bottom_vec_.size(), true);
+    propagate_down[1] = false;
+    layer.Backward(this->blob_top_vec_, propagate_down,
+                   this->blob_bottom_vec_);
+    vector<Blob<Dtype>*> diffs;
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      diffs.push_back(layer.blobs()[i].get());
+    }
+    diffs.push_back(&this->blob_bottom_);
+    diffs.push_back(&this->blob_bottom_static_);
+    vector<shared_ptr<Blob<Dtype> > > expected(diffs.size());
+    for (int i = 0; i < diffs.size(); ++i) {
+      expected[i].reset(new Blob<Dtype>(diffs[i]->shape()));
+      expected[i]->CopyFrom(*diffs[i], true);
+    }
+    fused_layer.Backward(fused_top_vec, propagate_down,
+                         this->blob_bottom_vec_);
+    diffs.resize(0);
+    for (int i = 0; i < fused_layer.blobs().size(); ++i) {
+      diffs.push_back(fused_layer.blobs()[i].get());
+    }
+    diffs.push_back(&this->blob_bottom_);
+    diffs.push_back(&this->blob_bottom_static_);
+    for (int i = 0; i < diffs.size(); ++i) {
+      for (int j = 0; j < diffs[i]->count(); ++j) {
+        EXPECT_NEAR(expected[i]->cpu_diff()[j], diffs[i]->cpu_diff()[j],
+                    kEpsilon) << "diff " << i << " at " << j;
+      }
+    }
+  }
+}
+
+TYPED_TEST(LSTMLayerTest, TestFusedGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  FusedLSTMLayer<Dtype> layer(this->layer_param_);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = i > 2;
+  }
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(LSTMLayerTest, TestFusedGradientWithStaticInput) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBlobs(3, 2);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_);
+  filler.Fill(&this->blob_bottom_static_);
+  this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+  FusedLSTMLayer<Dtype> layer(this->layer_param_);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = i > 2;
+  }
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 2);
+}
 
 }  // namespace caffe
@@ -56,6 +56,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -346,6 +347,44 @@ class MultiBoxLossLayerTest : public MultiDeviceTest<TypeParam> {
     delete fake_blob;
     delete fake_input;
   }
+
+  // Fill the bottom blobs with num_priors random priors, random predictions
+  // and ground truth for the first and last image, one of them difficult.
+  void FillRandom(int num_priors) {
+    num_priors_ = num_priors;
+    blob_bottom_loc_->Reshape(num_, num_priors_ * 4, 1, 1);
+    blob_bottom_conf_->Reshape(num_, num_priors_ * num_classes_, 1, 1);
+    blob_bottom_prior_->Reshape(1, 2, num_priors_ * 4, 1);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_loc_);
+    filler.Fill(blob_bottom_conf_);
+    Dtype* prior_data = blob_bottom_prior_->mutable_cpu_data();
+    vector<Dtype> centers(2 * num_priors_);
+    vector<Dtype> sizes(2 * num_priors_);
+    caffe_rng_uniform<Dtype>(centers.size(), 0, 1, &centers[0]);
+    caffe_rng_uniform<Dtype>(sizes.size(), 0.05, 0.5, &sizes[0]);
+    for (int p = 0; p < num_priors_; ++p) {
+      prior_data[p * 4] = centers[2 * p] - sizes[2 * p] / 2;
+      prior_data[p * 4 + 1] = centers[2 * p + 1] - sizes[2 * p + 1] / 2;
+      prior_data[p * 4 + 2] = centers[2 * p] + sizes[2 * p] / 2;
+      prior_data[p * 4 + 3] = centers[2 * p + 1] + sizes[2 * p + 1] / 2;
+      Dtype* variance = prior_data + (num_priors_ + p) * 4;
+      variance[0] = variance[1] = 0.1;
+      variance[2] = variance[3] = 0.2;
+    }
+    vector<int> gt_shape(4, 1);
+    gt_shape[2] = 6;
+    gt_shape[3] = 8;
+    blob_bottom_gt_->Reshape(gt_shape);
+    Dtype* gt_data = blob_bottom_gt_->mutable_cpu_data();
+    FillItem(gt_data, "2 2 0 0.6 0.6 0.8 0.9 0");
+    FillItem(gt_data + 8, "0 1 0 0.1 0.1 0.3 0.3 0");
+    FillItem(gt_data + 8 * 2, "2 1 0 0.1 0.1 0.3 0.3 0");
+    FillItem(gt_data + 8 * 3, "2 2 1 0.2 0.2 0.4 0.4 1");
+    FillItem(gt_data + 8 * 4, "0 2 1 0.45 0.3 0.95 0.7 0");
+    FillItem(gt_data + 8 * 5, "-1 0 0 0 0 0 0 0");
+  }
   int num_;
   int num_classes_;
   int width_;
@@ -361,6 +400,19 @@ class MultiBoxLossLayerTest : public MultiDeviceTest<TypeParam> {
   vector<Blob<Dtype>*> blob_top_vec_;
 };
 
+// Runs the generic bbox_util matching even where the flat one applies.
+template <typename Dtype>
+class GenericMultiBoxLossLayer : public MultiBoxLossLayer<Dtype> {
+ public:
+  explicit GenericMultiBoxLossLayer(const LayerParameter& param)
+      : MultiBoxLossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    MultiBoxLossLayer<Dtype>::LayerSetUp(bottom, top);
+    this->flat_matching_ = false;
+  }
+};
+
 TYPED_TEST_CASE(MultiBoxLossLayerTest, TestDtypesAndDevices);
 
 TYPED_TEST(MultiBoxLossLayerTest, TestSetUp) {
@@ -491,4 +543,63 @@ TYPED_TEST(MultiBoxLossLayerTest, TestConfGradient) {
   }
 }
 
+TYPED_TEST(MultiBoxLossLayerTest, TestFlatMatching) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(1701);
+  this->FillRandom(500);
+  LayerParameter layer_param;
+  layer_param.add_propagate_down(true);
+  layer_param.add_propagate_down(true);
+  MultiBoxLossParameter* multibox_loss_param =
+      layer_param.mutable_multibox_loss_param();
+  multibox_loss_param->set_num_classes(this->num_classes_);
+  multibox_loss_param->set_background_label_id(0);
+  for (int j = 0; j < 2; ++j) {
+    multibox_loss_param->set_match_type(kMatchTypes[j]);
+    for (int m = 0; m < 2; ++m) {
+      multibox_loss_param->set_mining_type(kMiningType[m]);
+      for (int u = 0; u < 2; ++u) {
+        multibox_loss_param->set_use_difficult_gt(kBoolChoices[u]);
+        for (int b = 0; b < 2; ++b) {
+          multibox_loss_param->set_bp_inside(kBoolChoices[b]);
+          multibox_loss_param->set_ignore_cross_boundary_bbox(kBoolChoices[b]);
+          multibox_loss_param->set_encode_variance_in_target(kBoolChoices[b]);
+          MultiBoxLossLayer<Dtype> layer(layer_param);
+          GenericMultiBoxLossLayer<Dtype> generic_layer(layer_param);
+          vector<Blob<Dtype>*> generic_top_vec(1, new Blob<Dtype>());
+          layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+          generic_layer.SetUp(this->blob_bottom_vec_, generic_top_vec);
+          vector<bool> propagate_down(4, false);
+          propagate_down[0] = propagate_down[1] = true;
+
+          layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+          layer.Backward(this->blob_top_vec_, propagate_down,
+                         this->blob_bottom_vec_);
+          Blob<Dtype> loc_diff, conf_diff;
+          loc_diff.CopyFrom(*this->blob_bottom_loc_, true, true);
+          conf_diff.CopyFrom(*this->blob_bottom_conf_, true, true);
+          generic_layer.Forward(this->blob_bottom_vec_, generic_top_vec);
+          generic_layer.Backward(generic_top_vec, propagate_down,
+                                 this->blob_bottom_vec_);
+
+          // The matches are the same; the internal loss layers may sum in
+          // a different order across threads.
+          const Dtype loss = generic_top_vec[0]->cpu_data()[0];
+          EXPECT_GT(loss, 0);
+          EXPECT_NEAR(loss, this->blob_top_loss_->cpu_data()[0], 1e-5 * loss);
+          for (int i = 0; i < loc_diff.count(); ++i) {
+            EXPECT_EQ(this->blob_bottom_loc_->cpu_diff()[i],
+                      loc_diff.cpu_diff()[i]);
+          }
+          for (int i = 0; i < conf_diff.count(); ++i) {
+            EXPECT_EQ(this->blob_bottom_conf_->cpu_diff()[i],
+                      conf_diff.cpu_diff()[i]);
+          }
+          delete generic_top_vec[0];
+        }
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -667,6 +667,196 @@ class ParentTest : public ParentType {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitBranchNet(const int branch_groups) {
+    // Two branches off 'data', one of which splits again into two inner
+    // products sharing their weights; the branches meet in a Concat.
+    ostringstream proto;
+    proto <<
+        "name: 'BranchNetwork' "
+        "force_backward: true "
+        "branch_groups: " << branch_groups << " "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 2 dim: 3 dim: 6 dim: 4 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'target' "
+        "  type: 'DummyData' "
+        "  top: 'target' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 9 } "
+        "    data_filler { type: 'constant' value: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip_a' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'a' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu_a' "
+        "  type: 'ReLU' "
+        "  bottom: 'a' "
+        "  top: 'a' "
+        "} "
+        "layer { "
+        "  name: 'pool_b' "
+        "  type: 'Pooling' "
+        "  bottom: 'data' "
+        "  top: 'b' "
+        "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+        "} "
+        "layer { "
+        "  name: 'ip_b' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'b' "
+        "  top: 'b1' "
+        "  param { name: 'shared_weights' } "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip_c' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'b' "
+        "  top: 'b2' "
+        "  param { name: 'shared_weights' } "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum_b' "
+        "  type: 'Eltwise' "
+        "  bottom: 'b1' "
+        "  bottom: 'b2' "
+        "  top: 'b3' "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'a' "
+        "  bottom: 'b3' "
+        "  top: 'out' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'out' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto.str());
+  }
+
+  virtual void InitConcatSliceNet() {
+    // A Slice feeding two branches that meet again in a Concat, both along
+    // the channel axis. The TanH needs its own output in Backward.
+    const string& proto =
+        "name: 'ConcatSliceNetwork' "
+        "force_backward: true "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "  shape: { dim: 1 dim: 3 dim: 2 dim: 2 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  bottom: 'ip' "
+        "  top: 's1' "
+        "  top: 's2' "
+        "  slice_param { slice_point: 2 } "
+        "} "
+        "layer { "
+        "  name: 'ip_a' "
+        "  type: 'InnerProduct' "
+        "  bottom: 's1' "
+        "  top: 'a' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'tanh_a' "
+        "  type: 'TanH' "
+        "  bottom: 'a' "
+        "  top: 'ta' "
+        "} "
+        "layer { "
+        "  name: 'ip_b' "
+        "  type: 'InnerProduct' "
+        "  bottom: 's2' "
+        "  top: 'b' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu_b' "
+        "  type: 'ReLU' "
+        "  bottom: 'b' "
+        "  top: 'b' "
+        "} "
+        "layer { "
+        "  name: 'concat' "
+        "  type: 'Concat' "
+        "  bottom: 'ta' "
+        "  bottom: 'b' "
+        "  top: 'out' "
+        "} "
+        "layer { "
+        "  name: 'ip_c' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'out' "
+        "  top: 'c' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'Reduction' "
+        "  bottom: 'c' "
+        "  top: 'loss' "
+        "  reduction_param { operation: SUMSQ axis: 0 } "
+        "  loss_weight: 1 "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -2494,6 +2684,326 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestBranchGroups) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Running independent layers concurrently must give the results of
+  // running them in index order.
+  Caffe::set_mode(Caffe::CPU);
+  vector<vector<Dtype> > results;
+  for (int groups = 1; groups <= 3; groups += 2) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitBranchNet(groups);
+    EXPECT_EQ(groups, this->net_->branch_groups());
+    Blob<Dtype>* data = this->net_->input_blobs()[0];
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(data);
+    Dtype loss;
+    this->net_->Forward(&loss);
+    this->net_->ClearParamDiffs();
+    this->net_->Backward();
+    vector<Dtype> result(1, loss);
+    result.insert(result.end(), data->cpu_diff(),
+                  data->cpu_diff() + data->count());
+    const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+    for (int i = 0; i < params.size(); ++i) {
+      result.insert(result.end(), params[i]->cpu_diff(),
+                    params[i]->cpu_diff() + params[i]->count());
+    }
+    results.push_back(result);
+  }
+  ASSERT_EQ(results[0].size(), results[1].size());
+  for (int i = 0; i < results[0].size(); ++i) {
+    EXPECT_NEAR(results[0][i], results[1][i], 1e-6);
+  }
+}
+
+TYPED_TEST(NetTest, TestBranchGroupsSeeded) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Layers run on the worker threads of the branch groups still draw from
+  // generators seeded by Caffe::set_random_seed.
+  Caffe::set_mode(Caffe::CPU);
+  const string& proto =
+      "name: 'DropoutBranches' "
+      "branch_groups: 2 "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  top: 'data' "
+      "  dummy_data_param { "
+      "    shape { dim: 4 dim: 64 } "
+      "    data_filler { type: 'constant' value: 1 } "
+      "  } "
+      "} "
+      "layer { name: 'drop_a' type: 'Dropout' bottom: 'data' top: 'a' } "
+      "layer { name: 'drop_b' type: 'Dropout' bottom: 'data' top: 'b' } "
+      "layer { name: 'drop_c' type: 'Dropout' bottom: 'data' top: 'c' } ";
+  vector<Dtype> results[2];
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitNetFromProtoString(proto);
+    this->net_->Forward();
+    const char* names[] = {"a", "b", "c"};
+    for (int i = 0; i < 3; ++i) {
+      const Blob<Dtype>& top = *this->net_->blob_by_name(names[i]);
+      results[run].insert(results[run].end(), top.cpu_data(),
+                          top.cpu_data() + top.count());
+    }
+  }
+  ASSERT_EQ(results[0].size(), results[1].size());
+  for (int i = 0; i < results[0].size(); ++i) {
+    EXPECT_EQ(results[0][i], results[1][i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestShareConcatSliceBuffers) {
+  typedef typename TypeParam::Dtype Dtype;
+  // With a single image the Slice outputs live in its input and the Concat
+  // inputs in its output. Two copies of the image are too many for that;
+  // each of them must see what the single image saw.
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(Caffe::CPU);
+  this->InitConcatSliceNet();
+  Net<Dtype>* net = this->net_.get();
+  Blob<Dtype>* data = net->input_blobs()[0];
+  Blob<Dtype> image(data->shape());
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&image);
+  const Blob<Dtype>& ip = *net->blob_by_name("ip");
+  const Blob<Dtype>& out = *net->blob_by_name("out");
+  const Blob<Dtype>& s2 = *net->blob_by_name("s2");
+  const Blob<Dtype>& b = *net->blob_by_name("b");
+  const vector<Blob<Dtype>*>& params = net->learnable_params();
+  vector<Dtype> results[3];
+  for (int run = 0; run < 3; ++run) {
+    const int num = run == 1 ? 2 : 1;
+    vector<int> shape = image.shape();
+    shape[0] = num;
+    data->Reshape(shape);
+    net->Reshape();
+    for (int n = 0; n < num; ++n) {
+      caffe_copy(image.count(), image.cpu_data(),
+                 data->mutable_cpu_data() + n * image.count());
+    }
+    EXPECT_EQ(num == 1, net->blob_by_name("s1")->SharesDataSlice(ip, 0));
+    EXPECT_EQ(num == 1, s2.SharesDataSlice(ip, 2));
+    EXPECT_EQ(num == 1, s2.SharesDiffSlice(ip, 2));
+    EXPECT_EQ(num == 1, net->blob_by_name("ta")->SharesDataSlice(out, 0));
+    EXPECT_EQ(num == 1, b.SharesDataSlice(out, 3));
+    EXPECT_EQ(num == 1, b.SharesDiffSlice(out, 3));
+    Dtype loss;
+    net->Forward(&loss);
+    net->ClearParamDiffs();
+    net->Backward();
+    results[run].push_back(loss / num);
+    for (int i = 0; i < image.count(); ++i) {
+      results[run].push_back(data->cpu_diff()[(num - 1) * image.count() + i]);
+    }
+    for (int i = 0; i < params.size(); ++i) {
+      for (int j = 0; j < params[i]->count(); ++j) {
+        results[run].push_back(params[i]->cpu_diff()[j] / num);
+      }
+    }
+  }
+  for (int run = 1; run < 3; ++run) {
+    ASSERT_EQ(results[0].size(), results[run].size());
+    for (int i = 0; i < results[0].size(); ++i) {
+      EXPECT_NEAR(results[0][i], results[run][i], 1e-5);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestConcatPartsResizedWithoutReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Resizing the inputs and calling Forward without Net::Reshape moves the
+  // middle part of the Concat output while the output keeps its shape. The
+  // part still lives where it was, which the grown first part overwrites.
+  Caffe::set_mode(Caffe::CPU);
+  const string& proto =
+      "name: 'ConcatResizeNetwork' "
+      "force_backward: true "
+      "layer { "
+      "  name: 'data' type: 'Input' top: 'a' top: 'b' top: 'c' "
+      "  input_param { "
+      "    shape: { dim: 1 dim: 2 dim: 2 dim: 2 } "
+      "    shape: { dim: 1 dim: 2 dim: 2 dim: 2 } "
+      "    shape: { dim: 1 dim: 2 dim: 2 dim: 2 } "
+      "  } "
+      "} "
+      "layer { name: 'pa' type: 'Power' bottom: 'a' top: 'pa' } "
+      "layer { name: 'pb' type: 'Power' bottom: 'b' top: 'pb' } "
+      "layer { name: 'pc' type: 'Power' bottom: 'c' top: 'pc' } "
+      "layer { "
+      "  name: 'concat' type: 'Concat' "
+      "  bottom: 'pa' bottom: 'pb' bottom: 'pc' top: 'out' "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  Net<Dtype>* net = this->net_.get();
+  Blob<Dtype>* out = net->blob_by_name("out").get();
+  ASSERT_TRUE(net->blob_by_name("pb")->SharesDataSlice(*out, 8));
+  vector<int> shape(4, 2);
+  shape[0] = 1;
+  shape[1] = 3;
+  net->blob_by_name("a")->Reshape(shape);
+  shape[1] = 1;
+  net->blob_by_name("c")->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  const vector<Blob<Dtype>*>& inputs = net->input_blobs();
+  ASSERT_EQ(3, inputs.size());
+  for (int i = 0; i < inputs.size(); ++i) {
+    filler.Fill(inputs[i]);
+  }
+  net->Forward();
+  ASSERT_EQ(24, out->count());
+  int offset = 0;
+  for (int i = 0; i < inputs.size(); ++i) {
+    for (int j = 0; j < inputs[i]->count(); ++j) {
+      EXPECT_EQ(inputs[i]->cpu_data()[j], out->cpu_data()[offset + j]);
+    }
+    offset += inputs[i]->count();
+  }
+  caffe_copy(out->count(), out->cpu_data(), out->mutable_cpu_diff());
+  net->Backward();
+  for (int i = 0; i < inputs.size(); ++i) {
+    for (int j = 0; j < inputs[i]->count(); ++j) {
+      EXPECT_EQ(inputs[i]->cpu_data()[j], inputs[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestShareConcatSliceBuffersSkipsRecurrent) {
+  typedef typename TypeParam::Dtype Dtype;
+  // An RNN shares its input and output with its unrolled net in Reshape, so
+  // they must stay out of the Slice and Concat buffers. Its output, and the
+  // gradient of a Backward right after Net::Reshape, have to match those of
+  // the RNN on its own.
+  Caffe::set_mode(Caffe::CPU);
+  const string& rnn =
+      "layer { "
+      "  name: 'rnn' type: 'RNN' bottom: 'x' bottom: 'cont' top: 'h' "
+      "  recurrent_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } "
+      "  } "
+      "} ";
+  const string& proto =
+      "name: 'RNNConcatSliceNetwork' "
+      "force_backward: true "
+      "layer { "
+      "  name: 'data' type: 'Input' top: 'data' top: 'cont' "
+      "  input_param { "
+      "    shape: { dim: 4 dim: 1 dim: 3 } "
+      "    shape: { dim: 2 dim: 1 } "
+      "  } "
+      "} "
+      "layer { name: 'pdata' type: 'Power' bottom: 'data' top: 'pdata' } "
+      "layer { "
+      "  name: 'slice' type: 'Slice' bottom: 'pdata' top: 'x' top: 'y' "
+      "  slice_param { axis: 0 } "
+      "} " + rnn +
+      "layer { name: 'py' type: 'Power' bottom: 'y' top: 'py' } "
+      "layer { "
+      "  name: 'concat' type: 'Concat' bottom: 'h' bottom: 'py' top: 'out' "
+      "  concat_param { axis: 0 } "
+      "} ";
+  const string& rnn_proto =
+      "name: 'RNNNetwork' "
+      "force_backward: true "
+      "layer { "
+      "  name: 'data' type: 'Input' top: 'x' top: 'cont' "
+      "  input_param { "
+      "    shape: { dim: 2 dim: 1 dim: 3 } "
+      "    shape: { dim: 2 dim: 1 } "
+      "  } "
+      "} " + rnn;
+  Caffe::set_random_seed(this->seed_);
+  this->InitNetFromProtoString(proto);
+  Net<Dtype>* net = this->net_.get();
+  Caffe::set_random_seed(this->seed_);
+  NetParameter rnn_param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(rnn_proto, &rnn_param));
+  Net<Dtype> rnn_net(rnn_param);
+  const Blob<Dtype>& out = *net->blob_by_name("out");
+  EXPECT_FALSE(net->blob_by_name("x")->SharesDataSlice(
+      *net->blob_by_name("pdata"), 0));
+  EXPECT_TRUE(net->blob_by_name("y")->SharesDataSlice(
+      *net->blob_by_name("pdata"), 6));
+  EXPECT_FALSE(net->blob_by_name("h")->SharesDataSlice(out, 0));
+  EXPECT_TRUE(net->blob_by_name("py")->SharesDataSlice(out, 6));
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype>* data = net->blob_by_name("data").get();
+  filler.Fill(data);
+  Blob<Dtype>* x = rnn_net.blob_by_name("x").get();
+  caffe_copy(x->count(), data->cpu_data(), x->mutable_cpu_data());
+  const Dtype cont[] = {0, 1};
+  caffe_copy(2, cont, net->blob_by_name("cont")->mutable_cpu_data());
+  caffe_copy(2, cont, rnn_net.blob_by_name("cont")->mutable_cpu_data());
+  net->Forward();
+  rnn_net.Forward();
+  const Blob<Dtype>& h = *rnn_net.blob_by_name("h");
+  ASSERT_EQ(12, out.count());
+  for (int i = 0; i < h.count(); ++i) {
+    EXPECT_NEAR(h.cpu_data()[i], out.cpu_data()[i], 1e-5);
+  }
+  for (int i = h.count(); i < out.count(); ++i) {
+    EXPECT_EQ(data->cpu_data()[i], out.cpu_data()[i]);
+  }
+  // A Backward without a Forward since the Reshape.
+  net->Reshape();
+  Blob<Dtype> h_diff(h.shape());
+  filler.Fill(&h_diff);
+  Dtype* out_diff = net->blob_by_name("out")->mutable_cpu_diff();
+  caffe_set(out.count(), Dtype(0), out_diff);
+  caffe_copy(h.count(), h_diff.cpu_data(), out_diff);
+  caffe_copy(h.count(), h_diff.cpu_data(),
+             rnn_net.blob_by_name("h")->mutable_cpu_diff());
+  net->Backward();
+  rnn_net.Backward();
+  for (int i = 0; i < x->count(); ++i) {
+    EXPECT_NEAR(x->cpu_diff()[i], data->cpu_diff()[i], 1e-5);
+  }
+}
+
+TYPED_TEST(NetTest, TestLatencyMode) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Switching a net to latency mode must reach every layer and leave the
+  // outputs unchanged.
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(Caffe::CPU);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> blob(1, 3, 12, 10);
+  filler.Fill(&blob);
+
+  this->InitReshapableNet();
+  EXPECT_FALSE(this->net_->latency_mode());
+  shared_ptr<Blob<Dtype> > input_blob = this->net_->blob_by_name("data");
+  Blob<Dtype>* output_blob = this->net_->output_blobs()[0];
+  input_blob->ReshapeLike(blob);
+  this->net_->Reshape();
+  caffe_copy(blob.count(), blob.cpu_data(), input_blob->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> output;
+  output.CopyFrom(*output_blob, false, true);
+
+  this->net_->SetLatencyMode(true);
+  EXPECT_TRUE(this->net_->latency_mode());
+  for (int i = 0; i < this->net_->layers().size(); ++i) {
+    EXPECT_TRUE(this->net_->layers()[i]->latency_mode());
+  }
+  this->net_->Forward();
+  for (int i = 0; i < output.count(); ++i) {
+    EXPECT_NEAR(output.cpu_data()[i], output_blob->cpu_data()[i], 1e-4);
+  }
+  // call backward just to make sure it runs
+  this->net_->Backward();
+}
+
 // TODO: this test should work for Caffe Engine as well
 // but there were problems visible on Intel OpenMP
 // that need to be investigated
@@ -3491,4 +4001,150 @@ TEST_F(CompileNetTest, TestNoCompileNet) {
   this->RunCompilerNetTest(input_proto, input_proto);
 }
 
+// Permute to channels-last and Flatten layers in front of every bottom
+// of a Concat, as in SSD prediction heads, are folded into the Concat
+// when the net opts in
+TEST_F(CompileNetTest, TestCompileNetPermuteFlattenConcat) {
+  const string& input_proto =
+      "name: 'TestNetwork' "
+      "fold_permute_flatten: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'loc1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'loc1' "
+      "} "
+      "layer { "
+      "  name: 'loc1_perm' "
+      "  type: 'Permute' "
+      "  bottom: 'loc1' "
+      "  top: 'loc1_perm' "
+      "  permute_param { order: 0 order: 2 order: 3 order: 1 } "
+      "} "
+      "layer { "
+      "  name: 'loc1_flat' "
+      "  type: 'Flatten' "
+      "  bottom: 'loc1_perm' "
+      "  top: 'loc1_flat' "
+      "  flatten_param { axis: 1 } "
+      "} "
+      "layer { "
+      "  name: 'loc2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'loc2' "
+      "} "
+      "layer { "
+      "  name: 'loc2_perm' "
+      "  type: 'Permute' "
+      "  bottom: 'loc2' "
+      "  top: 'loc2_perm' "
+      "  permute_param { order: 0 order: 2 order: 3 order: 1 } "
+      "} "
+      "layer { "
+      "  name: 'loc2_flat' "
+      "  type: 'Flatten' "
+      "  bottom: 'loc2_perm' "
+      "  top: 'loc2_flat' "
+      "  flatten_param { axis: 1 } "
+      "} "
+      "layer { "
+      "  name: 'mbox_loc' "
+      "  type: 'Concat' "
+      "  bottom: 'loc1_flat' "
+      "  bottom: 'loc2_flat' "
+      "  top: 'mbox_loc' "
+      "  concat_param { axis: 1 } "
+      "} ";
+
+  const string& output_proto =
+      "name: 'TestNetwork' "
+      "fold_permute_flatten: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'loc1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'loc1' "
+      "} "
+      "layer { "
+      "  name: 'loc2' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'loc2' "
+      "} "
+      "layer { "
+      "  name: 'mbox_loc' "
+      "  type: 'Concat' "
+      "  bottom: 'loc1' "
+      "  bottom: 'loc2' "
+      "  top: 'mbox_loc' "
+      "  concat_param { axis: 1 channels_last: true } "
+      "} ";
+  this->RunCompilerNetTest(input_proto, output_proto);
+
+  // Nothing is folded once a single bottom is not a permuted head.
+  const string& mixed_proto =
+      "name: 'TestNetwork' "
+      "fold_permute_flatten: true "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Data' "
+      "  top: 'data' "
+      "} "
+      "layer { "
+      "  name: 'loc1' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'loc1' "
+      "} "
+      "layer { "
+      "  name: 'loc1_perm' "
+      "  type: 'Permute' "
+      "  bottom: 'loc1' "
+      "  top: 'loc1_perm' "
+      "  permute_param { order: 0 order: 2 order: 3 order: 1 } "
+      "} "
+      "layer { "
+      "  name: 'loc1_flat' "
+      "  type: 'Flatten' "
+      "  bottom: 'loc1_perm' "
+      "  top: 'loc1_flat' "
+      "  flatten_param { axis: 1 } "
+      "} "
+      "layer { "
+      "  name: 'loc2_flat' "
+      "  type: 'Flatten' "
+      "  bottom: 'data' "
+      "  top: 'loc2_flat' "
+      "  flatten_param { axis: 1 } "
+      "} "
+      "layer { "
+      "  name: 'mbox_loc' "
+      "  type: 'Concat' "
+      "  bottom: 'loc1_flat' "
+      "  bottom: 'loc2_flat' "
+      "  top: 'mbox_loc' "
+      "  concat_param { axis: 1 } "
+      "} ";
+  this->RunCompilerNetTest(mixed_proto, mixed_proto);
+
+  // By default the layers are kept as written.
+  NetParameter default_param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(input_proto,
+      &default_param));
+  default_param.clear_fold_permute_flatten();
+  const string default_proto = default_param.DebugString();
+  this->RunCompilerNetTest(default_proto, default_proto);
+}
+
 }  // namespace caffe
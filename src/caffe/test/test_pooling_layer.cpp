@@ -35,6 +35,8 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -43,6 +45,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_pooling_layer.hpp"
@@ -646,6 +649,275 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+template <typename Dtype>
+class Pooling3DLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  Pooling3DLayerTest()
+      : blob_bottom_(new Blob<Dtype>()),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_mask_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    vector<int> shape(5);
+    shape[0] = 2;
+    shape[1] = 3;
+    shape[2] = 4;
+    shape[3] = 5;
+    shape[4] = 21;
+    blob_bottom_->Reshape(shape);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~Pooling3DLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_mask_;
+  }
+
+  void SetParam(PoolingParameter_PoolMethod pool, int kernel_w, int stride_w,
+      int pad, LayerParameter* layer_param) {
+    PoolingParameter* pooling_param = layer_param->mutable_pooling_param();
+    pooling_param->set_pool(pool);
+    pooling_param->add_kernel_size(2);
+    pooling_param->add_kernel_size(3);
+    pooling_param->add_kernel_size(kernel_w);
+    pooling_param->add_stride(1);
+    pooling_param->add_stride(2);
+    pooling_param->add_stride(stride_w);
+    for (int i = 0; i < 3; ++i) {
+      pooling_param->add_pad(pad);
+    }
+  }
+
+  // Straightforward 3D pooling of every channel, also returning the index
+  // of each maximum.
+  void Reference(const PoolingParameter& pooling_param,
+      vector<Dtype>* top_data, vector<int>* mask) {
+    const int* input = &blob_bottom_->shape()[2];
+    const int* output = &blob_top_->shape()[2];
+    const bool max_pool =
+        pooling_param.pool() == PoolingParameter_PoolMethod_MAX;
+    const int fm_size = input[0] * input[1] * input[2];
+    const int pooled_fm_size = output[0] * output[1] * output[2];
+    top_data->resize(blob_top_->count());
+    mask->assign(blob_top_->count(), -1);
+    for (int nc = 0; nc < blob_bottom_->count(0, 2); ++nc) {
+      const Dtype* bottom = blob_bottom_->cpu_data() + nc * fm_size;
+      for (int pz = 0; pz < output[0]; ++pz) {
+        for (int ph = 0; ph < output[1]; ++ph) {
+          for (int pw = 0; pw < output[2]; ++pw) {
+            const int p[3] = {pz, ph, pw};
+            int start[3], end[3];
+            int pool_size = 1;
+            for (int i = 0; i < 3; ++i) {
+              start[i] = p[i] * pooling_param.stride(i) - pooling_param.pad(i);
+              end[i] = std::min(start[i] + pooling_param.kernel_size(i),
+                                input[i] + pooling_param.pad(i));
+              pool_size *= end[i] - start[i];
+              start[i] = std::max(start[i], 0);
+              end[i] = std::min(end[i], input[i]);
+            }
+            Dtype acc = max_pool ? -FLT_MAX : 0;
+            int acc_index = -1;
+            for (int z = start[0]; z < end[0]; ++z) {
+              for (int h = start[1]; h < end[1]; ++h) {
+                for (int w = start[2]; w < end[2]; ++w) {
+                  const int index = (z * input[1] + h) * input[2] + w;
+                  if (!max_pool) {
+                    acc += bottom[index];
+                  } else if (bottom[index] > acc) {
+                    acc = bottom[index];
+                    acc_index = index;
+                  }
+                }
+              }
+            }
+            const int pool_index =
+                nc * pooled_fm_size + (pz * output[1] + ph) * output[2] + pw;
+            (*top_data)[pool_index] = max_pool ? acc : acc / pool_size;
+            (*mask)[pool_index] = acc_index;
+          }
+        }
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_mask_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(Pooling3DLayerTest, TestDtypes);
+
+TYPED_TEST(Pooling3DLayerTest, TestForward) {
+  typedef TypeParam Dtype;
+  for (int pool = 0; pool < 2; ++pool) {
+    for (int stride_w = 1; stride_w <= 2; ++stride_w) {
+      for (int pad = 0; pad <= 1; ++pad) {
+        LayerParameter layer_param;
+        this->SetParam(pool ? PoolingParameter_PoolMethod_AVE :
+                       PoolingParameter_PoolMethod_MAX, 3, stride_w, pad,
+                       &layer_param);
+        if (!pool) {
+          this->blob_top_vec_.push_back(this->blob_top_mask_);
+        }
+        PoolingLayer<Dtype> layer(layer_param);
+        layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        this->blob_top_vec_.resize(1);
+        vector<Dtype> top_data;
+        vector<int> mask;
+        this->Reference(layer_param.pooling_param(), &top_data, &mask);
+        for (int i = 0; i < this->blob_top_->count(); ++i) {
+          if (pool) {
+            EXPECT_NEAR(top_data[i], this->blob_top_->cpu_data()[i], 1e-5);
+          } else {
+            EXPECT_EQ(top_data[i], this->blob_top_->cpu_data()[i]);
+            EXPECT_EQ(mask[i], this->blob_top_mask_->cpu_data()[i]);
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestForwardReshape) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  this->SetParam(PoolingParameter_PoolMethod_MAX, 2, 2, 0, &layer_param);
+  PoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // A wider input giving the same top shape.
+  const vector<int> top_shape = this->blob_top_->shape();
+  vector<int> shape = this->blob_bottom_->shape();
+  shape[4] = 22;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(top_shape, this->blob_top_->shape());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<Dtype> top_data;
+  vector<int> mask;
+  this->Reference(layer_param.pooling_param(), &top_data, &mask);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_EQ(top_data[i], this->blob_top_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestBackward) {
+  typedef TypeParam Dtype;
+  const int* input = &this->blob_bottom_->shape()[2];
+  const int fm_size = input[0] * input[1] * input[2];
+  for (int pool = 0; pool < 2; ++pool) {
+    for (int stride_w = 1; stride_w <= 2; ++stride_w) {
+      for (int pad = 0; pad <= 1; ++pad) {
+        LayerParameter layer_param;
+        this->SetParam(pool ? PoolingParameter_PoolMethod_AVE :
+                       PoolingParameter_PoolMethod_MAX, 3, stride_w, pad,
+                       &layer_param);
+        const PoolingParameter& pooling_param = layer_param.pooling_param();
+        PoolingLayer<Dtype> layer(layer_param);
+        layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        FillerParameter filler_param;
+        GaussianFiller<Dtype> filler(filler_param);
+        filler.Fill(this->blob_top_);
+        caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+                   this->blob_top_->mutable_cpu_diff());
+        layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+                       this->blob_bottom_vec_);
+
+        vector<Dtype> top_data;
+        vector<int> mask;
+        this->Reference(pooling_param, &top_data, &mask);
+        vector<Dtype> bottom_diff(this->blob_bottom_->count(), 0);
+        const Dtype* top_diff = this->blob_top_->cpu_diff();
+        const int* output = &this->blob_top_->shape()[2];
+        const int pooled_fm_size = output[0] * output[1] * output[2];
+        for (int i = 0; i < this->blob_top_->count(); ++i) {
+          const int nc = i / pooled_fm_size;
+          Dtype* bottom = &bottom_diff[nc * fm_size];
+          if (!pool) {
+            bottom[mask[i]] += top_diff[i];
+            continue;
+          }
+          const int p[3] = {(i % pooled_fm_size) / (output[1] * output[2]),
+                            (i / output[2]) % output[1], i % output[2]};
+          int start[3], end[3];
+          int pool_size = 1;
+          for (int j = 0; j < 3; ++j) {
+            start[j] = p[j] * pooling_param.stride(j) - pooling_param.pad(j);
+            end[j] = std::min(start[j] + pooling_param.kernel_size(j),
+                              input[j] + pooling_param.pad(j));
+            pool_size *= end[j] - start[j];
+            start[j] = std::max(start[j], 0);
+            end[j] = std::min(end[j], input[j]);
+          }
+          for (int z = start[0]; z < end[0]; ++z) {
+            for (int h = start[1]; h < end[1]; ++h) {
+              for (int w = start[2]; w < end[2]; ++w) {
+                bottom[(z * input[1] + h) * input[2] + w] +=
+                    top_diff[i] / pool_size;
+              }
+            }
+          }
+        }
+        for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+          EXPECT_NEAR(bottom_diff[i], this->blob_bottom_->cpu_diff()[i], 1e-5);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestGradientMax) {
+  typedef TypeParam Dtype;
+  vector<int> shape(5);
+  shape[0] = 1;
+  shape[1] = 2;
+  shape[2] = 3;
+  shape[3] = 4;
+  shape[4] = 11;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  this->SetParam(PoolingParameter_PoolMethod_MAX, 2, 1, 1, &layer_param);
+  PoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(Pooling3DLayerTest, TestGradientAve) {
+  typedef TypeParam Dtype;
+  vector<int> shape(5);
+  shape[0] = 1;
+  shape[1] = 2;
+  shape[2] = 3;
+  shape[3] = 4;
+  shape[4] = 11;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  this->SetParam(PoolingParameter_PoolMethod_AVE, 3, 1, 1, &layer_param);
+  PoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
@@ -596,4 +596,47 @@ TYPED_TEST(PriorBoxLayerTest, TestCPUFixStep) {
   }
 }
 
+TYPED_TEST(PriorBoxLayerTest, TestCPUCached) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  PriorBoxParameter* prior_box_param = layer_param.mutable_prior_box_param();
+  prior_box_param->add_min_size(this->min_size_);
+  prior_box_param->add_max_size(this->max_size_);
+  prior_box_param->add_aspect_ratio(2.);
+  PriorBoxLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  // A second layer with the same parameters and shapes shares the priors.
+  Blob<Dtype> other_top;
+  vector<Blob<Dtype>*> other_top_vec(1, &other_top);
+  PriorBoxLayer<Dtype> other_layer(layer_param);
+  other_layer.SetUp(this->blob_bottom_vec_, other_top_vec);
+  other_layer.Forward(this->blob_bottom_vec_, other_top_vec);
+  EXPECT_EQ(this->blob_top_->cpu_data(), other_top.cpu_data());
+
+  // Different shapes get their own priors, which match a fresh layer.
+  this->blob_bottom_->Reshape(10, 10, 5, 5);
+  layer.Reshape(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_NE(this->blob_top_->cpu_data(), other_top.cpu_data());
+  EXPECT_EQ(this->blob_top_->count(), 5 * 5 * 4 * 4 * 2);
+  Blob<Dtype> fresh_top;
+  vector<Blob<Dtype>*> fresh_top_vec(1, &fresh_top);
+  PriorBoxLayer<Dtype> fresh_layer(layer_param);
+  fresh_layer.SetUp(this->blob_bottom_vec_, fresh_top_vec);
+  fresh_layer.Forward(this->blob_bottom_vec_, fresh_top_vec);
+  EXPECT_EQ(this->blob_top_->cpu_data(), fresh_top.cpu_data());
+  const Dtype eps = 1e-6;
+  const Dtype* top_data = this->blob_top_->cpu_data();
+  // pixel (0, 0), first prior box.
+  EXPECT_NEAR(top_data[0], (10 - this->min_size_ / 2.) / 100., eps);
+  EXPECT_NEAR(top_data[1], (10 - this->min_size_ / 2.) / 100., eps);
+  EXPECT_NEAR(top_data[2], (10 + this->min_size_ / 2.) / 100., eps);
+  EXPECT_NEAR(top_data[3], (10 + this->min_size_ / 2.) / 100., eps);
+  for (int d = 0; d < 5 * 5 * 4 * 4; ++d) {
+    EXPECT_NEAR(top_data[5 * 5 * 4 * 4 + d], 0.1, eps);
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,173 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/psroi_pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class PSROIPoolingLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  PSROIPoolingLayerTest()
+      : output_dim_(2), group_size_(2),
+        blob_bottom_data_(new Blob<Dtype>(2, 8, 5, 6)),
+        blob_bottom_rois_(new Blob<Dtype>(8, 5, 1, 1)),
+        blob_top_data_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    filler_param.set_std(10);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_data_);
+    // Random ROIs, some of them overhanging or missing the feature map.
+    Dtype* rois = blob_bottom_rois_->mutable_cpu_data();
+    for (int n = 0; n < blob_bottom_rois_->num(); ++n) {
+      rois[n * 5] = caffe_rng_rand() % blob_bottom_data_->num();
+      for (int i = 1; i < 5; ++i) {
+        const int extent = i % 2 ? blob_bottom_data_->width() :
+            blob_bottom_data_->height();
+        rois[n * 5 + i] = static_cast<int>(caffe_rng_rand() % (extent + 4)) - 2;
+      }
+    }
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_rois_);
+    blob_top_vec_.push_back(blob_top_data_);
+  }
+  virtual ~PSROIPoolingLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_rois_;
+    delete blob_top_data_;
+  }
+  const int output_dim_;
+  const int group_size_;
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_rois_;
+  Blob<Dtype>* const blob_top_data_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(PSROIPoolingLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(PSROIPoolingLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PSROIPoolingParameter* psroi_pooling_param =
+      layer_param.mutable_psroi_pooling_param();
+  psroi_pooling_param->set_spatial_scale(1);
+  psroi_pooling_param->set_output_dim(this->output_dim_);
+  psroi_pooling_param->set_group_size(this->group_size_);
+  PSROIPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int group_size = this->group_size_;
+  const int channels = this->blob_bottom_data_->channels();
+  const int height = this->blob_bottom_data_->height();
+  const int width = this->blob_bottom_data_->width();
+  EXPECT_EQ(this->blob_top_data_->num(), this->blob_bottom_rois_->num());
+  EXPECT_EQ(this->blob_top_data_->channels(), this->output_dim_);
+  EXPECT_EQ(this->blob_top_data_->height(), group_size);
+  EXPECT_EQ(this->blob_top_data_->width(), group_size);
+  // Average each bin of its position-sensitive channel.
+  const Dtype* bottom_data = this->blob_bottom_data_->cpu_data();
+  const Dtype* top_data = this->blob_top_data_->cpu_data();
+  for (int n = 0; n < this->blob_bottom_rois_->num(); ++n) {
+    const Dtype* roi = this->blob_bottom_rois_->cpu_data() + n * 5;
+    const int b = roi[0];
+    const Dtype roi_start_w = round(roi[1]);
+    const Dtype roi_start_h = round(roi[2]);
+    const Dtype bin_size_w =
+        std::max<Dtype>(round(roi[3]) + 1 - roi_start_w, 0.1) / group_size;
+    const Dtype bin_size_h =
+        std::max<Dtype>(round(roi[4]) + 1 - roi_start_h, 0.1) / group_size;
+    for (int ctop = 0; ctop < this->output_dim_; ++ctop) {
+      for (int ph = 0; ph < group_size; ++ph) {
+        for (int pw = 0; pw < group_size; ++pw) {
+          const int hstart = std::min(std::max(static_cast<int>(
+              floor(ph * bin_size_h + roi_start_h)), 0), height);
+          const int hend = std::min(std::max(static_cast<int>(
+              ceil((ph + 1) * bin_size_h + roi_start_h)), 0), height);
+          const int wstart = std::min(std::max(static_cast<int>(
+              floor(pw * bin_size_w + roi_start_w)), 0), width);
+          const int wend = std::min(std::max(static_cast<int>(
+              ceil((pw + 1) * bin_size_w + roi_start_w)), 0), width);
+          const int c = (ctop * group_size + ph) * group_size + pw;
+          Dtype sum = 0;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              sum += bottom_data[((b * channels + c) * height + h) * width + w];
+            }
+          }
+          const Dtype area = (hend - hstart) * (wend - wstart);
+          const Dtype expected =
+              (hend <= hstart || wend <= wstart) ? 0 : sum / area;
+          EXPECT_NEAR(expected, top_data[((n * this->output_dim_ + ctop)
+              * group_size + ph) * group_size + pw], 1e-4);
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PSROIPoolingLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  PSROIPoolingParameter* psroi_pooling_param =
+      layer_param.mutable_psroi_pooling_param();
+  psroi_pooling_param->set_spatial_scale(1);
+  psroi_pooling_param->set_output_dim(this->output_dim_);
+  psroi_pooling_param->set_group_size(this->group_size_);
+  PSROIPoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+}  // namespace caffe
@@ -14,6 +14,7 @@
 #include "caffe/layers/roi_pooling_layer.hpp"
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
+#include "caffe/util/math_functions.hpp"
 
 using boost::scoped_ptr;
 
@@ -156,6 +157,106 @@ TYPED_TEST(ROIPoolingLayerTest, TestGradient) {
       this->blob_top_vec_, 0);
 }
 
+TYPED_TEST(ROIPoolingLayerTest, TestForwardBackwardManyROIs) {
+  typedef typename TypeParam::Dtype Dtype;
+  // An odd channel count and ROIs that overhang or miss the feature map
+  // cover the vector tails and the empty bins.
+  const int num = 2, channels = 19, height = 9, width = 11;
+  const int num_rois = 40, pooled_h = 3, pooled_w = 4;
+  const Dtype spatial_scale = 0.5;
+  Blob<Dtype> blob_bottom_data(num, channels, height, width);
+  Blob<Dtype> blob_bottom_rois(num_rois, 5, 1, 1);
+  Blob<Dtype> blob_top_data;
+  FillerParameter filler_param;
+  filler_param.set_std(10);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&blob_bottom_data);
+  Dtype* rois = blob_bottom_rois.mutable_cpu_data();
+  for (int n = 0; n < num_rois; ++n) {
+    rois[n * 5] = caffe_rng_rand() % num;
+    for (int i = 1; i < 5; ++i) {
+      const int extent = (i % 2 ? width : height) / spatial_scale;
+      rois[n * 5 + i] = static_cast<int>(caffe_rng_rand() % (extent + 8)) - 4;
+    }
+  }
+  vector<Blob<Dtype>*> blob_bottom_vec;
+  vector<Blob<Dtype>*> blob_top_vec;
+  blob_bottom_vec.push_back(&blob_bottom_data);
+  blob_bottom_vec.push_back(&blob_bottom_rois);
+  blob_top_vec.push_back(&blob_top_data);
+
+  LayerParameter layer_param;
+  ROIPoolingParameter* roi_pooling_param =
+      layer_param.mutable_roi_pooling_param();
+  roi_pooling_param->set_pooled_h(pooled_h);
+  roi_pooling_param->set_pooled_w(pooled_w);
+  roi_pooling_param->set_spatial_scale(spatial_scale);
+  ROIPoolingLayer<Dtype> layer(layer_param);
+  layer.SetUp(blob_bottom_vec, blob_top_vec);
+  layer.Forward(blob_bottom_vec, blob_top_vec);
+  filler.Fill(&blob_top_data);
+  caffe_copy(blob_top_data.count(), blob_top_data.cpu_data(),
+             blob_top_data.mutable_cpu_diff());
+  layer.Forward(blob_bottom_vec, blob_top_vec);
+  vector<bool> propagate_down(2, true);
+  propagate_down[1] = false;
+  layer.Backward(blob_top_vec, propagate_down, blob_bottom_vec);
+
+  // Plain per-channel max pooling as a reference.
+  const Dtype* bottom_data = blob_bottom_data.cpu_data();
+  const Dtype* top_data = blob_top_data.cpu_data();
+  const Dtype* top_diff = blob_top_data.cpu_diff();
+  vector<Dtype> bottom_diff(blob_bottom_data.count(), 0);
+  for (int n = 0; n < num_rois; ++n) {
+    const Dtype* roi = blob_bottom_rois.cpu_data() + n * 5;
+    const int b = roi[0];
+    const int roi_start_w = round(roi[1] * spatial_scale);
+    const int roi_start_h = round(roi[2] * spatial_scale);
+    const int roi_end_w = round(roi[3] * spatial_scale);
+    const int roi_end_h = round(roi[4] * spatial_scale);
+    const Dtype bin_size_h = static_cast<Dtype>(
+        std::max(roi_end_h - roi_start_h + 1, 1)) / pooled_h;
+    const Dtype bin_size_w = static_cast<Dtype>(
+        std::max(roi_end_w - roi_start_w + 1, 1)) / pooled_w;
+    for (int c = 0; c < channels; ++c) {
+      for (int ph = 0; ph < pooled_h; ++ph) {
+        for (int pw = 0; pw < pooled_w; ++pw) {
+          const int hstart = std::min(std::max(roi_start_h +
+              static_cast<int>(floor(ph * bin_size_h)), 0), height);
+          const int hend = std::min(std::max(roi_start_h +
+              static_cast<int>(ceil((ph + 1) * bin_size_h)), 0), height);
+          const int wstart = std::min(std::max(roi_start_w +
+              static_cast<int>(floor(pw * bin_size_w)), 0), width);
+          const int wend = std::min(std::max(roi_start_w +
+              static_cast<int>(ceil((pw + 1) * bin_size_w)), 0), width);
+          const int top_index = ((n * channels + c) * pooled_h + ph)
+              * pooled_w + pw;
+          if (hend <= hstart || wend <= wstart) {
+            EXPECT_EQ(0, top_data[top_index]);
+            continue;
+          }
+          Dtype maxval = -FLT_MAX;
+          int maxidx = -1;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              const int index = ((b * channels + c) * height + h) * width + w;
+              if (bottom_data[index] > maxval) {
+                maxval = bottom_data[index];
+                maxidx = index;
+              }
+            }
+          }
+          EXPECT_EQ(maxval, top_data[top_index]);
+          bottom_diff[maxidx] += top_diff[top_index];
+        }
+      }
+    }
+  }
+  for (int i = 0; i < blob_bottom_data.count(); ++i) {
+    EXPECT_EQ(bottom_diff[i], blob_bottom_data.cpu_diff()[i]);
+  }
+}
+
 TYPED_TEST(ROIPoolingLayerTest, TestForward3d) {
   typedef typename TypeParam::Dtype Dtype;
 
@@ -35,6 +35,7 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <cmath>
 #include <vector>
 
@@ -120,6 +121,54 @@ TYPED_TEST(SoftmaxLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(SoftmaxLayerTest, TestForwardLargeShapes) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Channel counts past one running-max block and inner sizes past one
+  // tile, both with strided and contiguous channels and wide inputs.
+  vector<vector<int> > shapes;
+  shapes.push_back(vector<int>(4, 2));
+  shapes.back()[1] = 37;
+  shapes.back()[2] = 9;
+  shapes.back()[3] = 10;
+  shapes.push_back(vector<int>(2, 3));
+  shapes.back()[1] = 41;
+  for (int s = 0; s < shapes.size(); ++s) {
+    this->blob_bottom_->Reshape(shapes[s]);
+    FillerParameter filler_param;
+    filler_param.set_std(20);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    LayerParameter layer_param;
+    SoftmaxLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int outer_num = this->blob_bottom_->shape(0);
+    const int channels = this->blob_bottom_->shape(1);
+    const int inner_num = this->blob_bottom_->count(2);
+    const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    for (int i = 0; i < outer_num; ++i) {
+      for (int k = 0; k < inner_num; ++k) {
+        const int offset = i * channels * inner_num + k;
+        double max_val = bottom_data[offset];
+        for (int j = 1; j < channels; ++j) {
+          max_val = std::max(max_val,
+              static_cast<double>(bottom_data[offset + j * inner_num]));
+        }
+        double scale = 0;
+        for (int j = 0; j < channels; ++j) {
+          scale += exp(bottom_data[offset + j * inner_num] - max_val);
+        }
+        for (int j = 0; j < channels; ++j) {
+          EXPECT_NEAR(top_data[offset + j * inner_num],
+              exp(bottom_data[offset + j * inner_num] - max_val) / scale,
+              1e-5) << "debug: " << s << " " << i << " " << j << " " << k;
+        }
+      }
+    }
+  }
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNSoftmaxLayerTest : public GPUDeviceTest<Dtype> {
@@ -35,6 +35,12 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <algorithm>
+#include <cfloat>
 #include <cmath>
 #include <vector>
 
@@ -142,4 +148,92 @@ TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientUnnormalized) {
       this->blob_top_vec_, 0);
 }
 
+TYPED_TEST(SoftmaxWithLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SoftmaxWithLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype* data = this->blob_bottom_data_->cpu_data();
+  const Dtype* label = this->blob_bottom_label_->cpu_data();
+  const int channels = this->blob_bottom_data_->channels();
+  const int inner_num = this->blob_bottom_data_->count(2);
+  double loss = 0;
+  for (int i = 0; i < this->blob_bottom_label_->count(); ++i) {
+    const int offset = (i / inner_num) * channels * inner_num + i % inner_num;
+    double max_val = data[offset];
+    for (int c = 1; c < channels; ++c) {
+      max_val = std::max(max_val,
+          static_cast<double>(data[offset + c * inner_num]));
+    }
+    double sum = 0;
+    for (int c = 0; c < channels; ++c) {
+      sum += exp(data[offset + c * inner_num] - max_val);
+    }
+    const int label_value = static_cast<int>(label[i]);
+    loss -= std::max(log(static_cast<double>(FLT_MIN)),
+        data[offset + label_value * inner_num] - max_val - log(sum));
+  }
+  loss /= this->blob_bottom_label_->count();
+  EXPECT_NEAR(this->blob_top_loss_->cpu_data()[0], loss, 1e-4 * loss);
+}
+
+TYPED_TEST(SoftmaxWithLossLayerTest, TestGradientWeighted) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Per-instance weights are only implemented on the CPU.
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  Blob<Dtype> weights(10, 1, 2, 3);
+  FillerParameter filler_param;
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&weights);
+  this->blob_bottom_vec_.push_back(&weights);
+  LayerParameter layer_param;
+  layer_param.mutable_loss_param()->set_ignore_label(0);
+  SoftmaxWithLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2, 1701);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+#ifdef _OPENMP
+TYPED_TEST(SoftmaxWithLossLayerTest, TestForwardSameForAnyThreadCount) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  // A spatial loss over several summation blocks, weighted per position.
+  Blob<Dtype> data(2, 5, 60, 70);
+  Blob<Dtype> label(2, 1, 60, 70);
+  Blob<Dtype> weights(2, 1, 60, 70);
+  FillerParameter filler_param;
+  filler_param.set_std(10);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&data);
+  filler.Fill(&weights);
+  for (int i = 0; i < label.count(); ++i) {
+    label.mutable_cpu_data()[i] = caffe_rng_rand() % 5;
+  }
+  vector<Blob<Dtype>*> bottom_vec;
+  bottom_vec.push_back(&data);
+  bottom_vec.push_back(&label);
+  bottom_vec.push_back(&weights);
+  LayerParameter layer_param;
+  SoftmaxWithLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(bottom_vec, this->blob_top_vec_);
+  const int max_threads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  const Dtype serial_loss = this->blob_top_loss_->cpu_data()[0];
+  omp_set_num_threads(4);
+  layer.Forward(bottom_vec, this->blob_top_vec_);
+  const Dtype parallel_loss = this->blob_top_loss_->cpu_data()[0];
+  omp_set_num_threads(max_threads);
+  EXPECT_EQ(serial_loss, parallel_loss);
+}
+#endif
+
 }  // namespace caffe
@@ -46,6 +46,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/solver.hpp"
+#include "caffe/solver_factory.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -75,6 +76,82 @@ class SolverTest : public MultiDeviceTest<TypeParam> {
     solver_.reset(new SGDSolver<Dtype>(param));
   }
 
+  // Trains an embedding of rows 2 and 5 of a 10 row table for a few
+  // iterations and returns the initial and final weights.
+  void TrainEmbedding(const string& type, const string& extra_proto,
+      bool sparse_update, vector<Dtype>* initial, vector<Dtype>* trained) {
+    ostringstream proto;
+    proto <<
+       "type: '" << type << "' "
+       "base_lr: 0.1 "
+       "lr_policy: 'fixed' "
+       "max_iter: 5 "
+       "random_seed: 1701 "
+       "snapshot_after_train: false " << extra_proto <<
+       "net_param { "
+       "  name: 'TestEmbedding' "
+       "  layer { "
+       "    name: 'ids' "
+       "    type: 'DummyData' "
+       "    dummy_data_param { "
+       "      data_filler { type: 'constant' value: 2 } "
+       "      data_filler { type: 'constant' value: 5 } "
+       "      shape { dim: 2 } "
+       "      shape { dim: 1 } "
+       "    } "
+       "    top: 'ids_a' "
+       "    top: 'ids_b' "
+       "  } "
+       "  layer { "
+       "    name: 'concat' "
+       "    type: 'Concat' "
+       "    concat_param { axis: 0 } "
+       "    bottom: 'ids_a' "
+       "    bottom: 'ids_b' "
+       "    top: 'ids' "
+       "  } "
+       "  layer { "
+       "    name: 'target' "
+       "    type: 'DummyData' "
+       "    dummy_data_param { "
+       "      data_filler { type: 'gaussian' std: 1 } "
+       "      shape { dim: 3 dim: 4 } "
+       "    } "
+       "    top: 'target' "
+       "  } "
+       "  layer { "
+       "    name: 'embed' "
+       "    type: 'Embed' "
+       "    embed_param { "
+       "      input_dim: 10 "
+       "      num_output: 4 "
+       "      bias_term: false "
+       "      sparse_update: " << (sparse_update ? "true" : "false") << " "
+       "      weight_filler { type: 'gaussian' std: 1 } "
+       "    } "
+       "    bottom: 'ids' "
+       "    top: 'embed' "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'EuclideanLoss' "
+       "    bottom: 'embed' "
+       "    bottom: 'target' "
+       "  } "
+       "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    param.set_solver_mode(Caffe::mode() == Caffe::CPU ?
+        SolverParameter_SolverMode_CPU : SolverParameter_SolverMode_GPU);
+    solver_.reset(SolverRegistry<Dtype>::CreateSolver(param));
+    const Blob<Dtype>* weights =
+        solver_->net()->layer_by_name("embed")->blobs()[0].get();
+    const int count = weights->count();
+    initial->assign(weights->cpu_data(), weights->cpu_data() + count);
+    solver_->Solve();
+    trained->assign(weights->cpu_data(), weights->cpu_data() + count);
+  }
+
   shared_ptr<Solver<Dtype> > solver_;
 };
 
@@ -143,4 +220,37 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestSparseEmbedUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  const char* types[] = { "SGD", "AdaGrad", "Adam" };
+  const char* extra[] = { "momentum: 0.9 ", "", "momentum: 0.9 " };
+  for (int t = 0; t < 3; ++t) {
+    vector<Dtype> initial, dense, sparse;
+    this->TrainEmbedding(types[t], extra[t], false, &initial, &dense);
+    this->TrainEmbedding(types[t], extra[t], true, &initial, &sparse);
+    ASSERT_EQ(dense.size(), sparse.size());
+    for (int i = 0; i < dense.size(); ++i) {
+      EXPECT_NEAR(dense[i], sparse[i], 1e-5) << types[t] << " at " << i;
+    }
+  }
+}
+
+TYPED_TEST(SolverTest, TestSparseEmbedUpdateIsLazy) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  vector<Dtype> initial, trained;
+  this->TrainEmbedding("SGD", "momentum: 0.9 weight_decay: 0.1 ", true,
+      &initial, &trained);
+  for (int row = 0; row < 10; ++row) {
+    const bool touched = (row == 2 || row == 5);
+    for (int i = row * 4; i < (row + 1) * 4; ++i) {
+      if (touched) {
+        EXPECT_NE(initial[i], trained[i]);
+      } else {
+        EXPECT_EQ(initial[i], trained[i]);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
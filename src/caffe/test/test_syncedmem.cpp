@@ -159,4 +159,30 @@ TEST_F(SyncedMemoryTest, TestGPUWrite) {
 
 #endif
 
+TEST_F(SyncedMemoryTest, TestNumaPlacement) {
+  Caffe::set_mode(Caffe::CPU);
+  NumaParameter numa_param;
+  const numa::Placement placement(numa_param,
+                                  NumaParameter_Policy_INTERLEAVE);
+  EXPECT_TRUE(placement.enabled());
+  // Spans several pages so that it goes through the NUMA allocator.
+  const size_t size = 5 * numa::PageSize() + 3;
+  SyncedMemory mem(size);
+  mem.set_placement(placement);
+  const char* cpu_data = static_cast<const char*>(mem.cpu_data());
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ(cpu_data[i], 0);
+  }
+  void* mutable_data = mem.mutable_cpu_data();
+  caffe_memset(mem.size(), 1, mutable_data);
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ((static_cast<char*>(mutable_data))[i], 1);
+  }
+  // Changing the placement of allocated memory keeps its content.
+  mem.set_placement(numa::Placement(numa_param, NumaParameter_Policy_BIND));
+  for (int i = 0; i < mem.size(); ++i) {
+    EXPECT_EQ((static_cast<const char*>(mem.cpu_data()))[i], 1);
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,280 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/video_clip_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class VideoClipDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  VideoClipDataLayerTest()
+      : seed_(1701), height_(4), width_(6),
+        blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {}
+
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    Caffe::set_random_seed(seed_);
+    // Create three frame directories of 9, 3 and 20 gray frames. Pixel
+    // (h, w) of frame f is 10 * f + w, so clips show which frames they hold
+    // and whether they were mirrored.
+    MakeTempFilename(&filename_);
+    std::ofstream outfile(filename_.c_str(), std::ofstream::out);
+    LOG(INFO) << "Using temporary file " << filename_;
+    const int num_frames[] = {9, 3, 20};
+    for (int i = 0; i < 3; ++i) {
+      string dirname;
+      MakeTempDir(&dirname);
+      for (int f = 0; f < num_frames[i]; ++f) {
+        cv::Mat frame(height_, width_, CV_8UC1);
+        for (int h = 0; h < height_; ++h) {
+          for (int w = 0; w < width_; ++w) {
+            frame.at<uchar>(h, w) = 10 * f + w;
+          }
+        }
+        char name[16];
+        snprintf(name, sizeof(name), "/%03d.png", f);
+        cv::imwrite(dirname + name, frame);
+      }
+      outfile << dirname << " " << i << std::endl;
+    }
+    outfile.close();
+  }
+
+  virtual ~VideoClipDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  Dtype Pixel(int n, int d, int h, int w) {
+    const int clip_length = blob_top_data_->shape(2);
+    const int height = blob_top_data_->shape(3);
+    const int width = blob_top_data_->shape(4);
+    return blob_top_data_->cpu_data()[
+        ((n * clip_length + d) * height + h) * width + w];
+  }
+
+  int seed_;
+  const int height_;
+  const int width_;
+  string filename_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(VideoClipDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(VideoClipDataLayerTest, TestRead) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  VideoClipDataParameter* clip_param = param.mutable_video_clip_data_param();
+  clip_param->set_batch_size(3);
+  clip_param->set_source(this->filename_.c_str());
+  clip_param->set_clip_length(3);
+  clip_param->set_temporal_stride(2);
+  clip_param->set_random_offset(false);
+  clip_param->set_is_color(false);
+  VideoClipDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num_axes(), 5);
+  EXPECT_EQ(this->blob_top_data_->shape(0), 3);
+  EXPECT_EQ(this->blob_top_data_->shape(1), 1);
+  EXPECT_EQ(this->blob_top_data_->shape(2), 3);
+  EXPECT_EQ(this->blob_top_data_->shape(3), this->height_);
+  EXPECT_EQ(this->blob_top_data_->shape(4), this->width_);
+  EXPECT_EQ(this->blob_top_label_->num(), 3);
+  // Clips are centred; the 3 frame video repeats its last frame.
+  const int expected_frames[3][3] = {{2, 4, 6}, {0, 2, 2}, {7, 9, 11}};
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int n = 0; n < 3; ++n) {
+      EXPECT_EQ(n, this->blob_top_label_->cpu_data()[n]);
+      for (int d = 0; d < 3; ++d) {
+        for (int h = 0; h < this->height_; ++h) {
+          for (int w = 0; w < this->width_; ++w) {
+            EXPECT_EQ(10 * expected_frames[n][d] + w,
+                      this->Pixel(n, d, h, w));
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(VideoClipDataLayerTest, TestResize) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  VideoClipDataParameter* clip_param = param.mutable_video_clip_data_param();
+  clip_param->set_batch_size(3);
+  clip_param->set_source(this->filename_.c_str());
+  clip_param->set_clip_length(4);
+  clip_param->set_new_height(8);
+  clip_param->set_new_width(12);
+  VideoClipDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->shape(0), 3);
+  EXPECT_EQ(this->blob_top_data_->shape(1), 3);
+  EXPECT_EQ(this->blob_top_data_->shape(2), 4);
+  EXPECT_EQ(this->blob_top_data_->shape(3), 8);
+  EXPECT_EQ(this->blob_top_data_->shape(4), 12);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int n = 0; n < 3; ++n) {
+    EXPECT_EQ(n, this->blob_top_label_->cpu_data()[n]);
+  }
+}
+
+TYPED_TEST(VideoClipDataLayerTest, TestRandomOffsetAndMirror) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.set_phase(TRAIN);
+  param.mutable_transform_param()->set_mirror(true);
+  VideoClipDataParameter* clip_param = param.mutable_video_clip_data_param();
+  clip_param->set_batch_size(3);
+  clip_param->set_source(this->filename_.c_str());
+  clip_param->set_clip_length(4);
+  clip_param->set_is_color(false);
+  VideoClipDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int num_frames[] = {9, 3, 20};
+  for (int iter = 0; iter < 5; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int n = 0; n < 3; ++n) {
+      // Consecutive frames from a start that leaves room for the clip,
+      // all mirrored or none.
+      const int start = static_cast<int>(this->Pixel(n, 0, 0, 0)) / 10;
+      const bool mirror =
+          this->Pixel(n, 0, 0, 0) == 10 * start + this->width_ - 1;
+      EXPECT_LE(start, std::max(num_frames[n] - 4, 0));
+      for (int d = 0; d < 4; ++d) {
+        const int frame = std::min(start + d, num_frames[n] - 1);
+        for (int h = 0; h < this->height_; ++h) {
+          for (int w = 0; w < this->width_; ++w) {
+            const int x = mirror ? this->width_ - 1 - w : w;
+            EXPECT_EQ(10 * frame + x, this->Pixel(n, d, h, w));
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(VideoClipDataLayerTest, TestReadVideoFile) {
+  typedef typename TypeParam::Dtype Dtype;
+  // A 20 frame video whose frame f is a flat 10 * f. Motion JPEG keeps every
+  // frame a keyframe, so a clip starting anywhere must begin at its start.
+  string video;
+  MakeTempFilename(&video);
+  video += ".avi";
+  const int size = 16;
+  const int num_frames = 20;
+  {
+    cv::VideoWriter writer(video, CV_FOURCC('M', 'J', 'P', 'G'), 25,
+                           cv::Size(size, size));
+    ASSERT_TRUE(writer.isOpened()) << "Could not write " << video;
+    for (int f = 0; f < num_frames; ++f) {
+      writer << cv::Mat(size, size, CV_8UC3, cv::Scalar::all(10 * f));
+    }
+  }
+  string source;
+  MakeTempFilename(&source);
+  std::ofstream outfile(source.c_str(), std::ofstream::out);
+  outfile << video << " 5" << std::endl;
+  outfile.close();
+  for (int train = 0; train < 2; ++train) {
+    LayerParameter param;
+    param.set_phase(train ? TRAIN : TEST);
+    VideoClipDataParameter* clip_param =
+        param.mutable_video_clip_data_param();
+    clip_param->set_batch_size(4);
+    clip_param->set_source(source.c_str());
+    clip_param->set_clip_length(4);
+    clip_param->set_temporal_stride(2);
+    clip_param->set_random_offset(train);
+    clip_param->set_is_color(false);
+    VideoClipDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(size, this->blob_top_data_->shape(3));
+    ASSERT_EQ(size, this->blob_top_data_->shape(4));
+    for (int iter = 0; iter < 3; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      for (int n = 0; n < 4; ++n) {
+        EXPECT_EQ(5, this->blob_top_label_->cpu_data()[n]);
+        // Centred clips start at frame 6. The encoding is lossy, so frames
+        // are told apart by rounding.
+        const int start = train ?
+            (static_cast<int>(this->Pixel(n, 0, 0, 0)) + 5) / 10 : 6;
+        EXPECT_LE(start, num_frames - 7);
+        for (int d = 0; d < 4; ++d) {
+          for (int h = 0; h < size; ++h) {
+            for (int w = 0; w < size; ++w) {
+              EXPECT_NEAR(10 * (start + 2 * d), this->Pixel(n, d, h, w), 4);
+            }
+          }
+        }
+      }
+    }
+  }
+  std::remove(video.c_str());
+  std::remove(source.c_str());
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -0,0 +1,190 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <csignal>
+#include <cstdio>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/video_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class VideoDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  VideoDataLayerTest()
+      : size_(16), blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {}
+
+  virtual void SetUp() {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    // The layer raises SIGINT once the videos are used up.
+    old_handler_ = std::signal(SIGINT, SIG_IGN);
+    // Create two videos of 3 and 6 flat frames. Frame f of video v is
+    // Value(v, f), so batches show where their frames came from.
+    MakeTempFilename(&filename_);
+    std::ofstream outfile(filename_.c_str(), std::ofstream::out);
+    LOG(INFO) << "Using temporary file " << filename_;
+    const int num_frames[] = {3, 6};
+    for (int v = 0; v < 2; ++v) {
+      string video;
+      MakeTempFilename(&video);
+      video += ".avi";
+      cv::VideoWriter writer(video, CV_FOURCC('M', 'J', 'P', 'G'), 25,
+                             cv::Size(size_, size_));
+      CHECK(writer.isOpened()) << "Could not write " << video;
+      for (int f = 0; f < num_frames[v]; ++f) {
+        writer << cv::Mat(size_, size_, CV_8UC3, cv::Scalar::all(Value(v, f)));
+      }
+      videos_.push_back(video);
+      outfile << video << std::endl;
+    }
+    outfile.close();
+  }
+
+  virtual ~VideoDataLayerTest() {
+    std::signal(SIGINT, old_handler_);
+    for (int v = 0; v < videos_.size(); ++v) {
+      std::remove(videos_[v].c_str());
+    }
+    std::remove(filename_.c_str());
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  static int Value(int v, int f) { return 20 + 100 * v + 10 * f; }
+
+  // Runs batches of 4 and compares them with the expected frame values, 0
+  // standing for the zeros after the end of the input. The encoding is
+  // lossy, so the values are only matched approximately.
+  void TestBatches(int decode_threads, int skip_frames,
+                   const int expected[][4], int num_batches) {
+    LayerParameter param;
+    param.mutable_data_param()->set_batch_size(4);
+    VideoDataParameter* video_param = param.mutable_video_data_param();
+    video_param->set_video_type(VideoDataParameter_VideoType_VIDEO);
+    video_param->set_source(filename_.c_str());
+    video_param->set_decode_threads(decode_threads);
+    video_param->set_skip_frames(skip_frames);
+    VideoDataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(4, blob_top_data_->num());
+    EXPECT_EQ(3, blob_top_data_->channels());
+    EXPECT_EQ(size_, blob_top_data_->height());
+    EXPECT_EQ(size_, blob_top_data_->width());
+    const int dim = blob_top_data_->count(1);
+    for (int b = 0; b < num_batches; ++b) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int n = 0; n < 4; ++n) {
+        EXPECT_EQ(0, blob_top_label_->cpu_data()[n]);
+        const Dtype* item = blob_top_data_->cpu_data() + n * dim;
+        for (int i = 0; i < dim; ++i) {
+          if (expected[b][n] == 0) {
+            EXPECT_EQ(0, item[i]) << "batch " << b << " item " << n;
+          } else {
+            EXPECT_NEAR(expected[b][n], item[i], 4)
+                << "batch " << b << " item " << n;
+          }
+        }
+      }
+    }
+  }
+
+  const int size_;
+  string filename_;
+  vector<string> videos_;
+  void (*old_handler_)(int);
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(VideoDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(VideoDataLayerTest, TestReadInOrder) {
+  // One video after the other, the end of the input filled with zeros.
+  const int expected[][4] = {
+      {this->Value(0, 0), this->Value(0, 1), this->Value(0, 2),
+       this->Value(1, 0)},
+      {this->Value(1, 1), this->Value(1, 2), this->Value(1, 3),
+       this->Value(1, 4)},
+      {this->Value(1, 5), 0, 0, 0},
+      {0, 0, 0, 0}};
+  this->TestBatches(1, 0, expected, 4);
+}
+
+TYPED_TEST(VideoDataLayerTest, TestSkipFrames) {
+  // Every other frame, starting with the second of each video.
+  const int expected[][4] = {
+      {this->Value(0, 1), this->Value(1, 1), this->Value(1, 3),
+       this->Value(1, 5)},
+      {0, 0, 0, 0}};
+  this->TestBatches(1, 1, expected, 2);
+}
+
+TYPED_TEST(VideoDataLayerTest, TestDecodeThreads) {
+  // Frames are taken from both videos in turn. The shorter one finishes
+  // first and the rest of the frames come from the longer one alone.
+  const int expected[][4] = {
+      {this->Value(0, 0), this->Value(1, 0), this->Value(0, 1),
+       this->Value(1, 1)},
+      {this->Value(0, 2), this->Value(1, 2), this->Value(1, 3),
+       this->Value(1, 4)},
+      {this->Value(1, 5), 0, 0, 0}};
+  this->TestBatches(2, 0, expected, 3);
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
@@ -0,0 +1,198 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+// Reference convolution, defined in test_convolution_layer.cpp.
+template <typename Dtype>
+void caffe_conv(const Blob<Dtype>* in, ConvolutionParameter* conv_param,
+    const vector<shared_ptr<Blob<Dtype> > >& weights,
+    Blob<Dtype>* out);
+
+template <typename Dtype>
+class WinogradConvolutionLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  WinogradConvolutionLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 4, 7, 6)),
+        blob_bottom_2_(new Blob<Dtype>(2, 4, 13, 11)),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    FillerParameter filler_param;
+    filler_param.set_value(1.);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    filler.Fill(this->blob_bottom_2_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+
+  virtual ~WinogradConvolutionLayerTest() {
+    delete blob_bottom_;
+    delete blob_bottom_2_;
+    delete blob_top_;
+  }
+
+  // Runs the layer on bottom and compares with caffe_conv. Returns the tile
+  // size the layer picked.
+  int CheckForward(const LayerParameter& layer_param, Blob<Dtype>* bottom) {
+    this->blob_bottom_vec_.clear();
+    this->blob_bottom_vec_.push_back(bottom);
+    ConvolutionParameter conv_param = layer_param.convolution_param();
+    WinogradConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> ref_top;
+    ref_top.ReshapeLike(*this->blob_top_);
+    caffe_conv(bottom, &conv_param, layer.blobs(), &ref_top);
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    for (int j = 0; j < ref_top.count(); ++j) {
+      EXPECT_NEAR(top_data[j], ref_top.cpu_data()[j], 1e-3);
+    }
+    return layer.tile_size();
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_bottom_2_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(WinogradConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestSmallOutput) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(5);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  EXPECT_EQ(2, this->CheckForward(layer_param, this->blob_bottom_));
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestLargeOutput) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(20);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  EXPECT_EQ(4, this->CheckForward(layer_param, this->blob_bottom_2_));
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestUnpaddedGroup) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_group(2);
+  convolution_param->set_num_output(6);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->set_bias_term(false);
+  EXPECT_EQ(4, this->CheckForward(layer_param, this->blob_bottom_2_));
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestFallback) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  EXPECT_EQ(0, this->CheckForward(layer_param, this->blob_bottom_2_));
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestWeightUpdate) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  WinogradConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The cached filter transform follows changes of the weights.
+  caffe_scal(layer.blobs()[0]->count(), Dtype(2),
+      layer.blobs()[0]->mutable_cpu_data());
+  Blob<Dtype> first_top;
+  first_top.CopyFrom(*this->blob_top_, false, true);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < first_top.count(); ++i) {
+    EXPECT_NEAR(2 * first_top.cpu_data()[i], this->blob_top_->cpu_data()[i],
+        1e-3);
+  }
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestGradient) {
+  typedef TypeParam Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  this->blob_bottom_vec_.push_back(this->blob_bottom_);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+}  // namespace caffe
@@ -757,6 +757,148 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
   return;
 }
 
+void MatchBBox(const float* gt_bboxes, const float* gt_sizes,
+    const int num_gt, const float* pred_bboxes, const float* pred_sizes,
+    const int num_pred, const MatchType match_type,
+    const float overlap_threshold, const bool ignore_cross_boundary_bbox,
+    vector<float>* overlaps, int* match_indices, float* match_overlaps) {
+  std::fill(match_indices, match_indices + num_pred, -1);
+  std::fill(match_overlaps, match_overlaps + num_pred, 0.f);
+  if (num_gt == 0) {
+    return;
+  }
+  const float* pred_xmin = pred_bboxes;
+  const float* pred_ymin = pred_bboxes + num_pred;
+  const float* pred_xmax = pred_bboxes + 2 * num_pred;
+  const float* pred_ymax = pred_bboxes + 3 * num_pred;
+  if (ignore_cross_boundary_bbox) {
+    for (int i = 0; i < num_pred; ++i) {
+      if (pred_xmin[i] < 0 || pred_xmin[i] > 1 ||
+          pred_ymin[i] < 0 || pred_ymin[i] > 1 ||
+          pred_xmax[i] < 0 || pred_xmax[i] > 1 ||
+          pred_ymax[i] < 0 || pred_ymax[i] > 1) {
+        match_indices[i] = -2;
+      }
+    }
+  }
+
+  // One row of overlaps per ground truth, so that the loops over the
+  // predictions vectorize. Same arithmetic as JaccardOverlap.
+  overlaps->resize(num_gt * num_pred);
+  for (int j = 0; j < num_gt; ++j) {
+    const float* gt = gt_bboxes + j * 4;
+    const float gt_size = gt_sizes[j];
+    float* overlap = &(*overlaps)[j * num_pred];
+    for (int i = 0; i < num_pred; ++i) {
+      const float width =
+          std::min(pred_xmax[i], gt[2]) - std::max(pred_xmin[i], gt[0]);
+      const float height =
+          std::min(pred_ymax[i], gt[3]) - std::max(pred_ymin[i], gt[1]);
+      const float intersect_size = width * height;
+      overlap[i] = (width > 0 && height > 0) ?
+          intersect_size / (pred_sizes[i] + gt_size - intersect_size) : 0.f;
+    }
+    // Only overlaps above 1e-6 count as overlapping.
+    for (int i = 0; i < num_pred; ++i) {
+      const float positive_overlap = overlap[i] > 1e-6 ? overlap[i] : 0.f;
+      match_overlaps[i] = std::max(match_overlaps[i], positive_overlap);
+    }
+  }
+  for (int i = 0; i < num_pred; ++i) {
+    if (match_indices[i] == -2) {
+      match_overlaps[i] = 0.f;
+    }
+  }
+
+  // Bipartite matching: repeatedly match the most overlapped pair of an
+  // unmatched prediction and a ground truth, preferring the lower
+  // prediction and then ground truth index on ties. best_pred[j] caches the
+  // best unmatched prediction of ground truth j.
+  vector<int> best_pred(num_gt);
+  vector<float> best_overlap(num_gt);
+  vector<bool> gt_matched(num_gt, false);
+  for (int j = 0; j < num_gt; ++j) {
+    const float* overlap = &(*overlaps)[j * num_pred];
+    best_pred[j] = -1;
+    best_overlap[j] = -1;
+    for (int i = 0; i < num_pred; ++i) {
+      if (match_indices[i] == -1 && overlap[i] > 1e-6 &&
+          overlap[i] > best_overlap[j]) {
+        best_pred[j] = i;
+        best_overlap[j] = overlap[i];
+      }
+    }
+  }
+  for (int n = 0; n < num_gt; ++n) {
+    int max_gt_idx = -1;
+    for (int j = 0; j < num_gt; ++j) {
+      if (gt_matched[j] || best_pred[j] == -1) {
+        continue;
+      }
+      if (max_gt_idx == -1 || best_overlap[j] > best_overlap[max_gt_idx] ||
+          (best_overlap[j] == best_overlap[max_gt_idx] &&
+           best_pred[j] < best_pred[max_gt_idx])) {
+        max_gt_idx = j;
+      }
+    }
+    if (max_gt_idx == -1) {
+      // Cannot find good match.
+      break;
+    }
+    const int max_idx = best_pred[max_gt_idx];
+    match_indices[max_idx] = max_gt_idx;
+    match_overlaps[max_idx] = best_overlap[max_gt_idx];
+    gt_matched[max_gt_idx] = true;
+    // Ground truth which preferred the matched prediction look again.
+    for (int j = 0; j < num_gt; ++j) {
+      if (gt_matched[j] || best_pred[j] != max_idx) {
+        continue;
+      }
+      const float* overlap = &(*overlaps)[j * num_pred];
+      best_pred[j] = -1;
+      best_overlap[j] = -1;
+      for (int i = 0; i < num_pred; ++i) {
+        if (match_indices[i] == -1 && overlap[i] > 1e-6 &&
+            overlap[i] > best_overlap[j]) {
+          best_pred[j] = i;
+          best_overlap[j] = overlap[i];
+        }
+      }
+    }
+  }
+
+  switch (match_type) {
+    case MultiBoxLossParameter_MatchType_BIPARTITE:
+      // Already done.
+      break;
+    case MultiBoxLossParameter_MatchType_PER_PREDICTION: {
+      // Get most overlaped ground truth for the rest prediction bboxes.
+      vector<int> max_gt_idx(num_pred, -1);
+      vector<float> max_overlap(num_pred, -1);
+      for (int j = 0; j < num_gt; ++j) {
+        const float* overlap = &(*overlaps)[j * num_pred];
+        for (int i = 0; i < num_pred; ++i) {
+          if (overlap[i] > 1e-6 && overlap[i] >= overlap_threshold &&
+              overlap[i] > max_overlap[i]) {
+            max_gt_idx[i] = j;
+            max_overlap[i] = overlap[i];
+          }
+        }
+      }
+      for (int i = 0; i < num_pred; ++i) {
+        if (match_indices[i] == -1 && max_gt_idx[i] != -1) {
+          match_indices[i] = max_gt_idx[i];
+          match_overlaps[i] = max_overlap[i];
+        }
+      }
+      break;
+    }
+    default:
+      LOG(FATAL) << "Unknown matching type.";
+      break;
+  }
+}
+
 void FindMatches(const vector<LabelBBox>& all_loc_preds,
       const map<int, vector<NormalizedBBox> >& all_gt_bboxes,
       const vector<NormalizedBBox>& prior_bboxes,
@@ -1726,6 +1868,52 @@ template void GetPriorBBoxes(const double* prior_data, const int num_priors,
       vector<NormalizedBBox>* prior_bboxes,
       vector<vector<float> >* prior_variances);
 
+template <typename Dtype>
+bool PriorsChanged(const Dtype* prior_data, const int num_priors,
+      vector<Dtype>* last_prior_data) {
+  const int count = num_priors * 8;
+  if (last_prior_data->size() == count &&
+      std::equal(prior_data, prior_data + count, last_prior_data->begin())) {
+    return false;
+  }
+  last_prior_data->assign(prior_data, prior_data + count);
+  return true;
+}
+
+// Explicit initialization.
+template bool PriorsChanged(const float* prior_data, const int num_priors,
+      vector<float>* last_prior_data);
+template bool PriorsChanged(const double* prior_data, const int num_priors,
+      vector<double>* last_prior_data);
+
+template <typename Dtype>
+void SortROIsByArea(const Dtype* rois, const int num_rois,
+      const int num_spatial_axes, vector<int>* order) {
+  const int roi_size = 1 + 2 * num_spatial_axes;
+  vector<pair<float, int> > area_index(num_rois);
+  for (int n = 0; n < num_rois; ++n) {
+    const Dtype* roi = rois + n * roi_size;
+    float area = 1.;
+    for (int i = 0; i < num_spatial_axes; ++i) {
+      area *= std::max<float>(roi[1 + num_spatial_axes + i] - roi[1 + i] + 1,
+                              1.);
+    }
+    area_index[n] = std::make_pair(area, n);
+  }
+  std::stable_sort(area_index.begin(), area_index.end(),
+                   SortScorePairDescend<int>);
+  order->resize(num_rois);
+  for (int n = 0; n < num_rois; ++n) {
+    (*order)[n] = area_index[n].second;
+  }
+}
+
+// Explicit initialization.
+template void SortROIsByArea(const float* rois, const int num_rois,
+      const int num_spatial_axes, vector<int>* order);
+template void SortROIsByArea(const double* rois, const int num_rois,
+      const int num_spatial_axes, vector<int>* order);
+
 template <typename Dtype>
 void GetDetectionResults(const Dtype* det_data, const int num_det,
       const int background_label_id,
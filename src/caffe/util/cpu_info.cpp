@@ -373,11 +373,13 @@ bool OpenMpManager::isMajorThread(boost::thread::id currentThread) {
 
 // Ideally bind given thread to secondary logical core, if
 // only one thread exists then bind to primary one
-void OpenMpManager::bindCurrentThreadToNonPrimaryCoreIfPossible() {
+void OpenMpManager::bindCurrentThreadToNonPrimaryCoreIfPossible(
+    unsigned threadIndex) {
   OpenMpManager &openMpManager = getInstance();
   if (openMpManager.isThreadsBindAllowed()) {
     int totalNumberOfAvailableCores = CPU_COUNT(&openMpManager.currentCoreSet);
-    int logicalCoreToBindTo = totalNumberOfAvailableCores > 1 ? 1 : 0;
+    int logicalCoreToBindTo = totalNumberOfAvailableCores > 1 ?
+      1 + threadIndex % (totalNumberOfAvailableCores - 1) : 0;
     openMpManager.bindCurrentThreadToLogicalCoreCpus(logicalCoreToBindTo);
   }
 }
@@ -0,0 +1,396 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+#ifdef USE_MKL
+#include <mkl_service.h>
+#endif
+
+#include "boost/thread/mutex.hpp"
+#include "caffe/util/host_allocator.hpp"
+
+namespace caffe {
+namespace host_allocator {
+
+namespace {
+
+// Every block starts with a header that records its size class. It is as
+// large as the alignment guaranteed by mkl_malloc, so user pointers keep it.
+struct BlockHeader {
+  size_t requested;
+  int size_class;
+};
+const size_t kHeaderBytes = 64;
+
+// Class 0 holds blocks of up to 64 bytes. Above that, every power of two
+// interval (2^k, 2^(k+1)] is split into four classes. Blocks of more than
+// 2^kMaxShift bytes are not cached.
+const int kMinShift = 6;
+const int kMaxShift = 36;
+const int kNumClasses = 1 + (kMaxShift - kMinShift) * 4;
+
+// The per-thread cache only takes small blocks, which are the ones churned
+// by layers and data transformations, and stays within a few megabytes.
+const size_t kThreadCacheMaxBlock = 256 << 10;
+const size_t kThreadCacheBytes = 4 << 20;
+
+int FloorLog2(size_t value) {
+  int shift = 0;
+  while (value >>= 1) {
+    ++shift;
+  }
+  return shift;
+}
+
+int SizeClass(size_t size) {
+  if (size <= (size_t(1) << kMinShift)) {
+    return 0;
+  }
+  const int shift = FloorLog2(size - 1);
+  if (shift >= kMaxShift) {
+    return -1;
+  }
+  const size_t step_shift = shift - 2;
+  const size_t sub = (size - (size_t(1) << shift) + (size_t(1) << step_shift)
+      - 1) >> step_shift;
+  return 1 + (shift - kMinShift) * 4 + static_cast<int>(sub) - 1;
+}
+
+size_t ClassSize(int size_class) {
+  if (size_class == 0) {
+    return size_t(1) << kMinShift;
+  }
+  const int shift = kMinShift + (size_class - 1) / 4;
+  const size_t sub = (size_class - 1) % 4 + 1;
+  return (size_t(1) << shift) + (sub << (shift - 2));
+}
+
+void* SystemAllocate(size_t bytes) {
+#ifdef USE_MKL
+  return mkl_malloc(bytes, 64);
+#else
+  return malloc(bytes);
+#endif
+}
+
+void SystemFree(void* block) {
+#ifdef USE_MKL
+  mkl_free(block);
+#else
+  free(block);
+#endif
+}
+
+std::atomic<size_t> live_bytes(0);
+std::atomic<size_t> peak_bytes(0);
+std::atomic<size_t> cached_bytes(0);
+std::atomic<uint64_t> hits(0);
+std::atomic<uint64_t> misses(0);
+std::atomic<size_t> cache_limit(size_t(1) << 30);
+
+class SharedCache {
+ public:
+  // Never destroyed, so that blobs released during static destruction can
+  // still return their memory.
+  static SharedCache& Get() {
+    static SharedCache* cache = new SharedCache();
+    return *cache;
+  }
+
+  void* Pop(int size_class) {
+    boost::mutex::scoped_lock lock(mutex_);
+    std::vector<void*>& blocks = blocks_[size_class];
+    if (blocks.empty()) {
+      return NULL;
+    }
+    void* block = blocks.back();
+    blocks.pop_back();
+    bytes_ -= ClassSize(size_class);
+    cached_bytes -= ClassSize(size_class);
+    return block;
+  }
+
+  // Returns false when the block would take the cache over its limit.
+  bool Push(void* block, int size_class) {
+    const size_t size = ClassSize(size_class);
+    boost::mutex::scoped_lock lock(mutex_);
+    if (bytes_ + size > cache_limit.load()) {
+      return false;
+    }
+    blocks_[size_class].push_back(block);
+    bytes_ += size;
+    cached_bytes += size;
+    return true;
+  }
+
+  // Releases blocks to the system, largest first, until at most limit bytes
+  // are cached.
+  void Trim(size_t limit) {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (int c = kNumClasses - 1; c >= 0 && bytes_ > limit; --c) {
+      std::vector<void*>& blocks = blocks_[c];
+      while (!blocks.empty() && bytes_ > limit) {
+        SystemFree(blocks.back());
+        blocks.pop_back();
+        bytes_ -= ClassSize(c);
+        cached_bytes -= ClassSize(c);
+      }
+    }
+  }
+
+ private:
+  SharedCache() : bytes_(0) {}
+
+  boost::mutex mutex_;
+  std::vector<void*> blocks_[kNumClasses];
+  size_t bytes_;
+};
+
+class ThreadCache;
+
+// Every live thread cache, so that ReleaseCached can drain the caches of
+// other threads too. Never destroyed, like the shared cache.
+class ThreadCacheRegistry {
+ public:
+  static ThreadCacheRegistry& Get() {
+    static ThreadCacheRegistry* registry = new ThreadCacheRegistry();
+    return *registry;
+  }
+
+  void Add(ThreadCache* cache) {
+    boost::mutex::scoped_lock lock(mutex_);
+    caches_.push_back(cache);
+  }
+
+  void Remove(ThreadCache* cache) {
+    boost::mutex::scoped_lock lock(mutex_);
+    caches_.erase(std::remove(caches_.begin(), caches_.end(), cache),
+        caches_.end());
+  }
+
+  // Releases the blocks of every thread cache to the system.
+  void FlushAll();
+
+ private:
+  boost::mutex mutex_;
+  std::vector<ThreadCache*> caches_;
+};
+
+// The cache is only used by its thread, except when another thread drains it
+// through the registry, so its mutex is practically never contended.
+class ThreadCache {
+ public:
+  ThreadCache() : bytes_(0) {
+    ThreadCacheRegistry::Get().Add(this);
+  }
+  ~ThreadCache();
+
+  void* Pop(int size_class) {
+    boost::mutex::scoped_lock lock(mutex_);
+    return PopLocked(size_class);
+  }
+
+  bool Push(void* block, int size_class) {
+    const size_t size = ClassSize(size_class);
+    if (size > kThreadCacheMaxBlock) {
+      return false;
+    }
+    boost::mutex::scoped_lock lock(mutex_);
+    if (bytes_ + size > kThreadCacheBytes) {
+      return false;
+    }
+    blocks_[size_class].push_back(block);
+    bytes_ += size;
+    cached_bytes += size;
+    return true;
+  }
+
+  // Hands the blocks over to the shared cache, or to the system with
+  // to_system set.
+  void Flush(bool to_system) {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (int c = 0; c < kNumClasses && bytes_ > 0; ++c) {
+      while (void* block = PopLocked(c)) {
+        if (to_system || !SharedCache::Get().Push(block, c)) {
+          SystemFree(block);
+        }
+      }
+    }
+  }
+
+ private:
+  void* PopLocked(int size_class) {
+    std::vector<void*>& blocks = blocks_[size_class];
+    if (blocks.empty()) {
+      return NULL;
+    }
+    void* block = blocks.back();
+    blocks.pop_back();
+    bytes_ -= ClassSize(size_class);
+    cached_bytes -= ClassSize(size_class);
+    return block;
+  }
+
+  boost::mutex mutex_;
+  std::vector<void*> blocks_[kNumClasses];
+  size_t bytes_;
+};
+
+void ThreadCacheRegistry::FlushAll() {
+  boost::mutex::scoped_lock lock(mutex_);
+  for (size_t i = 0; i < caches_.size(); ++i) {
+    caches_[i]->Flush(true);
+  }
+}
+
+// The state is trivially destructible, so that blocks freed by thread_local
+// or static objects destroyed after the cache bypass it.
+enum ThreadCacheState { kThreadCacheNew, kThreadCacheAlive, kThreadCacheGone };
+thread_local ThreadCacheState thread_cache_state = kThreadCacheNew;
+
+ThreadCache::~ThreadCache() {
+  // Unregister first: a concurrent FlushAll holds the registry lock while it
+  // drains this cache, so the cache outlives it.
+  ThreadCacheRegistry::Get().Remove(this);
+  Flush(false);
+  thread_cache_state = kThreadCacheGone;
+}
+
+ThreadCache* LocalCache() {
+  if (thread_cache_state == kThreadCacheGone) {
+    return NULL;
+  }
+  thread_local ThreadCache cache;
+  thread_cache_state = kThreadCacheAlive;
+  return &cache;
+}
+
+void* HandOut(void* block, size_t size, int size_class) {
+  BlockHeader* header = static_cast<BlockHeader*>(block);
+  header->requested = size;
+  header->size_class = size_class;
+  const size_t live = live_bytes += size;
+  size_t peak = peak_bytes.load();
+  while (live > peak && !peak_bytes.compare_exchange_weak(peak, live)) {}
+  return static_cast<char*>(block) + kHeaderBytes;
+}
+
+}  // namespace
+
+void* Allocate(size_t size) {
+  const int size_class = SizeClass(size);
+  if (size_class >= 0 && cache_limit.load() > 0) {
+    void* block = NULL;
+    ThreadCache* local = LocalCache();
+    if (local) {
+      block = local->Pop(size_class);
+    }
+    if (!block) {
+      block = SharedCache::Get().Pop(size_class);
+    }
+    if (block) {
+      ++hits;
+      return HandOut(block, size, size_class);
+    }
+  }
+  ++misses;
+  const size_t bytes =
+      (size_class >= 0 ? ClassSize(size_class) : size) + kHeaderBytes;
+  void* block = SystemAllocate(bytes);
+  if (!block && cached_bytes.load() > 0) {
+    // Memory parked in the caches may be what the system is missing.
+    ReleaseCached();
+    block = SystemAllocate(bytes);
+  }
+  return block ? HandOut(block, size, size_class) : NULL;
+}
+
+void Free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  void* block = static_cast<char*>(ptr) - kHeaderBytes;
+  const BlockHeader* header = static_cast<const BlockHeader*>(block);
+  const int size_class = header->size_class;
+  live_bytes -= header->requested;
+  if (size_class >= 0 && cache_limit.load() > 0) {
+    ThreadCache* local = LocalCache();
+    if ((local && local->Push(block, size_class)) ||
+        SharedCache::Get().Push(block, size_class)) {
+      return;
+    }
+  }
+  SystemFree(block);
+}
+
+Stats GetStats() {
+  Stats stats;
+  stats.live_bytes = live_bytes.load();
+  stats.peak_bytes = peak_bytes.load();
+  stats.cached_bytes = cached_bytes.load();
+  stats.hits = hits.load();
+  stats.misses = misses.load();
+  return stats;
+}
+
+void ResetPeak() {
+  peak_bytes = live_bytes.load();
+}
+
+void SetCacheLimit(size_t bytes) {
+  cache_limit = bytes;
+  SharedCache::Get().Trim(bytes);
+  if (bytes == 0) {
+    ThreadCacheRegistry::Get().FlushAll();
+  }
+}
+
+size_t CacheLimit() {
+  return cache_limit.load();
+}
+
+void ReleaseCached() {
+  ThreadCacheRegistry::Get().FlushAll();
+  SharedCache::Get().Trim(0);
+}
+
+}  // namespace host_allocator
+}  // namespace caffe
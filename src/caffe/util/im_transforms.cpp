@@ -765,6 +765,222 @@ cv::Mat ApplyDistort(const cv::Mat& in_img, const DistortionParameter& param) {
 
   return out_img;
 }
+
+namespace {
+
+// Fixed-point tables of OpenCV's 8-bit BGR2HSV conversion, so that the fused
+// kernel below reproduces cv::cvtColor instead of approximating it.
+const int kHsvShift = 12;
+
+struct HsvTables {
+  int sdiv[256];
+  int hdiv[256];
+  HsvTables() {
+    sdiv[0] = hdiv[0] = 0;
+    for (int i = 1; i < 256; ++i) {
+      sdiv[i] = cv::saturate_cast<int>((255 << kHsvShift) / (1. * i));
+      hdiv[i] = cv::saturate_cast<int>((180 << kHsvShift) / (6. * i));
+    }
+  }
+};
+
+const HsvTables& hsv_tables() {
+  static const HsvTables tables;
+  return tables;
+}
+
+inline void BGR2HSV(const int b, const int g, const int r,
+                    const HsvTables& tab, int* h, int* s, int* v) {
+  const int vmax = std::max(b, std::max(g, r));
+  const int vmin = std::min(b, std::min(g, r));
+  const int diff = vmax - vmin;
+  const int vr = vmax == r ? -1 : 0;
+  const int vg = vmax == g ? -1 : 0;
+  const int half = 1 << (kHsvShift - 1);
+  int hue = (vr & (g - b)) +
+      (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+  hue = (hue * tab.hdiv[diff] + half) >> kHsvShift;
+  hue += hue < 0 ? 180 : 0;
+  *h = hue;
+  *s = (diff * tab.sdiv[vmax] + half) >> kHsvShift;
+  *v = vmax;
+}
+
+inline void HSV2BGR(const int h, const int s, const int v,
+                    uchar* b, uchar* g, uchar* r) {
+  static const int sector_data[6][3] = {
+    {1, 3, 0}, {1, 0, 2}, {3, 0, 1}, {0, 2, 1}, {0, 1, 3}, {2, 1, 0}};
+  const float fs = s * (1.f / 255.f);
+  const float fv = v * (1.f / 255.f);
+  if (s == 0) {
+    *b = *g = *r = cv::saturate_cast<uchar>(fv * 255.f);
+    return;
+  }
+  float fh = h * (6.f / 180.f);
+  while (fh >= 6.f) {
+    fh -= 6.f;
+  }
+  int sector = cvFloor(fh);
+  fh -= sector;
+  if (static_cast<unsigned>(sector) >= 6u) {
+    sector = 0;
+    fh = 0.f;
+  }
+  float tab[4];
+  tab[0] = fv;
+  tab[1] = fv * (1.f - fs);
+  tab[2] = fv * (1.f - fs * fh);
+  tab[3] = fv * (1.f - fs * (1.f - fh));
+  *b = cv::saturate_cast<uchar>(tab[sector_data[sector][0]] * 255.f);
+  *g = cv::saturate_cast<uchar>(tab[sector_data[sector][1]] * 255.f);
+  *r = cv::saturate_cast<uchar>(tab[sector_data[sector][2]] * 255.f);
+}
+
+// Draws one distortion exactly as the Random* functions above do, so that the
+// fused and the unfused path consume the same random sequence.
+bool DrawDistortion(const float distort_prob, const float lower,
+                    const float upper, float* delta) {
+  float prob;
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  if (prob < distort_prob) {
+    caffe_rng_uniform(1, lower, upper, delta);
+    return true;
+  }
+  return false;
+}
+
+// Photometric distortion of one BGR row: a lookup table before the HSV
+// stage, the HSV saturation and hue adjustments, a lookup table after them
+// and the channel shuffle. Saturation and hue each take their own round trip
+// through HSV, as AdjustSaturation and AdjustHue do.
+template <bool kHsv>
+void DistortRow(uchar* row, const int cols, const uchar* pre_lut,
+                const bool do_saturation, const float saturation,
+                const bool do_hue, const float hue,
+                const uchar* post_lut, const int* order) {
+  const HsvTables& tab = hsv_tables();
+  for (int x = 0; x < cols; ++x) {
+    uchar* pixel = row + 3 * x;
+    uchar bgr[3] = {pre_lut[pixel[0]], pre_lut[pixel[1]], pre_lut[pixel[2]]};
+    if (kHsv) {
+      int h, s, v;
+      if (do_saturation) {
+        BGR2HSV(bgr[0], bgr[1], bgr[2], tab, &h, &s, &v);
+        s = cv::saturate_cast<uchar>(s * saturation);
+        HSV2BGR(h, s, v, &bgr[0], &bgr[1], &bgr[2]);
+      }
+      if (do_hue) {
+        BGR2HSV(bgr[0], bgr[1], bgr[2], tab, &h, &s, &v);
+        h = cv::saturate_cast<uchar>(h + hue);
+        HSV2BGR(h, s, v, &bgr[0], &bgr[1], &bgr[2]);
+      }
+    }
+    pixel[0] = post_lut[bgr[order[0]]];
+    pixel[1] = post_lut[bgr[order[1]]];
+    pixel[2] = post_lut[bgr[order[2]]];
+  }
+}
+
+}  // namespace
+
+void ApplyDistortInPlace(const DistortionParameter& param, cv::Mat* img) {
+  CHECK(img);
+  if (img->type() != CV_8UC3) {
+    *img = ApplyDistort(*img, param);
+    return;
+  }
+  float prob;
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  const bool contrast_first = prob > 0.5;
+
+  float brightness = 0.f;
+  bool do_brightness = false;
+  if (param.brightness_prob() > 0) {
+    CHECK_GE(param.brightness_delta(), 0)
+        << "brightness_delta must be non-negative.";
+  }
+  do_brightness = DrawDistortion(param.brightness_prob(),
+      -param.brightness_delta(), param.brightness_delta(), &brightness) &&
+      fabs(brightness) > 0;
+
+  float contrast = 1.f, saturation = 1.f, hue = 0.f;
+  bool do_contrast = false, do_saturation = false, do_hue = false;
+  if (param.contrast_prob() > 0) {
+    CHECK_GE(param.contrast_upper(), param.contrast_lower())
+        << "contrast upper must be >= lower.";
+    CHECK_GE(param.contrast_lower(), 0)
+        << "contrast lower must be non-negative.";
+  }
+  if (param.saturation_prob() > 0) {
+    CHECK_GE(param.saturation_upper(), param.saturation_lower())
+        << "saturation upper must be >= lower.";
+    CHECK_GE(param.saturation_lower(), 0)
+        << "saturation lower must be non-negative.";
+  }
+  if (param.hue_prob() > 0) {
+    CHECK_GE(param.hue_delta(), 0) << "hue_delta must be non-negative.";
+  }
+  if (contrast_first) {
+    do_contrast = DrawDistortion(param.contrast_prob(),
+        param.contrast_lower(), param.contrast_upper(), &contrast);
+  }
+  do_saturation = DrawDistortion(param.saturation_prob(),
+      param.saturation_lower(), param.saturation_upper(), &saturation);
+  do_hue = DrawDistortion(param.hue_prob(),
+      -param.hue_delta(), param.hue_delta(), &hue) && fabs(hue) > 0;
+  if (!contrast_first) {
+    do_contrast = DrawDistortion(param.contrast_prob(),
+        param.contrast_lower(), param.contrast_upper(), &contrast);
+  }
+  do_contrast = do_contrast && fabs(contrast - 1.f) > 1e-3;
+
+  int order[3] = {0, 1, 2};
+  caffe_rng_uniform(1, 0.f, 1.f, &prob);
+  const bool do_order = prob < param.random_order_prob();
+  if (do_order) {
+    std::random_shuffle(order, order + 3);
+  }
+
+  // Brightness and contrast are per-value mappings with saturation after each
+  // step, so chains of them collapse into a 256-entry table.
+  uchar pre_lut[256], post_lut[256];
+  for (int i = 0; i < 256; ++i) {
+    uchar value = static_cast<uchar>(i);
+    if (do_brightness) {
+      value = cv::saturate_cast<uchar>(value * 1.f + brightness);
+    }
+    if (do_contrast && contrast_first) {
+      value = cv::saturate_cast<uchar>(value * contrast + 0.f);
+    }
+    pre_lut[i] = value;
+    post_lut[i] = (do_contrast && !contrast_first) ?
+        cv::saturate_cast<uchar>(i * contrast + 0.f) : static_cast<uchar>(i);
+  }
+  const bool do_hsv = do_saturation || do_hue;
+  if (!do_hsv) {
+    // Without the HSV stage both tables compose into one.
+    for (int i = 0; i < 256; ++i) {
+      pre_lut[i] = post_lut[pre_lut[i]];
+      post_lut[i] = static_cast<uchar>(i);
+    }
+    if (!do_brightness && !do_contrast && !do_order) {
+      return;
+    }
+  }
+
+  const int rows = img->isContinuous() ? 1 : img->rows;
+  const int cols = img->isContinuous() ? img->rows * img->cols : img->cols;
+  for (int y = 0; y < rows; ++y) {
+    uchar* row = img->ptr<uchar>(y);
+    if (do_hsv) {
+      DistortRow<true>(row, cols, pre_lut, do_saturation, saturation,
+                       do_hue, hue, post_lut, order);
+    } else {
+      DistortRow<false>(row, cols, pre_lut, false, 1.f, false, 0.f,
+                        post_lut, order);
+    }
+  }
+}
 #endif  // USE_OPENCV
 
 }  // namespace caffe
@@ -134,6 +134,97 @@ cv::Mat ReadImageToCVMat(const string& filename,
   return cv_img;
 }
 
+// Seeks from segment to segment up to the frame header: EXIF thumbnails and
+// ICC profiles can put it far into the file.
+bool ReadJPEGSize(const string& filename, int* height, int* width) {
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  unsigned char buf[9];
+  char* const bytes = reinterpret_cast<char*>(buf);
+  if (!file.read(bytes, 2) || buf[0] != 0xFF || buf[1] != 0xD8) {
+    return false;
+  }
+  while (file.read(bytes, 2)) {
+    if (buf[0] != 0xFF) {
+      return false;
+    }
+    while (buf[1] == 0xFF) {  // Fill bytes
+      if (!file.read(bytes + 1, 1)) {
+        return false;
+      }
+    }
+    const unsigned char marker = buf[1];
+    if (marker == 0xDA || marker == 0xD9) {  // Start of scan, end of image
+      return false;
+    }
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+      continue;  // TEM and RSTn stand alone, without a length
+    }
+    if (!file.read(bytes + 2, 2)) {
+      return false;
+    }
+    const int length = (buf[2] << 8) | buf[3];
+    if (length < 2) {
+      return false;
+    }
+    // Start of frame markers, except DHT, JPG and DAC.
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+        marker != 0xC8 && marker != 0xCC) {
+      if (!file.read(bytes + 4, 5)) {
+        return false;
+      }
+      *height = (buf[5] << 8) | buf[6];
+      *width = (buf[7] << 8) | buf[8];
+      return *height > 0 && *width > 0;
+    }
+    file.seekg(length - 2, std::ios::cur);
+  }
+  return false;
+}
+
+cv::Mat ReadImageToCVMat(const string& filename,
+    const int height, const int width, const bool is_color,
+    const bool reduced_decode) {
+  // IMREAD_REDUCED_* came with OpenCV 3.2; 2.4 defines CV_VERSION_EPOCH.
+#if !defined(CV_VERSION_EPOCH) && (CV_VERSION_MAJOR > 3 || \
+    (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2))
+  int jpeg_height, jpeg_width;
+  if (reduced_decode && height > 0 && width > 0 &&
+      ReadJPEGSize(filename, &jpeg_height, &jpeg_width)) {
+    int scale = 1;
+    while (scale < 8 && jpeg_height / (2 * scale) >= height &&
+           jpeg_width / (2 * scale) >= width) {
+      scale *= 2;
+    }
+    int cv_read_flag = -1;
+    switch (scale) {
+    case 2:
+      cv_read_flag = is_color ? cv::IMREAD_REDUCED_COLOR_2
+          : cv::IMREAD_REDUCED_GRAYSCALE_2;
+      break;
+    case 4:
+      cv_read_flag = is_color ? cv::IMREAD_REDUCED_COLOR_4
+          : cv::IMREAD_REDUCED_GRAYSCALE_4;
+      break;
+    case 8:
+      cv_read_flag = is_color ? cv::IMREAD_REDUCED_COLOR_8
+          : cv::IMREAD_REDUCED_GRAYSCALE_8;
+      break;
+    }
+    if (cv_read_flag != -1) {
+      cv::Mat cv_img_origin = cv::imread(filename, cv_read_flag);
+      // An EXIF rotation may leave the image too small one way, in which
+      // case it is decoded again at full size.
+      if (cv_img_origin.rows >= height && cv_img_origin.cols >= width) {
+        cv::Mat cv_img;
+        cv::resize(cv_img_origin, cv_img, cv::Size(width, height));
+        return cv_img;
+      }
+    }
+  }
+#endif
+  return ReadImageToCVMat(filename, height, width, is_color);
+}
+
 cv::Mat ReadImageToCVMat(const string& filename,
     const int height, const int width) {
   return ReadImageToCVMat(filename, height, width, true);
@@ -298,6 +389,16 @@ bool ReadFileToDatum(const string& filename, const int label,
   }
 }
 
+void ReadFileAhead(const string& filename) {
+#ifdef POSIX_FADV_WILLNEED
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd != -1) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+  }
+#endif
+}
+
 // Parse VOC/ILSVRC detection annotation.
 bool ReadXMLToAnnotatedDatum(const string& labelfile, const int img_height,
     const int img_width, const std::map<string, int>& name_to_label,
@@ -696,8 +797,9 @@ cv::Mat DecodeDatumToCVMatNative(const Datum& datum) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
-  cv_img = cv::imdecode(vec_data, -1);
+  // Decode straight from the datum's buffer instead of copying it first.
+  cv::Mat buf(1, data.size(), CV_8UC1, const_cast<char*>(data.data()));
+  cv_img = cv::imdecode(buf, -1);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
@@ -707,10 +809,10 @@ cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color) {
   cv::Mat cv_img;
   CHECK(datum.encoded()) << "Datum not encoded";
   const string& data = datum.data();
-  std::vector<char> vec_data(data.c_str(), data.c_str() + data.size());
+  cv::Mat buf(1, data.size(), CV_8UC1, const_cast<char*>(data.data()));
   int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
     CV_LOAD_IMAGE_GRAYSCALE);
-  cv_img = cv::imdecode(vec_data, cv_read_flag);
+  cv_img = cv::imdecode(buf, cv_read_flag);
   if (!cv_img.data) {
     LOG(ERROR) << "Could not decode datum ";
   }
@@ -742,8 +844,8 @@ void EncodeCVMatToDatum(const cv::Mat& cv_img, const string& encoding,
                         Datum* datum) {
   std::vector<uchar> buf;
   cv::imencode("."+encoding, cv_img, buf);
-  datum->set_data(std::string(reinterpret_cast<char*>(&buf[0]),
-                              buf.size()));
+  // Assigning in place reuses the capacity of a recycled datum.
+  datum->set_data(reinterpret_cast<char*>(&buf[0]), buf.size());
   datum->set_channels(cv_img.channels());
   datum->set_height(cv_img.rows);
   datum->set_width(cv_img.cols);
@@ -0,0 +1,206 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "caffe/common.hpp"
+#include "caffe/util/numa.hpp"
+
+namespace caffe {
+namespace numa {
+
+namespace {
+
+struct Topology {
+  int num_nodes;
+  uint64_t online_mask;
+
+  Topology() : num_nodes(1), online_mask(1) {
+    // The file holds a node list such as "0-1" or "0,2-3".
+    FILE* file = fopen("/sys/devices/system/node/online", "r");
+    if (!file) {
+      return;
+    }
+    char line[256];
+    uint64_t mask = 0;
+    if (fgets(line, sizeof(line), file)) {
+      char* token = strtok(line, ",\n");
+      while (token) {
+        int first, last;
+        const int parsed = sscanf(token, "%d-%d", &first, &last);
+        if (parsed == 1) {
+          last = first;
+        }
+        for (int node = first; parsed >= 1 && node <= last && node < 64;
+             ++node) {
+          mask |= uint64_t(1) << node;
+        }
+        token = strtok(NULL, ",\n");
+      }
+    }
+    fclose(file);
+    if (mask) {
+      online_mask = mask;
+      num_nodes = __builtin_popcountll(mask);
+    }
+  }
+};
+
+const Topology& topology() {
+  static const Topology topology;
+  return topology;
+}
+
+void SetPolicy(void* ptr, size_t size, const Placement& placement,
+               bool move) {
+#if defined(__linux__) && defined(__NR_mbind)
+  if (topology().num_nodes < 2) {
+    return;
+  }
+  int mode;
+  switch (placement.policy) {
+  case NumaParameter_Policy_LOCAL:
+    mode = MPOL_LOCAL;
+    break;
+  case NumaParameter_Policy_INTERLEAVE:
+    mode = MPOL_INTERLEAVE;
+    break;
+  case NumaParameter_Policy_BIND:
+    mode = MPOL_BIND;
+    break;
+  default:
+    return;
+  }
+  // mbind works on whole pages.
+  const size_t page = PageSize();
+  const uintptr_t begin =
+      (reinterpret_cast<uintptr_t>(ptr) + page - 1) / page * page;
+  const uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + size) / page * page;
+  if (end <= begin) {
+    return;
+  }
+  unsigned long nodemask = placement.nodemask ?  // NOLINT(runtime/int)
+      placement.nodemask & topology().online_mask : topology().online_mask;
+  const bool has_nodes = mode != MPOL_LOCAL;
+  const unsigned flags = move ? MPOL_MF_MOVE : 0;
+  if (syscall(__NR_mbind, begin, end - begin, mode,
+              has_nodes ? &nodemask : NULL,
+              has_nodes ? sizeof(nodemask) * 8 + 1 : 0, flags) != 0) {
+    LOG_FIRST_N(WARNING, 1) << "mbind failed: " << strerror(errno);
+  }
+#endif
+}
+
+void FirstTouch(void* ptr, size_t size, bool parallel) {
+  char* data = static_cast<char*>(ptr);
+  const long page = PageSize();  // NOLINT(runtime/int)
+  const long pages = (size + page - 1) / page;  // NOLINT(runtime/int)
+  // Same static partition as the outer loops of the layers that consume the
+  // buffer, so each thread's slice lands on that thread's node.
+#ifdef _OPENMP
+  #pragma omp parallel for schedule(static) if (parallel && pages > 1)
+#endif
+  for (long i = 0; i < pages; ++i) {  // NOLINT(runtime/int)
+    data[i * page] = 0;
+  }
+}
+
+}  // namespace
+
+Placement::Placement()
+    : policy(NumaParameter_Policy_DEFAULT), nodemask(0), huge_page_bytes(0),
+      parallel_first_touch(false), enabled_(false) {}
+
+Placement::Placement(const NumaParameter& param, NumaParameter_Policy policy)
+    : policy(policy), nodemask(0), huge_page_bytes(param.huge_page_bytes()),
+      parallel_first_touch(param.parallel_first_touch()), enabled_(true) {
+  for (int i = 0; i < param.node_size(); ++i) {
+    CHECK_LT(param.node(i), 64) << "NUMA node ids must be below 64";
+    nodemask |= uint64_t(1) << param.node(i);
+  }
+}
+
+int NumNodes() {
+  return topology().num_nodes;
+}
+
+size_t PageSize() {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+void* Allocate(size_t size, const Placement& placement) {
+  const size_t length = std::max<size_t>(size, 1);
+  void* ptr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  CHECK(ptr != MAP_FAILED) << "host allocation of size " << size
+      << " failed: " << strerror(errno);
+#ifdef MADV_HUGEPAGE
+  if (placement.huge_page_bytes > 0 && length >= placement.huge_page_bytes) {
+    madvise(ptr, length, MADV_HUGEPAGE);
+  }
+#endif
+  SetPolicy(ptr, length, placement, false);
+  // Anonymous mappings are already zero; touching them only decides where
+  // the pages are placed.
+  FirstTouch(ptr, length, placement.parallel_first_touch);
+  return ptr;
+}
+
+void Free(void* ptr, size_t size) {
+  munmap(ptr, std::max<size_t>(size, 1));
+}
+
+void Migrate(void* ptr, size_t size, const Placement& placement) {
+  if (placement.policy == NumaParameter_Policy_INTERLEAVE ||
+      placement.policy == NumaParameter_Policy_BIND) {
+    SetPolicy(ptr, size, placement, true);
+  }
+}
+
+}  // namespace numa
+}  // namespace caffe
@@ -0,0 +1,230 @@
+/*
+All modification made by Intel Corporation: © 2016 Intel Corporation
+
+All contributions by the University of California:
+Copyright (c) 2014, 2015, The Regents of the University of California (Regents)
+All rights reserved.
+
+All other contributions:
+Copyright (c) 2014, 2015, the respective contributors
+All rights reserved.
+For the list of contributors go to https://github.com/BVLC/caffe/blob/master/CONTRIBUTORS.md
+
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of Intel Corporation nor the names of its contributors
+      may be used to endorse or promote products derived from this software
+      without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "caffe/util/softmax.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Channels folded into the running max at once: the exponentials of a
+// block are summed against one max and the running sum is rescaled once.
+const int kChannelBlock = 16;
+// Inner positions processed together when channels are strided; the inner
+// loops run over them and vectorize.
+const int kInnerTile = 64;
+
+template <typename Dtype>
+inline Dtype softmax_exp(Dtype x) {
+  return std::exp(x);
+}
+
+// exp for float without a libm call so that loops calling it vectorize:
+// x = n ln2 + r with |r| <= ln2 / 2, a degree 6 polynomial for e^r and
+// 2^n built in the exponent bits (the Cephes expf constants).
+template <>
+inline float softmax_exp(float x) {
+  x = std::min(std::max(x, -87.3f), 88.3f);
+  const float n = std::floor(x * 1.44269504088896341f + 0.5f);
+  const float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+  const int bits = (static_cast<int>(n) + 127) << 23;
+  float pow2n;
+  std::memcpy(&pow2n, &bits, sizeof(pow2n));
+  return p * pow2n;
+}
+
+// One position whose channels are contiguous (inner_num == 1).
+template <typename Dtype>
+void softmax_contiguous(const Dtype* data, const int channels, Dtype* prob,
+    Dtype* log_norm) {
+  Dtype max_val = data[0];
+  Dtype sum = 0;
+  for (int b = 0; b < channels; b += kChannelBlock) {
+    const int end = std::min(b + kChannelBlock, channels);
+    Dtype block_max = max_val;
+    for (int c = b; c < end; ++c) {
+      block_max = std::max(block_max, data[c]);
+    }
+    sum *= softmax_exp(max_val - block_max);
+    max_val = block_max;
+    Dtype block_sum = 0;
+    for (int c = b; c < end; ++c) {
+      block_sum += softmax_exp(data[c] - max_val);
+    }
+    sum += block_sum;
+  }
+  const Dtype inv_sum = Dtype(1) / sum;
+  for (int c = 0; c < channels; ++c) {
+    prob[c] = softmax_exp(data[c] - max_val) * inv_sum;
+  }
+  if (log_norm) {
+    *log_norm = max_val + std::log(sum);
+  }
+}
+
+// len consecutive positions whose channels are inner_num apart.
+template <typename Dtype>
+void softmax_strided(const Dtype* data, const int channels,
+    const int inner_num, const int len, Dtype* prob, Dtype* log_norm) {
+  Dtype max_val[kInnerTile];
+  Dtype block_max[kInnerTile];
+  Dtype sum[kInnerTile];
+  for (int k = 0; k < len; ++k) {
+    max_val[k] = data[k];
+    sum[k] = 0;
+  }
+  for (int b = 0; b < channels; b += kChannelBlock) {
+    const int end = std::min(b + kChannelBlock, channels);
+    for (int k = 0; k < len; ++k) { block_max[k] = max_val[k]; }
+    for (int c = b; c < end; ++c) {
+      const Dtype* x = data + c * inner_num;
+      for (int k = 0; k < len; ++k) {
+        block_max[k] = std::max(block_max[k], x[k]);
+      }
+    }
+    for (int k = 0; k < len; ++k) {
+      sum[k] *= softmax_exp(max_val[k] - block_max[k]);
+      max_val[k] = block_max[k];
+    }
+    for (int c = b; c < end; ++c) {
+      const Dtype* x = data + c * inner_num;
+      for (int k = 0; k < len; ++k) {
+        sum[k] += softmax_exp(x[k] - max_val[k]);
+      }
+    }
+  }
+  if (log_norm) {
+    for (int k = 0; k < len; ++k) {
+      log_norm[k] = max_val[k] + std::log(sum[k]);
+    }
+  }
+  for (int k = 0; k < len; ++k) { sum[k] = Dtype(1) / sum[k]; }
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* x = data + c * inner_num;
+    Dtype* p = prob + c * inner_num;
+    for (int k = 0; k < len; ++k) {
+      p[k] = softmax_exp(x[k] - max_val[k]) * sum[k];
+    }
+  }
+}
+
+}  // namespace
+
+template <typename Dtype>
+void softmax_cpu(const Dtype* data, const int outer_num, const int channels,
+    const int inner_num, Dtype* prob, Dtype* log_norm) {
+  const int dim = channels * inner_num;
+  if (inner_num == 1) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i = 0; i < outer_num; ++i) {
+      softmax_contiguous(data + i * dim, channels, prob + i * dim,
+          log_norm ? log_norm + i : NULL);
+    }
+    return;
+  }
+  const int tiles = (inner_num + kInnerTile - 1) / kInnerTile;
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2)
+#endif
+  for (int i = 0; i < outer_num; ++i) {
+    for (int t = 0; t < tiles; ++t) {
+      const int begin = t * kInnerTile;
+      const int offset = i * dim + begin;
+      softmax_strided(data + offset, channels, inner_num,
+          std::min(kInnerTile, inner_num - begin), prob + offset,
+          log_norm ? log_norm + i * inner_num + begin : NULL);
+    }
+  }
+}
+
+template void softmax_cpu<float>(const float* data, const int outer_num,
+    const int channels, const int inner_num, float* prob, float* log_norm);
+template void softmax_cpu<double>(const double* data, const int outer_num,
+    const int channels, const int inner_num, double* prob, double* log_norm);
+
+template <typename Dtype>
+void softmax_backward_cpu(const Dtype* prob, const Dtype* top_diff,
+    const int outer_num, const int channels, const int inner_num,
+    Dtype* bottom_diff) {
+  const int dim = channels * inner_num;
+  const int tiles = (inner_num + kInnerTile - 1) / kInnerTile;
+#ifdef _OPENMP
+#pragma omp parallel for collapse(2)
+#endif
+  for (int i = 0; i < outer_num; ++i) {
+    for (int t = 0; t < tiles; ++t) {
+      const int begin = t * kInnerTile;
+      const int len = std::min(kInnerTile, inner_num - begin);
+      const int offset = i * dim + begin;
+      Dtype dot[kInnerTile];
+      for (int k = 0; k < len; ++k) { dot[k] = 0; }
+      for (int c = 0; c < channels; ++c) {
+        const Dtype* p = prob + offset + c * inner_num;
+        const Dtype* d = top_diff + offset + c * inner_num;
+        for (int k = 0; k < len; ++k) { dot[k] += p[k] * d[k]; }
+      }
+      for (int c = 0; c < channels; ++c) {
+        const int o = offset + c * inner_num;
+        for (int k = 0; k < len; ++k) {
+          bottom_diff[o + k] = prob[o + k] * (top_diff[o + k] - dot[k]);
+        }
+      }
+    }
+  }
+}
+
+template void softmax_backward_cpu<float>(const float* prob,
+    const float* top_diff, const int outer_num, const int channels,
+    const int inner_num, float* bottom_diff);
+template void softmax_backward_cpu<double>(const double* prob,
+    const double* top_diff, const int outer_num, const int channels,
+    const int inner_num, double* bottom_diff);
+
+}  // namespace caffe
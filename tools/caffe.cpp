@@ -53,6 +53,7 @@ namespace bp = boost::python;
 #include "boost/make_shared.hpp"
 #include "caffe/caffe.hpp"
 #include "caffe/training_utils.hpp"
+#include "caffe/util/host_allocator.hpp"
 #include "caffe/util/performance.hpp"
 #include "caffe/util/signal_handler.h"
 
@@ -118,6 +119,9 @@ DEFINE_bool(fast_compare, false,
 DEFINE_int32(fast_compare_max, 50,
     "Optional; Max errors for fast_compare");
 DEFINE_double(buffer_filler, std::nanf(""), "Buffer filler for compare tool");
+DEFINE_int32(host_cache_mb, 1024,
+    "Optional; Megabytes of freed host memory kept for reuse by blobs; "
+    "0 returns all freed memory to the system");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -692,6 +696,8 @@ int main(int argc, char** argv) {
       "  compare         collects layer data using inputs from other device");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  CHECK_GE(FLAGS_host_cache_mb, 0) << "host_cache_mb must be non-negative";
+  caffe::host_allocator::SetCacheLimit(size_t(FLAGS_host_cache_mb) << 20);
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {